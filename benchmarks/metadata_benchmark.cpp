@@ -0,0 +1,115 @@
+// Times reading the metadata of baked assets from the binary header against
+// reading the same metadata as version 1 JSON.
+//
+//   metadata_benchmark [iterations] asset...
+//
+// Takes .mesh and .tx files baked by the current baker. Their JSON is what
+// --json-sidecar writes, and is checked to read back to the same metadata.
+
+#include "../src/assetlib/asset_loader.hpp"
+#include "../src/assetlib/mesh_asset.hpp"
+#include "../src/assetlib/texture_asset.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+namespace {
+
+auto elapsed_ns(std::chrono::steady_clock::time_point start,
+                size_t iterations) -> double {
+  return std::chrono::duration<double, std::nano>(
+             std::chrono::steady_clock::now() - start)
+             .count() /
+         static_cast<double>(iterations);
+}
+
+// Time per read_info(version, metadata) call, the results are summed into
+// sink so the reads aren't optimized out
+template <typename Read>
+auto time_reads(Read read, int version, std::string_view metadata,
+                size_t iterations, size_t &sink) -> double {
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i != iterations; ++i) {
+    sink += read(version, metadata);
+  }
+  return elapsed_ns(start, iterations);
+}
+
+} // namespace
+
+auto main(int argc, char *argv[]) -> int {
+  int first = 1;
+  size_t iterations = 100'000;
+  if (argc > 1 && std::strtoull(argv[1], nullptr, 10) != 0) {
+    iterations = std::strtoull(argv[1], nullptr, 10);
+    first = 2;
+  }
+  if (first >= argc) {
+    std::cerr << "Usage: metadata_benchmark [iterations] asset...\n";
+    return EXIT_FAILURE;
+  }
+
+  size_t sink = 0;
+  bool same = true;
+  for (int arg = first; arg != argc; ++arg) {
+    assets::AssetFileView file;
+    if (!assets::load_binaryfile_view(argv[arg], file)) {
+      std::cerr << "Failed to load " << argv[arg] << '\n';
+      return EXIT_FAILURE;
+    }
+    if (file.version != assets::asset_binary_version) {
+      std::cerr << argv[arg] << " isn't a version "
+                << assets::asset_binary_version << " asset, rebake it\n";
+      return EXIT_FAILURE;
+    }
+
+    std::string binary{file.metadata};
+    std::string json;
+    double jsonTime = 0.0;
+    double binaryTime = 0.0;
+    if (std::memcmp(file.type, "MESH", 4) == 0) {
+      auto read = [](int version, std::string_view metadata) {
+        return assets::read_mesh_info(version, metadata).vertexBufferSize;
+      };
+      json = assets::mesh_info_to_json(assets::read_mesh_info(&file));
+      same = same && assets::mesh_info_to_json(assets::read_mesh_info(
+                         assets::asset_json_version, json)) == json;
+      jsonTime = time_reads(read, assets::asset_json_version, json,
+                            iterations, sink);
+      binaryTime = time_reads(read, assets::asset_binary_version, binary,
+                              iterations, sink);
+    } else if (std::memcmp(file.type, "TEXI", 4) == 0) {
+      auto read = [](int version, std::string_view metadata) {
+        return assets::read_texture_info(version, metadata).textureSize;
+      };
+      json = assets::texture_info_to_json(assets::read_texture_info(&file));
+      same = same && assets::texture_info_to_json(assets::read_texture_info(
+                         assets::asset_json_version, json)) == json;
+      jsonTime = time_reads(read, assets::asset_json_version, json,
+                            iterations, sink);
+      binaryTime = time_reads(read, assets::asset_binary_version, binary,
+                              iterations, sink);
+    } else {
+      std::cerr << argv[arg] << " is neither a mesh nor a texture\n";
+      return EXIT_FAILURE;
+    }
+
+    std::cout << argv[arg] << ": v1 JSON " << json.size() << " bytes in "
+              << jsonTime << "ns, v2 header " << binary.size()
+              << " bytes in " << binaryTime << "ns, "
+              << jsonTime / binaryTime << "x\n";
+  }
+
+  if (!same) {
+    std::cerr << "The JSON metadata doesn't read back the same\n";
+    return EXIT_FAILURE;
+  }
+  // Every asset has data, so this also keeps the reads alive
+  if (sink == 0) {
+    std::cerr << "The metadata reads back empty\n";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,133 @@
+// Times the baker's OBJ parser against tinyobjloader on a generated grid.
+//
+//   obj_benchmark [triangles] [path]
+//
+// Writes a grid of quads with positions, uvs and normals to path (a file in
+// the temp directory by default), loads it with both and checks that they
+// read the same triangles.
+
+#include "../src/asset-baker/obj_parser.hpp"
+#include "../src/assetlib/job_system.hpp"
+#include "../src/implementations/tiny_obj_loader_implementation.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+
+namespace {
+
+auto elapsed_ms(std::chrono::steady_clock::time_point start) -> double {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// A side x side grid of quads over a wavy surface, two triangles each
+void write_grid(const std::filesystem::path &path, size_t side) {
+  std::ofstream out(path, std::ios::binary);
+  char line[128];
+  for (size_t y = 0; y <= side; ++y) {
+    for (size_t x = 0; x <= side; ++x) {
+      float u = static_cast<float>(x) / static_cast<float>(side);
+      float v = static_cast<float>(y) / static_cast<float>(side);
+      float height = 0.05F * std::sin(u * 40.0F) * std::cos(v * 40.0F);
+      int length = snprintf(line, sizeof(line),
+                            "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn 0 1 0\n",
+                            u * 100.0F, height, v * 100.0F, u, v);
+      out.write(line, length);
+    }
+  }
+
+  size_t row = side + 1;
+  for (size_t y = 0; y != side; ++y) {
+    if (y % 1024 == 0) {
+      out << "o strip_" << y / 1024 << '\n';
+    }
+    for (size_t x = 0; x != side; ++x) {
+      size_t a = y * row + x + 1;
+      size_t b = a + 1;
+      size_t c = a + row + 1;
+      size_t d = a + row;
+      int length = snprintf(line, sizeof(line),
+                            "f %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu "
+                            "%zu/%zu/%zu\n",
+                            a, a, a, b, b, b, c, c, c, d, d, d);
+      out.write(line, length);
+    }
+  }
+}
+
+} // namespace
+
+auto main(int argc, char *argv[]) -> int {
+  size_t triangles =
+      argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10'000'000;
+  std::filesystem::path path =
+      argc > 2 ? std::filesystem::path{argv[2]}
+               : std::filesystem::temp_directory_path() / "obj_benchmark.obj";
+
+  auto side = static_cast<size_t>(
+      std::ceil(std::sqrt(static_cast<double>(triangles) / 2.0)));
+  if (!std::filesystem::exists(path)) {
+    std::cout << "Writing " << side * side * 2 << " triangles to " << path
+              << '\n';
+    write_grid(path, side);
+  }
+  std::cout << "Input: " << std::filesystem::file_size(path) / (1024 * 1024)
+            << "MB\n";
+
+  auto start = std::chrono::steady_clock::now();
+  tinyobj::attrib_t attrib;
+  std::vector<tinyobj::shape_t> shapes;
+  std::vector<tinyobj::material_t> materials;
+  std::string err;
+  tinyobj::LoadObj(&attrib, &shapes, &materials, &err, path.string().c_str());
+  double tinyobjTime = elapsed_ms(start);
+
+  size_t tinyobjTriangles = 0;
+  double tinyobjSum = 0.0;
+  for (auto &&shape : shapes) {
+    tinyobjTriangles += shape.mesh.indices.size() / 3;
+    for (auto &&index : shape.mesh.indices) {
+      tinyobjSum += attrib.vertices[3 * size_t(index.vertex_index) + 1] +
+                    attrib.texcoords[2 * size_t(index.texcoord_index)];
+    }
+  }
+
+  assets::JobSystem jobs(std::thread::hardware_concurrency());
+  start = std::chrono::steady_clock::now();
+  baker::ObjMesh mesh;
+  if (!baker::parse_obj(path, jobs, mesh, err)) {
+    std::cerr << "Failed to parse " << path << ": " << err << '\n';
+    return EXIT_FAILURE;
+  }
+  double parserTime = elapsed_ms(start);
+
+  double parserSum = 0.0;
+  for (auto &&corner : mesh.corners) {
+    parserSum += mesh.positions[3 * size_t(corner.position) + 1] +
+                 mesh.texcoords[2 * size_t(corner.texcoord)];
+  }
+
+  std::cout << "tinyobjloader: " << tinyobjTriangles << " triangles in "
+            << tinyobjTime << "ms\n"
+            << "obj_parser (" << jobs.thread_count()
+            << " threads): " << mesh.corners.size() / 3 << " triangles in "
+            << mesh.shapes.size() << " shapes in " << parserTime << "ms, "
+            << tinyobjTime / parserTime << "x\n";
+
+  bool same = tinyobjTriangles == mesh.corners.size() / 3 &&
+              std::abs(tinyobjSum - parserSum) <=
+                  1e-6 * std::max(std::abs(tinyobjSum), 1.0);
+  if (!same) {
+    std::cerr << "The parsers disagree\n";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -17,6 +17,9 @@ cameraData;
 
 struct ObjectData {
   mat4 model;
+  // xy scale and zw offset of the uvs inside textureLayer
+  vec4 uvTransform;
+  uint textureLayer;
 };
 
 // All object matrices
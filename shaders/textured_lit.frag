@@ -3,6 +3,8 @@
 // Shader input
 layout (location = 0) in vec3 inColor;
 layout (location = 1) in vec2 texCoord;
+layout (location = 2) flat in vec4 uvTransform;
+layout (location = 3) flat in uint textureLayer;
 
 // Output write
 layout (location = 0) out vec4 outFragColor;
@@ -15,9 +17,15 @@ layout(set = 0, binding = 1) uniform SceneData {
   vec4 sunlightColor;
 } sceneData;
 
-layout(set = 2, binding = 0) uniform sampler2D tex;
+// A texture of its own as a single layer, or an atlas of small textures
+layout(set = 2, binding = 0) uniform sampler2DArray tex;
 
 void main() {
-  vec3 color = texture(tex, texCoord).xyz;
+  // Repeat inside the texture's region of the layer. The gradients come from
+  // the unwrapped uvs, so the seams don't drop to the smallest mip.
+  vec2 uv = fract(texCoord) * uvTransform.xy + uvTransform.zw;
+  vec2 dx = dFdx(texCoord) * uvTransform.xy;
+  vec2 dy = dFdy(texCoord) * uvTransform.xy;
+  vec3 color = textureGrad(tex, vec3(uv, textureLayer), dx, dy).xyz;
   outFragColor = vec4(color, 1.F);
 }
\ No newline at end of file
@@ -1,5 +1,9 @@
 #version 460
 
+// Set for the pipeline of compact vertices, whose normal is octahedron
+// encoded in xy with z always 0
+layout(constant_id = 0) const bool compactVertices = false;
+
 layout(location = 0) in vec3 vPosition;
 layout(location = 1) in vec3 vNormal;
 layout(location = 2) in vec3 vColor;
@@ -7,6 +11,10 @@ layout(location = 3) in vec2 vTexCoord;
 
 layout(location = 0) out vec3 outColor;
 layout(location = 1) out vec2 texCoord;
+layout(location = 2) flat out vec4 uvTransform;
+layout(location = 3) flat out uint textureLayer;
+// World space, normalize after interpolation
+layout(location = 4) out vec3 outNormal;
 
 layout(set = 0, binding = 0) uniform CameraBuffer {
   mat4 view;
@@ -17,6 +25,9 @@ cameraData;
 
 struct ObjectData {
   mat4 model;
+  // xy scale and zw offset of the uvs inside textureLayer
+  vec4 uvTransform;
+  uint textureLayer;
 };
 
 // All object matrices
@@ -32,10 +43,25 @@ layout(push_constant) uniform constants {
 }
 PushConstants;
 
+// Same as assets::oct_decode
+vec3 oct_decode(vec2 encoded) {
+  vec3 normal = vec3(encoded, 1.F - abs(encoded.x) - abs(encoded.y));
+  if (normal.z < 0.F) {
+    vec2 signs =
+        mix(vec2(-1.F), vec2(1.F), greaterThanEqual(normal.xy, vec2(0.F)));
+    normal.xy = (1.F - abs(normal.yx)) * signs;
+  }
+  return normalize(normal);
+}
+
 void main() {
   mat4 modelMatrix = objectBuffer.objects[gl_InstanceIndex].model;
   mat4 transformMatrix = cameraData.viewproj * modelMatrix;
   gl_Position = transformMatrix * vec4(vPosition, 1.F);
+  vec3 normal = compactVertices ? oct_decode(vNormal.xy) : vNormal;
+  outNormal = mat3(modelMatrix) * normal;
   outColor = vColor;
   texCoord = vTexCoord;
+  uvTransform = objectBuffer.objects[gl_InstanceIndex].uvTransform;
+  textureLayer = objectBuffer.objects[gl_InstanceIndex].textureLayer;
 }
\ No newline at end of file
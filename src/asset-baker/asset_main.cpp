@@ -1,17 +1,73 @@
+#include "../assetlib/asset_archive.hpp"
+#include "../assetlib/job_system.hpp"
 #include "../assetlib/mesh_asset.hpp"
 #include "../assetlib/texture_asset.hpp"
 #include "../implementations/stb_image_implementation.hpp"
-#include "../implementations/tiny_obj_loader_implementation.hpp"
+#include "bake_manifest.hpp"
+#include "baker_settings.hpp"
+#include "block_compression.hpp"
+#include "glb_importer.hpp"
+#include "mesh_optimizer.hpp"
+#include "mesh_simplifier.hpp"
+#include "meshlet_builder.hpp"
+#include "mip_generator.hpp"
+#include "obj_parser.hpp"
+#include "process_memory.hpp"
+#include "texture_atlas.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cctype>
+#include <charconv>
 #include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <filesystem>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <sstream>
 #include <span>
+#include <string_view>
+#include <thread>
 #include <vector>
 
-void pack_vertex(assets::Vertex_f32_PNCV &new_vert, tinyobj::real_t vx,
-                 tinyobj::real_t vy, tinyobj::real_t vz, tinyobj::real_t nx,
-                 tinyobj::real_t ny, tinyobj::real_t nz, tinyobj::real_t ux,
-                 tinyobj::real_t uy) {
+// Per-file numbers collected by the converters for the throughput report
+struct BakeStats {
+  std::uintmax_t inputBytes = 0;
+  std::uintmax_t outputBytes = 0;
+  std::chrono::milliseconds loadTime{0};
+  std::chrono::milliseconds packTime{0};
+  std::chrono::milliseconds saveTime{0};
+  // Extra lines printed under the file, e.g. welding results
+  std::vector<std::string> notes;
+};
+
+auto elapsed_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::floor<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start);
+}
+
+constexpr double bytes_in_mb = 1024.0 * 1024.0;
+
+auto format_size(std::uintmax_t bytes) -> std::string {
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(1);
+  if (bytes < 1024 * 1024) {
+    out << static_cast<double>(bytes) / 1024.0 << "KB";
+  } else {
+    out << static_cast<double>(bytes) / bytes_in_mb << "MB";
+  }
+  return out.str();
+}
+
+void pack_vertex(assets::Vertex_f32_PNCV &new_vert, float vx, float vy,
+                 float vz, float nx, float ny, float nz, float ux, float uy) {
   new_vert.position[0] = vx;
   new_vert.position[1] = vy;
   new_vert.position[2] = vz;
@@ -24,184 +80,1525 @@ void pack_vertex(assets::Vertex_f32_PNCV &new_vert, tinyobj::real_t vx,
   new_vert.uv[1] = 1 - uy;
 }
 
-void pack_vertex(assets::Vertex_P32N8C8V16 &new_vert, tinyobj::real_t vx,
-                 tinyobj::real_t vy, tinyobj::real_t vz, tinyobj::real_t nx,
-                 tinyobj::real_t ny, tinyobj::real_t nz, tinyobj::real_t ux,
-                 tinyobj::real_t uy) {
+void pack_vertex(assets::Vertex_P32N8C8V16 &new_vert, float vx, float vy,
+                 float vz, float nx, float ny, float nz, float ux, float uy) {
   new_vert.position[0] = vx;
   new_vert.position[1] = vy;
   new_vert.position[2] = vz;
 
-  new_vert.normal[0] = uint8_t(((nx + 1.0) / 2.0) * 255);
-  new_vert.normal[1] = uint8_t(((ny + 1.0) / 2.0) * 255);
-  new_vert.normal[2] = uint8_t(((nz + 1.0) / 2.0) * 255);
+  float normal[3] = {nx, ny, nz};
+  assets::oct_encode(normal, new_vert.normal);
 
-  new_vert.uv[0] = ux;
-  new_vert.uv[1] = 1 - uy;
+  new_vert.uv[0] = assets::float_to_half(ux);
+  new_vert.uv[1] = assets::float_to_half(1 - uy);
 }
 
+// Vertex of an OBJ corner, with zeroes for a missing normal or uv
 template <typename V>
-void extract_mesh_from_obj(std::vector<tinyobj::shape_t> &shapes,
-                           tinyobj::attrib_t &attrib,
+auto obj_vertex(const float *positions, const float *texcoords,
+                const float *normals, const baker::ObjCorner &corner) -> V {
+  const float *position = positions + 3 * size_t(corner.position);
+
+  float normal[3] = {0.0F, 0.0F, 0.0F};
+  if (corner.normal >= 0) {
+    memcpy(normal, normals + 3 * size_t(corner.normal), sizeof(normal));
+  }
+  float uv[2] = {0.0F, 0.0F};
+  if (corner.texcoord >= 0) {
+    memcpy(uv, texcoords + 2 * size_t(corner.texcoord), sizeof(uv));
+  }
+
+  // The welder compares raw bytes, so clear the padding as well
+  V new_vert;
+  memset(&new_vert, 0, sizeof(V));
+  pack_vertex(new_vert, position[0], position[1], position[2], normal[0],
+              normal[1], normal[2], uv[0], uv[1]);
+  return new_vert;
+}
+
+template <typename V>
+void extract_mesh_from_obj(const baker::ObjMesh &mesh,
                            std::vector<uint32_t> &_indices,
                            std::vector<V> &_vertices) {
-  // Loop over shapes
-  for (size_t s = 0; s != shapes.size(); ++s) {
-    // Loop over faces (polygon)
-    size_t index_offset = 0;
-    for (size_t f = 0; f != shapes[s].mesh.num_face_vertices.size(); ++f) {
-      // Harcode loading to triangles
-      size_t fv = 3;
+  size_t cornerCount = mesh.corners.size();
+
+  // OBJ corners that share position, normal and uv become a single vertex.
+  // A typical closed mesh ends up with about a sixth of the unrolled vertices.
+  baker::VertexWelder<V> welder(cornerCount / 4);
+  _indices.reserve(_indices.size() + cornerCount);
+
+  // Shapes only name ranges of the corners, they all go into the same mesh
+  for (auto &&corner : mesh.corners) {
+    _indices.push_back(welder.add(
+        obj_vertex<V>(mesh.positions.data(), mesh.texcoords.data(),
+                      mesh.normals.data(), corner)));
+  }
 
-      // Loop over vertices in the face
-      for (size_t v = 0; v != fv; ++v) {
-        // Access to assets::Vertex_f32_PNCV
-        tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
+  _vertices = welder.take_vertices();
+}
 
-        // Vertex position
-        tinyobj::real_t vx = attrib.vertices[3 * idx.vertex_index + 0];
-        tinyobj::real_t vy = attrib.vertices[3 * idx.vertex_index + 1];
-        tinyobj::real_t vz = attrib.vertices[3 * idx.vertex_index + 2];
+// Normal and uv of a vertex, for the simplifier to match seam vertices
+auto vertex_attributes(const assets::Vertex_f32_PNCV &vertex)
+    -> std::array<float, 5> {
+  return {vertex.normal[0], vertex.normal[1], vertex.normal[2], vertex.uv[0],
+          vertex.uv[1]};
+}
 
-        // Vertex normal
-        tinyobj::real_t nx = attrib.normals[3 * idx.normal_index + 0];
-        tinyobj::real_t ny = attrib.normals[3 * idx.normal_index + 1];
-        tinyobj::real_t nz = attrib.normals[3 * idx.normal_index + 2];
+auto vertex_attributes(const assets::Vertex_P32N8C8V16 &vertex)
+    -> std::array<float, 5> {
+  float normal[3];
+  assets::oct_decode(vertex.normal, normal);
+  return {normal[0], normal[1], normal[2], assets::half_to_float(vertex.uv[0]),
+          assets::half_to_float(vertex.uv[1])};
+}
+
+template <typename V>
+auto vertex_attributes(const std::vector<V> &vertices) -> std::vector<float> {
+  std::vector<float> attributes;
+  attributes.reserve(vertices.size() * 5);
+  for (auto &&vertex : vertices) {
+    auto values = vertex_attributes(vertex);
+    attributes.insert(attributes.end(), values.begin(), values.end());
+  }
+  return attributes;
+}
 
-        // Vertex UV
-        tinyobj::real_t ux = attrib.texcoords[2 * idx.texcoord_index + 0];
-        tinyobj::real_t uy = attrib.texcoords[2 * idx.texcoord_index + 1];
+auto format_cache_stats(const baker::VertexCacheStats &before,
+                        const baker::VertexCacheStats &after) -> std::string {
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(3) << "vertex cache: ACMR "
+      << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr
+      << " -> " << after.atvr;
+  return out.str();
+}
 
-        // Copy it into our vertex
-        V new_vert{};
-        pack_vertex(new_vert, vx, vy, vz, nx, ny, nz, ux, uy);
+// Writes <output>.json next to a baked asset
+void write_json_sidecar(const std::filesystem::path &output,
+                        const std::string &json) {
+  auto path = output;
+  path += ".json";
+  std::ofstream outfile(path);
+  outfile << json << '\n';
+}
 
-        _indices.push_back(static_cast<uint32_t>(_vertices.size()));
-        _vertices.push_back(new_vert);
+// Optimizes and packs a mesh with vertices of type V. Triangles are only
+// reordered within their submesh, a mesh without submeshes is one range.
+template <typename V>
+auto bake_mesh(std::vector<V> _vertices, std::vector<uint32_t> _indices,
+               std::vector<assets::MeshSubmesh> submeshes,
+               const std::filesystem::path &input,
+               const std::filesystem::path &output,
+               const baker::BakerSettings &settings, std::uint64_t sourceHash,
+               BakeStats &stats) -> bool {
+  auto ranges = submeshes;
+  if (ranges.empty()) {
+    ranges.push_back({0, static_cast<uint32_t>(_indices.size()), 0});
+  }
+  auto range_indices = [&](const assets::MeshSubmesh &range) {
+    return std::span{_indices}.subspan(range.firstIndex, range.indexCount);
+  };
+
+  if (settings.optimizeMeshes && !_indices.empty()) {
+    auto optimizeStart = std::chrono::steady_clock::now();
+    auto before = baker::analyze_vertex_cache(_indices, _vertices.size());
+    for (auto &&range : ranges) {
+      baker::optimize_vertex_cache(range_indices(range), _vertices.size());
+      baker::optimize_overdraw(range_indices(range),
+                               _vertices.data()->position, sizeof(V),
+                               _vertices.size());
+    }
+    baker::optimize_vertex_fetch(_vertices, std::span{_indices});
+    auto after = baker::analyze_vertex_cache(_indices, _vertices.size());
+
+    stats.notes.push_back(format_cache_stats(before, after) + " in " +
+                          std::to_string(elapsed_since(optimizeStart).count()) +
+                          "ms");
+  }
+
+  // Meshlets go last, they reorder the index buffer into clusters. Each
+  // submesh gets its own, so a meshlet never mixes materials.
+  assets::MeshletData meshlets;
+  if (settings.buildMeshlets && !_indices.empty()) {
+    for (auto &&range : ranges) {
+      auto part = baker::build_meshlets(range_indices(range),
+                                        _vertices.data()->position, sizeof(V),
+                                        _vertices.size());
+      for (auto &meshlet : part.meshlets) {
+        meshlet.vertexOffset += static_cast<uint32_t>(meshlets.vertices.size());
+        meshlet.triangleOffset += range.firstIndex / 3;
       }
-      index_offset += fv;
+      meshlets.meshlets.insert(meshlets.meshlets.end(), part.meshlets.begin(),
+                               part.meshlets.end());
+      meshlets.vertices.insert(meshlets.vertices.end(), part.vertices.begin(),
+                               part.vertices.end());
+      meshlets.triangles.insert(meshlets.triangles.end(),
+                                part.triangles.begin(), part.triangles.end());
     }
+    stats.notes.push_back(
+        std::to_string(meshlets.meshlets.size()) + " meshlets, " +
+        std::to_string(meshlets.vertices.size()) + " meshlet vertices");
   }
+
+  auto bounds = assets::calcualate_bounds(_vertices.data(), _vertices.size());
+
+  // Every level is simplified from the previous one and appended to the
+  // index buffer, the vertices are shared
+  std::vector<assets::MeshLod> lods;
+  if (!settings.lodRatios.empty() && !_indices.empty()) {
+    auto lodStart = std::chrono::steady_clock::now();
+    auto attributes = vertex_attributes(_vertices);
+    float radius = std::max(bounds.radius, std::numeric_limits<float>::min());
+
+    size_t fullCount = _indices.size();
+    lods.push_back({0, static_cast<uint32_t>(fullCount), 0.0F});
+    std::vector<uint32_t> previous = _indices;
+
+    std::string note = "LODs: " + std::to_string(fullCount / 3);
+    for (auto &&ratio : settings.lodRatios) {
+      float errorBudget = settings.lodError - lods.back().error;
+      if (errorBudget <= 0.0F) {
+        break;
+      }
+
+      auto target = static_cast<size_t>(static_cast<float>(fullCount / 3) *
+                                        ratio) *
+                    3;
+      auto simplified = baker::simplify(
+          previous, _vertices.data()->position, sizeof(V),
+          _vertices.size(), attributes, 5, target, errorBudget * radius);
+
+      // Stop once the error limit keeps the simplifier from making progress
+      if (simplified.indices.empty() ||
+          simplified.indices.size() * 20 >= previous.size() * 19) {
+        break;
+      }
+      if (settings.optimizeMeshes) {
+        baker::optimize_vertex_cache(simplified.indices, _vertices.size());
+      }
+
+      lods.push_back({static_cast<uint32_t>(_indices.size()),
+                      static_cast<uint32_t>(simplified.indices.size()),
+                      lods.back().error + simplified.error / radius});
+      _indices.insert(_indices.end(), simplified.indices.begin(),
+                      simplified.indices.end());
+      previous = std::move(simplified.indices);
+
+      std::ostringstream level;
+      level << std::setprecision(3) << lods.back().error;
+      note += "/" + std::to_string(lods.back().indexCount / 3) + " (error " +
+              level.str() + ")";
+    }
+
+    stats.notes.push_back(note + " triangles in " +
+                          std::to_string(elapsed_since(lodStart).count()) +
+                          "ms");
+  }
+
+  assets::MeshInfo meshinfo;
+  meshinfo.vertexFormat = settings.vertexFormat;
+  meshinfo.vertexBufferSize = _vertices.size() * sizeof(V);
+  // Every level and meshlet indexes the same vertex buffer, so its size
+  // decides the index size of the whole mesh
+  meshinfo.indexSize = assets::index_size_for(_vertices.size());
+  meshinfo.indexBufferSize = _indices.size() * meshinfo.indexSize;
+  meshinfo.indexEncoding = settings.encodeIndices
+                               ? assets::IndexEncoding::Triangle
+                               : assets::IndexEncoding::Raw;
+  meshinfo.originalFile = input.string();
+  meshinfo.sourceHash = sourceHash;
+  meshinfo.bounds = bounds;
+  meshinfo.lods = std::move(lods);
+  meshinfo.submeshes = std::move(submeshes);
+
+  // Pack mesh file
+  auto packStart = std::chrono::steady_clock::now();
+
+  assets::AssetFile newFile =
+      assets::pack_mesh(&meshinfo, _vertices.data(), _indices.data(),
+                        &meshlets, settings.meshCompression);
+
+  stats.packTime = elapsed_since(packStart);
+  stats.notes.push_back(
+      std::to_string(int(meshinfo.indexSize) * 8) + " bit indices, " +
+      std::to_string(meshinfo.encodedIndexSize) + " of " +
+      std::to_string(_indices.size() * sizeof(uint32_t)) +
+      " bytes before compression");
+
+  // Save to disk
+  auto saveStart = std::chrono::steady_clock::now();
+  save_binaryfile(output.string().c_str(), newFile);
+  if (settings.jsonSidecar) {
+    write_json_sidecar(output, assets::mesh_info_to_json(meshinfo));
+  }
+  stats.saveTime = elapsed_since(saveStart);
+
+  return true;
 }
 
-auto convert_mesh(const std::filesystem::path &input,
-                  const std::filesystem::path &output) {
-  // Attrib will containt the assets::Vertex_f32_PNCV arrays of the file
-  tinyobj::attrib_t attrib;
-  // Shapes contains the info for each separate object in the file
-  std::vector<tinyobj::shape_t> shapes;
-  // Materials contains the information aobut the material of each shape, but we
-  // won't use it
-  std::vector<tinyobj::material_t> materials;
-
-  // Error and warning output from the load function
-  std::string err;
-  auto pngstart = std::chrono::steady_clock::now();
+// Welds an OBJ mesh into vertices of type V and bakes it
+template <typename V>
+auto bake_obj_mesh(const baker::ObjMesh &mesh,
+                   const std::filesystem::path &input,
+                   const std::filesystem::path &output,
+                   const baker::BakerSettings &settings,
+                   std::uint64_t sourceHash,
+                   std::chrono::steady_clock::time_point loadStart,
+                   BakeStats &stats) -> bool {
+  std::vector<V> _vertices;
+  std::vector<uint32_t> _indices;
+
+  extract_mesh_from_obj(mesh, _indices, _vertices);
+
+  stats.loadTime = elapsed_since(loadStart);
+  stats.notes.push_back("welded " + std::to_string(_indices.size()) +
+                        " corners into " + std::to_string(_vertices.size()) +
+                        " vertices");
+
+  return bake_mesh(std::move(_vertices), std::move(_indices), {}, input,
+                   output, settings, sourceHash, stats);
+}
+
+// Out of core mesh bakes parse the OBJ this many bytes at a time
+constexpr size_t stream_window_size = size_t{64} * 1024 * 1024;
+// and weld and optimize this many corners at a time
+constexpr size_t stream_weld_corners = size_t{6} * 1024 * 1024;
+// The blob is compressed from a buffer of this size, a multiple of
+// assets::blob_chunk_size
+constexpr size_t stream_buffer_size = size_t{64} * 1024 * 1024;
+
+// Scratch files of an out of core bake, removed along with the directory
+struct SpillDirectory {
+  std::filesystem::path path;
+
+  explicit SpillDirectory(std::filesystem::path directory)
+      : path{std::move(directory)} {}
+  SpillDirectory(const SpillDirectory &) = delete;
+  auto operator=(const SpillDirectory &) -> SpillDirectory & = delete;
+  ~SpillDirectory() {
+    std::error_code ec;
+    std::filesystem::remove_all(path, ec);
+  }
+};
 
-  auto material_path = std::filesystem::path(input).remove_filename();
+template <typename T>
+void write_spill(std::ofstream &file, const std::vector<T> &values) {
+  file.write(reinterpret_cast<const char *>(values.data()),
+             static_cast<std::streamsize>(values.size() * sizeof(T)));
+}
 
-  // Load the OBJ file
-  tinyobj::LoadObj(&attrib, &shapes, &materials, &err, input.string().c_str(),
-                   material_path.string().c_str());
-  auto pngend = std::chrono::steady_clock::now();
-  auto diff = std::chrono::floor<std::chrono::milliseconds>(pngend - pngstart);
+// Maps a spill file written before. Empty files can't be mapped and stay
+// closed, which is fine as nothing indexes into them.
+auto map_spill(const std::filesystem::path &path, assets::MappedFile &file)
+    -> bool {
+  std::error_code ec;
+  return std::filesystem::file_size(path, ec) == 0 ? !ec : file.open(path);
+}
 
-  std::cout << "Obj took " << diff.count() << "ms" << '\n';
+// Bakes an OBJ too large to hold in memory with bounded memory. The file is
+// parsed a window at a time into spill files next to the output, welded and
+// optimized stream_weld_corners at a time, and compressed a buffer at a time
+// into the output. Vertices are only merged within a weld window. LODs,
+// meshlets and index encoding need the whole mesh at once and are skipped.
+template <typename V>
+auto bake_mesh_streamed(const std::filesystem::path &input,
+                        const std::filesystem::path &output,
+                        const baker::BakerSettings &settings,
+                        std::uint64_t sourceHash, assets::JobSystem &jobs,
+                        BakeStats &stats) -> bool {
+  auto loadStart = std::chrono::steady_clock::now();
 
-  // Make sure to output the errors to the console in case there are issues with
-  // the file
-  if (!err.empty()) {
-    std::cerr << err << '\n';
+  auto spillPath = output;
+  spillPath += ".spill";
+  SpillDirectory spill{spillPath};
+  std::error_code ec;
+  std::filesystem::create_directories(spill.path, ec);
+  if (ec) {
+    std::cerr << "Failed to create " << spill.path << ": " << ec.message()
+              << '\n';
     return false;
   }
 
-  using VertexFormat = assets::Vertex_f32_PNCV;
+  // Every window's attributes and corners are appended to their own file
+  size_t cornerCount = 0;
+  {
+    assets::MappedFile source;
+    if (!source.open(input)) {
+      std::cerr << "Failed to open " << input << '\n';
+      return false;
+    }
+    source.advise(assets::AccessHint::Sequential);
 
-  std::vector<VertexFormat> _vertices;
-  std::vector<uint32_t> _indices;
+    std::ofstream positions(spill.path / "positions", std::ios::binary);
+    std::ofstream texcoords(spill.path / "texcoords", std::ios::binary);
+    std::ofstream normals(spill.path / "normals", std::ios::binary);
+    std::ofstream corners(spill.path / "corners", std::ios::binary);
+
+    auto text = std::string_view{source.data(), source.size()};
+    baker::ObjCounts counts;
+    baker::ObjMesh window;
+    size_t windowCount = 0;
+    for (size_t offset = 0; offset != text.size(); ++windowCount) {
+      size_t end = text.size();
+      if (text.size() - offset > stream_window_size) {
+        auto newline = text.find('\n', offset + stream_window_size);
+        end = newline == std::string_view::npos ? text.size() : newline + 1;
+      }
+
+      std::string err;
+      if (!baker::parse_obj_window(text.substr(offset, end - offset), counts,
+                                   jobs, window, err)) {
+        std::cerr << "Failed to load " << input << ": " << err << '\n';
+        return false;
+      }
+      write_spill(positions, window.positions);
+      write_spill(texcoords, window.texcoords);
+      write_spill(normals, window.normals);
+      write_spill(corners, window.corners);
+      cornerCount += window.corners.size();
+
+      source.advise(assets::AccessHint::DontNeed, offset, end - offset);
+      offset = end;
+    }
+
+    if (!positions.flush() || !texcoords.flush() || !normals.flush() ||
+        !corners.flush()) {
+      std::cerr << "Failed to write to " << spill.path << '\n';
+      return false;
+    }
+    stats.notes.push_back(
+        "streamed " + std::to_string(cornerCount / 3) + " triangles in " +
+        std::to_string(windowCount) + " windows in " +
+        std::to_string(elapsed_since(loadStart).count()) + "ms");
+  }
+
+  // Every weld window is welded and optimized on its own, and appended to
+  // the vertex and index files with its indices shifted past the vertices
+  // before it
+  size_t vertexCount = 0;
+  std::array<float, 3> min;
+  std::array<float, 3> max;
+  min.fill(std::numeric_limits<float>::max());
+  max.fill(std::numeric_limits<float>::lowest());
+  {
+    assets::MappedFile positions;
+    assets::MappedFile texcoords;
+    assets::MappedFile normals;
+    assets::MappedFile corners;
+    if (!map_spill(spill.path / "positions", positions) ||
+        !map_spill(spill.path / "texcoords", texcoords) ||
+        !map_spill(spill.path / "normals", normals) ||
+        !map_spill(spill.path / "corners", corners)) {
+      std::cerr << "Failed to read back " << spill.path << '\n';
+      return false;
+    }
+    const auto *positionData =
+        reinterpret_cast<const float *>(positions.data());
+    const auto *texcoordData =
+        reinterpret_cast<const float *>(texcoords.data());
+    const auto *normalData = reinterpret_cast<const float *>(normals.data());
+    const auto *cornerData =
+        reinterpret_cast<const baker::ObjCorner *>(corners.data());
+
+    std::ofstream vertexFile(spill.path / "vertices", std::ios::binary);
+    std::ofstream indexFile(spill.path / "indices", std::ios::binary);
+
+    std::vector<uint32_t> indices;
+    for (size_t first = 0; first < cornerCount;
+         first += stream_weld_corners) {
+      size_t count = std::min(stream_weld_corners, cornerCount - first);
+      baker::VertexWelder<V> welder(count / 4);
+      indices.clear();
+      for (size_t i = first; i != first + count; ++i) {
+        indices.push_back(welder.add(obj_vertex<V>(
+            positionData, texcoordData, normalData, cornerData[i])));
+      }
+      auto vertices = welder.take_vertices();
+      if (settings.optimizeMeshes) {
+        baker::optimize_mesh(vertices, std::span{indices});
+      }
+
+      if (vertexCount + vertices.size() >
+          std::numeric_limits<uint32_t>::max()) {
+        std::cerr << input << " has more vertices than 32 bit indices hold\n";
+        return false;
+      }
+      for (auto &&index : indices) {
+        index += static_cast<uint32_t>(vertexCount);
+      }
+      for (auto &&vertex : vertices) {
+        for (size_t j = 0; j != 3; ++j) {
+          min[j] = std::min(min[j], vertex.position[j]);
+          max[j] = std::max(max[j], vertex.position[j]);
+        }
+      }
+      write_spill(vertexFile, vertices);
+      write_spill(indexFile, indices);
+      vertexCount += vertices.size();
 
-  extract_mesh_from_obj(shapes, attrib, _indices, _vertices);
+      // Corners are read once, attributes all over the place. Dropping the
+      // pages keeps them in the page cache but out of the resident set.
+      corners.advise(assets::AccessHint::DontNeed,
+                     first * sizeof(baker::ObjCorner),
+                     count * sizeof(baker::ObjCorner));
+      positions.advise(assets::AccessHint::DontNeed);
+      texcoords.advise(assets::AccessHint::DontNeed);
+      normals.advise(assets::AccessHint::DontNeed);
+    }
+
+    if (!vertexFile.flush() || !indexFile.flush()) {
+      std::cerr << "Failed to write to " << spill.path << '\n';
+      return false;
+    }
+  }
+
+  stats.loadTime = elapsed_since(loadStart);
+  stats.notes.push_back("welded " + std::to_string(cornerCount) +
+                        " corners into " + std::to_string(vertexCount) +
+                        " vertices in windows of " +
+                        std::to_string(stream_weld_corners / 3) +
+                        " triangles");
+  if (settings.buildMeshlets || !settings.lodRatios.empty() ||
+      settings.encodeIndices) {
+    stats.notes.push_back(
+        "meshlets, LODs and index encoding are skipped when streaming");
+  }
+
+  auto packStart = std::chrono::steady_clock::now();
+  assets::MappedFile vertices;
+  assets::MappedFile indices;
+  if (!map_spill(spill.path / "vertices", vertices) ||
+      !map_spill(spill.path / "indices", indices)) {
+    std::cerr << "Failed to read back " << spill.path << '\n';
+    return false;
+  }
+  const auto *vertexData = reinterpret_cast<const V *>(vertices.data());
+  const auto *indexData = reinterpret_cast<const uint32_t *>(indices.data());
 
   assets::MeshInfo meshinfo;
-  meshinfo.vertexFormat = assets::VertexFormat::PNCV_F32;
-  meshinfo.vertexBufferSize = _vertices.size() * sizeof(VertexFormat);
-  meshinfo.indexBufferSize = _indices.size() * sizeof(uint32_t);
-  meshinfo.indexSize = sizeof(uint32_t);
+  meshinfo.vertexFormat = settings.vertexFormat;
+  meshinfo.vertexBufferSize = vertexCount * sizeof(V);
+  meshinfo.indexSize = assets::index_size_for(vertexCount);
+  meshinfo.indexBufferSize = cornerCount * meshinfo.indexSize;
+  meshinfo.encodedIndexSize = meshinfo.indexBufferSize;
+  meshinfo.indexEncoding = assets::IndexEncoding::Raw;
+  meshinfo.compressionMode = assets::CompressionMode::LZ4Chunked;
   meshinfo.originalFile = input.string();
+  meshinfo.sourceHash = sourceHash;
 
-  meshinfo.bounds =
-      assets::calcualate_bounds(_vertices.data(), _vertices.size());
-  // Pack mesh file
-  auto start = std::chrono::steady_clock::now();
+  // The same bounds calcualate_bounds finds, from the box of every window
+  // and a second pass over the vertices for the radius
+  float r2 = 0.0F;
+  for (size_t i = 0; i != 3; ++i) {
+    meshinfo.bounds.extents[i] = (max[i] - min[i]) / 2.0F;
+    meshinfo.bounds.origin[i] = meshinfo.bounds.extents[i] + min[i];
+  }
+  for (size_t i = 0; i != vertexCount; ++i) {
+    float distance = 0.0F;
+    for (size_t j = 0; j != 3; ++j) {
+      float offset = vertexData[i].position[j] - meshinfo.bounds.origin[j];
+      distance += offset * offset;
+    }
+    r2 = std::max(r2, distance);
+  }
+  meshinfo.bounds.radius = std::sqrt(r2);
 
-  assets::AssetFile newFile =
-      assets::pack_mesh(&meshinfo, _vertices.data(), _indices.data());
+  // The chunk count, and with it the metadata size, is known up front. The
+  // metadata is written once the chunks are compressed.
+  uint64_t blobSize = meshinfo.vertexBufferSize + meshinfo.indexBufferSize;
+  meshinfo.chunks.chunkSize = static_cast<uint32_t>(assets::blob_chunk_size);
+  meshinfo.chunks.compressedSizes.resize(
+      (blobSize + assets::blob_chunk_size - 1) / assets::blob_chunk_size);
+  size_t metadataSize = assets::write_mesh_metadata(meshinfo).size();
+  meshinfo.chunks.compressedSizes.clear();
 
-  auto end = std::chrono::steady_clock::now();
+  assets::AssetFileWriter writer;
+  if (!writer.open(output, "MESH", assets::asset_binary_version,
+                   metadataSize)) {
+    std::cerr << "Failed to write " << output << '\n';
+    return false;
+  }
 
-  diff = std::chrono::floor<std::chrono::milliseconds>(end - start);
+  std::vector<char> buffer(stream_buffer_size);
+  std::vector<char> compressed;
+  for (uint64_t offset = 0; offset < blobSize; offset += buffer.size()) {
+    auto size = static_cast<size_t>(
+        std::min<uint64_t>(buffer.size(), blobSize - offset));
 
-  std::cout << "Compression took " << diff.count() << "ms" << '\n';
+    // Vertices, then the indices at indexSize bytes each
+    size_t filled = 0;
+    if (offset < meshinfo.vertexBufferSize) {
+      filled = static_cast<size_t>(
+          std::min<uint64_t>(size, meshinfo.vertexBufferSize - offset));
+      memcpy(buffer.data(), vertices.data() + offset, filled);
+      vertices.advise(assets::AccessHint::DontNeed, offset, filled);
+    }
+    if (filled != size) {
+      size_t first =
+          (offset + filled - meshinfo.vertexBufferSize) / meshinfo.indexSize;
+      size_t count = (size - filled) / meshinfo.indexSize;
+      if (meshinfo.indexSize == sizeof(uint32_t)) {
+        memcpy(buffer.data() + filled, indexData + first,
+               count * sizeof(uint32_t));
+      } else {
+        for (size_t i = 0; i != count; ++i) {
+          auto index = static_cast<uint16_t>(indexData[first + i]);
+          memcpy(buffer.data() + filled + i * sizeof(uint16_t), &index,
+                 sizeof(index));
+        }
+      }
+      indices.advise(assets::AccessHint::DontNeed, first * sizeof(uint32_t),
+                     count * sizeof(uint32_t));
+    }
 
-  // Save to disk
-  save_binaryfile(output.string().c_str(), newFile);
+    compressed.clear();
+    auto chunks = assets::compress_chunked(
+        buffer.data(), size, settings.meshCompression, compressed, &jobs);
+    meshinfo.chunks.compressedSizes.insert(
+        meshinfo.chunks.compressedSizes.end(), chunks.compressedSizes.begin(),
+        chunks.compressedSizes.end());
+    if (!writer.append(compressed.data(), compressed.size())) {
+      std::cerr << "Failed to write " << output << '\n';
+      return false;
+    }
+  }
+
+  if (!writer.finish(assets::write_mesh_metadata(meshinfo))) {
+    if (writer.blob_size() > std::numeric_limits<uint32_t>::max()) {
+      std::cerr << "Failed to write " << output << ", "
+                << format_size(writer.blob_size())
+                << " compressed is over the 4 GB an asset file holds\n";
+    } else {
+      std::cerr << "Failed to write " << output << '\n';
+    }
+    std::filesystem::remove(output, ec);
+    return false;
+  }
+  stats.packTime = elapsed_since(packStart);
+
+  if (settings.jsonSidecar) {
+    write_json_sidecar(output, assets::mesh_info_to_json(meshinfo));
+  }
+  return true;
+}
+
+auto convert_mesh(const std::filesystem::path &input,
+                  const std::filesystem::path &output,
+                  const baker::BakerSettings &settings,
+                  std::uint64_t sourceHash, assets::JobSystem &jobs,
+                  BakeStats &stats) {
+  std::error_code ec;
+  auto inputSize = std::filesystem::file_size(input, ec);
+  if (!ec && inputSize >= settings.streamMeshSize) {
+    if (settings.vertexFormat == assets::VertexFormat::P32N8C8V16) {
+      return bake_mesh_streamed<assets::Vertex_P32N8C8V16>(
+          input, output, settings, sourceHash, jobs, stats);
+    }
+    return bake_mesh_streamed<assets::Vertex_f32_PNCV>(
+        input, output, settings, sourceHash, jobs, stats);
+  }
+
+  auto loadStart = std::chrono::steady_clock::now();
+
+  // Materials and the rest of the file are left to the material pipeline,
+  // only the geometry is read
+  baker::ObjMesh mesh;
+  std::string err;
+  if (!baker::parse_obj(input, jobs, mesh, err)) {
+    std::cerr << "Failed to load " << input << ": " << err << '\n';
+    return false;
+  }
+  stats.notes.push_back(
+      "parsed " + std::to_string(mesh.corners.size() / 3) + " triangles in " +
+      std::to_string(std::max<size_t>(mesh.shapes.size(), 1)) +
+      " shapes in " + std::to_string(elapsed_since(loadStart).count()) + "ms");
+
+  if (settings.vertexFormat == assets::VertexFormat::P32N8C8V16) {
+    return bake_obj_mesh<assets::Vertex_P32N8C8V16>(
+        mesh, input, output, settings, sourceHash, loadStart, stats);
+  }
+  return bake_obj_mesh<assets::Vertex_f32_PNCV>(mesh, input, output, settings,
+                                                sourceHash, loadStart, stats);
+}
+
+// Distance field font atlases stay RGBA8: block compression smears the
+// distances the glyph edges are cut from
+auto texture_format_for(const std::filesystem::path &input,
+                        const baker::BakerSettings &settings)
+    -> assets::TextureFormat {
+  auto lowercase = [](std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(), [](char c) {
+      return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    });
+    return text;
+  };
+  auto name = lowercase(input.stem().string());
+  auto directory = lowercase(input.parent_path().filename().string());
+
+  if (directory == "fonts" || name.find("msdf") != std::string::npos) {
+    return assets::TextureFormat::RGBA8;
+  }
+  if (name.find("normal") != std::string::npos) {
+    return settings.normalFormat;
+  }
+  return settings.colorFormat;
+}
+
+// Generates the mips of RGBA8 pixels, encodes them to format and saves the
+// texture
+auto bake_image(const stbi_uc *pixels, uint32_t width, uint32_t height,
+                assets::TextureFormat format, const std::string &originalFile,
+                const std::filesystem::path &output,
+                const baker::BakerSettings &settings, std::uint64_t sourceHash,
+                assets::JobSystem &jobs, BakeStats &stats) -> bool {
+  uint32_t levelCount =
+      settings.generateMips ? baker::mip_level_count(width, height) : 1;
+
+  // Every level is a page of its own, back to back after the full size image
+  assets::TextureInfo texinfo;
+  texinfo.textureSize = 0;
+  for (uint32_t level = 0; level != levelCount; ++level) {
+    uint32_t levelWidth = std::max(width >> level, 1U);
+    uint32_t levelHeight = std::max(height >> level, 1U);
+    auto levelSize =
+        baker::compressed_image_size(format, levelWidth, levelHeight);
+    texinfo.pages.push_back(
+        {.width = levelWidth,
+         .height = levelHeight,
+         .compressedSize = 0,
+         .originalSize = static_cast<uint32_t>(levelSize)});
+    texinfo.textureSize += levelSize;
+  }
+  texinfo.pixelsize[0] = width;
+  texinfo.pixelsize[1] = height;
+  texinfo.pixelsize[2] = 1;
+  texinfo.textureFormat = format;
+  texinfo.originalFile = originalFile;
+  texinfo.sourceHash = sourceHash;
+
+  // The mips are filtered from RGBA8 levels before block compression
+  std::vector<uint8_t> chain(levelCount > 1
+                                 ? baker::mip_chain_size(width, height)
+                                 : baker::mip_level_size(width, height, 0));
+  memcpy(chain.data(), pixels, baker::mip_level_size(width, height, 0));
+
+  auto packStart = std::chrono::steady_clock::now();
+  if (levelCount > 1) {
+    bool srgb = format != assets::TextureFormat::BC5;
+    baker::generate_mips(chain.data(), width, height, srgb);
+    stats.notes.push_back(std::to_string(levelCount) + " mip levels in " +
+                          std::to_string(elapsed_since(packStart).count()) +
+                          "ms");
+  }
+
+  if (format != assets::TextureFormat::RGBA8) {
+    auto encodeStart = std::chrono::steady_clock::now();
+    std::vector<uint8_t> blocks(texinfo.textureSize);
+    const uint8_t *level = chain.data();
+    uint8_t *levelBlocks = blocks.data();
+    for (auto &&page : texinfo.pages) {
+      baker::compress_image(format, level, page.width, page.height,
+                            levelBlocks, jobs);
+      level += size_t{page.width} * page.height * 4;
+      levelBlocks += page.originalSize;
+    }
+    chain = std::move(blocks);
+    stats.notes.push_back(
+        std::string{assets::texture_format_name(format)} + " in " +
+        std::to_string(elapsed_since(encodeStart).count()) + "ms");
+  }
+
+  assets::AssetFile newImage = assets::pack_texture(
+      &texinfo, chain.data(), settings.textureCompression);
+  stats.packTime = elapsed_since(packStart);
+
+  auto saveStart = std::chrono::steady_clock::now();
+  save_binaryfile(output.string().c_str(), newImage);
+  if (settings.jsonSidecar) {
+    write_json_sidecar(output, assets::texture_info_to_json(texinfo));
+  }
+  stats.saveTime = elapsed_since(saveStart);
 
   return true;
 }
 
 auto convert_image(const std::filesystem::path &input,
-                   const std::filesystem::path &output) {
+                   const std::filesystem::path &output,
+                   const baker::BakerSettings &settings,
+                   std::uint64_t sourceHash, assets::JobSystem &jobs,
+                   BakeStats &stats) {
   int texWidth;
   int texHeight;
   int texChannels;
 
+  auto loadStart = std::chrono::steady_clock::now();
+
   stbi_uc *pixels = stbi_load(input.string().c_str(), &texWidth, &texHeight,
                               &texChannels, STBI_rgb_alpha);
 
   if (pixels == nullptr) {
-    std::cout << "Failed to load texture file " << input << '\n';
+    std::cerr << "Failed to load texture file " << input << '\n';
     return false;
   }
 
-  int texture_size = texWidth * texHeight * 4;
-
-  assets::TextureInfo texinfo;
-  texinfo.textureSize = texture_size;
-  texinfo.pixelsize[0] = texWidth;
-  texinfo.pixelsize[1] = texHeight;
-  texinfo.textureFormat = assets::TextureFormat::RGBA8;
-  texinfo.originalFile = input.string();
-  assets::AssetFile newImage = assets::pack_texture(&texinfo, pixels);
+  stats.loadTime = elapsed_since(loadStart);
 
+  bool ok = bake_image(pixels, static_cast<uint32_t>(texWidth),
+                       static_cast<uint32_t>(texHeight),
+                       texture_format_for(input, settings), input.string(),
+                       output, settings, sourceHash, jobs, stats);
   stbi_image_free(pixels);
-  save_binaryfile(output.string().c_str(), newImage);
+  return ok;
+}
+
+// Baked texture of the index-th image embedded in a glb that bakes to
+// output, <stem>_image<index>.tx next to it
+auto glb_image_output(const std::filesystem::path &output, size_t index)
+    -> std::filesystem::path {
+  return output.parent_path() / (output.stem().string() + "_image" +
+                                 std::to_string(index) + ".tx");
+}
+
+template <typename V>
+auto bake_glb_mesh(const baker::GltfScene &scene,
+                   const std::filesystem::path &input,
+                   const std::filesystem::path &output,
+                   const baker::BakerSettings &settings,
+                   std::uint64_t sourceHash,
+                   std::chrono::steady_clock::time_point loadStart,
+                   BakeStats &stats) -> bool {
+  // The accessors already index unique vertices, so there's nothing to weld
+  size_t vertexCount = scene.positions.size() / 3;
+  std::vector<V> vertices(vertexCount);
+  for (size_t i = 0; i != vertexCount; ++i) {
+    const float *position = &scene.positions[3 * i];
+    const float *normal = &scene.normals[3 * i];
+    const float *uv = &scene.texcoords[2 * i];
+    memset(&vertices[i], 0, sizeof(V));
+    // glTF uvs start at the top left already, undo the OBJ flip
+    pack_vertex(vertices[i], position[0], position[1], position[2],
+                normal[0], normal[1], normal[2], uv[0], 1.0F - uv[1]);
+  }
+  stats.loadTime = elapsed_since(loadStart);
+
+  std::vector<assets::MeshSubmesh> submeshes;
+  submeshes.reserve(scene.primitives.size());
+  for (auto &&primitive : scene.primitives) {
+    submeshes.push_back(
+        {primitive.firstIndex, primitive.indexCount, primitive.material});
+  }
+
+  return bake_mesh(std::move(vertices), scene.indices, std::move(submeshes),
+                   input, output, settings, sourceHash, stats);
+}
+
+// Bakes a binary glTF into a mesh with a submesh per primitive, and its
+// embedded images into textures named by glb_image_output, which are added
+// to extraOutputs
+auto convert_glb(const std::filesystem::path &input,
+                 const std::filesystem::path &output,
+                 const baker::BakerSettings &settings,
+                 std::uint64_t sourceHash, assets::JobSystem &jobs,
+                 BakeStats &stats,
+                 std::vector<std::filesystem::path> &extraOutputs) -> bool {
+  auto loadStart = std::chrono::steady_clock::now();
+
+  assets::MappedFile file;
+  if (!file.open(input)) {
+    std::cerr << "Failed to open " << input << '\n';
+    return false;
+  }
+
+  baker::GltfScene scene;
+  std::string err;
+  if (!baker::load_glb(file.bytes(), scene, err)) {
+    std::cerr << "Failed to load " << input << ": " << err << '\n';
+    return false;
+  }
+  std::string note = "read " + std::to_string(scene.indices.size() / 3) +
+                     " triangles in " +
+                     std::to_string(scene.primitives.size()) +
+                     " primitives in " +
+                     std::to_string(elapsed_since(loadStart).count()) + "ms";
+  if (scene.skippedPrimitives != 0) {
+    note += ", skipped " + std::to_string(scene.skippedPrimitives) +
+            " that aren't triangle lists";
+  }
+  stats.notes.push_back(note);
+
+  bool ok = settings.vertexFormat == assets::VertexFormat::P32N8C8V16
+                ? bake_glb_mesh<assets::Vertex_P32N8C8V16>(
+                      scene, input, output, settings, sourceHash, loadStart,
+                      stats)
+                : bake_glb_mesh<assets::Vertex_f32_PNCV>(
+                      scene, input, output, settings, sourceHash, loadStart,
+                      stats);
+  if (!ok) {
+    return false;
+  }
+
+  // The images are decoded straight from the mapped file
+  for (size_t i = 0; i != scene.images.size(); ++i) {
+    const auto &image = scene.images[i];
+    auto imageOutput = glb_image_output(output, i);
+
+    int texWidth;
+    int texHeight;
+    int texChannels;
+    stbi_uc *pixels = stbi_load_from_memory(
+        reinterpret_cast<const stbi_uc *>(image.data.data()),
+        static_cast<int>(image.data.size()), &texWidth, &texHeight,
+        &texChannels, STBI_rgb_alpha);
+    if (pixels == nullptr) {
+      std::cerr << "Failed to decode image " << i << " of " << input << '\n';
+      return false;
+    }
+
+    BakeStats imageStats;
+    auto format =
+        image.isNormalMap ? settings.normalFormat : settings.colorFormat;
+    ok = bake_image(pixels, static_cast<uint32_t>(texWidth),
+                    static_cast<uint32_t>(texHeight), format,
+                    input.string() + "#" + std::to_string(i), imageOutput,
+                    settings, sourceHash, jobs, imageStats);
+    stbi_image_free(pixels);
+    if (!ok) {
+      return false;
+    }
+
+    stats.packTime += imageStats.packTime;
+    stats.saveTime += imageStats.saveTime;
+    std::string imageNote = imageOutput.filename().string() + ": " +
+                            std::to_string(texWidth) + "x" +
+                            std::to_string(texHeight) + " " +
+                            std::string{assets::texture_format_name(format)};
+    if (!image.name.empty()) {
+      imageNote += " (" + image.name + ")";
+    }
+    stats.notes.push_back(imageNote);
+    extraOutputs.push_back(imageOutput);
+  }
 
   return true;
 }
 
+// Packs the small baked textures of every format into a texture array at
+// the asset root, named by assets::atlas_file_name. Atlases are quick to
+// build from the baked files, so they're rebuilt on every run, and removed
+// when no longer asked for. textures are the baked files relative to the
+// root, the written atlases are added to atlases.
+auto bake_atlases(const std::filesystem::path &root,
+                  const std::vector<std::string> &textures,
+                  const baker::BakerSettings &settings,
+                  std::vector<std::string> &atlases) -> bool {
+  for (auto format :
+       {assets::TextureFormat::RGBA8, assets::TextureFormat::BC1,
+        assets::TextureFormat::BC3, assets::TextureFormat::BC5,
+        assets::TextureFormat::BC7}) {
+    std::error_code ec;
+    std::filesystem::remove(root / assets::atlas_file_name(format), ec);
+  }
+  if (settings.atlasMaxSize == 0) {
+    return true;
+  }
+
+  struct SmallTexture {
+    std::string name;
+    assets::TextureInfo info;
+    std::vector<char> pixels;
+  };
+  std::map<assets::TextureFormat, std::vector<SmallTexture>> groups;
+  for (auto &&texture : textures) {
+    assets::AssetFile file;
+    if (!assets::load_binaryfile((root / texture).string().c_str(), file)) {
+      continue;
+    }
+    auto info = assets::read_texture_info(&file);
+    if (info.textureFormat == assets::TextureFormat::Unknown ||
+        !baker::fits_atlas(info, settings.atlasMaxSize)) {
+      continue;
+    }
+    std::vector<char> pixels(info.textureSize);
+    if (!assets::unpack_texture(&info, file.binaryBlob.data(),
+                                file.binaryBlob.size(), pixels.data())) {
+      std::cerr << "Failed to read " << texture << " for its atlas\n";
+      return false;
+    }
+    groups[info.textureFormat].push_back(
+        {texture, std::move(info), std::move(pixels)});
+  }
+
+  for (auto &&[format, group] : groups) {
+    // A texture alone gains nothing from an atlas
+    if (group.size() < 2) {
+      continue;
+    }
+
+    auto atlasStart = std::chrono::steady_clock::now();
+    std::vector<baker::AtlasInput> inputs;
+    for (auto &&texture : group) {
+      inputs.push_back({texture.name, &texture.info, texture.pixels.data()});
+    }
+    assets::TextureInfo info;
+    std::vector<char> pixels;
+    baker::build_texture_atlas(inputs, info, pixels);
+
+    auto name = assets::atlas_file_name(format);
+    auto file =
+        assets::pack_texture(&info, pixels.data(), settings.textureCompression);
+    if (!save_binaryfile((root / name).string().c_str(), file)) {
+      std::cerr << "Failed to write texture atlas " << name << '\n';
+      return false;
+    }
+    if (settings.jsonSidecar) {
+      write_json_sidecar(root / name, assets::texture_info_to_json(info));
+    }
+    atlases.push_back(name);
+
+    std::cout << "Packed " << group.size() << " textures into " << name
+              << ": " << info.pixelsize[2] << " layers of "
+              << info.pixelsize[0] << "x" << info.pixelsize[1] << ", "
+              << info.pages.size() << " mip levels in "
+              << elapsed_since(atlasStart).count() << "ms\n";
+  }
+  return true;
+}
+
+auto parse_float(std::string_view text) -> std::optional<float> {
+  // std::from_chars for floats is missing from older libc++
+  std::string copy{text};
+  char *end = nullptr;
+  float value = std::strtof(copy.c_str(), &end);
+  if (copy.empty() || end != copy.c_str() + copy.size()) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+auto parse_compression_level(std::string_view text)
+    -> std::optional<assets::CompressionLevel> {
+  if (text == "fast") {
+    return assets::CompressionLevel::Fast;
+  }
+  if (text == "high") {
+    return assets::CompressionLevel::High;
+  }
+  return std::nullopt;
+}
+
+auto parse_texture_format(std::string_view text)
+    -> std::optional<assets::TextureFormat> {
+  if (text == "rgba8") {
+    return assets::TextureFormat::RGBA8;
+  }
+  if (text == "bc1") {
+    return assets::TextureFormat::BC1;
+  }
+  if (text == "bc3") {
+    return assets::TextureFormat::BC3;
+  }
+  if (text == "bc5") {
+    return assets::TextureFormat::BC5;
+  }
+  if (text == "bc7") {
+    return assets::TextureFormat::BC7;
+  }
+  return std::nullopt;
+}
+
+// Packs the baked assets into assets.pack, keyed by their path relative to
+// the asset root
+auto pack_assets(const std::filesystem::path &root,
+                 std::vector<std::string> outputs) -> bool {
+  // Sorted so assets of the same directory sit next to each other
+  std::sort(outputs.begin(), outputs.end());
+
+  std::vector<assets::ArchiveInput> inputs;
+  inputs.reserve(outputs.size());
+  for (auto &&output : outputs) {
+    inputs.push_back({output, root / output});
+  }
+
+  auto packStart = std::chrono::steady_clock::now();
+  auto packPath = root / "assets.pack";
+  if (!assets::write_archive(packPath, inputs)) {
+    std::cerr << "Failed to write asset pack " << packPath << '\n';
+    return false;
+  }
+
+  std::error_code ec;
+  auto size = std::filesystem::file_size(packPath, ec);
+  std::cout << "Packed " << inputs.size() << " assets into " << packPath
+            << " (" << format_size(ec ? 0 : size) << ") in "
+            << elapsed_since(packStart).count() << "ms\n";
+  return true;
+}
+
+void print_usage() {
+  std::cout << "Usage: asset_baker [options] [asset_directory]\n"
+               "  -j N     Bake with N worker threads (0 uses every core, "
+               "default 1)\n"
+               "  --force  Rebuild every asset, ignoring the bake manifest\n"
+               "  --vertex-format compact|f32\n"
+               "           Mesh vertex layout, compact is 24 bytes and f32 44 "
+               "bytes\n"
+               "           per vertex (default compact)\n"
+               "  --optimize\n"
+               "           Reorder meshes for the vertex cache, overdraw and "
+               "vertex fetch\n"
+               "  --meshlets\n"
+               "           Split meshes into meshlets for cluster culling\n"
+               "  --lods R,R,...\n"
+               "           Add simplified levels of detail with the given "
+               "triangle ratios,\n"
+               "           e.g. 0.5,0.25,0.1, at most 7\n"
+               "  --lod-error E\n"
+               "           Largest LOD error relative to the mesh radius "
+               "(default 0.1)\n"
+               "  --encode-indices\n"
+               "           Store mesh indices with a triangle codec that "
+               "compresses better\n"
+               "  --stream-meshes MB\n"
+               "           Bake OBJ files of at least MB megabytes out of "
+               "core, with bounded\n"
+               "           memory (default 1024, 0 streams every mesh)\n"
+               "  --no-mips\n"
+               "           Only bake the full size level of textures\n"
+               "  --color-format bc7|bc3|bc1|rgba8\n"
+               "           GPU format of color textures (default bc7)\n"
+               "  --normal-format bc5|rgba8\n"
+               "           GPU format of normal maps (default bc5)\n"
+               "  --atlas N\n"
+               "           Pack textures of at most N texels on a side into "
+               "shared texture\n"
+               "           arrays, N a power of two up to 1024\n"
+               "  --mesh-compression fast|high\n"
+               "  --texture-compression fast|high\n"
+               "           LZ4 or the slower and smaller LZ4HC, both load "
+               "equally fast\n"
+               "           (default fast)\n"
+               "  --pack   Also pack every baked asset into assets.pack at "
+               "the asset root\n"
+               "  --json-sidecar\n"
+               "           Write the metadata of each baked asset to "
+               "<asset>.json for debugging\n";
+}
+
 auto main([[maybe_unused]] int argc, [[maybe_unused]] char *argv[]) -> int {
   auto args = std::span{argv, size_t(argc)};
-  auto path = std::filesystem::path{argc < 2 ? "./assets" : args[1]};
+  baker::BakerSettings settings;
+
+  for (size_t i = 1; i < args.size(); ++i) {
+    auto arg = std::string_view{args[i]};
 
+    if (arg.starts_with("-j")) {
+      // Accept both "-j 8" and "-j8"
+      auto value = arg.substr(2);
+      if (value.empty() && i + 1 < args.size()) {
+        value = args[++i];
+      }
+
+      auto [ptr, ec] =
+          std::from_chars(value.data(), value.data() + value.size(),
+                          settings.threadCount);
+      if (ec != std::errc{} || ptr != value.data() + value.size()) {
+        std::cerr << "Invalid thread count '" << value << "'\n";
+        print_usage();
+        return 1;
+      }
+    } else if (arg == "--force") {
+      settings.force = true;
+    } else if (arg == "--vertex-format" && i + 1 < args.size()) {
+      auto value = std::string_view{args[++i]};
+      if (value == "compact") {
+        settings.vertexFormat = assets::VertexFormat::P32N8C8V16;
+      } else if (value == "f32") {
+        settings.vertexFormat = assets::VertexFormat::PNCV_F32;
+      } else {
+        std::cerr << "Unknown vertex format '" << value << "'\n";
+        print_usage();
+        return 1;
+      }
+    } else if (arg == "--optimize") {
+      settings.optimizeMeshes = true;
+    } else if (arg == "--meshlets") {
+      settings.buildMeshlets = true;
+    } else if (arg == "--lods" && i + 1 < args.size()) {
+      auto value = std::string_view{args[++i]};
+      settings.lodRatios.clear();
+      while (!value.empty()) {
+        auto comma = value.find(',');
+        auto item = value.substr(0, comma);
+        auto ratio = parse_float(item);
+        if (!ratio || *ratio <= 0.0F || *ratio >= 1.0F) {
+          std::cerr << "Invalid LOD ratio '" << item << "'\n";
+          print_usage();
+          return 1;
+        }
+        // The full detail level takes one slot of the mesh header
+        if (settings.lodRatios.size() + 1 == assets::max_mesh_lods) {
+          std::cerr << "At most " << assets::max_mesh_lods - 1
+                    << " LOD ratios are supported\n";
+          return 1;
+        }
+        settings.lodRatios.push_back(*ratio);
+        value = comma == std::string_view::npos ? std::string_view{}
+                                                : value.substr(comma + 1);
+      }
+    } else if (arg == "--lod-error" && i + 1 < args.size()) {
+      auto error = parse_float(args[++i]);
+      if (!error || *error <= 0.0F) {
+        std::cerr << "Invalid LOD error '" << args[i] << "'\n";
+        print_usage();
+        return 1;
+      }
+      settings.lodError = *error;
+    } else if (arg == "--encode-indices") {
+      settings.encodeIndices = true;
+    } else if (arg == "--stream-meshes" && i + 1 < args.size()) {
+      auto value = std::string_view{args[++i]};
+      std::uintmax_t megabytes = 0;
+      auto [ptr, ec] = std::from_chars(
+          value.data(), value.data() + value.size(), megabytes);
+      if (ec != std::errc{} || ptr != value.data() + value.size()) {
+        std::cerr << "Invalid mesh size '" << value << "'\n";
+        print_usage();
+        return 1;
+      }
+      settings.streamMeshSize = megabytes * 1024 * 1024;
+    } else if ((arg == "--mesh-compression" ||
+                arg == "--texture-compression") &&
+               i + 1 < args.size()) {
+      auto value = std::string_view{args[++i]};
+      auto level = parse_compression_level(value);
+      if (!level) {
+        std::cerr << "Unknown compression level '" << value << "'\n";
+        print_usage();
+        return 1;
+      }
+      if (arg == "--mesh-compression") {
+        settings.meshCompression = *level;
+      } else {
+        settings.textureCompression = *level;
+      }
+    } else if (arg == "--no-mips") {
+      settings.generateMips = false;
+    } else if ((arg == "--color-format" || arg == "--normal-format") &&
+               i + 1 < args.size()) {
+      auto value = std::string_view{args[++i]};
+      auto format = parse_texture_format(value);
+      // BC5 only has two channels, the others fit normal maps badly
+      bool isNormal = arg == "--normal-format";
+      if (!format || (isNormal != (*format == assets::TextureFormat::BC5) &&
+                      *format != assets::TextureFormat::RGBA8)) {
+        std::cerr << "Unsupported " << arg.substr(2) << " '" << value
+                  << "'\n";
+        print_usage();
+        return 1;
+      }
+      if (isNormal) {
+        settings.normalFormat = *format;
+      } else {
+        settings.colorFormat = *format;
+      }
+    } else if (arg == "--atlas" && i + 1 < args.size()) {
+      auto value = std::string_view{args[++i]};
+      uint32_t size = 0;
+      auto [ptr, ec] =
+          std::from_chars(value.data(), value.data() + value.size(), size);
+      if (ec != std::errc{} || ptr != value.data() + value.size() ||
+          !std::has_single_bit(size) || size > baker::atlas_max_layer_size) {
+        std::cerr << "Invalid atlas texture size '" << value << "'\n";
+        print_usage();
+        return 1;
+      }
+      settings.atlasMaxSize = size;
+    } else if (arg == "--pack") {
+      settings.pack = true;
+    } else if (arg == "--json-sidecar") {
+      settings.jsonSidecar = true;
+    } else if (arg == "-h" || arg == "--help") {
+      print_usage();
+      return 0;
+    } else if (arg.starts_with("-")) {
+      std::cerr << "Unknown option '" << arg << "'\n";
+      print_usage();
+      return 1;
+    } else {
+      settings.assetRoot = arg;
+    }
+  }
+
+  if (settings.threadCount == 0) {
+    settings.threadCount = std::max(std::thread::hardware_concurrency(), 1U);
+  }
+
+  const auto &path = settings.assetRoot;
   std::cout << "Loading asset directory at " << path << '\n';
 
+  // The manifest sits at the asset root, keyed by paths relative to it
+  auto manifestPath = path / "bake_manifest.json";
+
+  baker::BakeManifest manifest;
+  if (!settings.force && manifest.load(manifestPath)) {
+    std::cout << "Loaded bake manifest " << manifestPath << " with "
+              << manifest.size() << " entries\n";
+  }
+
+  const auto meshSettingsHash = baker::mesh_settings_hash(settings);
+  const auto textureSettingsHash = baker::texture_settings_hash(settings);
+  const auto gltfSettingsHash = baker::gltf_settings_hash(settings);
+
+  // Collect the work up-front so the jobs can be spread over the workers
+  enum class SourceKind { Mesh, Texture, Gltf };
+  struct BakeJob {
+    std::filesystem::path input;
+    std::filesystem::path output;
+    SourceKind kind;
+    // Manifest keys are relative to the asset root
+    std::string source;
+    std::optional<baker::ManifestEntry> previous;
+  };
+
+  std::vector<BakeJob> jobs;
   for (auto &&p : std::filesystem::recursive_directory_iterator(path)) {
+    auto extension = p.path().extension();
+    SourceKind kind;
+    if (extension == ".obj") {
+      kind = SourceKind::Mesh;
+    } else if (extension == ".png") {
+      kind = SourceKind::Texture;
+    } else if (extension == ".glb") {
+      kind = SourceKind::Gltf;
+    } else {
+      continue;
+    }
+
+    auto newpath = p.path();
+    newpath.replace_extension(kind == SourceKind::Texture ? ".tx" : ".mesh");
 
-    if (p.path().extension() == ".png") {
-      std::cout << "File: " << p.path() << " found a texture" << '\n';
+    auto source = p.path().lexically_relative(path).generic_string();
+    auto previous = manifest.find(source);
+    jobs.push_back({p.path(), newpath, kind, source, previous});
+  }
 
-      auto newpath = p.path();
-      newpath.replace_extension(".tx");
-      convert_image(p.path(), newpath);
+  // model.obj and model.glb would both bake into model.mesh, and whichever
+  // finished last would win
+  std::map<std::filesystem::path, const BakeJob *> outputSources;
+  bool collided = false;
+  for (auto &&job : jobs) {
+    auto [other, inserted] = outputSources.emplace(job.output, &job);
+    if (!inserted) {
+      std::cerr << "Both " << other->second->input << " and " << job.input
+                << " bake into " << job.output << ", rename one of them\n";
+      collided = true;
     }
-    if (p.path().extension() == ".obj") {
-      std::cout << "File: " << p.path() << " found a mesh" << '\n';
+  }
+  if (collided) {
+    return 1;
+  }
+
+  // Biggest files first, so a large mesh doesn't end up being the last job
+  // while every other worker is idle
+  std::vector<std::uintmax_t> sizes;
+  sizes.reserve(jobs.size());
+  for (auto &&job : jobs) {
+    std::error_code ec;
+    auto size = std::filesystem::file_size(job.input, ec);
+    sizes.push_back(ec ? 0 : size);
+  }
+  std::vector<size_t> order(jobs.size());
+  for (size_t i = 0; i != order.size(); ++i) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [&](size_t a, size_t b) { return sizes[a] > sizes[b]; });
+
+  std::cout << "Baking " << jobs.size() << " files with "
+            << settings.threadCount
+            << (settings.threadCount == 1 ? " thread" : " threads") << '\n';
+
+  std::mutex reportMutex;
+  size_t finished = 0;
+  size_t baked = 0;
+  size_t upToDate = 0;
+  // Jobs, atlases and the pack that failed
+  size_t failed = 0;
+  std::uintmax_t totalIn = 0;
+  std::uintmax_t totalOut = 0;
+
+  // The manifest is rebuilt from this run's sources, which drops entries for
+  // sources that were deleted since the last bake
+  baker::BakeManifest newManifest;
+
+  auto bakeStart = std::chrono::steady_clock::now();
+  {
+    assets::JobSystem jobSystem(settings.threadCount);
+
+    for (auto index : order) {
+      jobSystem.submit([&, index]() {
+        const BakeJob &job = jobs[index];
+
+        baker::ManifestEntry entry;
+        entry.sourceSize = sizes[index];
+        entry.sourceTime = baker::file_time(job.input);
+        switch (job.kind) {
+        case SourceKind::Mesh:
+          entry.settingsHash = meshSettingsHash;
+          break;
+        case SourceKind::Texture:
+          entry.settingsHash = textureSettingsHash;
+          break;
+        case SourceKind::Gltf:
+          entry.settingsHash = gltfSettingsHash;
+          break;
+        }
+        entry.output = job.output.lexically_relative(path).generic_string();
+
+        // Only rehash sources whose size or timestamp changed
+        const auto &previous = job.previous;
+        bool ok = true;
+        if (previous && previous->sourceSize == entry.sourceSize &&
+            previous->sourceTime == entry.sourceTime) {
+          entry.sourceHash = previous->sourceHash;
+        } else {
+          ok = assets::hash_file(job.input, entry.sourceHash);
+        }
+
+        // Skip the bake if the source, the settings and the output all match
+        // the previous run. Outputs that were modified or deleted are stale.
+        bool fresh = ok && !settings.force && previous &&
+                     previous->sourceHash == entry.sourceHash &&
+                     previous->settingsHash == entry.settingsHash &&
+                     previous->output == entry.output &&
+                     baker::is_output_fresh(job.output, entry.sourceHash);
+        if (fresh) {
+          for (auto &&extra : previous->extraOutputs) {
+            fresh = fresh &&
+                    baker::is_output_fresh(path / extra, entry.sourceHash);
+          }
+          entry.extraOutputs = previous->extraOutputs;
+        }
+
+        BakeStats stats;
+        stats.inputBytes = sizes[index];
+
+        if (ok && !fresh) {
+          std::vector<std::filesystem::path> extraOutputs;
+          switch (job.kind) {
+          case SourceKind::Mesh:
+            ok = convert_mesh(job.input, job.output, settings,
+                              entry.sourceHash, jobSystem, stats);
+            break;
+          case SourceKind::Texture:
+            ok = convert_image(job.input, job.output, settings,
+                               entry.sourceHash, jobSystem, stats);
+            break;
+          case SourceKind::Gltf:
+            ok = convert_glb(job.input, job.output, settings,
+                             entry.sourceHash, jobSystem, stats,
+                             extraOutputs);
+            break;
+          }
+          entry.extraOutputs.clear();
+          for (auto &&extra : extraOutputs) {
+            entry.extraOutputs.push_back(
+                extra.lexically_relative(path).generic_string());
+          }
+        }
+
+        if (ok && !fresh) {
+          std::error_code ec;
+          auto size = std::filesystem::file_size(job.output, ec);
+          stats.outputBytes = ec ? 0 : size;
+          for (auto &&extra : entry.extraOutputs) {
+            size = std::filesystem::file_size(path / extra, ec);
+            stats.outputBytes += ec ? 0 : size;
+          }
+        }
 
-      auto newpath = p.path();
-      newpath.replace_extension(".mesh");
-      convert_mesh(p.path(), newpath);
+        std::lock_guard lock(reportMutex);
+        ++finished;
+        if (!ok) {
+          ++failed;
+          std::cout << "[" << finished << "/" << jobs.size() << "] "
+                    << job.input.string() << " FAILED\n";
+          return;
+        }
+
+        newManifest.update(job.source, entry);
+
+        if (fresh) {
+          ++upToDate;
+          return;
+        }
+
+        ++baked;
+        totalIn += stats.inputBytes;
+        totalOut += stats.outputBytes;
+
+        std::cout << "[" << finished << "/" << jobs.size() << "] "
+                  << job.input.string() << " -> "
+                  << job.output.filename().string() << ": load "
+                  << stats.loadTime.count() << "ms, pack "
+                  << stats.packTime.count() << "ms, save "
+                  << stats.saveTime.count() << "ms, "
+                  << format_size(stats.inputBytes) << " -> "
+                  << format_size(stats.outputBytes) << '\n';
+        for (auto &&note : stats.notes) {
+          std::cout << "    " << note << '\n';
+        }
+      });
+    }
+
+    jobSystem.wait();
+  }
+
+  if (!newManifest.save(manifestPath)) {
+    std::cerr << "Failed to write bake manifest " << manifestPath << '\n';
+  }
+
+  std::vector<std::string> outputs;
+  std::vector<std::string> textures;
+  for (auto &&job : jobs) {
+    if (auto entry = newManifest.find(job.source)) {
+      outputs.push_back(entry->output);
+      if (job.kind == SourceKind::Texture) {
+        textures.push_back(entry->output);
+      }
+      // The extra outputs are the textures embedded in a glb
+      outputs.insert(outputs.end(), entry->extraOutputs.begin(),
+                     entry->extraOutputs.end());
+      textures.insert(textures.end(), entry->extraOutputs.begin(),
+                      entry->extraOutputs.end());
     }
   }
 
-  return 0;
+  std::vector<std::string> atlases;
+  if (!bake_atlases(path, textures, settings, atlases)) {
+    ++failed;
+  }
+  outputs.insert(outputs.end(), atlases.begin(), atlases.end());
+
+  if (settings.pack) {
+    if (!pack_assets(path, outputs)) {
+      ++failed;
+    }
+  }
+
+  std::chrono::duration<double> seconds =
+      std::chrono::steady_clock::now() - bakeStart;
+  double wall = std::max(seconds.count(), 1e-6);
+
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "Baked " << baked << " files (" << upToDate << " up to date, "
+            << failed << " failed) in " << wall << "s: "
+            << static_cast<double>(baked) / wall << " files/s, "
+            << static_cast<double>(totalIn) / bytes_in_mb / wall
+            << " MB/s in, "
+            << static_cast<double>(totalOut) / bytes_in_mb / wall
+            << " MB/s out\n";
+  std::cout << "Peak memory " << format_size(baker::peak_memory_usage())
+            << '\n';
+
+  return failed == 0 ? 0 : 1;
 }
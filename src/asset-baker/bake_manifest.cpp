@@ -0,0 +1,140 @@
+#include "bake_manifest.hpp"
+#include "../assetlib/asset_hash.hpp"
+#include "../assetlib/asset_loader.hpp"
+#include "../assetlib/mesh_asset.hpp"
+#include "../assetlib/texture_asset.hpp"
+#include <cstring>
+#include <fstream>
+#include <nlohmann/json.hpp>
+
+namespace baker {
+
+namespace {
+constexpr int manifest_version = 1;
+} // namespace
+
+auto BakeManifest::load(const std::filesystem::path &path) -> bool {
+  entries_.clear();
+
+  std::ifstream infile(path);
+  if (!infile.is_open()) {
+    return false;
+  }
+
+  auto manifest = nlohmann::json::parse(infile, nullptr, false);
+  if (manifest.is_discarded() ||
+      manifest.value("version", 0) != manifest_version) {
+    return false;
+  }
+
+  for (auto &&[source, value] : manifest["files"].items()) {
+    ManifestEntry entry;
+    entry.sourceHash =
+        assets::hash_from_string(value.value("source_hash", std::string{}));
+    entry.sourceSize = value.value("source_size", std::uintmax_t{0});
+    entry.sourceTime = value.value("source_time", std::int64_t{0});
+    entry.settingsHash =
+        assets::hash_from_string(value.value("settings_hash", std::string{}));
+    entry.output = value.value("output", std::string{});
+    entry.extraOutputs =
+        value.value("extra_outputs", std::vector<std::string>{});
+    entries_[source] = entry;
+  }
+
+  return true;
+}
+
+auto BakeManifest::save(const std::filesystem::path &path) const -> bool {
+  nlohmann::json files = nlohmann::json::object();
+  for (auto &&[source, entry] : entries_) {
+    files[source] = {
+        {"source_hash", assets::hash_to_string(entry.sourceHash)},
+        {"source_size", entry.sourceSize},
+        {"source_time", entry.sourceTime},
+        {"settings_hash", assets::hash_to_string(entry.settingsHash)},
+        {"output", entry.output},
+    };
+    if (!entry.extraOutputs.empty()) {
+      files[source]["extra_outputs"] = entry.extraOutputs;
+    }
+  }
+
+  nlohmann::json manifest;
+  manifest["version"] = manifest_version;
+  manifest["files"] = files;
+
+  // Write next to the real file and rename, so an interrupted bake never
+  // leaves a truncated manifest behind
+  auto tempPath = path;
+  tempPath += ".tmp";
+  {
+    std::ofstream outfile(tempPath);
+    if (!outfile.is_open()) {
+      return false;
+    }
+    outfile << manifest.dump(2);
+    if (!outfile) {
+      return false;
+    }
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(tempPath, path, ec);
+  return !ec;
+}
+
+auto BakeManifest::find(const std::string &source) const
+    -> std::optional<ManifestEntry> {
+  auto it = entries_.find(source);
+  if (it == entries_.end()) {
+    return std::nullopt;
+  }
+  return it->second;
+}
+
+void BakeManifest::update(const std::string &source,
+                          const ManifestEntry &entry) {
+  entries_[source] = entry;
+}
+
+auto BakeManifest::size() const -> size_t { return entries_.size(); }
+
+auto file_time(const std::filesystem::path &path) -> std::int64_t {
+  std::error_code ec;
+  auto time = std::filesystem::last_write_time(path, ec);
+  if (ec) {
+    return 0;
+  }
+  return static_cast<std::int64_t>(time.time_since_epoch().count());
+}
+
+auto is_output_fresh(const std::filesystem::path &output,
+                     std::uint64_t sourceHash) -> bool {
+  assets::AssetFile file;
+  if (!assets::load_binaryfile_header(output, file)) {
+    return false;
+  }
+
+  if (file.version == assets::asset_json_version) {
+    auto metadata = nlohmann::json::parse(file.metadata, nullptr, false);
+    if (metadata.is_discarded()) {
+      return false;
+    }
+    return assets::hash_from_string(metadata.value(
+               "source_hash", std::string{})) == sourceHash;
+  }
+
+  if (memcmp(file.type, "MESH", 4) == 0) {
+    auto info = assets::read_mesh_info(&file);
+    return info.vertexFormat != assets::VertexFormat::Unknown &&
+           info.sourceHash == sourceHash;
+  }
+  if (memcmp(file.type, "TEXI", 4) == 0) {
+    auto info = assets::read_texture_info(&file);
+    return info.textureFormat != assets::TextureFormat::Unknown &&
+           info.sourceHash == sourceHash;
+  }
+  return false;
+}
+
+} // namespace baker
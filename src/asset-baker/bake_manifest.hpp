@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace baker {
+
+struct ManifestEntry {
+  std::uint64_t sourceHash = 0;
+  // Size and modification time let unchanged sources skip rehashing
+  std::uintmax_t sourceSize = 0;
+  std::int64_t sourceTime = 0;
+  std::uint64_t settingsHash = 0;
+  // Output path, relative to the asset root
+  std::string output;
+  // Further outputs of sources that bake into several assets, such as the
+  // textures embedded in a glb
+  std::vector<std::string> extraOutputs;
+};
+
+// Record of what every source asset was last baked into. Lives next to the
+// asset root and lets the baker skip sources that haven't changed.
+class BakeManifest {
+public:
+  auto load(const std::filesystem::path &path) -> bool;
+  auto save(const std::filesystem::path &path) const -> bool;
+
+  [[nodiscard]] auto find(const std::string &source) const
+      -> std::optional<ManifestEntry>;
+  void update(const std::string &source, const ManifestEntry &entry);
+
+  [[nodiscard]] auto size() const -> size_t;
+
+private:
+  std::unordered_map<std::string, ManifestEntry> entries_;
+};
+
+auto file_time(const std::filesystem::path &path) -> std::int64_t;
+
+// Checks that a baked asset exists and was produced from the given source
+auto is_output_fresh(const std::filesystem::path &output,
+                     std::uint64_t sourceHash) -> bool;
+
+} // namespace baker
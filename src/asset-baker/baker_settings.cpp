@@ -0,0 +1,44 @@
+#include "baker_settings.hpp"
+#include "../assetlib/asset_hash.hpp"
+#include <string>
+
+auto baker::mesh_settings_hash(const BakerSettings &settings)
+    -> std::uint64_t {
+  std::string fingerprint = "mesh;version=" + std::to_string(baker_version);
+  fingerprint +=
+      ";vertex_format=" + std::to_string(int(settings.vertexFormat));
+  fingerprint += ";optimize=" + std::to_string(int(settings.optimizeMeshes));
+  fingerprint += ";meshlets=" + std::to_string(int(settings.buildMeshlets));
+  fingerprint += ";lods=";
+  for (auto &&ratio : settings.lodRatios) {
+    fingerprint += std::to_string(ratio) + ",";
+  }
+  fingerprint += ";lod_error=" + std::to_string(settings.lodError);
+  fingerprint +=
+      ";encode_indices=" + std::to_string(int(settings.encodeIndices));
+  fingerprint += ";stream=" + std::to_string(settings.streamMeshSize);
+  fingerprint +=
+      ";compression=" + std::to_string(int(settings.meshCompression));
+  fingerprint += ";json=" + std::to_string(int(settings.jsonSidecar));
+  return assets::hash_bytes(fingerprint.data(), fingerprint.size());
+}
+
+auto baker::texture_settings_hash(const BakerSettings &settings)
+    -> std::uint64_t {
+  std::string fingerprint = "texture;version=" + std::to_string(baker_version);
+  fingerprint += ";mips=" + std::to_string(int(settings.generateMips));
+  fingerprint += ";color_format=" + std::to_string(int(settings.colorFormat));
+  fingerprint +=
+      ";normal_format=" + std::to_string(int(settings.normalFormat));
+  fingerprint +=
+      ";compression=" + std::to_string(int(settings.textureCompression));
+  fingerprint += ";json=" + std::to_string(int(settings.jsonSidecar));
+  return assets::hash_bytes(fingerprint.data(), fingerprint.size());
+}
+
+auto baker::gltf_settings_hash(const BakerSettings &settings)
+    -> std::uint64_t {
+  std::uint64_t hashes[2] = {mesh_settings_hash(settings),
+                             texture_settings_hash(settings)};
+  return assets::hash_bytes(hashes, sizeof(hashes));
+}
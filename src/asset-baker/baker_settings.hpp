@@ -0,0 +1,64 @@
+#pragma once
+
+#include "../assetlib/mesh_asset.hpp"
+#include "../assetlib/texture_asset.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace baker {
+
+// Bump whenever a converter changes in a way that affects its output, so
+// incremental bakes rebuild everything that was produced by older bakers
+constexpr std::uint32_t baker_version = 9;
+
+struct BakerSettings {
+  std::filesystem::path assetRoot{"./assets"};
+  unsigned threadCount = 1;
+  // Ignore the bake manifest and rebuild every asset
+  bool force = false;
+  // Compact vertices are read by the GPU as they are, at about half the size
+  assets::VertexFormat vertexFormat = assets::VertexFormat::P32N8C8V16;
+  // Reorder mesh triangles and vertices for the vertex cache, overdraw and
+  // vertex fetch
+  bool optimizeMeshes = false;
+  // Split meshes into meshlets for cluster culling
+  bool buildMeshlets = false;
+  // Triangle ratios of the simplified levels after the full detail one,
+  // e.g. 0.5, 0.25, 0.1. Empty bakes a single level.
+  std::vector<float> lodRatios;
+  // Largest simplification error relative to the mesh radius
+  float lodError = 0.1F;
+  // Store indices with the triangle codec instead of as they are
+  bool encodeIndices = false;
+  // OBJ files of at least this many bytes are baked out of core, with
+  // bounded memory
+  std::uintmax_t streamMeshSize = std::uintmax_t{1024} * 1024 * 1024;
+  // Bake the full mip chain of textures
+  bool generateMips = true;
+  // GPU formats of color textures and of normal maps, the ones with "normal"
+  // in their name. Font atlases always stay RGBA8.
+  assets::TextureFormat colorFormat = assets::TextureFormat::BC7;
+  assets::TextureFormat normalFormat = assets::TextureFormat::BC5;
+  // Pack textures of at most this many texels on a side into texture arrays
+  // shared by their materials, 0 leaves every texture on its own
+  uint32_t atlasMaxSize = 0;
+  // LZ4 or LZ4HC for each asset class, loading speed is the same
+  assets::CompressionLevel meshCompression = assets::CompressionLevel::Fast;
+  assets::CompressionLevel textureCompression = assets::CompressionLevel::Fast;
+  // Write every baked asset into assets.pack at the asset root as well
+  bool pack = false;
+  // Write the metadata of every baked asset as JSON next to it, for
+  // debugging. Part of the settings hashes, so turning it on rebakes the
+  // assets that have no sidecar yet.
+  bool jsonSidecar = false;
+};
+
+// Hashes of the settings that influence the baked output of each asset
+// class. Changing a mesh option must not invalidate every texture.
+auto mesh_settings_hash(const BakerSettings &settings) -> std::uint64_t;
+auto texture_settings_hash(const BakerSettings &settings) -> std::uint64_t;
+// Binary glTF files bake into a mesh and textures
+auto gltf_settings_hash(const BakerSettings &settings) -> std::uint64_t;
+
+} // namespace baker
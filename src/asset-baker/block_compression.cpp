@@ -0,0 +1,500 @@
+#include "block_compression.hpp"
+#include "../assetlib/job_system.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BAKER_BLOCKS_SSE2
+#endif
+
+namespace baker {
+
+namespace {
+
+// Texels of a 4x4 block, 16 per channel so that four texels fill a register
+struct Block {
+  alignas(16) float channels[4][16];
+};
+
+void load_block(const uint8_t *pixels, uint32_t width, uint32_t height,
+                uint32_t blockX, uint32_t blockY, Block &block) {
+  for (uint32_t y = 0; y != 4; ++y) {
+    uint32_t row = std::min(blockY * 4 + y, height - 1);
+    for (uint32_t x = 0; x != 4; ++x) {
+      uint32_t column = std::min(blockX * 4 + x, width - 1);
+      const uint8_t *texel = pixels + (size_t{row} * width + column) * 4;
+      for (int c = 0; c != 4; ++c) {
+        block.channels[c][y * 4 + x] = texel[c];
+      }
+    }
+  }
+}
+
+// Mean and unit principal axis of the first channelCount channels, found by
+// power iteration on their covariance. The axis is zero for flat blocks.
+void principal_axis(const Block &block, int channelCount, float *mean,
+                    float *axis) {
+  for (int c = 0; c != channelCount; ++c) {
+    float sum = 0.0F;
+    for (float value : block.channels[c]) {
+      sum += value;
+    }
+    mean[c] = sum / 16.0F;
+  }
+
+  float covariance[4][4] = {};
+  for (int i = 0; i != 16; ++i) {
+    for (int a = 0; a != channelCount; ++a) {
+      for (int b = a; b != channelCount; ++b) {
+        covariance[a][b] += (block.channels[a][i] - mean[a]) *
+                            (block.channels[b][i] - mean[b]);
+      }
+    }
+  }
+  for (int a = 0; a != channelCount; ++a) {
+    for (int b = 0; b != a; ++b) {
+      covariance[a][b] = covariance[b][a];
+    }
+  }
+
+  // Start from the row of the channel that varies the most
+  int widest = 0;
+  for (int c = 1; c != channelCount; ++c) {
+    if (covariance[c][c] > covariance[widest][widest]) {
+      widest = c;
+    }
+  }
+  for (int c = 0; c != channelCount; ++c) {
+    axis[c] = covariance[widest][c];
+  }
+
+  for (int iteration = 0; iteration != 8; ++iteration) {
+    float next[4] = {};
+    float largest = 0.0F;
+    for (int a = 0; a != channelCount; ++a) {
+      for (int b = 0; b != channelCount; ++b) {
+        next[a] += covariance[a][b] * axis[b];
+      }
+      largest = std::max(largest, std::abs(next[a]));
+    }
+    if (largest == 0.0F) {
+      break;
+    }
+    for (int c = 0; c != channelCount; ++c) {
+      axis[c] = next[c] / largest;
+    }
+  }
+
+  float length = 0.0F;
+  for (int c = 0; c != channelCount; ++c) {
+    length += axis[c] * axis[c];
+  }
+  length = std::sqrt(length);
+  for (int c = 0; c != channelCount; ++c) {
+    axis[c] = length > 0.0F ? axis[c] / length : 0.0F;
+  }
+}
+
+// Endpoints at the two outermost texels along axis
+void axis_endpoints(const Block &block, int channelCount, const float *mean,
+                    const float *axis, float *e0, float *e1) {
+  float low = std::numeric_limits<float>::max();
+  float high = std::numeric_limits<float>::lowest();
+  for (int i = 0; i != 16; ++i) {
+    float position = 0.0F;
+    for (int c = 0; c != channelCount; ++c) {
+      position += (block.channels[c][i] - mean[c]) * axis[c];
+    }
+    low = std::min(low, position);
+    high = std::max(high, position);
+  }
+  for (int c = 0; c != channelCount; ++c) {
+    e0[c] = std::clamp(mean[c] + axis[c] * low, 0.0F, 255.0F);
+    e1[c] = std::clamp(mean[c] + axis[c] * high, 0.0F, 255.0F);
+  }
+}
+
+// Snaps every texel to the closest of levels points on the segment from e0
+// to e1, level l sitting at weights[l]. Returns the squared error.
+auto fit_levels(const Block &block, int channelCount, const float *e0,
+                const float *e1, const float *weights, int levels,
+                uint8_t *indices) -> float {
+  float delta[4] = {};
+  float length = 0.0F;
+  for (int c = 0; c != channelCount; ++c) {
+    delta[c] = e1[c] - e0[c];
+    length += delta[c] * delta[c];
+  }
+  float scale = length > 0.0F ? static_cast<float>(levels - 1) / length : 0.0F;
+
+#ifdef BAKER_BLOCKS_SSE2
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 half = _mm_set1_ps(0.5F);
+  const __m128 lastLevel = _mm_set1_ps(static_cast<float>(levels - 1));
+  __m128 total = zero;
+
+  // Four texels at a time, one channel per step
+  for (int i = 0; i != 16; i += 4) {
+    __m128 projection = zero;
+    for (int c = 0; c != channelCount; ++c) {
+      __m128 offset = _mm_sub_ps(_mm_load_ps(block.channels[c] + i),
+                                 _mm_set1_ps(e0[c]));
+      projection =
+          _mm_add_ps(projection, _mm_mul_ps(offset, _mm_set1_ps(delta[c])));
+    }
+    __m128 position = _mm_min_ps(
+        _mm_max_ps(_mm_mul_ps(projection, _mm_set1_ps(scale)), zero),
+        lastLevel);
+
+    alignas(16) int32_t level[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(level),
+                    _mm_cvttps_epi32(_mm_add_ps(position, half)));
+    __m128 weight = _mm_setr_ps(weights[level[0]], weights[level[1]],
+                                weights[level[2]], weights[level[3]]);
+
+    for (int c = 0; c != channelCount; ++c) {
+      __m128 decoded = _mm_add_ps(_mm_set1_ps(e0[c]),
+                                  _mm_mul_ps(weight, _mm_set1_ps(delta[c])));
+      __m128 difference =
+          _mm_sub_ps(decoded, _mm_load_ps(block.channels[c] + i));
+      total = _mm_add_ps(total, _mm_mul_ps(difference, difference));
+    }
+    for (int k = 0; k != 4; ++k) {
+      indices[i + k] = static_cast<uint8_t>(level[k]);
+    }
+  }
+
+  alignas(16) float lanes[4];
+  _mm_store_ps(lanes, total);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#else
+  float error = 0.0F;
+  for (int i = 0; i != 16; ++i) {
+    float projection = 0.0F;
+    for (int c = 0; c != channelCount; ++c) {
+      projection += (block.channels[c][i] - e0[c]) * delta[c];
+    }
+    float position = std::clamp(projection * scale, 0.0F,
+                                static_cast<float>(levels - 1));
+    auto level = static_cast<int>(position + 0.5F);
+    for (int c = 0; c != channelCount; ++c) {
+      float difference =
+          e0[c] + weights[level] * delta[c] - block.channels[c][i];
+      error += difference * difference;
+    }
+    indices[i] = static_cast<uint8_t>(level);
+  }
+  return error;
+#endif
+}
+
+// Least squares endpoints for texels already assigned to levels. Returns
+// false when every texel is on the same level, which leaves them undecided.
+auto refine_endpoints(const Block &block, int channelCount,
+                      const uint8_t *indices, const float *weights, float *e0,
+                      float *e1) -> bool {
+  float aa = 0.0F;
+  float ab = 0.0F;
+  float bb = 0.0F;
+  float x0[4] = {};
+  float x1[4] = {};
+  for (int i = 0; i != 16; ++i) {
+    float b = weights[indices[i]];
+    float a = 1.0F - b;
+    aa += a * a;
+    ab += a * b;
+    bb += b * b;
+    for (int c = 0; c != channelCount; ++c) {
+      x0[c] += a * block.channels[c][i];
+      x1[c] += b * block.channels[c][i];
+    }
+  }
+
+  float determinant = aa * bb - ab * ab;
+  if (std::abs(determinant) < 1e-6F) {
+    return false;
+  }
+  for (int c = 0; c != channelCount; ++c) {
+    e0[c] = std::clamp((x0[c] * bb - x1[c] * ab) / determinant, 0.0F, 255.0F);
+    e1[c] = std::clamp((x1[c] * aa - x0[c] * ab) / determinant, 0.0F, 255.0F);
+  }
+  return true;
+}
+
+struct Color565 {
+  uint16_t packed;
+  // The color the GPU expands it back to
+  float rgb[3];
+};
+
+auto quantize_565(const float *color) -> Color565 {
+  auto r = static_cast<int>(std::lround(color[0] * 31.0F / 255.0F));
+  auto g = static_cast<int>(std::lround(color[1] * 63.0F / 255.0F));
+  auto b = static_cast<int>(std::lround(color[2] * 31.0F / 255.0F));
+
+  Color565 result;
+  result.packed = static_cast<uint16_t>((r << 11) | (g << 5) | b);
+  result.rgb[0] = static_cast<float>((r << 3) | (r >> 2));
+  result.rgb[1] = static_cast<float>((g << 2) | (g >> 4));
+  result.rgb[2] = static_cast<float>((b << 3) | (b >> 2));
+  return result;
+}
+
+constexpr std::array<float, 4> bc1_weights = {0.0F, 1.0F / 3.0F, 2.0F / 3.0F,
+                                              1.0F};
+// From position on the line to BC1 index: endpoints are 0 and 1, the
+// colors in between 2 and 3
+constexpr std::array<uint32_t, 4> bc1_codes = {0, 2, 3, 1};
+
+void encode_bc1(const Block &block, uint8_t *out) {
+  float mean[4];
+  float axis[4];
+  float e0[4];
+  float e1[4];
+  principal_axis(block, 3, mean, axis);
+  axis_endpoints(block, 3, mean, axis, e0, e1);
+
+  uint8_t levels[16];
+  Color565 c0 = quantize_565(e0);
+  Color565 c1 = quantize_565(e1);
+  float error = fit_levels(block, 3, c0.rgb, c1.rgb, bc1_weights.data(), 4,
+                           levels);
+
+  if (refine_endpoints(block, 3, levels, bc1_weights.data(), e0, e1)) {
+    uint8_t refinedLevels[16];
+    Color565 r0 = quantize_565(e0);
+    Color565 r1 = quantize_565(e1);
+    if (fit_levels(block, 3, r0.rgb, r1.rgb, bc1_weights.data(), 4,
+                   refinedLevels) < error) {
+      c0 = r0;
+      c1 = r1;
+      memcpy(levels, refinedLevels, sizeof(levels));
+    }
+  }
+
+  // The first endpoint has to be the larger one to get four colors. Equal
+  // endpoints leave every texel on the first one.
+  uint32_t bits = 0;
+  if (c0.packed != c1.packed) {
+    bool swapped = c0.packed < c1.packed;
+    if (swapped) {
+      std::swap(c0, c1);
+    }
+    for (int i = 0; i != 16; ++i) {
+      int level = swapped ? 3 - levels[i] : levels[i];
+      bits |= bc1_codes[level] << (2 * i);
+    }
+  }
+
+  memcpy(out, &c0.packed, sizeof(uint16_t));
+  memcpy(out + 2, &c1.packed, sizeof(uint16_t));
+  memcpy(out + 4, &bits, sizeof(uint32_t));
+}
+
+// One channel between its extremes, in the 8 level mode
+void encode_bc4(const float *values, uint8_t *out) {
+  float low = 255.0F;
+  float high = 0.0F;
+  for (int i = 0; i != 16; ++i) {
+    low = std::min(low, values[i]);
+    high = std::max(high, values[i]);
+  }
+  auto a0 = static_cast<int>(std::lround(high));
+  auto a1 = static_cast<int>(std::lround(low));
+
+  uint64_t bits = 0;
+  if (a0 != a1) {
+    int palette[8] = {a0, a1};
+    for (int level = 2; level != 8; ++level) {
+      palette[level] = ((8 - level) * a0 + (level - 1) * a1) / 7;
+    }
+    for (int i = 0; i != 16; ++i) {
+      auto value = static_cast<int>(values[i]);
+      uint64_t best = 0;
+      for (int level = 1; level != 8; ++level) {
+        if (std::abs(palette[level] - value) <
+            std::abs(palette[best] - value)) {
+          best = static_cast<uint64_t>(level);
+        }
+      }
+      bits |= best << (3 * i);
+    }
+  }
+
+  out[0] = static_cast<uint8_t>(a0);
+  out[1] = static_cast<uint8_t>(a1);
+  memcpy(out + 2, &bits, 6);
+}
+
+constexpr std::array<float, 16> bc7_weights = {
+    0.0F / 64,  4.0F / 64,  9.0F / 64,  13.0F / 64, 17.0F / 64, 21.0F / 64,
+    26.0F / 64, 30.0F / 64, 34.0F / 64, 38.0F / 64, 43.0F / 64, 47.0F / 64,
+    51.0F / 64, 55.0F / 64, 60.0F / 64, 64.0F / 64};
+
+struct Bc7Endpoint {
+  uint8_t quantized[4];
+  uint32_t pbit;
+  // The color the GPU expands it back to
+  float rgba[4];
+};
+
+auto quantize_bc7(const float *color, uint32_t pbit) -> Bc7Endpoint {
+  Bc7Endpoint result;
+  result.pbit = pbit;
+  for (int c = 0; c != 4; ++c) {
+    auto value = std::clamp(
+        static_cast<int>(std::lround((color[c] - static_cast<float>(pbit)) /
+                                     2.0F)),
+        0, 127);
+    result.quantized[c] = static_cast<uint8_t>(value);
+    result.rgba[c] = static_cast<float>((value << 1) | static_cast<int>(pbit));
+  }
+  return result;
+}
+
+class BitWriter {
+public:
+  explicit BitWriter(uint8_t *out) : out_(out) {}
+
+  void write(uint32_t value, int count) {
+    for (int i = 0; i != count; ++i, ++position_) {
+      if (((value >> i) & 1U) != 0) {
+        out_[position_ / 8] |= static_cast<uint8_t>(1U << (position_ % 8));
+      }
+    }
+  }
+
+private:
+  uint8_t *out_;
+  size_t position_ = 0;
+};
+
+void encode_bc7(const Block &block, uint8_t *out) {
+  float mean[4];
+  float axis[4];
+  float e0[4];
+  float e1[4];
+  principal_axis(block, 4, mean, axis);
+  axis_endpoints(block, 4, mean, axis, e0, e1);
+
+  float bestError = std::numeric_limits<float>::max();
+  Bc7Endpoint best0{};
+  Bc7Endpoint best1{};
+  uint8_t levels[16] = {};
+
+  // Every endpoint has its own p-bit, the lowest bit of all its channels
+  auto try_endpoints = [&](const float *from, const float *to) {
+    for (uint32_t pbits = 0; pbits != 4; ++pbits) {
+      Bc7Endpoint q0 = quantize_bc7(from, pbits & 1U);
+      Bc7Endpoint q1 = quantize_bc7(to, pbits >> 1);
+      uint8_t candidate[16];
+      float error = fit_levels(block, 4, q0.rgba, q1.rgba,
+                               bc7_weights.data(), 16, candidate);
+      if (error < bestError) {
+        bestError = error;
+        best0 = q0;
+        best1 = q1;
+        memcpy(levels, candidate, sizeof(levels));
+      }
+    }
+  };
+
+  try_endpoints(e0, e1);
+  if (refine_endpoints(block, 4, levels, bc7_weights.data(), e0, e1)) {
+    try_endpoints(e0, e1);
+  }
+
+  // The first texel's index drops its top bit, so it has to be below 8
+  if (levels[0] >= 8) {
+    std::swap(best0, best1);
+    for (auto &&level : levels) {
+      level = static_cast<uint8_t>(15 - level);
+    }
+  }
+
+  memset(out, 0, 16);
+  BitWriter writer(out);
+  writer.write(1U << 6, 7);
+  for (int c = 0; c != 4; ++c) {
+    writer.write(best0.quantized[c], 7);
+    writer.write(best1.quantized[c], 7);
+  }
+  writer.write(best0.pbit, 1);
+  writer.write(best1.pbit, 1);
+  writer.write(levels[0], 3);
+  for (int i = 1; i != 16; ++i) {
+    writer.write(levels[i], 4);
+  }
+}
+
+void encode_block(assets::TextureFormat format, const Block &block,
+                  uint8_t *out) {
+  switch (format) {
+  case assets::TextureFormat::BC1:
+    encode_bc1(block, out);
+    break;
+  case assets::TextureFormat::BC3:
+    encode_bc4(block.channels[3], out);
+    encode_bc1(block, out + 8);
+    break;
+  case assets::TextureFormat::BC5:
+    encode_bc4(block.channels[0], out);
+    encode_bc4(block.channels[1], out + 8);
+    break;
+  case assets::TextureFormat::BC7:
+    encode_bc7(block, out);
+    break;
+  default:
+    break;
+  }
+}
+
+} // namespace
+
+auto block_bytes(assets::TextureFormat format) -> size_t {
+  switch (format) {
+  case assets::TextureFormat::BC1:
+    return 8;
+  case assets::TextureFormat::BC3:
+  case assets::TextureFormat::BC5:
+  case assets::TextureFormat::BC7:
+    return 16;
+  default:
+    return 0;
+  }
+}
+
+auto compressed_image_size(assets::TextureFormat format, uint32_t width,
+                           uint32_t height) -> size_t {
+  size_t bytes = block_bytes(format);
+  if (bytes == 0) {
+    return size_t{width} * height * 4;
+  }
+  return size_t{(width + 3) / 4} * ((height + 3) / 4) * bytes;
+}
+
+void compress_image(assets::TextureFormat format, const uint8_t *pixels,
+                    uint32_t width, uint32_t height, uint8_t *blocks,
+                    assets::JobSystem &jobs) {
+  uint32_t blocksWide = (width + 3) / 4;
+  uint32_t blocksHigh = (height + 3) / 4;
+  size_t bytes = block_bytes(format);
+
+  jobs.parallel_for(blocksHigh, [&](size_t blockY) {
+    Block block;
+    uint8_t *row = blocks + blockY * blocksWide * bytes;
+    for (uint32_t blockX = 0; blockX != blocksWide; ++blockX) {
+      load_block(pixels, width, height, blockX,
+                 static_cast<uint32_t>(blockY), block);
+      encode_block(format, block, row + blockX * bytes);
+    }
+  });
+}
+
+} // namespace baker
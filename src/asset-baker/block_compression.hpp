@@ -0,0 +1,30 @@
+#pragma once
+
+#include "../assetlib/texture_asset.hpp"
+#include <cstddef>
+#include <cstdint>
+
+namespace assets {
+class JobSystem;
+}
+
+namespace baker {
+
+// Bytes of one 4x4 block of a block compressed format, 0 for RGBA8
+auto block_bytes(assets::TextureFormat format) -> size_t;
+
+// Size of a width x height image in format, partial blocks included
+auto compressed_image_size(assets::TextureFormat format, uint32_t width,
+                           uint32_t height) -> size_t;
+
+// Encodes an RGBA8 image into 4x4 blocks of format, one row of blocks per
+// job. Blocks over the right and bottom edges repeat the last column and row.
+//   BC1  RGB, 4 colors on a line in 565
+//   BC3  BC1 color plus a separate 8 level alpha block
+//   BC5  red and green as two 8 level blocks, for normal maps
+//   BC7  RGBA, mode 6 only: 16 levels between 7 bit endpoints
+void compress_image(assets::TextureFormat format, const uint8_t *pixels,
+                    uint32_t width, uint32_t height, uint8_t *blocks,
+                    assets::JobSystem &jobs);
+
+} // namespace baker
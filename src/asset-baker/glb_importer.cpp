@@ -0,0 +1,605 @@
+#include "glb_importer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <nlohmann/json.hpp>
+#include <tuple>
+#include <type_traits>
+
+namespace baker {
+
+namespace {
+
+constexpr uint32_t glb_magic = 0x46546C67;  // "glTF"
+constexpr uint32_t chunk_json = 0x4E4F534A; // "JSON"
+constexpr uint32_t chunk_bin = 0x004E4942;  // "BIN\0"
+
+constexpr int component_byte = 5120;
+constexpr int component_unsigned_byte = 5121;
+constexpr int component_short = 5122;
+constexpr int component_unsigned_short = 5123;
+constexpr int component_unsigned_int = 5125;
+constexpr int component_float = 5126;
+
+constexpr int mode_triangles = 4;
+
+// Largest byteStride the specification allows
+constexpr size_t max_byte_stride = 252;
+
+// Column major, as glTF stores them
+using Matrix = std::array<float, 16>;
+
+constexpr Matrix identity = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+
+auto multiply(const Matrix &a, const Matrix &b) -> Matrix {
+  Matrix result{};
+  for (size_t column = 0; column != 4; ++column) {
+    for (size_t row = 0; row != 4; ++row) {
+      float sum = 0.0F;
+      for (size_t k = 0; k != 4; ++k) {
+        sum += a[k * 4 + row] * b[column * 4 + k];
+      }
+      result[column * 4 + row] = sum;
+    }
+  }
+  return result;
+}
+
+// The node's matrix, or its translation, rotation and scale combined
+auto local_transform(const nlohmann::json &node) -> Matrix {
+  if (node.contains("matrix")) {
+    auto values = node["matrix"].get<std::vector<float>>();
+    Matrix matrix = identity;
+    std::copy_n(values.begin(), std::min<size_t>(values.size(), 16),
+                matrix.begin());
+    return matrix;
+  }
+
+  auto t = node.value("translation", std::vector<float>{0, 0, 0});
+  auto r = node.value("rotation", std::vector<float>{0, 0, 0, 1});
+  auto s = node.value("scale", std::vector<float>{1, 1, 1});
+  t.resize(3, 0.0F);
+  r.resize(4, 0.0F);
+  s.resize(3, 1.0F);
+
+  float x = r[0];
+  float y = r[1];
+  float z = r[2];
+  float w = r[3];
+  return {(1 - 2 * (y * y + z * z)) * s[0],
+          2 * (x * y + z * w) * s[0],
+          2 * (x * z - y * w) * s[0],
+          0,
+          2 * (x * y - z * w) * s[1],
+          (1 - 2 * (x * x + z * z)) * s[1],
+          2 * (y * z + x * w) * s[1],
+          0,
+          2 * (x * z + y * w) * s[2],
+          2 * (y * z - x * w) * s[2],
+          (1 - 2 * (x * x + y * y)) * s[2],
+          0,
+          t[0],
+          t[1],
+          t[2],
+          1};
+}
+
+auto component_size(int componentType) -> size_t {
+  switch (componentType) {
+  case component_byte:
+  case component_unsigned_byte:
+    return 1;
+  case component_short:
+  case component_unsigned_short:
+    return 2;
+  case component_unsigned_int:
+  case component_float:
+    return 4;
+  default:
+    return 0;
+  }
+}
+
+auto type_components(std::string_view type) -> size_t {
+  if (type == "SCALAR") {
+    return 1;
+  }
+  if (type == "VEC2") {
+    return 2;
+  }
+  if (type == "VEC3") {
+    return 3;
+  }
+  if (type == "VEC4") {
+    return 4;
+  }
+  return 0;
+}
+
+// The elements of an accessor in the binary chunk
+struct AccessorView {
+  const char *data;
+  size_t count;
+  size_t stride;
+  size_t components;
+  int componentType;
+  bool normalized;
+};
+
+auto resolve_accessor(const nlohmann::json &gltf, size_t index,
+                      std::span<const char> bin, AccessorView &view,
+                      std::string &error) -> bool {
+  const auto &accessors = gltf["accessors"];
+  if (index >= accessors.size()) {
+    error = "accessor " + std::to_string(index) + " doesn't exist";
+    return false;
+  }
+  const auto &accessor = accessors[index];
+  if (accessor.contains("sparse") || !accessor.contains("bufferView")) {
+    error = "sparse accessors aren't supported";
+    return false;
+  }
+
+  view.count = accessor.value("count", size_t{0});
+  view.componentType = accessor.value("componentType", 0);
+  view.components = type_components(accessor.value("type", std::string{}));
+  view.normalized = accessor.value("normalized", false);
+  size_t elementSize = component_size(view.componentType) * view.components;
+  if (elementSize == 0) {
+    error = "accessor " + std::to_string(index) + " has an unknown type";
+    return false;
+  }
+
+  size_t viewIndex = accessor["bufferView"];
+  const auto &views = gltf["bufferViews"];
+  if (viewIndex >= views.size()) {
+    error = "buffer view " + std::to_string(viewIndex) + " doesn't exist";
+    return false;
+  }
+  const auto &bufferView = views[viewIndex];
+  const auto &buffers = gltf["buffers"];
+  if (bufferView.value("buffer", size_t{0}) != 0 || buffers.empty() ||
+      buffers[0].contains("uri")) {
+    error = "external buffers aren't supported";
+    return false;
+  }
+
+  size_t viewOffset = bufferView.value("byteOffset", size_t{0});
+  size_t viewLength = bufferView.value("byteLength", size_t{0});
+  size_t offset = accessor.value("byteOffset", size_t{0});
+  view.stride = bufferView.value("byteStride", elementSize);
+  // The count and stride are checked against the view first, so their
+  // product can't overflow
+  if (viewOffset > bin.size() || viewLength > bin.size() - viewOffset ||
+      view.stride < elementSize || view.stride > max_byte_stride ||
+      view.count > viewLength ||
+      (view.count != 0 &&
+       (offset > viewLength ||
+        (view.count - 1) * view.stride + elementSize > viewLength - offset))) {
+    error = "accessor " + std::to_string(index) +
+            " reaches past the binary chunk";
+    return false;
+  }
+
+  view.data = bin.data() + viewOffset + offset;
+  return true;
+}
+
+template <typename T> auto normalize(T value) -> float {
+  if constexpr (std::is_signed_v<T>) {
+    return std::max(static_cast<float>(value) /
+                        static_cast<float>(std::numeric_limits<T>::max()),
+                    -1.0F);
+  } else {
+    return static_cast<float>(value) /
+           static_cast<float>(std::numeric_limits<T>::max());
+  }
+}
+
+// Copies count elements of components floats out of the accessor, converting
+// the components. Components the accessor lacks are left alone.
+template <typename T>
+void copy_elements(const AccessorView &view, size_t components, float *out) {
+  size_t copied = std::min(components, view.components);
+  if constexpr (std::is_same_v<T, float>) {
+    if (view.stride == components * sizeof(float) && copied == components) {
+      memcpy(out, view.data, view.count * view.stride);
+      return;
+    }
+  }
+
+  for (size_t i = 0; i != view.count; ++i) {
+    const char *element = view.data + i * view.stride;
+    for (size_t c = 0; c != copied; ++c) {
+      T value;
+      memcpy(&value, element + c * sizeof(T), sizeof(T));
+      if constexpr (std::is_same_v<T, float>) {
+        out[i * components + c] = value;
+      } else {
+        out[i * components + c] =
+            view.normalized ? normalize(value) : static_cast<float>(value);
+      }
+    }
+  }
+}
+
+auto copy_floats(const AccessorView &view, size_t components, float *out)
+    -> bool {
+  switch (view.componentType) {
+  case component_float:
+    copy_elements<float>(view, components, out);
+    return true;
+  case component_byte:
+    copy_elements<int8_t>(view, components, out);
+    return true;
+  case component_unsigned_byte:
+    copy_elements<uint8_t>(view, components, out);
+    return true;
+  case component_short:
+    copy_elements<int16_t>(view, components, out);
+    return true;
+  case component_unsigned_short:
+    copy_elements<uint16_t>(view, components, out);
+    return true;
+  default:
+    return false;
+  }
+}
+
+template <typename T>
+void copy_indices(const AccessorView &view, uint32_t base, uint32_t *out) {
+  for (size_t i = 0; i != view.count; ++i) {
+    T value;
+    memcpy(&value, view.data + i * view.stride, sizeof(T));
+    out[i] = base + static_cast<uint32_t>(value);
+  }
+}
+
+class SceneBuilder {
+public:
+  SceneBuilder(const nlohmann::json &gltf, std::span<const char> bin,
+               GltfScene &scene)
+      : gltf_{gltf}, bin_{bin}, scene_{scene} {}
+
+  auto add_node(size_t index, const Matrix &parent, size_t depth,
+                std::string &error) -> bool {
+    const auto &nodes = gltf_["nodes"];
+    // Deeper than the node count means the hierarchy has a cycle
+    if (index >= nodes.size() || depth > nodes.size()) {
+      error = "invalid node hierarchy at node " + std::to_string(index);
+      return false;
+    }
+    const auto &node = nodes[index];
+    Matrix world = multiply(parent, local_transform(node));
+
+    if (node.contains("mesh") &&
+        !add_mesh(node["mesh"].get<size_t>(), world, error)) {
+      return false;
+    }
+    for (auto &&child : node.value("children", std::vector<size_t>{})) {
+      if (!add_node(child, world, depth + 1, error)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  auto add_mesh(size_t index, const Matrix &world, std::string &error)
+      -> bool {
+    const auto &meshes = gltf_["meshes"];
+    if (index >= meshes.size()) {
+      error = "mesh " + std::to_string(index) + " doesn't exist";
+      return false;
+    }
+    for (auto &&primitive :
+         meshes[index].value("primitives", nlohmann::json::array())) {
+      if (!add_primitive(primitive, world, error)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+private:
+  auto add_primitive(const nlohmann::json &primitive, const Matrix &world,
+                     std::string &error) -> bool {
+    if (primitive.value("mode", mode_triangles) != mode_triangles) {
+      ++scene_.skippedPrimitives;
+      return true;
+    }
+    if (primitive.contains("extensions")) {
+      error = "compressed primitives aren't supported";
+      return false;
+    }
+
+    auto attributes =
+        primitive.value("attributes", nlohmann::json::object());
+    if (!attributes.contains("POSITION")) {
+      ++scene_.skippedPrimitives;
+      return true;
+    }
+
+    AccessorView positions{};
+    if (!resolve_accessor(gltf_, attributes["POSITION"], bin_, positions,
+                          error)) {
+      return false;
+    }
+    size_t base = scene_.positions.size() / 3;
+    size_t count = positions.count;
+    if (base + count > std::numeric_limits<uint32_t>::max()) {
+      error = "too many vertices for 32 bit indices";
+      return false;
+    }
+
+    scene_.positions.resize((base + count) * 3, 0.0F);
+    scene_.normals.resize((base + count) * 3, 0.0F);
+    scene_.texcoords.resize((base + count) * 2, 0.0F);
+    if (!copy_floats(positions, 3, &scene_.positions[base * 3])) {
+      error = "positions have an unsupported component type";
+      return false;
+    }
+
+    for (auto &&[name, components, target] :
+         {std::tuple{"NORMAL", size_t{3}, &scene_.normals},
+          std::tuple{"TEXCOORD_0", size_t{2}, &scene_.texcoords}}) {
+      if (!attributes.contains(name)) {
+        continue;
+      }
+      AccessorView view{};
+      if (!resolve_accessor(gltf_, attributes[name], bin_, view, error)) {
+        return false;
+      }
+      if (view.count != count ||
+          !copy_floats(view, components, &(*target)[base * components])) {
+        error = std::string{name} + " doesn't match the positions";
+        return false;
+      }
+    }
+
+    float determinant = transform_vertices(world, base, count);
+
+    uint32_t firstIndex = static_cast<uint32_t>(scene_.indices.size());
+    if (primitive.contains("indices")) {
+      AccessorView indices{};
+      if (!resolve_accessor(gltf_, primitive["indices"], bin_, indices,
+                            error)) {
+        return false;
+      }
+      size_t first = scene_.indices.size();
+      scene_.indices.resize(first + indices.count);
+      auto vertexBase = static_cast<uint32_t>(base);
+      uint32_t *out = &scene_.indices[first];
+      switch (indices.componentType) {
+      case component_unsigned_byte:
+        copy_indices<uint8_t>(indices, vertexBase, out);
+        break;
+      case component_unsigned_short:
+        copy_indices<uint16_t>(indices, vertexBase, out);
+        break;
+      case component_unsigned_int:
+        copy_indices<uint32_t>(indices, vertexBase, out);
+        break;
+      default:
+        error = "indices have an unsupported component type";
+        return false;
+      }
+      for (size_t i = first; i != scene_.indices.size(); ++i) {
+        if (scene_.indices[i] - vertexBase >= count) {
+          error = "an index is past the primitive's vertices";
+          return false;
+        }
+      }
+    } else {
+      for (size_t i = 0; i != count; ++i) {
+        scene_.indices.push_back(static_cast<uint32_t>(base + i));
+      }
+    }
+
+    // Incomplete triangles are dropped, mirrored instances get their winding
+    // flipped back
+    scene_.indices.resize(firstIndex +
+                          (scene_.indices.size() - firstIndex) / 3 * 3);
+    if (determinant < 0.0F) {
+      for (size_t i = firstIndex; i != scene_.indices.size(); i += 3) {
+        std::swap(scene_.indices[i + 1], scene_.indices[i + 2]);
+      }
+    }
+
+    scene_.primitives.push_back(
+        {firstIndex,
+         static_cast<uint32_t>(scene_.indices.size() - firstIndex),
+         primitive.value("material", gltf_no_material)});
+    return true;
+  }
+
+  // Moves count vertices from base into world space and returns the
+  // determinant of the transform
+  auto transform_vertices(const Matrix &m, size_t base, size_t count)
+      -> float {
+    // Normals go through the cofactor matrix, the inverse transpose scaled
+    // by the determinant, so mirroring transforms need the sign put back
+    std::array<float, 9> normal = {
+        m[5] * m[10] - m[6] * m[9], m[6] * m[8] - m[4] * m[10],
+        m[4] * m[9] - m[5] * m[8],  m[9] * m[2] - m[10] * m[1],
+        m[10] * m[0] - m[8] * m[2], m[8] * m[1] - m[9] * m[0],
+        m[1] * m[6] - m[2] * m[5],  m[2] * m[4] - m[0] * m[6],
+        m[0] * m[5] - m[1] * m[4]};
+    float determinant = m[0] * normal[0] + m[4] * normal[3] + m[8] * normal[6];
+    if (m == identity) {
+      return determinant;
+    }
+
+    for (size_t i = base; i != base + count; ++i) {
+      float *p = &scene_.positions[i * 3];
+      float x = p[0];
+      float y = p[1];
+      float z = p[2];
+      for (size_t row = 0; row != 3; ++row) {
+        p[row] = m[row] * x + m[4 + row] * y + m[8 + row] * z + m[12 + row];
+      }
+
+      float *n = &scene_.normals[i * 3];
+      x = n[0];
+      y = n[1];
+      z = n[2];
+      std::array<float, 3> result{};
+      for (size_t row = 0; row != 3; ++row) {
+        result[row] = normal[row * 3] * x + normal[row * 3 + 1] * y +
+                      normal[row * 3 + 2] * z;
+      }
+      float length = std::sqrt(result[0] * result[0] + result[1] * result[1] +
+                               result[2] * result[2]);
+      if (length > 0.0F) {
+        if (determinant < 0.0F) {
+          length = -length;
+        }
+        for (size_t row = 0; row != 3; ++row) {
+          n[row] = result[row] / length;
+        }
+      }
+    }
+    return determinant;
+  }
+
+  const nlohmann::json &gltf_;
+  std::span<const char> bin_;
+  GltfScene &scene_;
+};
+
+auto read_u32(const char *data) -> uint32_t {
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+auto load_images(const nlohmann::json &gltf, std::span<const char> bin,
+                 GltfScene &scene, std::string &error) -> bool {
+  const auto &images = gltf["images"];
+
+  // Normal maps are compressed to two channels, so find them through the
+  // materials
+  std::vector<bool> normalMaps(images.size(), false);
+  const auto &textures = gltf["textures"];
+  for (auto &&material : gltf["materials"]) {
+    if (!material.contains("normalTexture")) {
+      continue;
+    }
+    size_t texture = material["normalTexture"].value("index", size_t{0});
+    if (texture < textures.size()) {
+      size_t source = textures[texture].value("source", images.size());
+      if (source < images.size()) {
+        normalMaps[source] = true;
+      }
+    }
+  }
+
+  const auto &views = gltf["bufferViews"];
+  for (size_t i = 0; i != images.size(); ++i) {
+    const auto &image = images[i];
+    // Images in separate files or data URIs are left to the texture path
+    if (!image.contains("bufferView")) {
+      continue;
+    }
+    size_t viewIndex = image["bufferView"];
+    if (viewIndex >= views.size()) {
+      error = "image " + std::to_string(i) + " has no buffer view";
+      return false;
+    }
+    size_t offset = views[viewIndex].value("byteOffset", size_t{0});
+    size_t length = views[viewIndex].value("byteLength", size_t{0});
+    if (offset > bin.size() || length > bin.size() - offset) {
+      error = "image " + std::to_string(i) + " reaches past the binary chunk";
+      return false;
+    }
+    scene.images.push_back({image.value("name", std::string{}),
+                            image.value("mimeType", std::string{}),
+                            bin.subspan(offset, length), normalMaps[i]});
+  }
+  return true;
+}
+
+} // namespace
+
+auto load_glb(std::span<const char> file, GltfScene &scene,
+              std::string &error) -> bool {
+  // Magic, version and length, then the chunks: length, type and data
+  constexpr size_t headerSize = 12;
+  constexpr size_t chunkHeaderSize = 8;
+  if (file.size() < headerSize + chunkHeaderSize ||
+      read_u32(file.data()) != glb_magic) {
+    error = "not a binary glTF file";
+    return false;
+  }
+  if (read_u32(file.data() + 4) != 2) {
+    error = "only glTF 2.0 is supported";
+    return false;
+  }
+
+  std::string_view json;
+  std::span<const char> bin;
+  size_t length = std::min<size_t>(read_u32(file.data() + 8), file.size());
+  for (size_t offset = headerSize; offset + chunkHeaderSize <= length;) {
+    size_t chunkLength = read_u32(file.data() + offset);
+    uint32_t chunkType = read_u32(file.data() + offset + 4);
+    offset += chunkHeaderSize;
+    if (chunkLength > length - offset) {
+      error = "truncated chunk";
+      return false;
+    }
+    if (chunkType == chunk_json && json.empty()) {
+      json = {file.data() + offset, chunkLength};
+    } else if (chunkType == chunk_bin && bin.empty()) {
+      bin = file.subspan(offset, chunkLength);
+    }
+    // Chunks are padded to 4 bytes
+    offset += (chunkLength + 3) & ~size_t{3};
+  }
+
+  auto gltf = nlohmann::json::parse(json.begin(), json.end(), nullptr, false);
+  if (gltf.is_discarded() || !gltf.is_object()) {
+    error = "malformed JSON chunk";
+    return false;
+  }
+
+  // Missing arrays read as empty ones from here on
+  for (auto &&key : {"accessors", "bufferViews", "buffers", "images",
+                     "materials", "meshes", "nodes", "scenes", "textures"}) {
+    if (!gltf.contains(key)) {
+      gltf[key] = nlohmann::json::array();
+    }
+  }
+
+  try {
+    SceneBuilder builder{gltf, bin, scene};
+    const auto &scenes = gltf["scenes"];
+    if (scenes.empty()) {
+      // Without a scene every mesh is placed once, untransformed
+      for (size_t i = 0; i != gltf["meshes"].size(); ++i) {
+        if (!builder.add_mesh(i, identity, error)) {
+          return false;
+        }
+      }
+    } else {
+      size_t sceneIndex = gltf.value("scene", size_t{0});
+      if (sceneIndex >= scenes.size()) {
+        error = "scene " + std::to_string(sceneIndex) + " doesn't exist";
+        return false;
+      }
+      for (auto &&node :
+           scenes[sceneIndex].value("nodes", std::vector<size_t>{})) {
+        if (!builder.add_node(node, identity, 0, error)) {
+          return false;
+        }
+      }
+    }
+    return load_images(gltf, bin, scene, error);
+  } catch (const nlohmann::json::exception &e) {
+    error = std::string{"unexpected JSON: "} + e.what();
+    return false;
+  }
+}
+
+} // namespace baker
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace baker {
+
+// Material index of primitives without a material
+constexpr uint32_t gltf_no_material = ~0U;
+
+// Triangles of one glTF primitive, a range of GltfScene::indices
+struct GltfPrimitive {
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  uint32_t material;
+};
+
+// An image stored in the binary chunk, still PNG or JPEG encoded
+struct GltfImage {
+  std::string name;
+  std::string mimeType;
+  std::span<const char> data;
+  // Used as a normal map by a material
+  bool isNormalMap;
+};
+
+// Triangles of every mesh instance of a glb's default scene, with the node
+// transforms applied, in one vertex list. Attributes a primitive lacks are
+// zero.
+struct GltfScene {
+  std::vector<float> positions; // xyz
+  std::vector<float> normals;   // xyz
+  std::vector<float> texcoords; // uv, from the top left like glTF
+  std::vector<uint32_t> indices;
+  std::vector<GltfPrimitive> primitives;
+  // Images with their data in the binary chunk, pointing into the file
+  std::vector<GltfImage> images;
+  // Primitives that aren't triangle lists, left out
+  size_t skippedPrimitives = 0;
+};
+
+// Reads a binary glTF 2.0 file. Accessors are copied straight out of the
+// binary chunk with typed strided copies. External buffers, sparse
+// accessors and Draco compression aren't supported. Returns false with a
+// message on malformed input.
+auto load_glb(std::span<const char> file, GltfScene &scene,
+              std::string &error) -> bool;
+
+} // namespace baker
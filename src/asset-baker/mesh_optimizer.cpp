@@ -0,0 +1,359 @@
+#include "mesh_optimizer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <numeric>
+
+namespace baker {
+
+namespace {
+
+// Triangles using each vertex, in CSR layout: the triangles of vertex v are
+// triangles[offsets[v]] up to triangles[offsets[v + 1]]
+struct TriangleAdjacency {
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> triangles;
+};
+
+auto build_adjacency(std::span<const uint32_t> indices, size_t vertexCount)
+    -> TriangleAdjacency {
+  TriangleAdjacency adjacency;
+  adjacency.offsets.assign(vertexCount + 1, 0);
+  adjacency.triangles.resize(indices.size());
+
+  for (auto &&index : indices) {
+    ++adjacency.offsets[index + 1];
+  }
+  std::partial_sum(adjacency.offsets.begin(), adjacency.offsets.end(),
+                   adjacency.offsets.begin());
+
+  std::vector<uint32_t> fill(adjacency.offsets.begin(),
+                             adjacency.offsets.end() - 1);
+  for (size_t i = 0; i != indices.size(); ++i) {
+    adjacency.triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+  }
+
+  return adjacency;
+}
+
+// FIFO cache simulation: a vertex is cached while fewer than cacheSize misses
+// happened since it was last transformed
+class CacheSimulator {
+public:
+  CacheSimulator(size_t vertexCount, unsigned cacheSize)
+      : cacheSize_{cacheSize}, timestamps_(vertexCount, 0) {}
+
+  // Returns the number of vertices of the triangle that had to be transformed
+  auto add_triangle(const uint32_t *triangle) -> unsigned {
+    unsigned misses = 0;
+    for (int i = 0; i != 3; ++i) {
+      uint32_t vertex = triangle[i];
+      if (time_ - timestamps_[vertex] >= cacheSize_) {
+        timestamps_[vertex] = time_++;
+        ++misses;
+      }
+    }
+    return misses;
+  }
+
+  // Evicts everything, cheaper than building a new simulator
+  void flush() { time_ += cacheSize_; }
+
+private:
+  unsigned cacheSize_;
+  // Start at cacheSize_ so every vertex is a miss the first time
+  unsigned time_{cacheSize_};
+  std::vector<unsigned> timestamps_;
+};
+
+} // namespace
+
+auto analyze_vertex_cache(std::span<const uint32_t> indices,
+                          size_t vertexCount, unsigned cacheSize)
+    -> VertexCacheStats {
+  VertexCacheStats stats;
+  if (indices.empty()) {
+    return stats;
+  }
+
+  CacheSimulator cache(vertexCount, cacheSize);
+  size_t misses = 0;
+  for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+    misses += cache.add_triangle(&indices[i]);
+  }
+
+  std::vector<bool> used(vertexCount, false);
+  size_t usedCount = 0;
+  for (auto &&index : indices) {
+    if (!used[index]) {
+      used[index] = true;
+      ++usedCount;
+    }
+  }
+
+  stats.acmr =
+      static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+  stats.atvr = static_cast<float>(misses) / static_cast<float>(usedCount);
+  return stats;
+}
+
+void optimize_vertex_cache(std::span<uint32_t> indices, size_t vertexCount,
+                           unsigned cacheSize) {
+  size_t triangleCount = indices.size() / 3;
+  if (triangleCount == 0) {
+    return;
+  }
+
+  auto adjacency = build_adjacency(indices, vertexCount);
+
+  // Triangles not yet emitted that use each vertex
+  std::vector<uint32_t> liveTriangles(vertexCount);
+  for (size_t v = 0; v != vertexCount; ++v) {
+    liveTriangles[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+  }
+
+  std::vector<unsigned> cacheTime(vertexCount, 0);
+  std::vector<bool> emitted(triangleCount, false);
+  // Recently touched vertices, the cheap way out of a dead end
+  std::vector<uint32_t> deadEndStack;
+  std::vector<uint32_t> candidates;
+
+  std::vector<uint32_t> result;
+  result.reserve(indices.size());
+
+  unsigned time = cacheSize + 1;
+  size_t scanCursor = 0;
+
+  auto skip_dead_end = [&]() -> int64_t {
+    while (!deadEndStack.empty()) {
+      uint32_t vertex = deadEndStack.back();
+      deadEndStack.pop_back();
+      if (liveTriangles[vertex] > 0) {
+        return vertex;
+      }
+    }
+    while (scanCursor < vertexCount) {
+      if (liveTriangles[scanCursor] > 0) {
+        return static_cast<int64_t>(scanCursor);
+      }
+      ++scanCursor;
+    }
+    return -1;
+  };
+
+  int64_t fanning = skip_dead_end();
+  while (fanning >= 0) {
+    candidates.clear();
+
+    // Emit every remaining triangle around the fanning vertex
+    auto begin = adjacency.offsets[fanning];
+    auto end = adjacency.offsets[fanning + 1];
+    for (auto t = begin; t != end; ++t) {
+      uint32_t triangle = adjacency.triangles[t];
+      if (emitted[triangle]) {
+        continue;
+      }
+      emitted[triangle] = true;
+
+      for (int i = 0; i != 3; ++i) {
+        uint32_t vertex = indices[triangle * 3 + i];
+        result.push_back(vertex);
+        deadEndStack.push_back(vertex);
+        candidates.push_back(vertex);
+        --liveTriangles[vertex];
+
+        if (time - cacheTime[vertex] > cacheSize) {
+          cacheTime[vertex] = time++;
+        }
+      }
+    }
+
+    // Next fanning vertex: the one that is still in the cache after its
+    // remaining triangles are emitted and was transformed the longest ago
+    int64_t best = -1;
+    int64_t bestPriority = -1;
+    for (auto &&vertex : candidates) {
+      if (liveTriangles[vertex] == 0) {
+        continue;
+      }
+      int64_t priority = 0;
+      if (time - cacheTime[vertex] + 2 * liveTriangles[vertex] <= cacheSize) {
+        priority = time - cacheTime[vertex];
+      }
+      if (priority > bestPriority) {
+        bestPriority = priority;
+        best = vertex;
+      }
+    }
+
+    fanning = best >= 0 ? best : skip_dead_end();
+  }
+
+  std::copy(result.begin(), result.end(), indices.begin());
+}
+
+void optimize_overdraw(std::span<uint32_t> indices, const float *positions,
+                       size_t positionStride, size_t vertexCount,
+                       float threshold) {
+  size_t triangleCount = indices.size() / 3;
+  if (triangleCount == 0) {
+    return;
+  }
+
+  auto position = [&](uint32_t vertex) {
+    const auto *base = reinterpret_cast<const char *>(positions) +
+                       static_cast<size_t>(vertex) * positionStride;
+    const auto *p = reinterpret_cast<const float *>(base);
+    return std::array<float, 3>{p[0], p[1], p[2]};
+  };
+
+  // Hard boundaries: triangles where the cache starts over, i.e. all three
+  // vertices are misses. Reordering whole runs between them costs nothing.
+  std::vector<uint32_t> clusterStarts;
+  {
+    CacheSimulator cache(vertexCount, vertex_cache_size);
+    for (size_t t = 0; t != triangleCount; ++t) {
+      if (cache.add_triangle(&indices[t * 3]) == 3) {
+        clusterStarts.push_back(static_cast<uint32_t>(t));
+      }
+    }
+  }
+  if (clusterStarts.empty() || clusterStarts.front() != 0) {
+    clusterStarts.insert(clusterStarts.begin(), 0);
+  }
+
+  // Soft boundaries: split the hard clusters further wherever the running
+  // ACMR is within the threshold of the whole cluster's ACMR
+  std::vector<uint32_t> softStarts;
+  std::vector<unsigned> misses;
+  CacheSimulator cache(vertexCount, vertex_cache_size);
+  for (size_t c = 0; c != clusterStarts.size(); ++c) {
+    uint32_t start = clusterStarts[c];
+    uint32_t end = c + 1 == clusterStarts.size()
+                       ? static_cast<uint32_t>(triangleCount)
+                       : clusterStarts[c + 1];
+
+    misses.clear();
+    cache.flush();
+    unsigned total = 0;
+    for (uint32_t t = start; t != end; ++t) {
+      total += cache.add_triangle(&indices[t * 3]);
+      misses.push_back(total);
+    }
+    float clusterThreshold =
+        threshold * static_cast<float>(total) / static_cast<float>(end - start);
+
+    softStarts.push_back(start);
+    uint32_t softStart = start;
+    unsigned startMisses = 0;
+    for (uint32_t t = start; t != end; ++t) {
+      uint32_t length = t - softStart + 1;
+      unsigned runMisses = misses[t - start] - startMisses;
+      // A dozen triangles at least, sorting single triangles would wreck the
+      // cache order for very little overdraw gain
+      if (t + 1 != end && length >= 12 &&
+          static_cast<float>(runMisses) / static_cast<float>(length) <=
+              clusterThreshold) {
+        softStart = t + 1;
+        startMisses = misses[t - start];
+        softStarts.push_back(softStart);
+      }
+    }
+  }
+
+  // Mesh centroid for the sort key
+  std::array<double, 3> meshCenter{0, 0, 0};
+  for (auto &&index : indices) {
+    auto p = position(index);
+    for (int i = 0; i != 3; ++i) {
+      meshCenter[i] += p[i];
+    }
+  }
+  for (auto &&value : meshCenter) {
+    value /= static_cast<double>(indices.size());
+  }
+
+  struct Cluster {
+    uint32_t start;
+    uint32_t end;
+    float sortKey;
+  };
+
+  std::vector<Cluster> clusters;
+  clusters.reserve(softStarts.size());
+  for (size_t c = 0; c != softStarts.size(); ++c) {
+    Cluster cluster{};
+    cluster.start = softStarts[c];
+    cluster.end = c + 1 == softStarts.size()
+                      ? static_cast<uint32_t>(triangleCount)
+                      : softStarts[c + 1];
+
+    // Area weighted centroid and normal of the cluster
+    std::array<double, 3> center{0, 0, 0};
+    std::array<double, 3> normal{0, 0, 0};
+    double area = 0.0;
+    for (uint32_t t = cluster.start; t != cluster.end; ++t) {
+      auto a = position(indices[t * 3 + 0]);
+      auto b = position(indices[t * 3 + 1]);
+      auto d = position(indices[t * 3 + 2]);
+
+      std::array<double, 3> ab{b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+      std::array<double, 3> ad{d[0] - a[0], d[1] - a[1], d[2] - a[2]};
+      std::array<double, 3> n{ab[1] * ad[2] - ab[2] * ad[1],
+                              ab[2] * ad[0] - ab[0] * ad[2],
+                              ab[0] * ad[1] - ab[1] * ad[0]};
+      double triangleArea = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+      for (int i = 0; i != 3; ++i) {
+        center[i] += (a[i] + b[i] + d[i]) / 3.0 * triangleArea;
+        normal[i] += n[i];
+      }
+      area += triangleArea;
+    }
+
+    double normalLength = std::sqrt(normal[0] * normal[0] +
+                                    normal[1] * normal[1] +
+                                    normal[2] * normal[2]);
+    if (area > 0.0 && normalLength > 0.0) {
+      double key = 0.0;
+      for (int i = 0; i != 3; ++i) {
+        key += (center[i] / area - meshCenter[i]) * normal[i] / normalLength;
+      }
+      cluster.sortKey = static_cast<float>(key);
+    }
+
+    clusters.push_back(cluster);
+  }
+
+  // Clusters facing away from the center are the likely occluders
+  std::stable_sort(clusters.begin(), clusters.end(),
+                   [](const Cluster &a, const Cluster &b) {
+                     return a.sortKey > b.sortKey;
+                   });
+
+  std::vector<uint32_t> result;
+  result.reserve(indices.size());
+  for (auto &&cluster : clusters) {
+    result.insert(result.end(), indices.begin() + cluster.start * 3,
+                  indices.begin() + cluster.end * 3);
+  }
+
+  std::copy(result.begin(), result.end(), indices.begin());
+}
+
+auto build_vertex_fetch_remap(std::span<const uint32_t> indices,
+                              size_t vertexCount) -> std::vector<uint32_t> {
+  std::vector<uint32_t> remap(vertexCount, ~0U);
+
+  uint32_t next = 0;
+  for (auto &&index : indices) {
+    if (remap[index] == ~0U) {
+      remap[index] = next++;
+    }
+  }
+
+  return remap;
+}
+
+} // namespace baker
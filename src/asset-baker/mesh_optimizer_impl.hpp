@@ -0,0 +1,102 @@
+#pragma once
+
+#include "../assetlib/asset_hash.hpp"
+#include "mesh_optimizer.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <type_traits>
+
+template <typename V>
+baker::VertexWelder<V>::VertexWelder(size_t expectedVertices) {
+  static_assert(std::is_trivially_copyable_v<V>,
+                "Vertices are hashed and compared as raw bytes");
+
+  vertices_.reserve(expectedVertices);
+  rehash(std::bit_ceil(std::max<size_t>(expectedVertices * 2, 64)));
+}
+
+template <typename V>
+auto baker::VertexWelder<V>::add(const V &vertex) -> uint32_t {
+  // Keep the load factor under 1/2 so probe sequences stay short
+  if ((vertices_.size() + 1) * 2 > table_.size()) {
+    rehash(table_.size() * 2);
+  }
+
+  size_t mask = table_.size() - 1;
+  size_t slot = assets::hash_bytes(&vertex, sizeof(V)) & mask;
+
+  while (table_[slot] != ~0U) {
+    if (memcmp(&vertices_[table_[slot]], &vertex, sizeof(V)) == 0) {
+      return table_[slot];
+    }
+    slot = (slot + 1) & mask;
+  }
+
+  auto index = static_cast<uint32_t>(vertices_.size());
+  table_[slot] = index;
+  vertices_.push_back(vertex);
+  return index;
+}
+
+template <typename V>
+auto baker::VertexWelder<V>::vertices() const -> const std::vector<V> & {
+  return vertices_;
+}
+
+template <typename V>
+auto baker::VertexWelder<V>::take_vertices() -> std::vector<V> {
+  table_.clear();
+  return std::move(vertices_);
+}
+
+template <typename V> void baker::VertexWelder<V>::rehash(size_t capacity) {
+  table_.assign(capacity, ~0U);
+
+  size_t mask = capacity - 1;
+  for (size_t i = 0; i != vertices_.size(); ++i) {
+    size_t slot = assets::hash_bytes(&vertices_[i], sizeof(V)) & mask;
+    while (table_[slot] != ~0U) {
+      slot = (slot + 1) & mask;
+    }
+    table_[slot] = static_cast<uint32_t>(i);
+  }
+}
+
+template <typename V>
+void baker::optimize_vertex_fetch(std::vector<V> &vertices,
+                                  std::span<uint32_t> indices) {
+  auto remap = build_vertex_fetch_remap(indices, vertices.size());
+
+  size_t usedCount = 0;
+  for (auto &&target : remap) {
+    if (target != ~0U) {
+      ++usedCount;
+    }
+  }
+
+  std::vector<V> reordered(usedCount);
+  for (size_t i = 0; i != vertices.size(); ++i) {
+    if (remap[i] != ~0U) {
+      reordered[remap[i]] = vertices[i];
+    }
+  }
+  for (auto &&index : indices) {
+    index = remap[index];
+  }
+
+  vertices = std::move(reordered);
+}
+
+template <typename V>
+void baker::optimize_mesh(std::vector<V> &vertices,
+                          std::span<uint32_t> indices) {
+  if (indices.empty()) {
+    return;
+  }
+
+  optimize_vertex_cache(indices, vertices.size());
+  optimize_overdraw(indices, vertices.data()->position, sizeof(V),
+                    vertices.size());
+  optimize_vertex_fetch(vertices, indices);
+}
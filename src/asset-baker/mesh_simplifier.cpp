@@ -0,0 +1,382 @@
+#include "mesh_simplifier.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace baker {
+
+namespace {
+
+using Vec3 = std::array<double, 3>;
+
+auto sub(const Vec3 &a, const Vec3 &b) -> Vec3 {
+  return {a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+}
+
+auto dot(const Vec3 &a, const Vec3 &b) -> double {
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+auto cross(const Vec3 &a, const Vec3 &b) -> Vec3 {
+  return {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2],
+          a[0] * b[1] - a[1] * b[0]};
+}
+
+// Sum of squared distances to a set of planes, as the upper triangle of a
+// symmetric 4x4 matrix. Planes are weighted by triangle area so the error
+// doesn't depend on tessellation.
+struct Quadric {
+  double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+  double a11 = 0, a12 = 0, a13 = 0;
+  double a22 = 0, a23 = 0;
+  double a33 = 0;
+  double weight = 0;
+
+  void add_plane(const Vec3 &n, double d, double w) {
+    a00 += w * n[0] * n[0];
+    a01 += w * n[0] * n[1];
+    a02 += w * n[0] * n[2];
+    a03 += w * n[0] * d;
+    a11 += w * n[1] * n[1];
+    a12 += w * n[1] * n[2];
+    a13 += w * n[1] * d;
+    a22 += w * n[2] * n[2];
+    a23 += w * n[2] * d;
+    a33 += w * d * d;
+    weight += w;
+  }
+
+  void add(const Quadric &other) {
+    a00 += other.a00;
+    a01 += other.a01;
+    a02 += other.a02;
+    a03 += other.a03;
+    a11 += other.a11;
+    a12 += other.a12;
+    a13 += other.a13;
+    a22 += other.a22;
+    a23 += other.a23;
+    a33 += other.a33;
+    weight += other.weight;
+  }
+
+  [[nodiscard]] auto evaluate(const Vec3 &p) const -> double {
+    double x = p[0];
+    double y = p[1];
+    double z = p[2];
+    return x * x * a00 + 2 * x * y * a01 + 2 * x * z * a02 + 2 * x * a03 +
+           y * y * a11 + 2 * y * z * a12 + 2 * y * a13 + z * z * a22 +
+           2 * z * a23 + a33;
+  }
+};
+
+// Error of the combined quadrics at p as a distance
+auto collapse_error(const Quadric &a, const Quadric &b, const Vec3 &p)
+    -> double {
+  double weight = a.weight + b.weight;
+  if (weight <= 0.0) {
+    return 0.0;
+  }
+  double cost = a.evaluate(p) + b.evaluate(p);
+  return std::sqrt(std::max(cost, 0.0) / weight);
+}
+
+struct Collapse {
+  double error;
+  uint32_t from;
+  uint32_t to;
+};
+
+} // namespace
+
+auto simplify(std::span<const uint32_t> indices, const float *positions,
+              size_t positionStride, size_t vertexCount,
+              std::span<const float> attributes, size_t attributeCount,
+              size_t targetIndexCount, float targetError) -> SimplifyResult {
+  SimplifyResult result;
+  result.indices.assign(indices.begin(), indices.end());
+
+  if (indices.size() <= targetIndexCount || vertexCount == 0) {
+    return result;
+  }
+
+  std::vector<Vec3> points(vertexCount);
+  for (size_t v = 0; v != vertexCount; ++v) {
+    const auto *p = reinterpret_cast<const float *>(
+        reinterpret_cast<const char *>(positions) + v * positionStride);
+    points[v] = {p[0], p[1], p[2]};
+  }
+
+  // Vertices with the same position form a group, named after its first
+  // vertex. Collapses happen between groups.
+  std::vector<uint32_t> group(vertexCount);
+  std::vector<uint32_t> groupOffsets(vertexCount + 1, 0);
+  std::vector<uint32_t> groupVertices(vertexCount);
+  {
+    std::vector<uint32_t> order(vertexCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+      return points[a] < points[b];
+    });
+    for (size_t i = 0; i != order.size(); ++i) {
+      bool same = i != 0 && points[order[i]] == points[order[i - 1]];
+      group[order[i]] = same ? group[order[i - 1]] : order[i];
+    }
+
+    for (size_t v = 0; v != vertexCount; ++v) {
+      ++groupOffsets[group[v] + 1];
+    }
+    std::partial_sum(groupOffsets.begin(), groupOffsets.end(),
+                     groupOffsets.begin());
+    std::vector<uint32_t> fill(groupOffsets.begin(), groupOffsets.end() - 1);
+    for (size_t v = 0; v != vertexCount; ++v) {
+      groupVertices[fill[group[v]]++] = static_cast<uint32_t>(v);
+    }
+  }
+
+  auto &current = result.indices;
+
+  // Plane quadrics of the original triangles
+  std::vector<Quadric> quadrics(vertexCount);
+  for (size_t i = 0; i + 2 < current.size(); i += 3) {
+    const Vec3 &a = points[current[i + 0]];
+    const Vec3 &b = points[current[i + 1]];
+    const Vec3 &c = points[current[i + 2]];
+
+    Vec3 n = cross(sub(b, a), sub(c, a));
+    double length = std::sqrt(dot(n, n));
+    if (length == 0.0) {
+      continue;
+    }
+    for (auto &&value : n) {
+      value /= length;
+    }
+    double d = -dot(n, a);
+    for (int k = 0; k != 3; ++k) {
+      quadrics[group[current[i + k]]].add_plane(n, d, length / 2);
+    }
+  }
+
+  // Edges used by one triangle (borders) or by more than two (non-manifold)
+  // lock their vertices, moving those would open holes
+  std::vector<bool> locked(vertexCount, false);
+  {
+    std::vector<std::pair<uint32_t, uint32_t>> edges;
+    edges.reserve(current.size());
+    for (size_t i = 0; i + 2 < current.size(); i += 3) {
+      for (int k = 0; k != 3; ++k) {
+        uint32_t a = group[current[i + k]];
+        uint32_t b = group[current[i + (k + 1) % 3]];
+        edges.emplace_back(std::min(a, b), std::max(a, b));
+      }
+    }
+    std::sort(edges.begin(), edges.end());
+
+    for (size_t i = 0; i != edges.size();) {
+      size_t j = i;
+      while (j != edges.size() && edges[j] == edges[i]) {
+        ++j;
+      }
+      if (j - i != 2) {
+        locked[edges[i].first] = true;
+        locked[edges[i].second] = true;
+      }
+      i = j;
+    }
+  }
+
+  auto attribute_distance = [&](uint32_t a, uint32_t b) {
+    float distance = 0.0F;
+    for (size_t k = 0; k != attributeCount; ++k) {
+      float delta = attributes[a * attributeCount + k] -
+                    attributes[b * attributeCount + k];
+      distance += delta * delta;
+    }
+    return distance;
+  };
+
+  size_t targetTriangles = targetIndexCount / 3;
+
+  std::vector<uint32_t> triangleOffsets;
+  std::vector<uint32_t> groupTriangles;
+  std::vector<std::pair<uint32_t, uint32_t>> edges;
+  std::vector<Collapse> collapses;
+  std::vector<bool> touched(vertexCount, false);
+  std::vector<uint32_t> collapseTarget(vertexCount, ~0U);
+  std::vector<uint32_t> vertexRemap(vertexCount, ~0U);
+
+  while (current.size() / 3 > targetTriangles) {
+    size_t triangleCount = current.size() / 3;
+
+    // Triangles around each group
+    triangleOffsets.assign(vertexCount + 1, 0);
+    for (auto &&index : current) {
+      ++triangleOffsets[group[index] + 1];
+    }
+    std::partial_sum(triangleOffsets.begin(), triangleOffsets.end(),
+                     triangleOffsets.begin());
+    groupTriangles.resize(current.size());
+    {
+      std::vector<uint32_t> fill(triangleOffsets.begin(),
+                                 triangleOffsets.end() - 1);
+      for (size_t i = 0; i != current.size(); ++i) {
+        groupTriangles[fill[group[current[i]]]++] =
+            static_cast<uint32_t>(i / 3);
+      }
+    }
+
+    // Cheapest direction of every edge
+    edges.clear();
+    for (size_t i = 0; i != current.size(); i += 3) {
+      for (int k = 0; k != 3; ++k) {
+        uint32_t a = group[current[i + k]];
+        uint32_t b = group[current[i + (k + 1) % 3]];
+        edges.emplace_back(std::min(a, b), std::max(a, b));
+      }
+    }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+    collapses.clear();
+    for (auto &&[a, b] : edges) {
+      double error = collapse_error(quadrics[a], quadrics[b], points[b]);
+      Collapse best{std::numeric_limits<double>::max(), a, b};
+      if (!locked[a]) {
+        best.error = error;
+      }
+      if (!locked[b]) {
+        double reverse = collapse_error(quadrics[a], quadrics[b], points[a]);
+        if (reverse < best.error) {
+          best = {reverse, b, a};
+        }
+      }
+      if (best.error <= targetError) {
+        collapses.push_back(best);
+      }
+    }
+    std::sort(collapses.begin(), collapses.end(),
+              [](const Collapse &a, const Collapse &b) {
+                return a.error < b.error;
+              });
+
+    // Apply the cheapest independent collapses. Collapses don't share any
+    // triangle, so the flip test of each one stays valid.
+    std::fill(touched.begin(), touched.end(), false);
+    size_t remainingTriangles = triangleCount;
+    size_t applied = 0;
+
+    for (auto &&collapse : collapses) {
+      if (remainingTriangles <= targetTriangles) {
+        break;
+      }
+      if (touched[collapse.from] || touched[collapse.to]) {
+        continue;
+      }
+
+      bool flips = false;
+      size_t removed = 0;
+      auto begin = triangleOffsets[collapse.from];
+      auto end = triangleOffsets[collapse.from + 1];
+      for (auto t = begin; t != end && !flips; ++t) {
+        const uint32_t *triangle = &current[groupTriangles[t] * 3];
+        std::array<uint32_t, 3> groups{group[triangle[0]], group[triangle[1]],
+                                       group[triangle[2]]};
+        if (std::find(groups.begin(), groups.end(), collapse.to) !=
+            groups.end()) {
+          ++removed;
+          continue;
+        }
+
+        std::array<Vec3, 3> before{points[groups[0]], points[groups[1]],
+                                   points[groups[2]]};
+        std::array<Vec3, 3> after = before;
+        for (int k = 0; k != 3; ++k) {
+          if (groups[k] == collapse.from) {
+            after[k] = points[collapse.to];
+          }
+        }
+        Vec3 oldNormal =
+            cross(sub(before[1], before[0]), sub(before[2], before[0]));
+        Vec3 newNormal =
+            cross(sub(after[1], after[0]), sub(after[2], after[0]));
+        // Rejects flipped triangles and ones that turn into slivers
+        double oldLength = std::sqrt(dot(oldNormal, oldNormal));
+        double newLength = std::sqrt(dot(newNormal, newNormal));
+        if (dot(oldNormal, newNormal) <= 0.25 * oldLength * newLength) {
+          flips = true;
+        }
+      }
+      if (flips) {
+        continue;
+      }
+
+      collapseTarget[collapse.from] = collapse.to;
+      quadrics[collapse.to].add(quadrics[collapse.from]);
+      result.error =
+          std::max(result.error, static_cast<float>(collapse.error));
+
+      // Lock the one-ring for the rest of the pass
+      for (auto t = begin; t != end; ++t) {
+        for (int k = 0; k != 3; ++k) {
+          touched[group[current[groupTriangles[t] * 3 + k]]] = true;
+        }
+      }
+      touched[collapse.to] = true;
+
+      remainingTriangles -= removed;
+      ++applied;
+    }
+
+    if (applied == 0) {
+      break;
+    }
+
+    // Move the corners of collapsed groups to the target vertex with the
+    // closest attributes
+    for (auto &&index : current) {
+      uint32_t target = collapseTarget[group[index]];
+      if (target == ~0U) {
+        continue;
+      }
+      if (vertexRemap[index] == ~0U) {
+        uint32_t best = groupVertices[groupOffsets[target]];
+        float bestDistance = std::numeric_limits<float>::max();
+        for (auto i = groupOffsets[target]; i != groupOffsets[target + 1];
+             ++i) {
+          float distance = attribute_distance(index, groupVertices[i]);
+          if (distance < bestDistance) {
+            bestDistance = distance;
+            best = groupVertices[i];
+          }
+        }
+        vertexRemap[index] = best;
+      }
+      index = vertexRemap[index];
+    }
+
+    // Drop the triangles that collapsed into lines
+    size_t write = 0;
+    for (size_t i = 0; i != current.size(); i += 3) {
+      uint32_t a = group[current[i + 0]];
+      uint32_t b = group[current[i + 1]];
+      uint32_t c = group[current[i + 2]];
+      if (a == b || b == c || a == c) {
+        continue;
+      }
+      current[write++] = current[i + 0];
+      current[write++] = current[i + 1];
+      current[write++] = current[i + 2];
+    }
+    current.resize(write);
+
+    std::fill(collapseTarget.begin(), collapseTarget.end(), ~0U);
+    std::fill(vertexRemap.begin(), vertexRemap.end(), ~0U);
+  }
+
+  return result;
+}
+
+} // namespace baker
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace baker {
+
+struct SimplifyResult {
+  std::vector<uint32_t> indices;
+  // Largest geometric error of the collapses, in mesh units
+  float error = 0.0F;
+};
+
+// Quadric error metric simplifier (Garland and Heckbert 1997). Collapses
+// edges onto one of their endpoints, so the result indexes into the same
+// vertex buffer. Connectivity is taken from positions only: corners on a
+// normal or uv seam are moved to the vertex of the collapse target with the
+// closest attributes. Mesh borders and non-manifold edges stay locked.
+//
+// attributes holds attributeCount floats per vertex (normal and uv) and is
+// only used to pick vertices across seams.
+// Stops at targetIndexCount or when the next collapse would exceed
+// targetError, whichever comes first.
+auto simplify(std::span<const uint32_t> indices, const float *positions,
+              size_t positionStride, size_t vertexCount,
+              std::span<const float> attributes, size_t attributeCount,
+              size_t targetIndexCount, float targetError) -> SimplifyResult;
+
+} // namespace baker
@@ -0,0 +1,277 @@
+#include "meshlet_builder.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace baker {
+
+namespace {
+
+using Vec3 = std::array<float, 3>;
+
+auto sub(const Vec3 &a, const Vec3 &b) -> Vec3 {
+  return {a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+}
+
+auto dot(const Vec3 &a, const Vec3 &b) -> float {
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+auto cross(const Vec3 &a, const Vec3 &b) -> Vec3 {
+  return {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2],
+          a[0] * b[1] - a[1] * b[0]};
+}
+
+auto length(const Vec3 &a) -> float { return std::sqrt(dot(a, a)); }
+
+// Fills in the bounding sphere and normal cone of a finished meshlet
+void compute_bounds(assets::Meshlet &meshlet,
+                    std::span<const uint32_t> meshletVertices,
+                    std::span<const uint8_t> localTriangles,
+                    const std::vector<Vec3> &points) {
+  // Sphere around the center of the bounding box
+  Vec3 min = points[meshletVertices[0]];
+  Vec3 max = min;
+  for (auto &&vertex : meshletVertices) {
+    for (int i = 0; i != 3; ++i) {
+      min[i] = std::min(min[i], points[vertex][i]);
+      max[i] = std::max(max[i], points[vertex][i]);
+    }
+  }
+  Vec3 center{(min[0] + max[0]) / 2, (min[1] + max[1]) / 2,
+              (min[2] + max[2]) / 2};
+  float radius = 0.0F;
+  for (auto &&vertex : meshletVertices) {
+    radius = std::max(radius, length(sub(points[vertex], center)));
+  }
+
+  // Cone around the average triangle normal
+  std::vector<Vec3> normals;
+  normals.reserve(localTriangles.size() / 3);
+  Vec3 axis{0, 0, 0};
+  for (size_t t = 0; t + 2 < localTriangles.size(); t += 3) {
+    const Vec3 &a = points[meshletVertices[localTriangles[t + 0]]];
+    const Vec3 &b = points[meshletVertices[localTriangles[t + 1]]];
+    const Vec3 &c = points[meshletVertices[localTriangles[t + 2]]];
+
+    Vec3 normal = cross(sub(b, a), sub(c, a));
+    float area = length(normal);
+    if (area == 0.0F) {
+      continue;
+    }
+    for (int i = 0; i != 3; ++i) {
+      normal[i] /= area;
+      axis[i] += normal[i];
+    }
+    normals.push_back(normal);
+  }
+
+  float axisLength = length(axis);
+  // Cutoff of 1 can never pass the culling test
+  float cutoff = 1.0F;
+  if (axisLength > 0.0F) {
+    for (auto &&value : axis) {
+      value /= axisLength;
+    }
+
+    float minDot = 1.0F;
+    for (auto &&normal : normals) {
+      minDot = std::min(minDot, dot(normal, axis));
+    }
+    // Normals spread over more than a hemisphere make the cone useless
+    if (minDot > 0.0F) {
+      cutoff = std::sqrt(1.0F - minDot * minDot);
+    }
+  }
+
+  for (int i = 0; i != 3; ++i) {
+    meshlet.center[i] = center[i];
+    meshlet.coneAxis[i] = axis[i];
+  }
+  meshlet.radius = radius;
+  meshlet.coneCutoff = cutoff;
+}
+
+} // namespace
+
+auto build_meshlets(std::span<uint32_t> indices, const float *positions,
+                    size_t positionStride, size_t vertexCount)
+    -> assets::MeshletData {
+  assets::MeshletData data;
+
+  size_t triangleCount = indices.size() / 3;
+  if (triangleCount == 0) {
+    return data;
+  }
+
+  std::vector<Vec3> points(vertexCount);
+  for (size_t v = 0; v != vertexCount; ++v) {
+    const auto *p = reinterpret_cast<const float *>(
+        reinterpret_cast<const char *>(positions) + v * positionStride);
+    points[v] = {p[0], p[1], p[2]};
+  }
+
+  // Vertices split along normal or uv seams still share a position, so
+  // connectivity is built on positions only. Flat shaded meshes would
+  // otherwise have no neighbours at all.
+  std::vector<uint32_t> positionId(vertexCount);
+  {
+    std::vector<uint32_t> order(vertexCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+      return points[a] < points[b];
+    });
+    for (size_t i = 0; i != order.size(); ++i) {
+      bool same = i != 0 && points[order[i]] == points[order[i - 1]];
+      positionId[order[i]] = same ? positionId[order[i - 1]] : order[i];
+    }
+  }
+
+  // Triangles using each position
+  std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+  for (auto &&index : indices) {
+    ++adjacencyOffsets[positionId[index] + 1];
+  }
+  std::partial_sum(adjacencyOffsets.begin(), adjacencyOffsets.end(),
+                   adjacencyOffsets.begin());
+  std::vector<uint32_t> adjacency(indices.size());
+  {
+    std::vector<uint32_t> fill(adjacencyOffsets.begin(),
+                               adjacencyOffsets.end() - 1);
+    for (size_t i = 0; i != indices.size(); ++i) {
+      adjacency[fill[positionId[indices[i]]]++] = static_cast<uint32_t>(i / 3);
+    }
+  }
+
+  std::vector<bool> emitted(triangleCount, false);
+  // Local index of each vertex in the current meshlet, 0xff when not in it
+  std::vector<uint8_t> localIndex(vertexCount, 0xff);
+
+  std::vector<uint32_t> result;
+  result.reserve(indices.size());
+
+  size_t scanCursor = 0;
+  assets::Meshlet current{};
+  Vec3 centroid{0, 0, 0};
+
+  auto finish_meshlet = [&]() {
+    if (current.triangleCount == 0) {
+      return;
+    }
+    compute_bounds(
+        current,
+        std::span{data.vertices}.subspan(current.vertexOffset,
+                                         current.vertexCount),
+        std::span{data.triangles}.subspan(current.triangleOffset * 3,
+                                          current.triangleCount * 3),
+        points);
+    for (size_t i = 0; i != current.vertexCount; ++i) {
+      localIndex[data.vertices[current.vertexOffset + i]] = 0xff;
+    }
+    data.meshlets.push_back(current);
+
+    current = assets::Meshlet{};
+    current.vertexOffset = static_cast<uint32_t>(data.vertices.size());
+    current.triangleOffset = static_cast<uint32_t>(data.triangles.size() / 3);
+    centroid = {0, 0, 0};
+  };
+
+  auto new_vertex_count = [&](uint32_t triangle) {
+    unsigned count = 0;
+    for (int i = 0; i != 3; ++i) {
+      if (localIndex[indices[triangle * 3 + i]] == 0xff) {
+        ++count;
+      }
+    }
+    return count;
+  };
+
+  auto add_triangle = [&](uint32_t triangle) {
+    if (current.vertexCount + new_vertex_count(triangle) >
+            assets::max_meshlet_vertices ||
+        current.triangleCount + 1 > assets::max_meshlet_triangles) {
+      finish_meshlet();
+    }
+
+    for (int i = 0; i != 3; ++i) {
+      uint32_t vertex = indices[triangle * 3 + i];
+      if (localIndex[vertex] == 0xff) {
+        localIndex[vertex] = static_cast<uint8_t>(current.vertexCount++);
+        data.vertices.push_back(vertex);
+
+        // Running average of the meshlet's vertices
+        for (int j = 0; j != 3; ++j) {
+          centroid[j] += (points[vertex][j] - centroid[j]) /
+                         static_cast<float>(current.vertexCount);
+        }
+      }
+      data.triangles.push_back(localIndex[vertex]);
+      result.push_back(vertex);
+    }
+    ++current.triangleCount;
+    emitted[triangle] = true;
+  };
+
+  while (true) {
+    // Best neighbour of the current meshlet: fewest new vertices, then
+    // closest to the centroid so meshlets stay round and their cones tight
+    int64_t best = -1;
+    unsigned bestNew = 3;
+    float bestDistance = std::numeric_limits<float>::max();
+    for (size_t i = 0; i != current.vertexCount; ++i) {
+      uint32_t position = positionId[data.vertices[current.vertexOffset + i]];
+      for (auto t = adjacencyOffsets[position];
+           t != adjacencyOffsets[position + 1]; ++t) {
+        uint32_t triangle = adjacency[t];
+        if (emitted[triangle]) {
+          continue;
+        }
+
+        unsigned newVertices = new_vertex_count(triangle);
+        if (newVertices > bestNew) {
+          continue;
+        }
+
+        Vec3 triangleCenter{0, 0, 0};
+        for (int k = 0; k != 3; ++k) {
+          const auto &p = points[indices[triangle * 3 + k]];
+          for (int j = 0; j != 3; ++j) {
+            triangleCenter[j] += p[j] / 3.0F;
+          }
+        }
+        Vec3 offset = sub(triangleCenter, centroid);
+        float distance = dot(offset, offset);
+
+        if (newVertices < bestNew || distance < bestDistance) {
+          best = triangle;
+          bestNew = newVertices;
+          bestDistance = distance;
+        }
+      }
+    }
+
+    if (best < 0) {
+      // Nothing connected is left: continue with the next free triangle in
+      // the original order, which is close by after cache optimization
+      while (scanCursor < triangleCount && emitted[scanCursor]) {
+        ++scanCursor;
+      }
+      if (scanCursor == triangleCount) {
+        break;
+      }
+      best = static_cast<int64_t>(scanCursor);
+    }
+
+    add_triangle(static_cast<uint32_t>(best));
+  }
+  finish_meshlet();
+
+  std::copy(result.begin(), result.end(), indices.begin());
+
+  return data;
+}
+
+} // namespace baker
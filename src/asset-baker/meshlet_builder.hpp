@@ -0,0 +1,17 @@
+#pragma once
+
+#include "../assetlib/mesh_asset.hpp"
+#include <cstdint>
+#include <span>
+
+namespace baker {
+
+// Greedily grows meshlets of at most assets::max_meshlet_vertices vertices and
+// assets::max_meshlet_triangles triangles over the triangle adjacency, always
+// picking the neighbouring triangle that adds the fewest new vertices.
+// The index buffer is rewritten so every meshlet is a contiguous range.
+auto build_meshlets(std::span<uint32_t> indices, const float *positions,
+                    size_t positionStride, size_t vertexCount)
+    -> assets::MeshletData;
+
+} // namespace baker
@@ -0,0 +1,166 @@
+#include "mip_generator.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BAKER_MIPS_SSE2
+#endif
+
+namespace baker {
+
+namespace {
+
+// Steps of the linear to sRGB table. Fine enough that neighbouring steps are
+// less than one 8 bit value apart, even near black where sRGB is steepest.
+constexpr int encode_steps = 4096;
+
+// Decodes 8 bit colors to linear floats and encodes them back
+struct ColorTables {
+  std::array<float, 256> toLinear;
+  std::array<uint8_t, encode_steps> fromLinear;
+};
+
+auto make_tables(bool srgb) -> ColorTables {
+  ColorTables result{};
+  for (int i = 0; i != 256; ++i) {
+    float value = static_cast<float>(i) / 255.0F;
+    result.toLinear[i] = value;
+    if (srgb) {
+      result.toLinear[i] =
+          value <= 0.04045F ? value / 12.92F
+                            : std::pow((value + 0.055F) / 1.055F, 2.4F);
+    }
+  }
+  for (int i = 0; i != encode_steps; ++i) {
+    float value = static_cast<float>(i) / (encode_steps - 1);
+    float encoded = value;
+    if (srgb) {
+      encoded = value <= 0.0031308F
+                    ? value * 12.92F
+                    : 1.055F * std::pow(value, 1.0F / 2.4F) - 0.055F;
+    }
+    result.fromLinear[i] = static_cast<uint8_t>(
+        std::lround(std::clamp(encoded, 0.0F, 1.0F) * 255.0F));
+  }
+  return result;
+}
+
+auto color_tables(bool srgb) -> const ColorTables & {
+  static const ColorTables srgbTables = make_tables(true);
+  static const ColorTables linearTables = make_tables(false);
+  return srgb ? srgbTables : linearTables;
+}
+
+// Linear RGBA, alpha is only scaled to [0, 1]
+void decode_row(const uint8_t *row, uint32_t width, float *linear,
+                const ColorTables &tables) {
+  for (uint32_t x = 0; x != width; ++x) {
+    linear[4 * x + 0] = tables.toLinear[row[4 * x + 0]];
+    linear[4 * x + 1] = tables.toLinear[row[4 * x + 1]];
+    linear[4 * x + 2] = tables.toLinear[row[4 * x + 2]];
+    linear[4 * x + 3] = static_cast<float>(row[4 * x + 3]) / 255.0F;
+  }
+}
+
+// Averages 2x2 blocks of two linear rows into one sRGB row. The last column
+// of an odd width is dropped, a width of 1 reads its only column twice.
+void filter_row(const float *row0, const float *row1, uint32_t sourceWidth,
+                uint8_t *destination, uint32_t width,
+                const ColorTables &tables) {
+  // Averages and scales to table steps for color, to 8 bits for alpha
+  constexpr float colorScale = 0.25F * (encode_steps - 1);
+  constexpr float alphaScale = 0.25F * 255.0F;
+
+#ifdef BAKER_MIPS_SSE2
+  const __m128 scale =
+      _mm_setr_ps(colorScale, colorScale, colorScale, alphaScale);
+  const __m128 half = _mm_set1_ps(0.5F);
+#endif
+
+  for (uint32_t x = 0; x != width; ++x) {
+    size_t left = 4 * size_t{2 * x};
+    size_t right = 4 * size_t{std::min(2 * x + 1, sourceWidth - 1)};
+
+    alignas(16) int32_t steps[4];
+#ifdef BAKER_MIPS_SSE2
+    // One RGBA texel per register
+    __m128 sum = _mm_add_ps(
+        _mm_add_ps(_mm_loadu_ps(row0 + left), _mm_loadu_ps(row0 + right)),
+        _mm_add_ps(_mm_loadu_ps(row1 + left), _mm_loadu_ps(row1 + right)));
+    __m128i rounded =
+        _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(sum, scale), half));
+    _mm_store_si128(reinterpret_cast<__m128i *>(steps), rounded);
+#else
+    for (size_t c = 0; c != 4; ++c) {
+      float sum = row0[left + c] + row0[right + c] + row1[left + c] +
+                  row1[right + c];
+      steps[c] = static_cast<int32_t>(
+          sum * (c == 3 ? alphaScale : colorScale) + 0.5F);
+    }
+#endif
+
+    uint8_t *texel = destination + 4 * size_t{x};
+    for (size_t c = 0; c != 3; ++c) {
+      texel[c] = tables.fromLinear[std::min(steps[c], encode_steps - 1)];
+    }
+    texel[3] = static_cast<uint8_t>(std::min(steps[3], 255));
+  }
+}
+
+} // namespace
+
+auto mip_level_count(uint32_t width, uint32_t height) -> uint32_t {
+  return static_cast<uint32_t>(std::bit_width(std::max({width, height, 1U})));
+}
+
+auto mip_level_size(uint32_t width, uint32_t height, uint32_t level)
+    -> size_t {
+  return size_t{std::max(width >> level, 1U)} *
+         std::max(height >> level, 1U) * 4;
+}
+
+auto mip_chain_size(uint32_t width, uint32_t height) -> size_t {
+  size_t size = 0;
+  for (uint32_t level = 0; level != mip_level_count(width, height); ++level) {
+    size += mip_level_size(width, height, level);
+  }
+  return size;
+}
+
+void generate_mips(uint8_t *chain, uint32_t width, uint32_t height,
+                   bool srgb) {
+  const auto &tables = color_tables(srgb);
+
+  std::vector<float> row0(size_t{width} * 4);
+  std::vector<float> row1(size_t{width} * 4);
+
+  uint8_t *source = chain;
+  for (uint32_t level = 1; level < mip_level_count(width, height); ++level) {
+    uint32_t sourceWidth = std::max(width >> (level - 1), 1U);
+    uint32_t sourceHeight = std::max(height >> (level - 1), 1U);
+    uint32_t levelWidth = std::max(width >> level, 1U);
+    uint32_t levelHeight = std::max(height >> level, 1U);
+    uint8_t *destination = source + mip_level_size(width, height, level - 1);
+
+    size_t sourcePitch = size_t{sourceWidth} * 4;
+    for (uint32_t y = 0; y != levelHeight; ++y) {
+      uint32_t bottom = std::min(2 * y + 1, sourceHeight - 1);
+      decode_row(source + 2 * y * sourcePitch, sourceWidth, row0.data(),
+                 tables);
+      decode_row(source + bottom * sourcePitch, sourceWidth, row1.data(),
+                 tables);
+      filter_row(row0.data(), row1.data(), sourceWidth,
+                 destination + y * size_t{levelWidth} * 4, levelWidth,
+                 tables);
+    }
+
+    source = destination;
+  }
+}
+
+} // namespace baker
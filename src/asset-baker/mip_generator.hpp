@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace baker {
+
+// Levels in the full mip chain of an image, down to 1x1
+auto mip_level_count(uint32_t width, uint32_t height) -> uint32_t;
+
+// Size of one level of an RGBA8 image
+auto mip_level_size(uint32_t width, uint32_t height, uint32_t level)
+    -> size_t;
+
+// Size of the full mip chain of an RGBA8 image, level 0 included
+auto mip_chain_size(uint32_t width, uint32_t height) -> size_t;
+
+// Fills in every level after the first of an RGBA8 mip chain. chain
+// holds mip_chain_size bytes with level 0 at the start and the levels back
+// to back. Each level is a 2x2 box filter of the one above it, averaged in
+// linear space so dark and bright texels mix like they do on screen. Alpha
+// is averaged as is, and so is everything else when srgb is false, e.g. for
+// normal maps.
+void generate_mips(uint8_t *chain, uint32_t width, uint32_t height,
+                   bool srgb = true);
+
+} // namespace baker
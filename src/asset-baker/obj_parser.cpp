@@ -0,0 +1,452 @@
+#include "obj_parser.hpp"
+#include "../assetlib/job_system.hpp"
+#include "../assetlib/mapped_file.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace baker {
+
+namespace {
+
+// Smaller files are split into fewer chunks, below this size the job
+// overhead outweighs the parsing
+constexpr size_t min_chunk_size = 1024 * 1024;
+
+// Powers of ten that doubles hold exactly. A mantissa below 2^53 times or
+// divided by one of them is rounded only once.
+constexpr std::array<double, 23> exact_powers_of_ten = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+constexpr uint64_t max_exact_mantissa = uint64_t{1} << 53;
+
+auto is_digit(char c) -> bool { return c >= '0' && c <= '9'; }
+
+auto is_space(char c) -> bool { return c == ' ' || c == '\t' || c == '\r'; }
+
+void skip_spaces(const char *&text, const char *end) {
+  while (text != end && is_space(*text)) {
+    ++text;
+  }
+}
+
+auto read_int(const char *&text, const char *end, int64_t &value) -> bool {
+  const char *cursor = text;
+  bool negative = false;
+  if (cursor != end && (*cursor == '-' || *cursor == '+')) {
+    negative = *cursor == '-';
+    ++cursor;
+  }
+
+  const char *digits = cursor;
+  int64_t result = 0;
+  for (; cursor != end && is_digit(*cursor); ++cursor) {
+    // Anything this large is out of range anyway, don't overflow
+    if (result < std::numeric_limits<int32_t>::max()) {
+      result = result * 10 + (*cursor - '0');
+    }
+  }
+  if (cursor == digits) {
+    return false;
+  }
+
+  value = negative ? -result : result;
+  text = cursor;
+  return true;
+}
+
+// Corner of a face before the polygon is fanned, with a bit for every
+// index that is relative to the chunk's own attributes
+struct PolygonCorner {
+  ObjCorner corner;
+  uint8_t relativeMask;
+};
+
+// Lines parsed by one job. Relative indices are only resolved once the
+// attribute counts of the chunks before are known.
+struct Chunk {
+  std::vector<float> positions;
+  std::vector<float> texcoords;
+  std::vector<float> normals;
+  std::vector<ObjCorner> corners;
+  // Corner attributes holding an index relative to the chunk's first
+  // attribute, as corner * 3 + 0 for the position, 1 the texcoord and 2 the
+  // normal
+  std::vector<size_t> relative;
+  std::vector<ObjShape> shapes;
+  size_t lineCount = 0;
+  // First error, on line errorLine of the chunk
+  std::string error;
+  size_t errorLine = 0;
+};
+
+// Reads count floats into values. Missing ones after the first required
+// are filled with 0.
+auto read_floats(const char *&text, const char *end, size_t required,
+                 size_t count, std::vector<float> &values) -> bool {
+  for (size_t i = 0; i != count; ++i) {
+    skip_spaces(text, end);
+    float value = 0.0F;
+    if (!read_float(text, end, value) && i < required) {
+      return false;
+    }
+    values.push_back(value);
+  }
+  return true;
+}
+
+// Converts an index of the file, 1 based or negative from the end, into a
+// 0 based one. Relative ones are relative to the chunk's attributes.
+auto resolve_index(int64_t index, size_t count, int32_t &resolved,
+                   bool &relative) -> bool {
+  if (index == 0 || index > std::numeric_limits<int32_t>::max() ||
+      index < std::numeric_limits<int32_t>::min()) {
+    return false;
+  }
+  relative = index < 0;
+  resolved = static_cast<int32_t>(relative ? static_cast<int64_t>(count) + index
+                                           : index - 1);
+  return true;
+}
+
+auto corner_index(ObjCorner &corner, size_t attribute) -> int32_t & {
+  switch (attribute) {
+  case 0:
+    return corner.position;
+  case 1:
+    return corner.texcoord;
+  default:
+    return corner.normal;
+  }
+}
+
+// Reads a face corner such as 3, 3/1, 3//2 or 3/1/2
+auto read_corner(const char *&text, const char *end, const Chunk &chunk,
+                 PolygonCorner &corner) -> bool {
+  corner = {{-1, -1, -1}, 0};
+  std::array<size_t, 3> counts = {chunk.positions.size() / 3,
+                                  chunk.texcoords.size() / 2,
+                                  chunk.normals.size() / 3};
+
+  for (size_t attribute = 0; attribute != 3; ++attribute) {
+    if (attribute != 0) {
+      if (text == end || *text != '/') {
+        break;
+      }
+      ++text;
+      // The texcoord may be left out as in 3//2
+      if (attribute == 1 && text != end && *text == '/') {
+        continue;
+      }
+    }
+
+    int64_t index = 0;
+    bool relative = false;
+    if (!read_int(text, end, index) ||
+        !resolve_index(index, counts[attribute],
+                       corner_index(corner.corner, attribute), relative)) {
+      return false;
+    }
+    corner.relativeMask |= static_cast<uint8_t>(relative ? 1 << attribute : 0);
+  }
+  return text == end || is_space(*text);
+}
+
+void add_corner(Chunk &chunk, const PolygonCorner &corner) {
+  for (size_t attribute = 0; attribute != 3; ++attribute) {
+    if ((corner.relativeMask & (1 << attribute)) != 0) {
+      chunk.relative.push_back(chunk.corners.size() * 3 + attribute);
+    }
+  }
+  chunk.corners.push_back(corner.corner);
+}
+
+void start_shape(Chunk &chunk, std::string_view name) {
+  chunk.shapes.push_back({std::string{name}, chunk.corners.size()});
+}
+
+void parse_chunk(const char *begin, const char *end, Chunk &chunk) {
+  std::vector<PolygonCorner> polygon;
+
+  for (const char *line = begin; line != end;) {
+    const auto *newline =
+        static_cast<const char *>(memchr(line, '\n', end - line));
+    const char *lineEnd = newline != nullptr ? newline : end;
+    ++chunk.lineCount;
+
+    const char *cursor = line;
+    line = newline != nullptr ? newline + 1 : end;
+
+    skip_spaces(cursor, lineEnd);
+    const char *keywordStart = cursor;
+    while (cursor != lineEnd && !is_space(*cursor)) {
+      ++cursor;
+    }
+    auto keyword = std::string_view{
+        keywordStart, static_cast<size_t>(cursor - keywordStart)};
+
+    bool ok = true;
+    if (keyword == "v") {
+      // Vertex colors after the position are skipped
+      ok = read_floats(cursor, lineEnd, 3, 3, chunk.positions);
+    } else if (keyword == "vt") {
+      ok = read_floats(cursor, lineEnd, 1, 2, chunk.texcoords);
+    } else if (keyword == "vn") {
+      ok = read_floats(cursor, lineEnd, 3, 3, chunk.normals);
+    } else if (keyword == "f") {
+      polygon.clear();
+      for (skip_spaces(cursor, lineEnd); ok && cursor != lineEnd;
+           skip_spaces(cursor, lineEnd)) {
+        PolygonCorner corner;
+        ok = read_corner(cursor, lineEnd, chunk, corner);
+        polygon.push_back(corner);
+      }
+      ok = ok && polygon.size() >= 3;
+
+      // Polygons are fanned around their first corner, which is right for
+      // the convex ones exporters write
+      for (size_t i = 2; ok && i < polygon.size(); ++i) {
+        add_corner(chunk, polygon[0]);
+        add_corner(chunk, polygon[i - 1]);
+        add_corner(chunk, polygon[i]);
+      }
+    } else if (keyword == "o" || keyword == "g") {
+      skip_spaces(cursor, lineEnd);
+      const char *nameEnd = lineEnd;
+      while (nameEnd != cursor && is_space(nameEnd[-1])) {
+        --nameEnd;
+      }
+      start_shape(chunk, {cursor, static_cast<size_t>(nameEnd - cursor)});
+    }
+
+    if (!ok) {
+      chunk.error = "malformed '" + std::string{keyword} + "' line";
+      chunk.errorLine = chunk.lineCount;
+      return;
+    }
+  }
+}
+
+// Start of the line after offset, or the end of text
+auto next_line(std::string_view text, size_t offset) -> size_t {
+  auto newline = text.find('\n', offset);
+  return newline == std::string_view::npos ? text.size() : newline + 1;
+}
+
+} // namespace
+
+auto read_float(const char *&text, const char *end, float &value) -> bool {
+  const char *cursor = text;
+  bool negative = false;
+  if (cursor != end && (*cursor == '-' || *cursor == '+')) {
+    negative = *cursor == '-';
+    ++cursor;
+  }
+
+  // Up to 19 significant digits fit the mantissa, the rest only count
+  // towards the exponent
+  uint64_t mantissa = 0;
+  int significant = 0;
+  int exponent = 0;
+  bool anyDigit = false;
+  for (; cursor != end && is_digit(*cursor); ++cursor) {
+    anyDigit = true;
+    if (significant < 19) {
+      mantissa = mantissa * 10 + static_cast<uint64_t>(*cursor - '0');
+      significant += mantissa != 0 ? 1 : 0;
+    } else {
+      ++exponent;
+    }
+  }
+  if (cursor != end && *cursor == '.') {
+    ++cursor;
+    for (; cursor != end && is_digit(*cursor); ++cursor) {
+      anyDigit = true;
+      if (significant < 19) {
+        mantissa = mantissa * 10 + static_cast<uint64_t>(*cursor - '0');
+        significant += mantissa != 0 ? 1 : 0;
+        --exponent;
+      }
+    }
+  }
+  if (!anyDigit) {
+    return false;
+  }
+
+  // An e without digits after it isn't part of the number
+  if (cursor != end && (*cursor == 'e' || *cursor == 'E')) {
+    const char *exponentCursor = cursor + 1;
+    bool negativeExponent = false;
+    if (exponentCursor != end &&
+        (*exponentCursor == '-' || *exponentCursor == '+')) {
+      negativeExponent = *exponentCursor == '-';
+      ++exponentCursor;
+    }
+    if (exponentCursor != end && is_digit(*exponentCursor)) {
+      int written = 0;
+      for (; exponentCursor != end && is_digit(*exponentCursor);
+           ++exponentCursor) {
+        written = std::min(written * 10 + (*exponentCursor - '0'), 10000);
+      }
+      exponent += negativeExponent ? -written : written;
+      cursor = exponentCursor;
+    }
+  }
+
+  auto result = static_cast<double>(mantissa);
+  if (mantissa < max_exact_mantissa && exponent >= 0 &&
+      exponent < static_cast<int>(exact_powers_of_ten.size())) {
+    result *= exact_powers_of_ten[exponent];
+  } else if (mantissa < max_exact_mantissa && exponent < 0 &&
+             -exponent < static_cast<int>(exact_powers_of_ten.size())) {
+    result /= exact_powers_of_ten[-exponent];
+  } else if (mantissa != 0) {
+    result *= std::pow(10.0, exponent);
+  }
+
+  value = static_cast<float>(negative ? -result : result);
+  text = cursor;
+  return true;
+}
+
+auto parse_obj(std::string_view text, assets::JobSystem &jobs, ObjMesh &mesh,
+               std::string &error) -> bool {
+  ObjCounts counts;
+  return parse_obj_window(text, counts, jobs, mesh, error);
+}
+
+auto parse_obj_window(std::string_view text, ObjCounts &counts,
+                      assets::JobSystem &jobs, ObjMesh &mesh,
+                      std::string &error) -> bool {
+  size_t chunkCount = std::clamp<size_t>(text.size() / min_chunk_size, 1,
+                                         size_t{jobs.thread_count()} * 4);
+
+  // Every chunk starts at the beginning of a line
+  std::vector<size_t> starts(chunkCount + 1, text.size());
+  starts[0] = 0;
+  for (size_t i = 1; i != chunkCount; ++i) {
+    size_t split = text.size() / chunkCount * i;
+    starts[i] = std::max(starts[i - 1], next_line(text, split));
+  }
+
+  std::vector<Chunk> chunks(chunkCount);
+  jobs.parallel_for(chunkCount, [&](size_t i) {
+    parse_chunk(text.data() + starts[i], text.data() + starts[i + 1],
+                chunks[i]);
+  });
+
+  size_t line = counts.lines;
+  for (auto &&chunk : chunks) {
+    if (!chunk.error.empty()) {
+      error = "line " + std::to_string(line + chunk.errorLine) + ": " +
+              chunk.error;
+      return false;
+    }
+    line += chunk.lineCount;
+  }
+
+  // Where every chunk's attributes and corners go in the merged mesh
+  struct Offsets {
+    size_t positions = 0;
+    size_t texcoords = 0;
+    size_t normals = 0;
+    size_t corners = 0;
+  };
+  std::vector<Offsets> offsets(chunkCount + 1);
+  for (size_t i = 0; i != chunkCount; ++i) {
+    offsets[i + 1] = {offsets[i].positions + chunks[i].positions.size(),
+                      offsets[i].texcoords + chunks[i].texcoords.size(),
+                      offsets[i].normals + chunks[i].normals.size(),
+                      offsets[i].corners + chunks[i].corners.size()};
+  }
+  const Offsets &total = offsets[chunkCount];
+  mesh.positions.resize(total.positions);
+  mesh.texcoords.resize(total.texcoords);
+  mesh.normals.resize(total.normals);
+  mesh.corners.resize(total.corners);
+
+  std::vector<char> valid(chunkCount, 1);
+  jobs.parallel_for(chunkCount, [&](size_t i) {
+    Chunk &chunk = chunks[i];
+    const Offsets &offset = offsets[i];
+    std::copy(chunk.positions.begin(), chunk.positions.end(),
+              mesh.positions.begin() +
+                  static_cast<std::ptrdiff_t>(offset.positions));
+    std::copy(chunk.texcoords.begin(), chunk.texcoords.end(),
+              mesh.texcoords.begin() +
+                  static_cast<std::ptrdiff_t>(offset.texcoords));
+    std::copy(chunk.normals.begin(), chunk.normals.end(),
+              mesh.normals.begin() +
+                  static_cast<std::ptrdiff_t>(offset.normals));
+
+    // Relative indices are shifted by the attributes of the chunks before
+    std::array<size_t, 3> bases = {counts.positions + offset.positions / 3,
+                                   counts.texcoords + offset.texcoords / 2,
+                                   counts.normals + offset.normals / 3};
+    for (auto entry : chunk.relative) {
+      corner_index(chunk.corners[entry / 3], entry % 3) +=
+          static_cast<int32_t>(bases[entry % 3]);
+    }
+
+    std::array<int64_t, 3> defined = {
+        static_cast<int64_t>(counts.positions + total.positions / 3),
+        static_cast<int64_t>(counts.texcoords + total.texcoords / 2),
+        static_cast<int64_t>(counts.normals + total.normals / 3)};
+    for (auto &&corner : chunk.corners) {
+      for (size_t attribute = 0; attribute != 3; ++attribute) {
+        int32_t index = corner_index(corner, attribute);
+        // Only the position is required
+        if (index >= defined[attribute] ||
+            (index < 0 && (attribute == 0 || index != -1))) {
+          valid[i] = 0;
+        }
+      }
+    }
+    std::copy(chunk.corners.begin(), chunk.corners.end(),
+              mesh.corners.begin() +
+                  static_cast<std::ptrdiff_t>(offset.corners));
+  });
+
+  if (std::find(valid.begin(), valid.end(), 0) != valid.end()) {
+    error = "a face refers to a vertex attribute the file doesn't have";
+    return false;
+  }
+
+  counts.lines = line;
+  counts.positions += total.positions / 3;
+  counts.texcoords += total.texcoords / 2;
+  counts.normals += total.normals / 3;
+
+  // A shape line without faces after it only renames the shape
+  mesh.shapes.clear();
+  for (size_t i = 0; i != chunkCount; ++i) {
+    for (auto &&shape : chunks[i].shapes) {
+      size_t firstCorner = offsets[i].corners + shape.firstCorner;
+      if (!mesh.shapes.empty() &&
+          mesh.shapes.back().firstCorner == firstCorner) {
+        mesh.shapes.back().name = std::move(shape.name);
+      } else {
+        mesh.shapes.push_back({std::move(shape.name), firstCorner});
+      }
+    }
+  }
+  return true;
+}
+
+auto parse_obj(const std::filesystem::path &path, assets::JobSystem &jobs,
+               ObjMesh &mesh, std::string &error) -> bool {
+  assets::MappedFile file;
+  if (!file.open(path)) {
+    error = "can't open " + path.string();
+    return false;
+  }
+  file.advise(assets::AccessHint::Sequential);
+  return parse_obj(std::string_view{file.data(), file.size()}, jobs, mesh,
+                   error);
+}
+
+} // namespace baker
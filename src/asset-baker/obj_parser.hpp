@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace assets {
+class JobSystem;
+}
+
+namespace baker {
+
+// Corner of an OBJ face as zero based indices into the attribute arrays, -1
+// when the face doesn't have the attribute
+struct ObjCorner {
+  int32_t position;
+  int32_t texcoord;
+  int32_t normal;
+};
+
+// Faces from an o or g line up to the next one
+struct ObjShape {
+  std::string name;
+  // Into ObjMesh::corners
+  size_t firstCorner;
+};
+
+// Geometry of an OBJ file. Polygons are fanned into triangles, materials,
+// smoothing groups and everything else is skipped.
+struct ObjMesh {
+  std::vector<float> positions; // xyz
+  std::vector<float> texcoords; // uv
+  std::vector<float> normals;   // xyz
+  // Three per triangle, in file order
+  std::vector<ObjCorner> corners;
+  // Empty when the file has no o or g lines
+  std::vector<ObjShape> shapes;
+};
+
+// Lines and attributes, in vertices, of the text before a window
+struct ObjCounts {
+  size_t lines = 0;
+  size_t positions = 0;
+  size_t texcoords = 0;
+  size_t normals = 0;
+};
+
+// Parses OBJ text split at line boundaries, one chunk per job. The chunks
+// are merged back in file order, so the result doesn't depend on the thread
+// count. Negative (relative) indices are resolved across chunks. Returns
+// false with a message naming the line on malformed input.
+auto parse_obj(std::string_view text, assets::JobSystem &jobs, ObjMesh &mesh,
+               std::string &error) -> bool;
+
+// Parses a window of a file too large to parse at once, starting at a line
+// boundary. Indices are resolved against counts, the windows before, which
+// is then advanced past this one. mesh only gets the window's attributes,
+// while its corners index the attributes of the whole file.
+auto parse_obj_window(std::string_view text, ObjCounts &counts,
+                      assets::JobSystem &jobs, ObjMesh &mesh,
+                      std::string &error) -> bool;
+
+// Maps the file and parses it
+auto parse_obj(const std::filesystem::path &path, assets::JobSystem &jobs,
+               ObjMesh &mesh, std::string &error) -> bool;
+
+// Parses a decimal number such as -1.5, .25 or 3e-2 at the start of text and
+// advances past it. Digits past the 19th are dropped, far beyond float
+// precision. Returns false when there is no number.
+auto read_float(const char *&text, const char *end, float &value) -> bool;
+
+} // namespace baker
@@ -0,0 +1,33 @@
+#include "process_memory.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+// windows.h has to come first
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+auto baker::peak_memory_usage() -> std::uintmax_t {
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters{};
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &counters,
+                           sizeof(counters)) == 0) {
+    return 0;
+  }
+  return counters.PeakWorkingSetSize;
+#else
+  rusage usage{};
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+#ifdef __APPLE__
+  // Bytes on macOS, kilobytes everywhere else
+  return static_cast<std::uintmax_t>(usage.ru_maxrss);
+#else
+  return static_cast<std::uintmax_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
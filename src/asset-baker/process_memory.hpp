@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstdint>
+
+namespace baker {
+
+// Largest resident set of the process so far in bytes, 0 where unsupported
+auto peak_memory_usage() -> std::uintmax_t;
+
+} // namespace baker
@@ -0,0 +1,160 @@
+#include "texture_atlas.hpp"
+#include "block_compression.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <numeric>
+
+namespace baker {
+
+namespace {
+
+// Texels on a side of the format's blocks, RGBA8 counts as 1x1 blocks
+auto block_dimension(assets::TextureFormat format) -> uint32_t {
+  return block_bytes(format) == 0 ? 1 : 4;
+}
+
+// Every other bit of value, from bit 0 on
+auto even_bits(uint64_t value) -> uint32_t {
+  uint32_t result = 0;
+  for (uint32_t bit = 0; value != 0; ++bit, value >>= 2) {
+    result |= static_cast<uint32_t>(value & 1) << bit;
+  }
+  return result;
+}
+
+struct Placement {
+  uint32_t layer;
+  uint32_t x;
+  uint32_t y;
+};
+
+} // namespace
+
+auto fits_atlas(const assets::TextureInfo &info, uint32_t maxSize) -> bool {
+  uint32_t width = info.pixelsize[0];
+  uint32_t height = info.pixelsize[1];
+  return info.pixelsize[2] == 1 && !info.pages.empty() &&
+         std::has_single_bit(width) && std::has_single_bit(height) &&
+         std::max(width, height) <= maxSize &&
+         std::min(width, height) >= atlas_min_texture_size;
+}
+
+void build_texture_atlas(std::span<const AtlasInput> inputs,
+                         assets::TextureInfo &info,
+                         std::vector<char> &pixels) {
+  auto format = inputs.front().info->textureFormat;
+  uint32_t blockDim = block_dimension(format);
+  size_t blockSize = block_bytes(format) == 0 ? 4 : block_bytes(format);
+
+  auto cell_size = [&](size_t i) {
+    return std::max(inputs[i].info->pixelsize[0],
+                    inputs[i].info->pixelsize[1]);
+  };
+
+  std::vector<size_t> order(inputs.size());
+  std::iota(order.begin(), order.end(), size_t{0});
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return cell_size(a) > cell_size(b);
+  });
+
+  // The smallest square layer that holds every cell, unless that's over the
+  // limit
+  uint64_t area = 0;
+  for (size_t i = 0; i != inputs.size(); ++i) {
+    area += uint64_t{cell_size(i)} * cell_size(i);
+  }
+  uint32_t layerSize = cell_size(order.front());
+  while (layerSize < atlas_max_layer_size &&
+         uint64_t{layerSize} * layerSize < area) {
+    layerSize *= 2;
+  }
+
+  // Cells are placed largest first, so the Z curve position of every cell
+  // is a multiple of its own area and decodes to an aligned corner
+  std::vector<Placement> placements(inputs.size());
+  uint32_t layerCount = 1;
+  uint64_t cursor = 0;
+  for (auto i : order) {
+    uint64_t cellArea = uint64_t{cell_size(i)} * cell_size(i);
+    if (cursor + cellArea > uint64_t{layerSize} * layerSize) {
+      ++layerCount;
+      cursor = 0;
+    }
+    placements[i] = {layerCount - 1, even_bits(cursor),
+                     even_bits(cursor >> 1)};
+    cursor += cellArea;
+  }
+
+  auto levelCount = static_cast<uint32_t>(std::bit_width(layerSize));
+  for (auto &&input : inputs) {
+    uint32_t smallest =
+        std::min(input.info->pixelsize[0], input.info->pixelsize[1]);
+    levelCount = std::min(
+        {levelCount, static_cast<uint32_t>(input.info->pages.size()),
+         static_cast<uint32_t>(std::bit_width(smallest / blockDim))});
+  }
+
+  info = {};
+  info.textureFormat = format;
+  info.pixelsize[0] = layerSize;
+  info.pixelsize[1] = layerSize;
+  info.pixelsize[2] = layerCount;
+  info.textureSize = 0;
+  for (uint32_t level = 0; level != levelCount; ++level) {
+    uint32_t side = layerSize >> level;
+    auto layerBytes = compressed_image_size(format, side, side);
+    info.pages.push_back(
+        {.width = side,
+         .height = side,
+         .compressedSize = 0,
+         .originalSize = static_cast<uint32_t>(layerBytes * layerCount)});
+    info.textureSize += layerBytes * layerCount;
+  }
+
+  pixels.assign(info.textureSize, 0);
+
+  for (size_t i = 0; i != inputs.size(); ++i) {
+    const auto &input = inputs[i];
+    const auto &placement = placements[i];
+    uint32_t width = input.info->pixelsize[0];
+    uint32_t height = input.info->pixelsize[1];
+
+    const char *source = input.pixels;
+    char *page = pixels.data();
+    for (uint32_t level = 0; level != levelCount; ++level) {
+      // Both sides are powers of two of at least one block at every level
+      // that is copied, so the rows are whole blocks
+      uint32_t blocksWide = (width >> level) / blockDim;
+      uint32_t blocksHigh = (height >> level) / blockDim;
+      uint32_t layerBlocksWide = (layerSize >> level) / blockDim;
+      size_t layerBytes = info.pages[level].originalSize / layerCount;
+
+      char *layer = page + placement.layer * layerBytes;
+      uint32_t firstColumn = (placement.x >> level) / blockDim;
+      uint32_t firstRow = (placement.y >> level) / blockDim;
+      for (uint32_t row = 0; row != blocksHigh; ++row) {
+        memcpy(layer + (size_t{firstRow + row} * layerBlocksWide +
+                        firstColumn) *
+                           blockSize,
+               source + size_t{row} * blocksWide * blockSize,
+               blocksWide * blockSize);
+      }
+
+      source += input.info->pages[level].originalSize;
+      page += info.pages[level].originalSize;
+    }
+
+    auto size = static_cast<float>(layerSize);
+    info.regions.push_back(
+        {.name = input.name,
+         .layer = placement.layer,
+         .uvScale = {static_cast<float>(width) / size,
+                     static_cast<float>(height) / size},
+         .uvOffset = {static_cast<float>(placement.x) / size,
+                      static_cast<float>(placement.y) / size}});
+  }
+}
+
+} // namespace baker
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "../assetlib/texture_asset.hpp"
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace baker {
+
+// Layers of an atlas grow up to this size before a new one is started
+constexpr uint32_t atlas_max_layer_size = 1024;
+// Texels on the shorter side of the smallest texture an atlas takes. The
+// atlas stops at the level where its smallest texture is one block wide, so
+// tiny textures would cut the mip chain of every other one short.
+constexpr uint32_t atlas_min_texture_size = 16;
+
+// A baked texture to pack, with its pages unpacked back to back
+struct AtlasInput {
+  std::string name;
+  const assets::TextureInfo *info;
+  const char *pixels;
+};
+
+// Whether a baked texture can share an atlas with textures of at most
+// maxSize texels on a side. Only single layer textures with power of two
+// sides of at least atlas_min_texture_size are packed, so that every mip
+// level of a texture stays inside its own region.
+auto fits_atlas(const assets::TextureInfo &info, uint32_t maxSize) -> bool;
+
+// Packs textures of the same format into the layers of a texture array,
+// copying their blocks as they are. Every texture takes a square cell as
+// wide as its larger side, placed largest first along a Z curve so that
+// cells never straddle each other at any level. The array has the levels
+// every texture has, down to the one where the smallest side is one block.
+// info gets one region per input, pixels the pages of the array.
+void build_texture_atlas(std::span<const AtlasInput> inputs,
+                         assets::TextureInfo &info, std::vector<char> &pixels);
+
+} // namespace baker
@@ -0,0 +1,156 @@
+#include "asset_archive.hpp"
+#include "asset_hash.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+auto assets::archive_key_hash(std::string_view key) -> std::uint64_t {
+  std::uint64_t hash = hash_bytes(key.data(), key.size());
+  // 0 is the empty slot marker
+  return hash == 0 ? 1 : hash;
+}
+
+auto assets::write_archive(const std::filesystem::path &path,
+                           std::span<const ArchiveInput> inputs) -> bool {
+  auto tableSize = static_cast<std::uint32_t>(
+      std::bit_ceil(std::max<size_t>(inputs.size() * 2, 1)));
+  std::vector<ArchiveEntry> table(tableSize, ArchiveEntry{});
+
+  std::ofstream outfile(path, std::ios::binary | std::ios::out);
+  if (!outfile.is_open()) {
+    return false;
+  }
+
+  ArchiveHeader header = {.magic = {'P', 'A', 'C', 'K'},
+                          .version = archive_version,
+                          .entryCount =
+                              static_cast<std::uint32_t>(inputs.size()),
+                          .tableSize = tableSize};
+
+  // The table is written once every offset is known
+  size_t offset = sizeof(ArchiveHeader) + tableSize * sizeof(ArchiveEntry);
+  outfile.seekp(static_cast<std::streamoff>(offset));
+
+  std::vector<char> padding(archive_alignment, 0);
+  for (auto &&input : inputs) {
+    AssetFileView asset;
+    if (!load_binaryfile_view(input.file, asset)) {
+      return false;
+    }
+
+    std::uint64_t keyHash = archive_key_hash(input.key);
+    auto slot = static_cast<std::uint32_t>(keyHash) & (tableSize - 1);
+    while (table[slot].keyHash != 0) {
+      if (table[slot].keyHash == keyHash) {
+        return false;
+      }
+      slot = (slot + 1) & (tableSize - 1);
+    }
+
+    size_t aligned =
+        (offset + archive_alignment - 1) & ~(archive_alignment - 1);
+    outfile.write(padding.data(),
+                  static_cast<std::streamsize>(aligned - offset));
+    offset = aligned;
+
+    ArchiveEntry &entry = table[slot];
+    entry.keyHash = keyHash;
+    entry.offset = offset;
+    entry.metadataSize = static_cast<std::uint32_t>(asset.metadata.size());
+    entry.blobSize = static_cast<std::uint32_t>(asset.binaryBlob.size());
+    memcpy(entry.type, asset.type, 4);
+    entry.version = static_cast<std::uint32_t>(asset.version);
+
+    // Streams straight from the source mapping
+    outfile.write(asset.metadata.data(),
+                  static_cast<std::streamsize>(asset.metadata.size()));
+    outfile.write(asset.binaryBlob.data(),
+                  static_cast<std::streamsize>(asset.binaryBlob.size()));
+    offset += asset.metadata.size() + asset.binaryBlob.size();
+  }
+
+  outfile.seekp(0);
+  outfile.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  outfile.write(reinterpret_cast<const char *>(table.data()),
+                static_cast<std::streamsize>(table.size() *
+                                             sizeof(ArchiveEntry)));
+
+  return static_cast<bool>(outfile);
+}
+
+auto assets::Archive::open(const std::filesystem::path &path) -> bool {
+  close();
+  if (!file_.open(path)) {
+    return false;
+  }
+
+  ArchiveHeader header{};
+  if (file_.size() < sizeof(header)) {
+    close();
+    return false;
+  }
+  memcpy(&header, file_.data(), sizeof(header));
+
+  bool valid = memcmp(header.magic, "PACK", 4) == 0 &&
+               header.version == archive_version &&
+               std::has_single_bit(header.tableSize) &&
+               header.entryCount < header.tableSize &&
+               file_.size() - sizeof(header) >=
+                   static_cast<size_t>(header.tableSize) * sizeof(ArchiveEntry);
+  if (!valid) {
+    close();
+    return false;
+  }
+
+  // The header keeps the table 8 byte aligned in the page aligned mapping
+  table_ =
+      reinterpret_cast<const ArchiveEntry *>(file_.data() + sizeof(header));
+  tableSize_ = header.tableSize;
+  entryCount_ = header.entryCount;
+
+  // Assets are laid out in load order, let the kernel read ahead
+  file_.advise(AccessHint::Sequential);
+  return true;
+}
+
+void assets::Archive::close() {
+  file_.close();
+  table_ = nullptr;
+  tableSize_ = 0;
+  entryCount_ = 0;
+}
+
+auto assets::Archive::find(std::string_view key,
+                           AssetFileView &outputFile) const -> bool {
+  if (table_ == nullptr) {
+    return false;
+  }
+
+  std::uint64_t keyHash = archive_key_hash(key);
+  auto slot = static_cast<std::uint32_t>(keyHash) & (tableSize_ - 1);
+  // The table is never full, so an empty slot ends every probe
+  while (table_[slot].keyHash != 0) {
+    const ArchiveEntry &entry = table_[slot];
+    if (entry.keyHash == keyHash) {
+      if (entry.offset > file_.size() ||
+          file_.size() - entry.offset <
+              static_cast<size_t>(entry.metadataSize) + entry.blobSize) {
+        return false;
+      }
+
+      const char *data = file_.data() + entry.offset;
+      memcpy(outputFile.type, entry.type, 4);
+      outputFile.version = static_cast<int>(entry.version);
+      outputFile.metadata = {data, entry.metadataSize};
+      outputFile.binaryBlob = {data + entry.metadataSize, entry.blobSize};
+      outputFile.file.close();
+      return true;
+    }
+    slot = (slot + 1) & (tableSize_ - 1);
+  }
+
+  return false;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "asset_loader.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace assets {
+
+// Pack file layout, little endian:
+//   ArchiveHeader
+//   ArchiveEntry[tableSize], an open addressing hash table keyed by path hash
+//   asset data, each entry's metadata then blob, aligned to archive_alignment
+//
+// Keys are asset paths relative to the asset root with '/' separators, e.g.
+// "character/character.mesh". A lookup hashes the key and probes the table,
+// nothing is parsed when the archive is opened.
+constexpr std::uint32_t archive_version = 1;
+constexpr size_t archive_alignment = 64;
+
+struct ArchiveHeader {
+  char magic[4];
+  std::uint32_t version;
+  std::uint32_t entryCount;
+  // Power of two
+  std::uint32_t tableSize;
+};
+
+struct ArchiveEntry {
+  // 0 marks an empty slot, see archive_key_hash
+  std::uint64_t keyHash;
+  std::uint64_t offset;
+  std::uint32_t metadataSize;
+  std::uint32_t blobSize;
+  char type[4];
+  std::uint32_t version;
+};
+
+static_assert(sizeof(ArchiveHeader) == 16);
+static_assert(sizeof(ArchiveEntry) == 32);
+
+auto archive_key_hash(std::string_view key) -> std::uint64_t;
+
+struct ArchiveInput {
+  std::string key;
+  std::filesystem::path file;
+};
+
+// Packs the asset files into one archive, in the order given so related
+// assets end up next to each other. Fails on duplicate keys.
+auto write_archive(const std::filesystem::path &path,
+                   std::span<const ArchiveInput> inputs) -> bool;
+
+// Read side of a pack file, one mapping shared by every asset in it
+class Archive {
+public:
+  auto open(const std::filesystem::path &path) -> bool;
+  void close();
+
+  [[nodiscard]] auto is_open() const -> bool { return file_.is_open(); }
+  [[nodiscard]] auto size() const -> size_t { return entryCount_; }
+
+  // Points outputFile into the archive mapping, which must outlive it.
+  // outputFile.file stays closed.
+  auto find(std::string_view key, AssetFileView &outputFile) const -> bool;
+
+private:
+  MappedFile file_;
+  const ArchiveEntry *table_ = nullptr;
+  std::uint32_t tableSize_ = 0;
+  std::uint32_t entryCount_ = 0;
+};
+
+} // namespace assets
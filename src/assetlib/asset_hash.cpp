@@ -0,0 +1,190 @@
+#include "asset_hash.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+namespace {
+constexpr std::uint64_t prime1 = 11400714785074694791ULL;
+constexpr std::uint64_t prime2 = 14029467366897019727ULL;
+constexpr std::uint64_t prime3 = 1609587929392839161ULL;
+constexpr std::uint64_t prime4 = 9650029242287828579ULL;
+constexpr std::uint64_t prime5 = 2870177450012600261ULL;
+
+constexpr auto rotl(std::uint64_t x, int r) -> std::uint64_t {
+  return (x << r) | (x >> (64 - r));
+}
+
+auto read64(const unsigned char *p) -> std::uint64_t {
+  std::uint64_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+auto read32(const unsigned char *p) -> std::uint32_t {
+  std::uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+constexpr auto xxh_round(std::uint64_t acc, std::uint64_t input)
+    -> std::uint64_t {
+  acc += input * prime2;
+  acc = rotl(acc, 31);
+  return acc * prime1;
+}
+
+constexpr auto merge_round(std::uint64_t acc, std::uint64_t value)
+    -> std::uint64_t {
+  acc ^= xxh_round(0, value);
+  return acc * prime1 + prime4;
+}
+} // namespace
+
+assets::Hasher::Hasher(std::uint64_t seed)
+    : acc_{seed + prime1 + prime2, seed + prime2, seed, seed - prime1},
+      seed_(seed), buffer_{} {}
+
+void assets::Hasher::update(const void *data, size_t size) {
+  const auto *p = static_cast<const unsigned char *>(data);
+  const auto *end = p + size;
+  totalSize_ += size;
+
+  // Top up a partially filled stripe first
+  if (bufferSize_ != 0) {
+    size_t fill = std::min(sizeof(buffer_) - bufferSize_, size);
+    memcpy(buffer_ + bufferSize_, p, fill);
+    bufferSize_ += fill;
+    p += fill;
+
+    if (bufferSize_ != sizeof(buffer_)) {
+      return;
+    }
+
+    for (size_t i = 0; i != 4; ++i) {
+      acc_[i] = xxh_round(acc_[i], read64(buffer_ + i * 8));
+    }
+    bufferSize_ = 0;
+  }
+
+  // Full 32-byte stripes straight from the input
+  while (end - p >= 32) {
+    for (size_t i = 0; i != 4; ++i) {
+      acc_[i] = xxh_round(acc_[i], read64(p + i * 8));
+    }
+    p += 32;
+  }
+
+  bufferSize_ = static_cast<size_t>(end - p);
+  memcpy(buffer_, p, bufferSize_);
+}
+
+auto assets::Hasher::digest() const -> std::uint64_t {
+  std::uint64_t h;
+  if (totalSize_ >= 32) {
+    h = rotl(acc_[0], 1) + rotl(acc_[1], 7) + rotl(acc_[2], 12) +
+        rotl(acc_[3], 18);
+    for (auto acc : acc_) {
+      h = merge_round(h, acc);
+    }
+  } else {
+    h = seed_ + prime5;
+  }
+
+  h += totalSize_;
+
+  const unsigned char *p = buffer_;
+  const unsigned char *end = buffer_ + bufferSize_;
+
+  while (end - p >= 8) {
+    h ^= xxh_round(0, read64(p));
+    h = rotl(h, 27) * prime1 + prime4;
+    p += 8;
+  }
+
+  if (end - p >= 4) {
+    h ^= static_cast<std::uint64_t>(read32(p)) * prime1;
+    h = rotl(h, 23) * prime2 + prime3;
+    p += 4;
+  }
+
+  while (p != end) {
+    h ^= (*p) * prime5;
+    h = rotl(h, 11) * prime1;
+    ++p;
+  }
+
+  // Final avalanche
+  h ^= h >> 33;
+  h *= prime2;
+  h ^= h >> 29;
+  h *= prime3;
+  h ^= h >> 32;
+
+  return h;
+}
+
+auto assets::hash_bytes(const void *data, size_t size, std::uint64_t seed)
+    -> std::uint64_t {
+  Hasher hasher(seed);
+  hasher.update(data, size);
+  return hasher.digest();
+}
+
+auto assets::hash_file(const std::filesystem::path &path,
+                       std::uint64_t &outHash) -> bool {
+  std::ifstream infile;
+  infile.open(path, std::ios::binary);
+
+  if (!infile.is_open()) {
+    return false;
+  }
+
+  Hasher hasher;
+  std::vector<char> buffer(1 << 20);
+  while (infile) {
+    infile.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    hasher.update(buffer.data(), static_cast<size_t>(infile.gcount()));
+  }
+
+  outHash = hasher.digest();
+  return true;
+}
+
+auto assets::hash_to_string(std::uint64_t hash) -> std::string {
+  constexpr const char *digits = "0123456789abcdef";
+
+  std::string str(16, '0');
+  for (size_t i = 0; i != 16; ++i) {
+    str[15 - i] = digits[(hash >> (i * 4)) & 0xF];
+  }
+  return str;
+}
+
+auto assets::hash_from_string(const std::string &str) -> std::uint64_t {
+  std::uint64_t hash = 0;
+  for (char c : str) {
+    hash <<= 4;
+    if (c >= '0' && c <= '9') {
+      hash |= static_cast<std::uint64_t>(c - '0');
+    } else if (c >= 'a' && c <= 'f') {
+      hash |= static_cast<std::uint64_t>(c - 'a' + 10);
+    } else {
+      return 0;
+    }
+  }
+  return hash;
+}
+
+auto assets::is_source_stale(const std::string &originalFile,
+                             std::uint64_t sourceHash) -> bool {
+  if (sourceHash == 0 || !std::filesystem::exists(originalFile)) {
+    return false;
+  }
+
+  std::uint64_t currentHash = 0;
+  if (!hash_file(originalFile, currentHash)) {
+    return false;
+  }
+  return currentHash != sourceHash;
+}
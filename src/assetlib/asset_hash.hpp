@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+namespace assets {
+
+// Streaming 64-bit content hash (XXH64). Fast enough to hash source assets on
+// every bake, and stable across platforms so hashes can be stored on disk.
+class Hasher {
+public:
+  explicit Hasher(std::uint64_t seed = 0);
+
+  void update(const void *data, size_t size);
+  [[nodiscard]] auto digest() const -> std::uint64_t;
+
+private:
+  std::uint64_t acc_[4];
+  std::uint64_t seed_;
+  std::uint64_t totalSize_{0};
+  unsigned char buffer_[32];
+  size_t bufferSize_{0};
+};
+
+auto hash_bytes(const void *data, size_t size, std::uint64_t seed = 0)
+    -> std::uint64_t;
+
+auto hash_file(const std::filesystem::path &path, std::uint64_t &outHash)
+    -> bool;
+
+// Hashes are stored as fixed-width hex strings in the asset metadata
+auto hash_to_string(std::uint64_t hash) -> std::string;
+auto hash_from_string(const std::string &str) -> std::uint64_t;
+
+// Returns true when the asset's source file still exists and no longer
+// matches the hash it was baked from. Unknown hashes are never stale.
+auto is_source_stale(const std::string &originalFile, std::uint64_t sourceHash)
+    -> bool;
+
+} // namespace assets
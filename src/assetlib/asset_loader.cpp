@@ -1,6 +1,8 @@
 #include "asset_loader.hpp"
 #include <fstream>
 #include <cstring>
+#include <limits>
+#include <vector>
 
 auto assets::save_binaryfile(const std::filesystem::path &path,
                              const AssetFile &file) -> bool {
@@ -11,16 +13,16 @@ auto assets::save_binaryfile(const std::filesystem::path &path,
   // Version
   outfile.write((const char *)&version, sizeof(uint32_t));
 
-  // Json length
-  uint32_t length = static_cast<uint32_t>(file.json.size());
+  // Metadata length
+  uint32_t length = static_cast<uint32_t>(file.metadata.size());
   outfile.write((const char *)&length, sizeof(uint32_t));
 
   // Blob length
   uint32_t bloblength = static_cast<uint32_t>(file.binaryBlob.size());
   outfile.write((const char *)&bloblength, sizeof(uint32_t));
 
-  // Json stream
-  outfile.write(file.json.data(), length);
+  // Metadata
+  outfile.write(file.metadata.data(), length);
   // Blob data
   outfile.write(file.binaryBlob.data(), file.binaryBlob.size());
 
@@ -44,14 +46,14 @@ auto assets::load_binaryfile(const std::filesystem::path &path,
   infile.read(outputFile.type, 4);
   infile.read((char *)&outputFile.version, sizeof(uint32_t));
 
-  uint32_t jsonlen = 0;
-  infile.read((char *)&jsonlen, sizeof(uint32_t));
+  uint32_t metadatalen = 0;
+  infile.read((char *)&metadatalen, sizeof(uint32_t));
 
   uint32_t bloblen = 0;
   infile.read((char *)&bloblen, sizeof(uint32_t));
 
-  outputFile.json.resize(jsonlen);
-  infile.read(outputFile.json.data(), jsonlen);
+  outputFile.metadata.resize(metadatalen);
+  infile.read(outputFile.metadata.data(), metadatalen);
 
   outputFile.binaryBlob.resize(bloblen);
   infile.read(outputFile.binaryBlob.data(), bloblen);
@@ -59,10 +61,129 @@ auto assets::load_binaryfile(const std::filesystem::path &path,
   return true;
 }
 
+auto assets::load_binaryfile_header(const std::filesystem::path &path,
+                                    AssetFile &outputFile) -> bool {
+  std::ifstream infile;
+  infile.open(path, std::ios::binary);
+
+  if (!infile.is_open()) {
+    return false;
+  }
+
+  infile.read(outputFile.type, 4);
+  infile.read((char *)&outputFile.version, sizeof(uint32_t));
+
+  uint32_t metadatalen = 0;
+  infile.read((char *)&metadatalen, sizeof(uint32_t));
+
+  uint32_t bloblen = 0;
+  infile.read((char *)&bloblen, sizeof(uint32_t));
+
+  outputFile.metadata.resize(metadatalen);
+  infile.read(outputFile.metadata.data(), metadatalen);
+  outputFile.binaryBlob.clear();
+
+  return static_cast<bool>(infile);
+}
+
+auto assets::load_binaryfile_view(const std::filesystem::path &path,
+                                  AssetFileView &outputFile) -> bool {
+  if (!outputFile.file.open(path)) {
+    return false;
+  }
+
+  // Type, version, metadata length and blob length
+  constexpr size_t headerSize = 4 + 3 * sizeof(uint32_t);
+  const char *data = outputFile.file.data();
+  size_t size = outputFile.file.size();
+  if (size < headerSize) {
+    outputFile.file.close();
+    return false;
+  }
+
+  uint32_t version = 0;
+  uint32_t metadatalen = 0;
+  uint32_t bloblen = 0;
+  memcpy(outputFile.type, data, 4);
+  memcpy(&version, data + 4, sizeof(uint32_t));
+  memcpy(&metadatalen, data + 8, sizeof(uint32_t));
+  memcpy(&bloblen, data + 12, sizeof(uint32_t));
+
+  if (size - headerSize < static_cast<size_t>(metadatalen) + bloblen) {
+    outputFile.file.close();
+    return false;
+  }
+
+  outputFile.version = static_cast<int>(version);
+  outputFile.metadata = {data + headerSize, metadatalen};
+  outputFile.binaryBlob = {data + headerSize + metadatalen, bloblen};
+
+  outputFile.file.advise(AccessHint::Sequential, headerSize + metadatalen,
+                         bloblen);
+  return true;
+}
+
+auto assets::AssetFileWriter::open(const std::filesystem::path &path,
+                                   const char type[4], int version,
+                                   size_t metadataSize) -> bool {
+  memcpy(type_, type, 4);
+  version_ = version;
+  metadataSize_ = metadataSize;
+  blobSize_ = 0;
+
+  file_.open(path, std::ios::binary | std::ios::out | std::ios::trunc);
+  // Type, version, metadata length and blob length
+  std::vector<char> placeholder(4 + 3 * sizeof(uint32_t) + metadataSize, 0);
+  file_.write(placeholder.data(),
+              static_cast<std::streamsize>(placeholder.size()));
+  return static_cast<bool>(file_);
+}
+
+auto assets::AssetFileWriter::append(const char *data, size_t size) -> bool {
+  file_.write(data, static_cast<std::streamsize>(size));
+  blobSize_ += size;
+  return static_cast<bool>(file_);
+}
+
+auto assets::AssetFileWriter::finish(std::string_view metadata) -> bool {
+  if (metadata.size() != metadataSize_ ||
+      blobSize_ > std::numeric_limits<uint32_t>::max()) {
+    file_.close();
+    return false;
+  }
+
+  file_.seekp(0);
+  file_.write(type_, 4);
+  auto version = static_cast<uint32_t>(version_);
+  auto length = static_cast<uint32_t>(metadata.size());
+  auto bloblength = static_cast<uint32_t>(blobSize_);
+  file_.write((const char *)&version, sizeof(uint32_t));
+  file_.write((const char *)&length, sizeof(uint32_t));
+  file_.write((const char *)&bloblength, sizeof(uint32_t));
+  file_.write(metadata.data(), static_cast<std::streamsize>(metadata.size()));
+
+  bool ok = static_cast<bool>(file_);
+  file_.close();
+  return ok;
+}
+
 auto assets::parse_compression(const char *f) -> assets::CompressionMode {
   if (strcmp(f, "LZ4") == 0) {
     return assets::CompressionMode::LZ4;
+  } else if (strcmp(f, "LZ4_CHUNKED") == 0) {
+    return assets::CompressionMode::LZ4Chunked;
   } else {
     return assets::CompressionMode::None;
   }
 }
+
+auto assets::compression_name(CompressionMode mode) -> const char * {
+  switch (mode) {
+  case CompressionMode::LZ4:
+    return "LZ4";
+  case CompressionMode::LZ4Chunked:
+    return "LZ4_CHUNKED";
+  default:
+    return "None";
+  }
+}
@@ -1,22 +1,80 @@
 #pragma once
+#include "mapped_file.hpp"
+#include <cstdint>
 #include <filesystem>
+#include <fstream>
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace assets {
+// Version 1 files carry JSON metadata, version 2 files a fixed layout binary
+// header (see MeshMetadata and TextureMetadata) that is read with one copy.
+// Both are still accepted by the readers.
+constexpr int asset_json_version = 1;
+constexpr int asset_binary_version = 2;
+
 struct AssetFile {
   char type[4];
   int version;
-  std::string json;
+  std::string metadata;
   std::vector<char> binaryBlob;
 };
-enum class CompressionMode : uint32_t { None, LZ4 };
+// Asset file read through a memory mapping: metadata and binaryBlob point into
+// the mapped file and stay valid while the view lives. Views served by an
+// Archive leave file closed and point into the archive's mapping instead.
+struct AssetFileView {
+  char type[4];
+  int version;
+  std::string_view metadata;
+  std::span<const char> binaryBlob;
+  MappedFile file;
+};
+
+enum class CompressionMode : uint32_t {
+  None,
+  LZ4,       // One LZ4 block
+  LZ4Chunked // Independent LZ4 blocks, see BlobChunks
+};
 
 auto save_binaryfile(const std::filesystem::path &path, const AssetFile &file)
     -> bool;
 auto load_binaryfile(const std::filesystem::path &path, AssetFile &outputFile)
     -> bool;
+// Reads the header and metadata only, leaving binaryBlob empty
+auto load_binaryfile_header(const std::filesystem::path &path,
+                            AssetFile &outputFile) -> bool;
+
+// Maps the file and checks its header, without reading or copying the blob.
+// The blob is advised for sequential access.
+auto load_binaryfile_view(const std::filesystem::path &path,
+                          AssetFileView &outputFile) -> bool;
+
+// Writes an asset file whose blob is too large to hold in memory. The blob
+// is appended piece by piece after room left for the metadata, which is
+// written by finish() once the blob, and with it the metadata, is complete.
+class AssetFileWriter {
+public:
+  // Leaves metadataSize bytes for the metadata
+  auto open(const std::filesystem::path &path, const char type[4],
+            int version, size_t metadataSize) -> bool;
+  auto append(const char *data, size_t size) -> bool;
+  // Writes the header and the metadata, which has to be the size passed to
+  // open(). Fails when the blob is over the 4 GB a file can hold.
+  auto finish(std::string_view metadata) -> bool;
+
+  [[nodiscard]] auto blob_size() const -> std::uint64_t { return blobSize_; }
+
+private:
+  std::ofstream file_;
+  char type_[4] = {};
+  int version_ = 0;
+  size_t metadataSize_ = 0;
+  std::uint64_t blobSize_ = 0;
+};
 
 auto parse_compression(const char *f) -> assets::CompressionMode;
+auto compression_name(CompressionMode mode) -> const char *;
 
 } // namespace assets
\ No newline at end of file
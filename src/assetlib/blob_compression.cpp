@@ -0,0 +1,141 @@
+#include "blob_compression.hpp"
+#include "job_system.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <lz4.h>
+#include <lz4hc.h>
+
+auto assets::compress_chunked(const char *source, size_t size,
+                              CompressionLevel level, std::vector<char> &blob,
+                              JobSystem *jobs) -> BlobChunks {
+  size_t chunkCount = (size + blob_chunk_size - 1) / blob_chunk_size;
+
+  // Every job compresses a run of whole chunks into a blob of its own, the
+  // runs are joined in order so the result is the same as on one thread
+  if (jobs != nullptr && chunkCount > 1) {
+    size_t runLength = (chunkCount + jobs->thread_count() - 1) /
+                       jobs->thread_count() * blob_chunk_size;
+    size_t runCount = (size + runLength - 1) / runLength;
+    std::vector<std::vector<char>> blobs(runCount);
+    std::vector<BlobChunks> runs(runCount);
+    jobs->parallel_for(runCount, [&](size_t i) {
+      size_t offset = i * runLength;
+      runs[i] = compress_chunked(source + offset,
+                                 std::min(runLength, size - offset), level,
+                                 blobs[i]);
+    });
+
+    BlobChunks chunks;
+    chunks.chunkSize = static_cast<std::uint32_t>(blob_chunk_size);
+    for (size_t i = 0; i != runCount; ++i) {
+      blob.insert(blob.end(), blobs[i].begin(), blobs[i].end());
+      chunks.compressedSizes.insert(chunks.compressedSizes.end(),
+                                    runs[i].compressedSizes.begin(),
+                                    runs[i].compressedSizes.end());
+    }
+    return chunks;
+  }
+
+  BlobChunks chunks;
+  chunks.chunkSize = static_cast<std::uint32_t>(blob_chunk_size);
+  chunks.compressedSizes.reserve(chunkCount);
+  auto chunkBound = static_cast<size_t>(
+      LZ4_compressBound(static_cast<int>(std::min(size, blob_chunk_size))));
+  blob.reserve(blob.size() + chunkBound * chunkCount);
+
+  for (size_t offset = 0; offset < size; offset += blob_chunk_size) {
+    auto chunkSize = static_cast<int>(std::min(blob_chunk_size, size - offset));
+    int bound = LZ4_compressBound(chunkSize);
+    size_t start = blob.size();
+    blob.resize(start + bound);
+
+    int compressedSize =
+        level == CompressionLevel::High
+            ? LZ4_compress_HC(source + offset, blob.data() + start, chunkSize,
+                              bound, LZ4HC_CLEVEL_DEFAULT)
+            : LZ4_compress_default(source + offset, blob.data() + start,
+                                   chunkSize, bound);
+    blob.resize(start + compressedSize);
+    chunks.compressedSizes.push_back(
+        static_cast<std::uint32_t>(compressedSize));
+  }
+
+  return chunks;
+}
+
+void assets::write_chunk_table(const BlobChunks &chunks,
+                               std::string &metadata) {
+  metadata.resize((metadata.size() + 3) & ~size_t{3}, '\0');
+
+  auto chunkCount = static_cast<std::uint32_t>(chunks.compressedSizes.size());
+  size_t offset = metadata.size();
+  metadata.resize(offset + (2 + chunkCount) * sizeof(std::uint32_t));
+  memcpy(metadata.data() + offset, &chunks.chunkSize, sizeof(std::uint32_t));
+  memcpy(metadata.data() + offset + 4, &chunkCount, sizeof(std::uint32_t));
+  memcpy(metadata.data() + offset + 8, chunks.compressedSizes.data(),
+         chunkCount * sizeof(std::uint32_t));
+}
+
+auto assets::read_chunk_table(std::string_view metadata, size_t offset,
+                              BlobChunks &chunks) -> bool {
+  offset = (offset + 3) & ~size_t{3};
+  std::uint32_t chunkCount = 0;
+  if (metadata.size() < offset + 2 * sizeof(std::uint32_t)) {
+    return false;
+  }
+  memcpy(&chunks.chunkSize, metadata.data() + offset, sizeof(std::uint32_t));
+  memcpy(&chunkCount, metadata.data() + offset + 4, sizeof(std::uint32_t));
+
+  offset += 2 * sizeof(std::uint32_t);
+  if ((metadata.size() - offset) / sizeof(std::uint32_t) < chunkCount) {
+    return false;
+  }
+  chunks.compressedSizes.resize(chunkCount);
+  memcpy(chunks.compressedSizes.data(), metadata.data() + offset,
+         chunkCount * sizeof(std::uint32_t));
+  return true;
+}
+
+auto assets::decompress_chunked(const BlobChunks &chunks, const char *source,
+                                size_t sourceSize, char *destination,
+                                size_t size, JobSystem *jobs) -> bool {
+  size_t chunkCount = chunks.compressedSizes.size();
+  if (chunks.chunkSize == 0 ||
+      chunkCount != (size + chunks.chunkSize - 1) / chunks.chunkSize) {
+    return false;
+  }
+
+  // Prefix sums of the compressed sizes locate every chunk in the blob
+  std::vector<size_t> offsets(chunkCount + 1, 0);
+  for (size_t i = 0; i != chunkCount; ++i) {
+    offsets[i + 1] = offsets[i] + chunks.compressedSizes[i];
+  }
+  if (offsets.back() != sourceSize) {
+    return false;
+  }
+
+  std::atomic<bool> valid{true};
+  auto decode = [&](size_t chunk) {
+    size_t offset = chunk * chunks.chunkSize;
+    auto expected = static_cast<int>(
+        std::min<size_t>(chunks.chunkSize, size - offset));
+    int decompressed = LZ4_decompress_safe(
+        source + offsets[chunk], destination + offset,
+        static_cast<int>(chunks.compressedSizes[chunk]), expected);
+    if (decompressed != expected) {
+      valid.store(false, std::memory_order_relaxed);
+    }
+  };
+
+  if (jobs != nullptr && chunkCount > 1) {
+    jobs->parallel_for(chunkCount, decode);
+  } else {
+    for (size_t i = 0; i != chunkCount; ++i) {
+      decode(i);
+    }
+  }
+
+  return valid.load(std::memory_order_relaxed);
+}
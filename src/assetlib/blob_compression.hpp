@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace assets {
+
+class JobSystem;
+
+// Uncompressed size of every chunk of a chunked blob but the last one. Small
+// enough to spread a big texture over every core, large enough that LZ4
+// still finds its matches.
+constexpr size_t blob_chunk_size = 256 * 1024;
+
+// LZ4 packs fast, LZ4HC packs several times slower into smaller blobs. Both
+// decode at the same speed.
+enum class CompressionLevel : uint32_t { Fast, High };
+
+// Chunk table of a CompressionMode::LZ4Chunked blob. The chunks are
+// independent LZ4 blocks stored back to back, so they decode in any order.
+struct BlobChunks {
+  std::uint32_t chunkSize = 0;
+  std::vector<std::uint32_t> compressedSizes;
+};
+
+// Compresses size bytes in chunks of blob_chunk_size, appended to blob. The
+// chunks are spread over jobs when it's not null.
+auto compress_chunked(const char *source, size_t size, CompressionLevel level,
+                      std::vector<char> &blob, JobSystem *jobs = nullptr)
+    -> BlobChunks;
+
+// Appends the table to version 2 metadata, 4 byte aligned:
+//   uint32_t chunkSize, uint32_t chunkCount, uint32_t compressedSizes[]
+void write_chunk_table(const BlobChunks &chunks, std::string &metadata);
+// Reads a table written by write_chunk_table at offset, before alignment
+auto read_chunk_table(std::string_view metadata, size_t offset,
+                      BlobChunks &chunks) -> bool;
+
+// Decompresses a chunked blob into destination, which holds size bytes. The
+// chunks are spread over jobs when it's not null. Returns false when the
+// blob doesn't match the table.
+auto decompress_chunked(const BlobChunks &chunks, const char *source,
+                        size_t sourceSize, char *destination, size_t size,
+                        JobSystem *jobs = nullptr) -> bool;
+
+} // namespace assets
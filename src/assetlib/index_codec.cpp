@@ -0,0 +1,262 @@
+#include "index_codec.hpp"
+
+#include <array>
+#include <cstring>
+
+namespace {
+
+struct Edge {
+  uint32_t a;
+  uint32_t b;
+};
+
+// Most recent triangle edges, the code byte has room for 15 slots and one
+// escape value
+constexpr unsigned edge_fifo_size = 15;
+constexpr uint8_t no_edge = 0xF;
+
+class EdgeFifo {
+public:
+  EdgeFifo() { edges_.fill({~0U, ~0U}); }
+
+  void push(uint32_t a, uint32_t b) {
+    edges_[head_++ % edges_.size()] = {a, b};
+  }
+
+  // Slot 0 is the newest edge
+  [[nodiscard]] auto at(unsigned slot) const -> const Edge & {
+    return edges_[(head_ - 1 - slot) % edges_.size()];
+  }
+
+  [[nodiscard]] auto find(uint32_t a, uint32_t b) const -> int {
+    for (unsigned slot = 0; slot != edge_fifo_size; ++slot) {
+      const Edge &edge = at(slot);
+      if (edge.a == a && edge.b == b) {
+        return static_cast<int>(slot);
+      }
+    }
+    return -1;
+  }
+
+private:
+  std::array<Edge, 16> edges_{};
+  unsigned head_ = 0;
+};
+
+// Vertex indices are predicted from the previous one and from the lowest
+// index never seen, which is what vertex fetch optimized meshes use next
+struct Predictor {
+  uint32_t last = 0;
+  uint32_t next = 0;
+
+  void update(uint32_t vertex) {
+    last = vertex;
+    if (vertex >= next) {
+      next = vertex + 1;
+    }
+  }
+};
+
+auto zigzag(uint32_t delta) -> uint32_t {
+  auto value = static_cast<int32_t>(delta);
+  return (static_cast<uint32_t>(value) << 1) ^
+         static_cast<uint32_t>(value >> 31);
+}
+
+auto unzigzag(uint32_t value) -> uint32_t {
+  return (value >> 1) ^ (0U - (value & 1));
+}
+
+void write_varint(std::vector<char> &out, uint32_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+class Reader {
+public:
+  Reader(const char *data, size_t size) : data_{data}, size_{size} {}
+
+  auto byte(uint8_t &value) -> bool {
+    if (offset_ == size_) {
+      return false;
+    }
+    value = static_cast<uint8_t>(data_[offset_++]);
+    return true;
+  }
+
+  auto varint(uint32_t &value) -> bool {
+    value = 0;
+    for (unsigned shift = 0; shift < 35; shift += 7) {
+      uint8_t b = 0;
+      if (!byte(b)) {
+        return false;
+      }
+      value |= static_cast<uint32_t>(b & 0x7F) << shift;
+      if ((b & 0x80) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+private:
+  const char *data_;
+  size_t size_;
+  size_t offset_ = 0;
+};
+
+} // namespace
+
+auto assets::parse_index_encoding(const char *f) -> IndexEncoding {
+  if (strcmp(f, "TRIANGLE") == 0) {
+    return IndexEncoding::Triangle;
+  }
+  return IndexEncoding::Raw;
+}
+
+auto assets::index_size_for(size_t vertexCount) -> char {
+  return vertexCount < 65536 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+auto assets::encode_indices(std::span<const uint32_t> indices)
+    -> std::vector<char> {
+  std::vector<char> out;
+  out.reserve(indices.size() / 2);
+
+  EdgeFifo fifo;
+  Predictor predictor;
+
+  for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+    const uint32_t *triangle = &indices[t];
+
+    // Rotate the triangle so it starts with an edge a recent triangle shares.
+    // Neighbours with the same winding walk the edge the other way.
+    int slot = -1;
+    int rotation = 0;
+    for (; rotation != 3; ++rotation) {
+      uint32_t x = triangle[rotation];
+      uint32_t y = triangle[(rotation + 1) % 3];
+      slot = fifo.find(y, x);
+      if (slot >= 0) {
+        break;
+      }
+    }
+
+    std::array<uint32_t, 3> vertices{};
+    if (slot >= 0) {
+      vertices = {triangle[rotation], triangle[(rotation + 1) % 3],
+                  triangle[(rotation + 2) % 3]};
+      uint32_t third = vertices[2];
+      bool isNext = third == predictor.next;
+
+      out.push_back(static_cast<char>((slot << 4) | (isNext ? 0 : 1)));
+      if (!isNext) {
+        write_varint(out, zigzag(third - predictor.last));
+      }
+      predictor.update(third);
+    } else {
+      vertices = {triangle[0], triangle[1], triangle[2]};
+
+      size_t codeOffset = out.size();
+      out.push_back(0);
+      uint8_t nextFlags = 0;
+      for (int i = 0; i != 3; ++i) {
+        if (vertices[i] == predictor.next) {
+          nextFlags |= 1 << i;
+        } else {
+          write_varint(out, zigzag(vertices[i] - predictor.last));
+        }
+        predictor.update(vertices[i]);
+      }
+      out[codeOffset] = static_cast<char>((no_edge << 4) | nextFlags);
+    }
+
+    fifo.push(vertices[0], vertices[1]);
+    fifo.push(vertices[1], vertices[2]);
+    fifo.push(vertices[2], vertices[0]);
+  }
+
+  return out;
+}
+
+auto assets::decode_indices(const char *source, size_t sourceSize,
+                            char *indexBuffer, size_t indexCount,
+                            size_t indexSize) -> bool {
+  if (indexCount % 3 != 0 || (indexSize != 2 && indexSize != 4)) {
+    return false;
+  }
+
+  auto store = [&](size_t i, uint32_t vertex) {
+    if (indexSize == sizeof(uint16_t)) {
+      if (vertex > 0xFFFF) {
+        return false;
+      }
+      auto value = static_cast<uint16_t>(vertex);
+      memcpy(indexBuffer + i * indexSize, &value, sizeof(value));
+    } else {
+      memcpy(indexBuffer + i * indexSize, &vertex, sizeof(vertex));
+    }
+    return true;
+  };
+
+  Reader reader(source, sourceSize);
+  EdgeFifo fifo;
+  Predictor predictor;
+
+  for (size_t t = 0; t != indexCount; t += 3) {
+    uint8_t code = 0;
+    if (!reader.byte(code)) {
+      return false;
+    }
+
+    unsigned slot = code >> 4;
+    std::array<uint32_t, 3> vertices{};
+    if (slot != no_edge) {
+      const Edge &edge = fifo.at(slot);
+      if (edge.a == ~0U) {
+        return false;
+      }
+      vertices[0] = edge.b;
+      vertices[1] = edge.a;
+
+      if ((code & 1) == 0) {
+        vertices[2] = predictor.next;
+      } else {
+        uint32_t delta = 0;
+        if (!reader.varint(delta)) {
+          return false;
+        }
+        vertices[2] = predictor.last + unzigzag(delta);
+      }
+      predictor.update(vertices[2]);
+    } else {
+      for (int i = 0; i != 3; ++i) {
+        if ((code & (1 << i)) != 0) {
+          vertices[i] = predictor.next;
+        } else {
+          uint32_t delta = 0;
+          if (!reader.varint(delta)) {
+            return false;
+          }
+          vertices[i] = predictor.last + unzigzag(delta);
+        }
+        predictor.update(vertices[i]);
+      }
+    }
+
+    for (int i = 0; i != 3; ++i) {
+      if (!store(t + i, vertices[i])) {
+        return false;
+      }
+    }
+
+    fifo.push(vertices[0], vertices[1]);
+    fifo.push(vertices[1], vertices[2]);
+    fifo.push(vertices[2], vertices[0]);
+  }
+
+  return true;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace assets {
+
+enum class IndexEncoding : uint32_t {
+  Raw,     // Indices stored as they are, indexSize bytes each
+  Triangle // Triangle list encoded with encode_indices
+};
+
+auto parse_index_encoding(const char *f) -> IndexEncoding;
+
+// Index size the mesh needs: 2 bytes when every vertex fits a uint16_t
+auto index_size_for(size_t vertexCount) -> char;
+
+// Encodes a triangle list into a byte stream that LZ4 compresses much better
+// than raw indices. Triangles that share an edge with a recent one cost a
+// code byte plus the third vertex, written either as "next unseen vertex" or
+// as a zigzag varint delta. Meshes optimized for vertex fetch mostly need a
+// single byte per triangle.
+//
+// Decoded triangles may come back rotated, their winding is kept.
+auto encode_indices(std::span<const uint32_t> indices) -> std::vector<char>;
+
+// Decodes indexCount indices of indexSize bytes (2 or 4) into indexBuffer.
+// Returns false when the stream is malformed.
+auto decode_indices(const char *source, size_t sourceSize, char *indexBuffer,
+                    size_t indexCount, size_t indexSize) -> bool;
+
+} // namespace assets
@@ -0,0 +1,182 @@
+#include "job_system.hpp"
+
+#include <algorithm>
+
+namespace assets {
+
+namespace {
+// Index of the worker running on the current thread, used so that jobs
+// submitted from inside a job land on the local queue
+thread_local unsigned currentWorker = ~0U;
+} // namespace
+
+JobSystem::JobSystem(unsigned threadCount) {
+  threadCount = std::max(threadCount, 1U);
+
+  queues_.reserve(threadCount);
+  for (unsigned i = 0; i != threadCount; ++i) {
+    queues_.push_back(std::make_unique<WorkerQueue>());
+  }
+
+  workers_.reserve(threadCount);
+  for (unsigned i = 0; i != threadCount; ++i) {
+    workers_.emplace_back([this, i]() { worker_loop(i); });
+  }
+}
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard lock(stateMutex_);
+    stopping_ = true;
+  }
+  wakeCondition_.notify_all();
+
+  for (auto &&worker : workers_) {
+    worker.join();
+  }
+}
+
+void JobSystem::submit(std::function<void()> &&job) {
+  unsigned index = currentWorker;
+  bool local = index < queues_.size();
+  if (!local) {
+    // Submitted from outside: spread the jobs round-robin
+    index = nextQueue_.fetch_add(1, std::memory_order_relaxed) %
+            static_cast<unsigned>(queues_.size());
+  }
+
+  pending_.fetch_add(1, std::memory_order_relaxed);
+  {
+    std::lock_guard lock(queues_[index]->mutex);
+    (local ? queues_[index]->jobs : queues_[index]->submitted)
+        .push_back(std::move(job));
+  }
+
+  // Take the state lock so a worker can't miss the wakeup between checking
+  // the queues and going to sleep
+  { std::lock_guard lock(stateMutex_); }
+  wakeCondition_.notify_one();
+}
+
+void JobSystem::wait() {
+  std::unique_lock lock(stateMutex_);
+  doneCondition_.wait(
+      lock, [this]() { return pending_.load(std::memory_order_acquire) == 0; });
+}
+
+void JobSystem::parallel_for(size_t count,
+                             const std::function<void(size_t)> &body) {
+  if (count == 0) {
+    return;
+  }
+
+  struct Batch {
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    std::mutex mutex;
+    std::condition_variable finished;
+  };
+  auto batch = std::make_shared<Batch>();
+
+  // Helpers that only get to run after every index was taken return without
+  // touching body, which is gone by then
+  auto run = [batch, count, &body]() {
+    size_t index = 0;
+    while ((index = batch->next.fetch_add(1, std::memory_order_relaxed)) <
+           count) {
+      body(index);
+      if (batch->done.fetch_add(1, std::memory_order_acq_rel) + 1 == count) {
+        std::lock_guard lock(batch->mutex);
+        batch->finished.notify_all();
+      }
+    }
+  };
+
+  size_t helpers = std::min<size_t>(count, workers_.size() + 1) - 1;
+  for (size_t i = 0; i != helpers; ++i) {
+    submit(run);
+  }
+  run();
+
+  std::unique_lock lock(batch->mutex);
+  batch->finished.wait(lock, [&batch, count]() {
+    return batch->done.load(std::memory_order_acquire) == count;
+  });
+}
+
+auto JobSystem::thread_count() const -> unsigned {
+  return static_cast<unsigned>(workers_.size());
+}
+
+auto JobSystem::try_pop(unsigned index, std::function<void()> &job) -> bool {
+  // Own queue first: the newest job it submitted itself, then the oldest
+  // one submitted from outside
+  {
+    auto &queue = *queues_[index];
+    std::lock_guard lock(queue.mutex);
+    if (!queue.jobs.empty()) {
+      job = std::move(queue.jobs.back());
+      queue.jobs.pop_back();
+      return true;
+    }
+    if (!queue.submitted.empty()) {
+      job = std::move(queue.submitted.front());
+      queue.submitted.pop_front();
+      return true;
+    }
+  }
+
+  // Steal the oldest job from somebody else, outside submissions first
+  auto count = static_cast<unsigned>(queues_.size());
+  for (unsigned offset = 1; offset != count; ++offset) {
+    auto &victim = *queues_[(index + offset) % count];
+    std::lock_guard lock(victim.mutex);
+    auto &jobs = victim.submitted.empty() ? victim.jobs : victim.submitted;
+    if (!jobs.empty()) {
+      job = std::move(jobs.front());
+      jobs.pop_front();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void JobSystem::worker_loop(unsigned index) {
+  currentWorker = index;
+
+  std::function<void()> job;
+  while (true) {
+    if (try_pop(index, job)) {
+      job();
+      job = nullptr;
+
+      if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        std::lock_guard lock(stateMutex_);
+        doneCondition_.notify_all();
+      }
+      continue;
+    }
+
+    std::unique_lock lock(stateMutex_);
+    if (stopping_) {
+      return;
+    }
+
+    // Re-check the queues under the state lock, submit() takes it before
+    // notifying
+    bool hasWork = false;
+    for (auto &&queue : queues_) {
+      std::lock_guard queueLock(queue->mutex);
+      if (!queue->empty()) {
+        hasWork = true;
+        break;
+      }
+    }
+    if (!hasWork) {
+      wakeCondition_.wait(lock);
+    }
+  }
+}
+
+} // namespace assets
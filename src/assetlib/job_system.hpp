@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace assets {
+
+// Work-stealing job system. Every worker owns two deques: jobs submitted from
+// outside run in the order they came in, so callers can put long jobs (big
+// meshes) first, and jobs a worker submits itself run newest first. A worker
+// that runs dry steals the oldest jobs of the others, so long jobs don't
+// leave the other cores idle.
+class JobSystem {
+public:
+  explicit JobSystem(unsigned threadCount);
+  ~JobSystem();
+
+  JobSystem(const JobSystem &) = delete;
+  JobSystem(JobSystem &&other) noexcept = delete;
+  auto operator=(const JobSystem &) -> const JobSystem & = delete;
+  auto operator=(JobSystem &&other) noexcept -> JobSystem & = delete;
+
+  void submit(std::function<void()> &&job);
+
+  // Blocks until every submitted job has finished
+  void wait();
+
+  // Runs body(i) for every i in [0, count) on the workers and the calling
+  // thread, and returns once all of them are done. Unlike wait() it only
+  // waits for its own work, so it can be called from inside a job.
+  void parallel_for(size_t count, const std::function<void(size_t)> &body);
+
+  [[nodiscard]] auto thread_count() const -> unsigned;
+
+private:
+  struct WorkerQueue {
+    std::mutex mutex;
+    // Submitted from outside, popped from the front
+    std::deque<std::function<void()>> submitted;
+    // Submitted by the worker's own jobs, popped from the back
+    std::deque<std::function<void()>> jobs;
+
+    [[nodiscard]] auto empty() const -> bool {
+      return submitted.empty() && jobs.empty();
+    }
+  };
+
+  void worker_loop(unsigned index);
+  auto try_pop(unsigned index, std::function<void()> &job) -> bool;
+
+  std::vector<std::unique_ptr<WorkerQueue>> queues_;
+  std::vector<std::thread> workers_;
+
+  std::atomic<size_t> pending_{0};
+  std::atomic<unsigned> nextQueue_{0};
+
+  std::mutex stateMutex_;
+  std::condition_variable wakeCondition_;
+  std::condition_variable doneCondition_;
+  bool stopping_{false};
+};
+
+} // namespace assets
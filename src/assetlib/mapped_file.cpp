@@ -0,0 +1,168 @@
+#include "mapped_file.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace assets {
+
+MappedFile::~MappedFile() { close(); }
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : data_{std::exchange(other.data_, nullptr)},
+      size_{std::exchange(other.size_, 0)}
+#ifdef _WIN32
+      ,
+      mapping_{std::exchange(other.mapping_, nullptr)}
+#endif
+{
+}
+
+auto MappedFile::operator=(MappedFile &&other) noexcept -> MappedFile & {
+  if (this != &other) {
+    close();
+    data_ = std::exchange(other.data_, nullptr);
+    size_ = std::exchange(other.size_, 0);
+#ifdef _WIN32
+    mapping_ = std::exchange(other.mapping_, nullptr);
+#endif
+  }
+  return *this;
+}
+
+#ifdef _WIN32
+
+auto MappedFile::open(const std::filesystem::path &path) -> bool {
+  close();
+
+  HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            nullptr, OPEN_EXISTING,
+                            FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+
+  LARGE_INTEGER fileSize;
+  if (GetFileSizeEx(file, &fileSize) == 0 || fileSize.QuadPart == 0) {
+    CloseHandle(file);
+    return false;
+  }
+
+  // The mapping keeps the file open on its own
+  HANDLE mapping =
+      CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(file);
+  if (mapping == nullptr) {
+    return false;
+  }
+
+  void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (view == nullptr) {
+    CloseHandle(mapping);
+    return false;
+  }
+
+  data_ = static_cast<const char *>(view);
+  size_ = static_cast<size_t>(fileSize.QuadPart);
+  mapping_ = mapping;
+  return true;
+}
+
+void MappedFile::close() {
+  if (data_ != nullptr) {
+    UnmapViewOfFile(data_);
+    CloseHandle(mapping_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+  mapping_ = nullptr;
+}
+
+void MappedFile::advise(AccessHint hint, size_t offset, size_t length) const {
+  if (data_ == nullptr || offset >= size_ || hint != AccessHint::WillNeed) {
+    return;
+  }
+  WIN32_MEMORY_RANGE_ENTRY range{
+      .VirtualAddress = const_cast<char *>(data_ + offset),
+      .NumberOfBytes = std::min(length, size_ - offset)};
+  PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
+
+#else
+
+auto MappedFile::open(const std::filesystem::path &path) -> bool {
+  close();
+
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat fileStat {};
+  if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+    ::close(fd);
+    return false;
+  }
+
+  auto fileSize = static_cast<size_t>(fileStat.st_size);
+  void *view = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping keeps the file open on its own
+  ::close(fd);
+  if (view == MAP_FAILED) {
+    return false;
+  }
+
+  data_ = static_cast<const char *>(view);
+  size_ = fileSize;
+  return true;
+}
+
+void MappedFile::close() {
+  if (data_ != nullptr) {
+    munmap(const_cast<char *>(data_), size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+}
+
+void MappedFile::advise(AccessHint hint, size_t offset, size_t length) const {
+  if (data_ == nullptr || offset >= size_) {
+    return;
+  }
+
+  // madvise wants a page aligned start
+  auto pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size_t alignedOffset = offset / pageSize * pageSize;
+  size_t alignedLength = std::min(length, size_ - offset) + offset -
+                         alignedOffset;
+
+  int advice = MADV_NORMAL;
+  switch (hint) {
+  case AccessHint::Normal:
+    advice = MADV_NORMAL;
+    break;
+  case AccessHint::Sequential:
+    advice = MADV_SEQUENTIAL;
+    break;
+  case AccessHint::WillNeed:
+    advice = MADV_WILLNEED;
+    break;
+  case AccessHint::DontNeed:
+    advice = MADV_DONTNEED;
+    break;
+  }
+  madvise(const_cast<char *>(data_ + alignedOffset), alignedLength, advice);
+}
+
+#endif
+
+} // namespace assets
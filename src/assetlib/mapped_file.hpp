@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <filesystem>
+#include <span>
+
+namespace assets {
+
+// How a mapped range is going to be read, forwarded to madvise
+enum class AccessHint {
+  Normal,
+  Sequential, // Read front to back once, read ahead aggressively
+  WillNeed,   // Start paging the range in now
+  DontNeed    // Done with the range, its pages can be dropped
+};
+
+// Read only memory mapping of a whole file. Pages are only read from the
+// page cache when touched, nothing is copied to the heap.
+class MappedFile {
+public:
+  MappedFile() = default;
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  auto operator=(const MappedFile &) -> MappedFile & = delete;
+  MappedFile(MappedFile &&other) noexcept;
+  auto operator=(MappedFile &&other) noexcept -> MappedFile &;
+
+  auto open(const std::filesystem::path &path) -> bool;
+  void close();
+
+  // Hint for a range of the file, a no-op where unsupported
+  void advise(AccessHint hint, size_t offset = 0,
+              size_t length = static_cast<size_t>(-1)) const;
+
+  [[nodiscard]] auto data() const -> const char * { return data_; }
+  [[nodiscard]] auto size() const -> size_t { return size_; }
+  [[nodiscard]] auto bytes() const -> std::span<const char> {
+    return {data_, size_};
+  }
+  [[nodiscard]] auto is_open() const -> bool { return data_ != nullptr; }
+
+private:
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+#ifdef _WIN32
+  void *mapping_ = nullptr;
+#endif
+};
+
+} // namespace assets
@@ -1,5 +1,11 @@
 #include "mesh_asset.hpp"
 
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <nlohmann/json.hpp>
+
 auto assets::parse_format(const char *f) -> VertexFormat {
   if (strcmp(f, "PNCV_F32") == 0) {
     return assets::VertexFormat::PNCV_F32;
@@ -10,19 +16,39 @@ auto assets::parse_format(const char *f) -> VertexFormat {
   return assets::VertexFormat::Unknown;
 }
 
-auto assets::read_mesh_info(AssetFile *file) -> MeshInfo {
-  nlohmann::json metadata = nlohmann::json::parse(file->json);
+namespace {
+
+auto vertex_format_name(assets::VertexFormat format) -> const char * {
+  switch (format) {
+  case assets::VertexFormat::PNCV_F32:
+    return "PNCV_F32";
+  case assets::VertexFormat::P32N8C8V16:
+    return "P32N8C8V16";
+  default:
+    return "UNKNOWN";
+  }
+}
+
+// Version 1 files, and the debug sidecar written by mesh_info_to_json
+auto read_mesh_info_json(std::string_view json) -> assets::MeshInfo {
+  nlohmann::json metadata = nlohmann::json::parse(json.begin(), json.end());
 
   std::string compressionString = metadata["compression"];
   std::string vertexFormat = metadata["vertex_format"];
 
-  MeshInfo info = {.vertexBufferSize = metadata["vertex_buffer_size"],
-                   .indexBufferSize = metadata["index_buffer_size"],
-                   .vertexFormat = parse_format(vertexFormat.c_str()),
-                   .indexSize = static_cast<int8_t>(metadata["index_size"]),
-                   .compressionMode =
-                       parse_compression(compressionString.c_str()),
-                   .originalFile = metadata["original_file"]};
+  assets::MeshInfo info = {
+      .vertexBufferSize = metadata["vertex_buffer_size"],
+      .indexBufferSize = metadata["index_buffer_size"],
+      .lods = {},
+      .submeshes = {},
+      .bounds = {},
+      .vertexFormat = assets::parse_format(vertexFormat.c_str()),
+      .indexSize = static_cast<int8_t>(metadata["index_size"]),
+      .compressionMode = assets::parse_compression(compressionString.c_str()),
+      .chunks = {},
+      .originalFile = metadata["original_file"],
+      .sourceHash = assets::hash_from_string(
+          metadata.value("source_hash", std::string{}))};
 
   auto boundsData = metadata["bounds"].get<std::vector<float>>();
 
@@ -33,33 +59,309 @@ auto assets::read_mesh_info(AssetFile *file) -> MeshInfo {
 
   info.bounds.radius = boundsData[3];
 
+  // Older files only have raw indices
+  info.indexEncoding = assets::parse_index_encoding(
+      metadata.value("index_encoding", std::string{"RAW"}).c_str());
+  info.encodedIndexSize =
+      metadata.value("encoded_index_size", info.indexBufferSize);
+
+  // Meshlets are optional, older files don't have them
+  info.meshletCount = metadata.value("meshlet_count", 0U);
+  info.meshletVertexCount = metadata.value("meshlet_vertex_count", 0U);
+  info.meshletBufferSize =
+      metadata.value("meshlet_buffer_size", std::uint64_t{0});
+
+  if (metadata.contains("lods")) {
+    for (auto &&lod : metadata["lods"]) {
+      info.lods.push_back({.firstIndex = lod["first_index"],
+                           .indexCount = lod["index_count"],
+                           .error = lod["error"]});
+    }
+  }
+
+  if (metadata.contains("submeshes")) {
+    for (auto &&submesh : metadata["submeshes"]) {
+      info.submeshes.push_back({.firstIndex = submesh["first_index"],
+                                .indexCount = submesh["index_count"],
+                                .material = submesh["material"]});
+    }
+  }
+
+  // Only debug sidecars of chunked blobs have a chunk table
+  if (metadata.contains("chunk_sizes")) {
+    info.chunks.chunkSize = metadata["chunk_size"];
+    info.chunks.compressedSizes =
+        metadata["chunk_sizes"].get<std::vector<std::uint32_t>>();
+  }
+
+  return info;
+}
+
+// Bytes the vertices, encoded indices and meshlets of a mesh decompress to.
+// Out of core bakes write meshes of more than 2 GB, so this never narrows.
+constexpr auto blob_size(std::uint64_t vertexBufferSize,
+                         std::uint64_t encodedIndexSize,
+                         std::uint64_t meshletBufferSize) -> size_t {
+  return vertexBufferSize + encodedIndexSize + meshletBufferSize;
+}
+
+static_assert(blob_size(std::uint64_t{2} << 30, std::uint64_t{1} << 30, 64) ==
+              (std::uint64_t{3} << 30) + 64);
+static_assert(blob_size(INT_MAX, 1, 0) > INT_MAX);
+
+} // namespace
+
+auto assets::read_mesh_info(AssetFile *file) -> MeshInfo {
+  return read_mesh_info(file->version, std::string_view{file->metadata});
+}
+
+auto assets::read_mesh_info(const AssetFileView *file) -> MeshInfo {
+  return read_mesh_info(file->version, file->metadata);
+}
+
+auto assets::read_mesh_info(int version, std::string_view metadata)
+    -> MeshInfo {
+  if (version == asset_json_version) {
+    return read_mesh_info_json(metadata);
+  }
+
+  MeshInfo info{};
+  info.vertexFormat = VertexFormat::Unknown;
+
+  MeshMetadata header;
+  if (version != asset_binary_version || metadata.size() < sizeof(header)) {
+    return info;
+  }
+  memcpy(&header, metadata.data(), sizeof(header));
+  // Files from before submeshes have a zero there
+  size_t submeshesSize = size_t{header.submeshCount} * sizeof(MeshSubmesh);
+  if (header.lodCount > max_mesh_lods ||
+      (metadata.size() - sizeof(header)) / sizeof(MeshSubmesh) <
+          header.submeshCount ||
+      metadata.size() - sizeof(header) - submeshesSize <
+          header.originalFileSize) {
+    return info;
+  }
+
+  info.vertexBufferSize = header.vertexBufferSize;
+  info.indexBufferSize = header.indexBufferSize;
+  info.encodedIndexSize = header.encodedIndexSize;
+  info.indexEncoding = static_cast<IndexEncoding>(header.indexEncoding);
+  info.meshletBufferSize = header.meshletBufferSize;
+  info.meshletCount = header.meshletCount;
+  info.meshletVertexCount = header.meshletVertexCount;
+  info.lods.assign(header.lods, header.lods + header.lodCount);
+  info.bounds = header.bounds;
+  info.vertexFormat = static_cast<VertexFormat>(header.vertexFormat);
+  info.indexSize = static_cast<char>(header.indexSize);
+  info.compressionMode = static_cast<CompressionMode>(header.compressionMode);
+  info.submeshes.resize(header.submeshCount);
+  memcpy(info.submeshes.data(), metadata.data() + sizeof(header),
+         submeshesSize);
+  info.originalFile = metadata.substr(sizeof(header) + submeshesSize,
+                                      header.originalFileSize);
+  info.sourceHash = header.sourceHash;
+
+  if (info.compressionMode == CompressionMode::LZ4Chunked &&
+      !read_chunk_table(metadata,
+                        sizeof(header) + submeshesSize +
+                            header.originalFileSize,
+                        info.chunks)) {
+    info.vertexFormat = VertexFormat::Unknown;
+  }
   return info;
 }
 
-void assets::unpack_mesh(MeshInfo *info, const char *sourceBuffer,
+auto assets::write_mesh_metadata(const MeshInfo &info) -> std::string {
+  MeshMetadata header{};
+  header.vertexBufferSize = info.vertexBufferSize;
+  header.indexBufferSize = info.indexBufferSize;
+  header.encodedIndexSize = info.encodedIndexSize;
+  header.meshletBufferSize = info.meshletBufferSize;
+  header.sourceHash = info.sourceHash;
+  header.bounds = info.bounds;
+  header.vertexFormat = static_cast<std::uint32_t>(info.vertexFormat);
+  header.indexEncoding = static_cast<std::uint32_t>(info.indexEncoding);
+  header.compressionMode = static_cast<std::uint32_t>(info.compressionMode);
+  header.indexSize = static_cast<std::uint32_t>(info.indexSize);
+  header.meshletCount = info.meshletCount;
+  header.meshletVertexCount = info.meshletVertexCount;
+  header.lodCount = static_cast<std::uint32_t>(
+      std::min(info.lods.size(), max_mesh_lods));
+  header.originalFileSize =
+      static_cast<std::uint32_t>(info.originalFile.size());
+  std::copy_n(info.lods.begin(), header.lodCount, header.lods);
+  header.submeshCount = static_cast<std::uint32_t>(info.submeshes.size());
+
+  size_t submeshesSize = info.submeshes.size() * sizeof(MeshSubmesh);
+  std::string metadata(
+      sizeof(header) + submeshesSize + info.originalFile.size(), '\0');
+  memcpy(metadata.data(), &header, sizeof(header));
+  memcpy(metadata.data() + sizeof(header), info.submeshes.data(),
+         submeshesSize);
+  memcpy(metadata.data() + sizeof(header) + submeshesSize,
+         info.originalFile.data(), info.originalFile.size());
+  if (info.compressionMode == CompressionMode::LZ4Chunked) {
+    write_chunk_table(info.chunks, metadata);
+  }
+  return metadata;
+}
+
+auto assets::mesh_info_to_json(const MeshInfo &info) -> std::string {
+  nlohmann::json metadata;
+  metadata["vertex_format"] = vertex_format_name(info.vertexFormat);
+  metadata["vertex_buffer_size"] = info.vertexBufferSize;
+  metadata["index_buffer_size"] = info.indexBufferSize;
+  metadata["index_size"] = info.indexSize;
+  if (info.indexEncoding == IndexEncoding::Triangle) {
+    metadata["index_encoding"] = "TRIANGLE";
+  }
+  metadata["encoded_index_size"] = info.encodedIndexSize;
+  metadata["original_file"] = info.originalFile;
+  metadata["source_hash"] = hash_to_string(info.sourceHash);
+  metadata["bounds"] = {info.bounds.origin[0],  info.bounds.origin[1],
+                        info.bounds.origin[2],  info.bounds.radius,
+                        info.bounds.extents[0], info.bounds.extents[1],
+                        info.bounds.extents[2]};
+
+  if (!info.lods.empty()) {
+    nlohmann::json lods = nlohmann::json::array();
+    for (auto &&lod : info.lods) {
+      lods.push_back({{"first_index", lod.firstIndex},
+                      {"index_count", lod.indexCount},
+                      {"error", lod.error}});
+    }
+    metadata["lods"] = lods;
+  }
+
+  if (!info.submeshes.empty()) {
+    nlohmann::json submeshes = nlohmann::json::array();
+    for (auto &&submesh : info.submeshes) {
+      submeshes.push_back({{"first_index", submesh.firstIndex},
+                           {"index_count", submesh.indexCount},
+                           {"material", submesh.material}});
+    }
+    metadata["submeshes"] = submeshes;
+  }
+
+  if (info.meshletCount != 0) {
+    metadata["meshlet_count"] = info.meshletCount;
+    metadata["meshlet_vertex_count"] = info.meshletVertexCount;
+    metadata["meshlet_buffer_size"] = info.meshletBufferSize;
+  }
+
+  metadata["compression"] = compression_name(info.compressionMode);
+  if (info.compressionMode == CompressionMode::LZ4Chunked) {
+    metadata["chunk_size"] = info.chunks.chunkSize;
+    metadata["chunk_sizes"] = info.chunks.compressedSizes;
+  }
+  return metadata.dump(2);
+}
+
+auto assets::mesh_unpack_layout(const MeshInfo *info) -> MeshUnpackLayout {
+  MeshUnpackLayout layout{};
+  layout.vertexOffset = 0;
+  layout.meshletOffset = info->vertexBufferSize + info->encodedIndexSize;
+  size_t blobSize = blob_size(info->vertexBufferSize, info->encodedIndexSize,
+                              info->meshletBufferSize);
+
+  if (info->indexEncoding == IndexEncoding::Triangle) {
+    // Keep the decoded indices aligned to their size
+    layout.indexOffset = (blobSize + 3) & ~size_t{3};
+    layout.size = layout.indexOffset + info->indexBufferSize;
+  } else {
+    layout.indexOffset = info->vertexBufferSize;
+    layout.size = blobSize;
+  }
+  return layout;
+}
+
+auto assets::unpack_mesh(const MeshInfo *info, const char *sourceBuffer,
+                         size_t sourceSize, const MeshUnpackLayout &layout,
+                         char *destination, JobSystem *jobs) -> bool {
+  size_t blobSize = blob_size(info->vertexBufferSize, info->encodedIndexSize,
+                              info->meshletBufferSize);
+  if (info->compressionMode == CompressionMode::LZ4Chunked) {
+    if (!decompress_chunked(info->chunks, sourceBuffer, sourceSize,
+                            destination, blobSize, jobs)) {
+      return false;
+    }
+  } else if (info->compressionMode == CompressionMode::LZ4) {
+    // A single LZ4 block holds at most 2 GB, larger blobs are chunked
+    if (blobSize > INT_MAX || sourceSize > INT_MAX) {
+      return false;
+    }
+    int decompressed = LZ4_decompress_safe(sourceBuffer, destination,
+                                           static_cast<int>(sourceSize),
+                                           static_cast<int>(blobSize));
+    if (decompressed != static_cast<int>(blobSize)) {
+      return false;
+    }
+  } else {
+    if (sourceSize != blobSize) {
+      return false;
+    }
+    memcpy(destination, sourceBuffer, sourceSize);
+  }
+
+  if (info->indexEncoding == IndexEncoding::Triangle) {
+    size_t indexCount = info->indexBufferSize / info->indexSize;
+    return decode_indices(destination + info->vertexBufferSize,
+                          info->encodedIndexSize,
+                          destination + layout.indexOffset, indexCount,
+                          info->indexSize);
+  }
+  return true;
+}
+
+auto assets::unpack_mesh(MeshInfo *info, const char *sourceBuffer,
                          size_t sourceSize, char *vertexBuffer,
-                         char *indexBuffer) {
-  // Decompression into temporal vector. TODO: streaming decompress directly
-  // on the buffers
-  std::vector<char> decompressedBuffer;
-  decompressedBuffer.resize(info->vertexBufferSize + info->indexBufferSize);
+                         char *indexBuffer, char *meshletBuffer) -> bool {
+  auto layout = mesh_unpack_layout(info);
+  std::vector<char> unpacked(layout.size);
+  if (!unpack_mesh(info, sourceBuffer, sourceSize, layout, unpacked.data())) {
+    return false;
+  }
+
+  memcpy(vertexBuffer, &unpacked[layout.vertexOffset], info->vertexBufferSize);
+  memcpy(indexBuffer, &unpacked[layout.indexOffset], info->indexBufferSize);
+  if (meshletBuffer != nullptr && info->meshletBufferSize != 0) {
+    memcpy(meshletBuffer, &unpacked[layout.meshletOffset],
+           info->meshletBufferSize);
+  }
+
+  return true;
+}
+
+auto assets::read_meshlets(const MeshInfo *info, const char *meshletBuffer)
+    -> MeshletData {
+  MeshletData data;
+  if (info->meshletCount == 0) {
+    return data;
+  }
 
-  LZ4_decompress_safe(sourceBuffer, decompressedBuffer.data(),
-                      static_cast<int>(sourceSize),
-                      static_cast<int>(decompressedBuffer.size()));
+  data.meshlets.resize(info->meshletCount);
+  data.vertices.resize(info->meshletVertexCount);
 
-  // Copy vertex buffer
-  memcpy(vertexBuffer, decompressedBuffer.data(), info->vertexBufferSize);
+  size_t meshletsSize = data.meshlets.size() * sizeof(Meshlet);
+  size_t verticesSize = data.vertices.size() * sizeof(std::uint32_t);
+  data.triangles.resize(info->meshletBufferSize - meshletsSize - verticesSize);
 
-  // Copy index buffer
-  memcpy(indexBuffer, &decompressedBuffer[info->vertexBufferSize],
-         info->indexBufferSize);
+  memcpy(data.meshlets.data(), meshletBuffer, meshletsSize);
+  memcpy(data.vertices.data(), meshletBuffer + meshletsSize, verticesSize);
+  memcpy(data.triangles.data(), meshletBuffer + meshletsSize + verticesSize,
+         data.triangles.size());
+
+  return data;
 }
 
-auto assets::calcualate_bounds(Vertex_f32_PNCV *vertices, size_t count)
+namespace {
+
+template <typename V>
+auto calculate_bounds_impl(const V *vertices, size_t count)
     -> assets::MeshBounds {
   auto max_float = std::numeric_limits<float>::max();
-  auto min_float = std::numeric_limits<float>::min();
+  auto min_float = std::numeric_limits<float>::lowest();
 
   auto min = std::array<float, 3>{max_float, max_float, max_float};
   auto max = std::array<float, 3>{min_float, min_float, min_float};
@@ -71,7 +373,7 @@ auto assets::calcualate_bounds(Vertex_f32_PNCV *vertices, size_t count)
     }
   }
 
-  MeshBounds bounds;
+  assets::MeshBounds bounds;
   for (size_t i = 0; i != 3; ++i) {
     bounds.extents[i] = (max[i] - min[i]) / 2.0F;
     bounds.origin[i] = bounds.extents[i] + min[i];
@@ -93,4 +395,143 @@ auto assets::calcualate_bounds(Vertex_f32_PNCV *vertices, size_t count)
   bounds.radius = std::sqrt(r2);
 
   return bounds;
-}
\ No newline at end of file
+}
+
+} // namespace
+
+auto assets::calcualate_bounds(Vertex_f32_PNCV *vertices, size_t count)
+    -> MeshBounds {
+  return calculate_bounds_impl(vertices, count);
+}
+
+auto assets::calcualate_bounds(Vertex_P32N8C8V16 *vertices, size_t count)
+    -> MeshBounds {
+  return calculate_bounds_impl(vertices, count);
+}
+
+auto assets::vertex_size(VertexFormat format) -> size_t {
+  switch (format) {
+  case VertexFormat::PNCV_F32:
+    return sizeof(Vertex_f32_PNCV);
+  case VertexFormat::P32N8C8V16:
+    return sizeof(Vertex_P32N8C8V16);
+  default:
+    return 0;
+  }
+}
+
+auto assets::float_to_half(float value) -> std::uint16_t {
+  std::uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+
+  auto sign = static_cast<std::uint16_t>((bits >> 16) & 0x8000);
+  std::uint32_t exponent = (bits >> 23) & 0xff;
+  std::uint32_t mantissa = bits & 0x7fffff;
+
+  // NaN and infinity
+  if (exponent == 0xff) {
+    return sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0);
+  }
+
+  int halfExponent = static_cast<int>(exponent) - 127 + 15;
+  // Overflow rounds to infinity
+  if (halfExponent >= 0x1f) {
+    return sign | 0x7c00;
+  }
+
+  // Subnormal halves, or zero when too small
+  if (halfExponent <= 0) {
+    if (halfExponent < -10) {
+      return sign;
+    }
+    mantissa |= 0x800000;
+    auto shift = static_cast<std::uint32_t>(14 - halfExponent);
+    std::uint32_t half = mantissa >> shift;
+    std::uint32_t rest = mantissa & ((1U << shift) - 1);
+    std::uint32_t halfway = 1U << (shift - 1);
+    if (rest > halfway || (rest == halfway && (half & 1) != 0)) {
+      ++half;
+    }
+    return sign | static_cast<std::uint16_t>(half);
+  }
+
+  std::uint32_t half =
+      (static_cast<std::uint32_t>(halfExponent) << 10) | (mantissa >> 13);
+  std::uint32_t rest = mantissa & 0x1fff;
+  // Round to nearest even, a carry into the exponent is still correct
+  if (rest > 0x1000 || (rest == 0x1000 && (half & 1) != 0)) {
+    ++half;
+  }
+  return sign | static_cast<std::uint16_t>(half);
+}
+
+auto assets::half_to_float(std::uint16_t value) -> float {
+  std::uint32_t sign = static_cast<std::uint32_t>(value & 0x8000) << 16;
+  std::uint32_t exponent = (value >> 10) & 0x1f;
+  std::uint32_t mantissa = value & 0x3ff;
+
+  std::uint32_t bits;
+  if (exponent == 0x1f) {
+    bits = sign | 0x7f800000 | (mantissa << 13);
+  } else if (exponent != 0) {
+    bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+  } else if (mantissa == 0) {
+    bits = sign;
+  } else {
+    // Subnormal half, normalize it
+    exponent = 127 - 15 + 1;
+    while ((mantissa & 0x400) == 0) {
+      mantissa <<= 1;
+      --exponent;
+    }
+    bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+  }
+
+  float result;
+  memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+void assets::oct_encode(const float normal[3], std::int8_t encoded[2]) {
+  float length =
+      std::abs(normal[0]) + std::abs(normal[1]) + std::abs(normal[2]);
+  if (length == 0.0F) {
+    encoded[0] = 0;
+    encoded[1] = 0;
+    return;
+  }
+
+  float x = normal[0] / length;
+  float y = normal[1] / length;
+  // Fold the lower hemisphere over the diagonals
+  if (normal[2] < 0.0F) {
+    float foldedX = (1.0F - std::abs(y)) * (x >= 0.0F ? 1.0F : -1.0F);
+    float foldedY = (1.0F - std::abs(x)) * (y >= 0.0F ? 1.0F : -1.0F);
+    x = foldedX;
+    y = foldedY;
+  }
+
+  encoded[0] = static_cast<std::int8_t>(
+      std::round(std::clamp(x, -1.0F, 1.0F) * 127.0F));
+  encoded[1] = static_cast<std::int8_t>(
+      std::round(std::clamp(y, -1.0F, 1.0F) * 127.0F));
+}
+
+void assets::oct_decode(const std::int8_t encoded[2], float normal[3]) {
+  // Same as the snorm8 conversion done by the GPU
+  float x = std::max(static_cast<float>(encoded[0]) / 127.0F, -1.0F);
+  float y = std::max(static_cast<float>(encoded[1]) / 127.0F, -1.0F);
+  float z = 1.0F - std::abs(x) - std::abs(y);
+
+  if (z < 0.0F) {
+    float unfoldedX = (1.0F - std::abs(y)) * (x >= 0.0F ? 1.0F : -1.0F);
+    float unfoldedY = (1.0F - std::abs(x)) * (y >= 0.0F ? 1.0F : -1.0F);
+    x = unfoldedX;
+    y = unfoldedY;
+  }
+
+  float length = std::sqrt(x * x + y * y + z * z);
+  normal[0] = x / length;
+  normal[1] = y / length;
+  normal[2] = z / length;
+}
@@ -1,7 +1,11 @@
 #pragma once
+#include "asset_hash.hpp"
 #include "asset_loader.hpp"
+#include "blob_compression.hpp"
+#include "index_codec.hpp"
+#include <cstring>
 #include <lz4.h>
-#include <nlohmann/json.hpp>
+#include <string>
 
 namespace assets {
 struct Vertex_f32_PNCV {
@@ -11,13 +15,21 @@ struct Vertex_f32_PNCV {
   float uv[2];
 };
 
+// Compact vertex, read by the GPU as is. Attributes stay 4 byte aligned,
+// which Metal requires.
 struct Vertex_P32N8C8V16 {
   float position[3];
-  std::uint8_t normal[3];
-  std::uint8_t color[3];
-  float uv[2];
+  // Octahedral encoded unit normal as snorm8, see oct_encode
+  std::int8_t normal[2];
+  std::int8_t padding[2];
+  // unorm8, alpha is unused
+  std::uint8_t color[4];
+  // Half floats
+  std::uint16_t uv[2];
 };
 
+static_assert(sizeof(Vertex_P32N8C8V16) == 24);
+
 enum class VertexFormat : uint32_t {
   Unknown = 0,
   PNCV_F32,  // Everything at 32 bits
@@ -25,33 +37,193 @@ enum class VertexFormat : uint32_t {
              // 16 bits float
 };
 
+constexpr size_t vertex_format_count = 3;
+
+// Size of one vertex in bytes, 0 for unknown formats
+auto vertex_size(VertexFormat format) -> size_t;
+
+// IEEE half float conversions, rounding to nearest even
+auto float_to_half(float value) -> std::uint16_t;
+auto half_to_float(std::uint16_t value) -> float;
+
+// Octahedral normal encoding (Meyer et al. 2010): maps the unit sphere onto
+// a square, so two snorm8 values hold a normal with under a degree of error
+void oct_encode(const float normal[3], std::int8_t encoded[2]);
+void oct_decode(const std::int8_t encoded[2], float normal[3]);
+
 struct MeshBounds {
   float origin[3];
   float radius;
   float extents[3];
 };
 
+// Limits that keep a meshlet within what mesh shaders are tuned for, and
+// small enough that culling it on its own pays off
+constexpr size_t max_meshlet_vertices = 64;
+constexpr size_t max_meshlet_triangles = 124;
+
+// A cluster of triangles that can be culled on its own. Its triangles are the
+// contiguous range [triangleOffset, triangleOffset + triangleCount) of the
+// index buffer, so it can be drawn with a plain indexed draw.
+struct Meshlet {
+  // Bounding sphere
+  float center[3];
+  float radius;
+  // Normal cone: every triangle faces away from a viewer at position p when
+  // dot(center - p, coneAxis) >= coneCutoff * length(center - p) + radius
+  float coneAxis[3];
+  float coneCutoff;
+  // Range in the meshlet vertex array, which holds indices into the vertex
+  // buffer
+  std::uint32_t vertexOffset;
+  std::uint32_t vertexCount;
+  // Range in the index buffer and in the local triangle array, which holds
+  // three uint8_t indices into the meshlet's vertices per triangle
+  std::uint32_t triangleOffset;
+  std::uint32_t triangleCount;
+};
+
+// Meshlets as stored in the mesh blob, after the index buffer
+struct MeshletData {
+  std::vector<Meshlet> meshlets;
+  std::vector<std::uint32_t> vertices;
+  std::vector<std::uint8_t> triangles;
+};
+
+// One level of detail: a range of the index buffer over the vertices shared
+// by all levels
+struct MeshLod {
+  std::uint32_t firstIndex;
+  std::uint32_t indexCount;
+  // Geometric error of the level relative to the bounding sphere radius
+  float error;
+};
+
+// A range of the finest level drawn with a material of its own, such as a
+// glTF primitive
+struct MeshSubmesh {
+  std::uint32_t firstIndex;
+  std::uint32_t indexCount;
+  // Index into the source file's materials, ~0 for none
+  std::uint32_t material;
+};
+
 struct MeshInfo {
   std::uint64_t vertexBufferSize;
+  // Size of the decoded index buffer, indexSize bytes per index
   std::uint64_t indexBufferSize;
+  // Size of the indices in the blob, differs from indexBufferSize when they
+  // are encoded
+  std::uint64_t encodedIndexSize = 0;
+  IndexEncoding indexEncoding = IndexEncoding::Raw;
+  // Size of the optional meshlet section, 0 when the mesh has none
+  std::uint64_t meshletBufferSize = 0;
+  std::uint32_t meshletCount = 0;
+  std::uint32_t meshletVertexCount = 0;
+  // Detail levels, finest first. Meshlets cover the first one. Empty when
+  // the whole index buffer is a single level.
+  std::vector<MeshLod> lods;
+  // Material ranges of the first level. Empty when the whole mesh is one.
+  std::vector<MeshSubmesh> submeshes;
   MeshBounds bounds;
   VertexFormat vertexFormat;
+  // 2 or 4, see index_size_for
   char indexSize;
   CompressionMode compressionMode;
+  // Empty unless compressionMode is LZ4Chunked
+  BlobChunks chunks;
   std::string originalFile;
+  // Content hash of the source file the mesh was baked from
+  std::uint64_t sourceHash;
+};
+
+// Detail levels a version 2 mesh header has room for
+constexpr size_t max_mesh_lods = 8;
+
+// Version 2 metadata, stored as is in front of the submeshes, the original
+// file name and the chunk table of chunked blobs. Every field sits at its
+// natural alignment, so the header is read with a single copy and no parsing.
+struct MeshMetadata {
+  std::uint64_t vertexBufferSize;
+  std::uint64_t indexBufferSize;
+  std::uint64_t encodedIndexSize;
+  std::uint64_t meshletBufferSize;
+  std::uint64_t sourceHash;
+  MeshBounds bounds;
+  std::uint32_t vertexFormat;
+  std::uint32_t indexEncoding;
+  std::uint32_t compressionMode;
+  std::uint32_t indexSize;
+  std::uint32_t meshletCount;
+  std::uint32_t meshletVertexCount;
+  std::uint32_t lodCount;
+  // Length of the original file name that follows the header
+  std::uint32_t originalFileSize;
+  MeshLod lods[max_mesh_lods];
+  // MeshSubmesh records that follow the header
+  std::uint32_t submeshCount;
 };
 
+static_assert(sizeof(MeshMetadata) == 200);
+
 auto parse_format(const char *f) -> VertexFormat;
 
+// Reads the metadata of an asset file of the given version. A malformed
+// header yields VertexFormat::Unknown.
+auto read_mesh_info(int version, std::string_view metadata) -> MeshInfo;
 auto read_mesh_info(AssetFile *file) -> MeshInfo;
+auto read_mesh_info(const AssetFileView *file) -> MeshInfo;
+
+// Unpacks into separate buffers, going through a temporary copy. Indices
+// are decoded into indexBuffer at info->indexSize bytes each. meshletBuffer
+// receives the raw meshlet section when it's not null, see read_meshlets.
+// Returns false when the blob or the indices are corrupt.
+auto unpack_mesh(MeshInfo *info, const char *sourceBuffer, size_t sourceSize,
+                 char *vertexBuffer, char *indexBuffer,
+                 char *meshletBuffer = nullptr) -> bool;
+
+// Where unpack_mesh puts each part of a mesh in a single destination, such
+// as a mapped staging buffer. The blob is decompressed in place, so the
+// vertices come first and raw indices follow them directly. Encoded indices
+// are decoded after the end of the blob.
+struct MeshUnpackLayout {
+  size_t vertexOffset;
+  size_t indexOffset;
+  size_t meshletOffset;
+  // Bytes the destination needs
+  size_t size;
+};
+
+auto mesh_unpack_layout(const MeshInfo *info) -> MeshUnpackLayout;
+
+// Unpacks without intermediate copies into destination, which holds
+// layout.size bytes. Chunked blobs are decompressed on jobs when it's not
+// null. Returns false when the blob or the indices are corrupt.
+auto unpack_mesh(const MeshInfo *info, const char *sourceBuffer,
+                 size_t sourceSize, const MeshUnpackLayout &layout,
+                 char *destination, JobSystem *jobs = nullptr) -> bool;
+
+// Splits an unpacked meshlet section into its arrays
+auto read_meshlets(const MeshInfo *info, const char *meshletBuffer)
+    -> MeshletData;
+
+// Version 2 metadata of a packed mesh, at most max_mesh_lods levels
+auto write_mesh_metadata(const MeshInfo &info) -> std::string;
 
-void unpack_mesh(MeshInfo *info, const char *sourceBuffer, size_t sourceSize,
-                 char *vertexBuffer, char *indexBuffer);
+// The metadata as version 1 JSON, for debugging. read_mesh_info reads it
+// back with asset_json_version.
+auto mesh_info_to_json(const MeshInfo &info) -> std::string;
 
+// Takes 32 bit indices and stores them at info->indexSize bytes each, with
+// info->indexEncoding. The blob is compressed in chunks at level.
 template <typename V>
-auto pack_mesh(MeshInfo *info, V *vertexData, uint32_t *indexData) -> AssetFile;
+auto pack_mesh(MeshInfo *info, V *vertexData, uint32_t *indexData,
+               const MeshletData *meshlets = nullptr,
+               CompressionLevel level = CompressionLevel::Fast) -> AssetFile;
 
 auto calcualate_bounds(Vertex_f32_PNCV *vertices, size_t count) -> MeshBounds;
+auto calcualate_bounds(Vertex_P32N8C8V16 *vertices, size_t count)
+    -> MeshBounds;
 
 } // namespace assets
 
@@ -3,43 +3,45 @@
 #include "mesh_asset.hpp"
 
 template <typename V>
-auto assets::pack_mesh(MeshInfo *info, V *vertexData, uint32_t *indexData)
+auto assets::pack_mesh(MeshInfo *info, V *vertexData, uint32_t *indexData,
+                       const MeshletData *meshlets, CompressionLevel level)
     -> AssetFile {
   AssetFile file;
   file.type[0] = 'M';
   file.type[1] = 'E';
   file.type[2] = 'S';
   file.type[3] = 'H';
-  file.version = 1;
-
-  nlohmann::json metadata;
-  if (info->vertexFormat == VertexFormat::P32N8C8V16) {
-    metadata["vertex_format"] = "P32N8C8V16";
-  } else if (info->vertexFormat == VertexFormat::PNCV_F32) {
-    metadata["vertex_format"] = "PNCV_F32";
+  file.version = asset_binary_version;
+
+  size_t indexCount = info->indexBufferSize / info->indexSize;
+  std::vector<char> indexBytes;
+  if (info->indexEncoding == IndexEncoding::Triangle) {
+    indexBytes = encode_indices({indexData, indexCount});
+  } else if (info->indexSize == sizeof(uint16_t)) {
+    indexBytes.resize(info->indexBufferSize);
+    for (size_t i = 0; i != indexCount; ++i) {
+      auto index = static_cast<uint16_t>(indexData[i]);
+      memcpy(indexBytes.data() + i * sizeof(uint16_t), &index, sizeof(index));
+    }
+  } else {
+    indexBytes.resize(info->indexBufferSize);
+    memcpy(indexBytes.data(), indexData, info->indexBufferSize);
+  }
+  info->encodedIndexSize = indexBytes.size();
+
+  info->meshletCount = 0;
+  info->meshletVertexCount = 0;
+  info->meshletBufferSize = 0;
+  if (meshlets != nullptr && !meshlets->meshlets.empty()) {
+    info->meshletCount = static_cast<uint32_t>(meshlets->meshlets.size());
+    info->meshletVertexCount = static_cast<uint32_t>(meshlets->vertices.size());
+    info->meshletBufferSize = meshlets->meshlets.size() * sizeof(Meshlet) +
+                              meshlets->vertices.size() * sizeof(uint32_t) +
+                              meshlets->triangles.size();
   }
 
-  metadata["vertex_buffer_size"] = info->vertexBufferSize;
-  metadata["index_buffer_size"] = info->indexBufferSize;
-  metadata["index_size"] = info->indexSize;
-  metadata["original_file"] = info->originalFile;
-
-  std::vector<float> boundsData;
-  boundsData.resize(7);
-
-  boundsData[0] = info->bounds.origin[0];
-  boundsData[1] = info->bounds.origin[1];
-  boundsData[2] = info->bounds.origin[2];
-
-  boundsData[3] = info->bounds.radius;
-
-  boundsData[4] = info->bounds.extents[0];
-  boundsData[5] = info->bounds.extents[1];
-  boundsData[6] = info->bounds.extents[2];
-
-  metadata["bounds"] = boundsData;
-
-  size_t fullsize = info->vertexBufferSize + info->indexBufferSize;
+  size_t fullsize = info->vertexBufferSize + info->encodedIndexSize +
+                    info->meshletBufferSize;
 
   std::vector<char> merged_buffer;
   merged_buffer.resize(fullsize);
@@ -48,21 +50,29 @@ auto assets::pack_mesh(MeshInfo *info, V *vertexData, uint32_t *indexData)
   memcpy(merged_buffer.data(), vertexData, info->vertexBufferSize);
 
   // Copy index buffer
-  memcpy(merged_buffer.data() + info->vertexBufferSize, indexData,
-         info->indexBufferSize);
-
-  // Compress buffer and copy it into the file struct
-  size_t compressStaging = LZ4_compressBound(static_cast<int>(fullsize));
-  file.binaryBlob.resize(compressStaging);
+  memcpy(merged_buffer.data() + info->vertexBufferSize, indexBytes.data(),
+         indexBytes.size());
+
+  // Copy meshlets: descriptors, vertex references, then local triangles
+  if (info->meshletBufferSize != 0) {
+    char *meshletData = merged_buffer.data() + info->vertexBufferSize +
+                        info->encodedIndexSize;
+    size_t meshletsSize = meshlets->meshlets.size() * sizeof(Meshlet);
+    size_t verticesSize = meshlets->vertices.size() * sizeof(uint32_t);
+
+    memcpy(meshletData, meshlets->meshlets.data(), meshletsSize);
+    memcpy(meshletData + meshletsSize, meshlets->vertices.data(),
+           verticesSize);
+    memcpy(meshletData + meshletsSize + verticesSize,
+           meshlets->triangles.data(), meshlets->triangles.size());
+  }
 
-  int compressedSize =
-      LZ4_compress_default(merged_buffer.data(), file.binaryBlob.data(),
-                           static_cast<int>(merged_buffer.size()),
-                           static_cast<int>(compressStaging));
-  file.binaryBlob.resize(compressedSize);
+  // Compress buffer in chunks that can be decompressed in parallel
+  info->compressionMode = CompressionMode::LZ4Chunked;
+  info->chunks = compress_chunked(merged_buffer.data(), merged_buffer.size(),
+                                  level, file.binaryBlob);
 
-  metadata["compression"] = "LZ4";
-  file.json = metadata.dump();
+  file.metadata = write_mesh_metadata(*info);
 
   return file;
 }
\ No newline at end of file
@@ -1,4 +1,7 @@
 #include "texture_asset.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
 #include <iostream>
 #include <lz4.h>
 #include <nlohmann/json.hpp>
@@ -7,70 +10,363 @@ auto parse_format(const char *f) -> assets::TextureFormat {
   if (strcmp(f, "RGBA8") == 0) {
     return assets::TextureFormat::RGBA8;
   }
+  if (strcmp(f, "BC1") == 0) {
+    return assets::TextureFormat::BC1;
+  }
+  if (strcmp(f, "BC3") == 0) {
+    return assets::TextureFormat::BC3;
+  }
+  if (strcmp(f, "BC5") == 0) {
+    return assets::TextureFormat::BC5;
+  }
+  if (strcmp(f, "BC7") == 0) {
+    return assets::TextureFormat::BC7;
+  }
   return assets::TextureFormat::Unknown;
 }
 
-auto assets::read_texture_info(AssetFile *file) -> TextureInfo {
-  TextureInfo info;
-  nlohmann::json texture_metadata = nlohmann::json::parse(file->json);
+auto assets::texture_format_name(TextureFormat format) -> const char * {
+  switch (format) {
+  case TextureFormat::RGBA8:
+    return "RGBA8";
+  case TextureFormat::BC1:
+    return "BC1";
+  case TextureFormat::BC3:
+    return "BC3";
+  case TextureFormat::BC5:
+    return "BC5";
+  case TextureFormat::BC7:
+    return "BC7";
+  default:
+    return "UNKNOWN";
+  }
+}
+
+auto assets::atlas_file_name(TextureFormat format) -> std::string {
+  std::string name = texture_format_name(format);
+  std::transform(name.begin(), name.end(), name.begin(), [](char c) {
+    return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  });
+  return "atlas_" + name + ".tx";
+}
+
+// Version 1 files carry JSON
+auto read_texture_info_json(std::string_view json) -> assets::TextureInfo {
+  assets::TextureInfo info;
+  nlohmann::json texture_metadata =
+      nlohmann::json::parse(json.begin(), json.end());
 
   std::string formatString = texture_metadata["format"];
   info.textureFormat = parse_format(formatString.c_str());
 
   std::string compressionString = texture_metadata["compression"];
-  info.compressionMode = parse_compression(compressionString.c_str());
+  info.compressionMode = assets::parse_compression(compressionString.c_str());
 
   info.pixelsize[0] = texture_metadata["width"];
   info.pixelsize[1] = texture_metadata["height"];
+  info.pixelsize[2] = texture_metadata.value("layers", 1U);
 
   info.textureSize = texture_metadata["buffer_size"];
   info.originalFile = texture_metadata["original_file"];
+  info.sourceHash = assets::hash_from_string(
+      texture_metadata.value("source_hash", std::string{}));
+
+  // Only debug sidecars have pages and a chunk table
+  if (texture_metadata.contains("pages")) {
+    for (auto &&page : texture_metadata["pages"]) {
+      info.pages.push_back({.width = page["width"],
+                            .height = page["height"],
+                            .compressedSize = page["compressed_size"],
+                            .originalSize = page["original_size"]});
+    }
+  }
+  if (texture_metadata.contains("regions")) {
+    for (auto &&region : texture_metadata["regions"]) {
+      info.regions.push_back({.name = region["name"],
+                              .layer = region["layer"],
+                              .uvScale = {region["uv_scale"][0],
+                                          region["uv_scale"][1]},
+                              .uvOffset = {region["uv_offset"][0],
+                                           region["uv_offset"][1]}});
+    }
+  }
+  if (texture_metadata.contains("chunk_sizes")) {
+    info.chunks.chunkSize = texture_metadata["chunk_size"];
+    info.chunks.compressedSizes =
+        texture_metadata["chunk_sizes"].get<std::vector<std::uint32_t>>();
+  }
 
   return info;
 }
 
-void assets::unpack_texture(TextureInfo *info, const char *sourceBuffer,
-                            size_t sourceSize, char *destination) {
+auto assets::read_texture_info(AssetFile *file) -> TextureInfo {
+  return read_texture_info(file->version, std::string_view{file->metadata});
+}
+
+auto assets::read_texture_info(const AssetFileView *file) -> TextureInfo {
+  return read_texture_info(file->version, file->metadata);
+}
+
+auto assets::read_texture_info(int version, std::string_view metadata)
+    -> TextureInfo {
+  if (version == asset_json_version) {
+    return read_texture_info_json(metadata);
+  }
+
+  TextureInfo info{};
+  info.textureFormat = TextureFormat::Unknown;
+
+  TextureMetadata header;
+  if (version != asset_binary_version || metadata.size() < sizeof(header)) {
+    return info;
+  }
+  memcpy(&header, metadata.data(), sizeof(header));
+  if (metadata.size() - sizeof(header) < header.originalFileSize) {
+    return info;
+  }
+
+  info.textureSize = header.textureSize;
+  info.textureFormat = static_cast<TextureFormat>(header.textureFormat);
+  info.compressionMode = static_cast<CompressionMode>(header.compressionMode);
+  std::copy_n(header.pixelsize, 3, info.pixelsize);
+  info.originalFile = metadata.substr(sizeof(header), header.originalFileSize);
+  info.sourceHash = header.sourceHash;
+
+  size_t pagesOffset =
+      (sizeof(header) + header.originalFileSize + 3) & ~size_t{3};
+  size_t pagesEnd = pagesOffset + header.pageCount * sizeof(PageInfo);
+  if (metadata.size() < pagesEnd) {
+    info.textureFormat = TextureFormat::Unknown;
+    return info;
+  }
+  info.pages.resize(header.pageCount);
+  memcpy(info.pages.data(), metadata.data() + pagesOffset,
+         header.pageCount * sizeof(PageInfo));
+
+  // The region names follow the region table back to back
+  size_t regionOffset = pagesEnd;
+  size_t regionsEnd = pagesEnd + size_t{header.regionCount} *
+                                     sizeof(AtlasRegionMetadata);
+  if (metadata.size() < regionsEnd) {
+    info.textureFormat = TextureFormat::Unknown;
+    return info;
+  }
+  info.regions.resize(header.regionCount);
+  for (auto &&region : info.regions) {
+    AtlasRegionMetadata regionHeader;
+    memcpy(&regionHeader, metadata.data() + regionOffset,
+           sizeof(regionHeader));
+    regionOffset += sizeof(regionHeader);
+    if (metadata.size() - regionsEnd < regionHeader.nameSize) {
+      info.textureFormat = TextureFormat::Unknown;
+      return info;
+    }
+    region.name = metadata.substr(regionsEnd, regionHeader.nameSize);
+    regionsEnd += regionHeader.nameSize;
+    region.layer = regionHeader.layer;
+    std::copy_n(regionHeader.uvScale, 2, region.uvScale);
+    std::copy_n(regionHeader.uvOffset, 2, region.uvOffset);
+  }
+
+  std::uint64_t pagesSize = 0;
+  for (auto &&page : info.pages) {
+    pagesSize += page.originalSize;
+  }
+
+  if (pagesSize != info.textureSize ||
+      (info.compressionMode == CompressionMode::LZ4Chunked &&
+       !read_chunk_table(metadata, regionsEnd, info.chunks))) {
+    info.textureFormat = TextureFormat::Unknown;
+  }
+  return info;
+}
+
+auto assets::unpack_texture(TextureInfo *info, const char *sourceBuffer,
+                            size_t sourceSize, char *destination,
+                            JobSystem *jobs) -> bool {
+  if (info->compressionMode == CompressionMode::LZ4Chunked) {
+    std::uint64_t blobSize = 0;
+    for (auto &&page : info->pages) {
+      blobSize += page.compressedSize;
+    }
+    return blobSize == sourceSize &&
+           unpack_texture_pages(info, sourceBuffer, sourceSize, 0,
+                                info->pages.size(), destination, jobs);
+  }
   if (info->compressionMode == CompressionMode::LZ4) {
-    LZ4_decompress_safe(sourceBuffer, destination, static_cast<int>(sourceSize),
-                        static_cast<int>(info->textureSize));
-  } else {
-    memcpy(destination, sourceBuffer, sourceSize);
+    int decompressed = LZ4_decompress_safe(
+        sourceBuffer, destination, static_cast<int>(sourceSize),
+        static_cast<int>(info->textureSize));
+    return decompressed == static_cast<int>(info->textureSize);
   }
+  if (sourceSize != info->textureSize) {
+    return false;
+  }
+  memcpy(destination, sourceBuffer, sourceSize);
+  return true;
 }
 
-auto assets::pack_texture(TextureInfo *info, void *pixelData) -> AssetFile {
-  nlohmann::json texture_metadata;
-  texture_metadata["format"] = "RGBA8";
-  texture_metadata["width"] = info->pixelsize[0];
-  texture_metadata["height"] = info->pixelsize[1];
-  texture_metadata["buffer_size"] = info->textureSize;
-  texture_metadata["original_file"] = info->originalFile;
+auto assets::unpack_texture_pages(TextureInfo *info, const char *sourceBuffer,
+                                  size_t sourceSize, size_t firstPage,
+                                  size_t pageCount, char *destination,
+                                  JobSystem *jobs) -> bool {
+  const auto &sizes = info->chunks.compressedSizes;
+  size_t chunkSize = info->chunks.chunkSize;
+  if (info->compressionMode != CompressionMode::LZ4Chunked || chunkSize == 0 ||
+      firstPage + pageCount > info->pages.size()) {
+    return false;
+  }
+
+  // Every page has chunks of its own, the big first page is the one that
+  // gets spread over the workers. The pages before firstPage are skipped
+  // through their sizes.
+  BlobChunks pageChunks;
+  pageChunks.chunkSize = info->chunks.chunkSize;
+  size_t firstChunk = 0;
+  size_t sourceOffset = 0;
+  size_t destinationOffset = 0;
+  for (size_t i = 0; i != firstPage + pageCount; ++i) {
+    const PageInfo &page = info->pages[i];
+    size_t chunkCount = (page.originalSize + chunkSize - 1) / chunkSize;
+    if (sizes.size() - firstChunk < chunkCount ||
+        sourceSize - sourceOffset < page.compressedSize ||
+        info->textureSize - destinationOffset < page.originalSize) {
+      return false;
+    }
 
+    if (i >= firstPage) {
+      pageChunks.compressedSizes.assign(
+          sizes.begin() + static_cast<std::ptrdiff_t>(firstChunk),
+          sizes.begin() + static_cast<std::ptrdiff_t>(firstChunk + chunkCount));
+      if (!decompress_chunked(pageChunks, sourceBuffer + sourceOffset,
+                              page.compressedSize,
+                              destination + destinationOffset,
+                              page.originalSize, jobs)) {
+        return false;
+      }
+      destinationOffset += page.originalSize;
+    }
+
+    firstChunk += chunkCount;
+    sourceOffset += page.compressedSize;
+  }
+  return true;
+}
+
+auto assets::pack_texture(TextureInfo *info, void *pixelData,
+                          CompressionLevel level) -> AssetFile {
   // Core file header
   AssetFile file;
   file.type[0] = 'T';
   file.type[1] = 'E';
   file.type[2] = 'X';
   file.type[3] = 'I';
-  file.version = 1;
+  file.version = asset_binary_version;
+
+  if (info->pages.empty()) {
+    info->pages.push_back({.width = info->pixelsize[0],
+                           .height = info->pixelsize[1],
+                           .compressedSize = 0,
+                           .originalSize =
+                               static_cast<uint32_t>(info->textureSize)});
+  }
 
-  // Compress buffer into blob
-  texture_metadata["compression"] = "LZ4";
-  int compressStaging = LZ4_compressBound(static_cast<int>(info->textureSize));
+  // Compress every page into the blob, in chunks that can be decompressed in
+  // parallel
+  info->compressionMode = CompressionMode::LZ4Chunked;
+  info->chunks = {};
+  const auto *pixels = static_cast<const char *>(pixelData);
+  for (auto &&page : info->pages) {
+    size_t blobSize = file.binaryBlob.size();
+    auto pageChunks =
+        compress_chunked(pixels, page.originalSize, level, file.binaryBlob);
 
-  file.binaryBlob.resize(compressStaging);
-  int compressedSize = LZ4_compress_default(
-      static_cast<const char *>(pixelData), file.binaryBlob.data(),
-      static_cast<int>(info->textureSize), compressStaging);
-  file.binaryBlob.resize(compressedSize);
+    page.compressedSize =
+        static_cast<uint32_t>(file.binaryBlob.size() - blobSize);
+    info->chunks.chunkSize = pageChunks.chunkSize;
+    info->chunks.compressedSizes.insert(info->chunks.compressedSizes.end(),
+                                        pageChunks.compressedSizes.begin(),
+                                        pageChunks.compressedSizes.end());
+    pixels += page.originalSize;
+  }
 
   // Store uncompressed
   // file.binaryBlob.resize(info->textureSize);
   // memcpy(file.binaryBlob.data(), pixelData, info->textureSize);
-  // texture_metadata["compression"] = "None";
+  // info->compressionMode = CompressionMode::None;
 
-  file.json = texture_metadata.dump();
+  TextureMetadata header{};
+  header.textureSize = info->textureSize;
+  header.sourceHash = info->sourceHash;
+  header.textureFormat = static_cast<std::uint32_t>(info->textureFormat);
+  header.compressionMode = static_cast<std::uint32_t>(info->compressionMode);
+  std::copy_n(info->pixelsize, 3, header.pixelsize);
+  header.originalFileSize =
+      static_cast<std::uint32_t>(info->originalFile.size());
+  header.pageCount = static_cast<std::uint32_t>(info->pages.size());
+  header.regionCount = static_cast<std::uint32_t>(info->regions.size());
+
+  size_t pagesOffset =
+      (sizeof(header) + info->originalFile.size() + 3) & ~size_t{3};
+  file.metadata.resize(pagesOffset + info->pages.size() * sizeof(PageInfo));
+  memcpy(file.metadata.data(), &header, sizeof(header));
+  memcpy(file.metadata.data() + sizeof(header), info->originalFile.data(),
+         info->originalFile.size());
+  memcpy(file.metadata.data() + pagesOffset, info->pages.data(),
+         info->pages.size() * sizeof(PageInfo));
+
+  std::string regionNames;
+  for (auto &&region : info->regions) {
+    AtlasRegionMetadata regionHeader{};
+    std::copy_n(region.uvScale, 2, regionHeader.uvScale);
+    std::copy_n(region.uvOffset, 2, regionHeader.uvOffset);
+    regionHeader.layer = region.layer;
+    regionHeader.nameSize = static_cast<std::uint32_t>(region.name.size());
+    file.metadata.append(reinterpret_cast<const char *>(&regionHeader),
+                         sizeof(regionHeader));
+    regionNames += region.name;
+  }
+  file.metadata += regionNames;
+  if (info->compressionMode == CompressionMode::LZ4Chunked) {
+    write_chunk_table(info->chunks, file.metadata);
+  }
 
   return file;
 }
+
+auto assets::texture_info_to_json(const TextureInfo &info) -> std::string {
+  nlohmann::json texture_metadata;
+  texture_metadata["format"] = texture_format_name(info.textureFormat);
+  texture_metadata["width"] = info.pixelsize[0];
+  texture_metadata["height"] = info.pixelsize[1];
+  texture_metadata["layers"] = info.pixelsize[2];
+  texture_metadata["buffer_size"] = info.textureSize;
+  texture_metadata["original_file"] = info.originalFile;
+  texture_metadata["source_hash"] = hash_to_string(info.sourceHash);
+  texture_metadata["compression"] = compression_name(info.compressionMode);
+  if (!info.pages.empty()) {
+    nlohmann::json pages = nlohmann::json::array();
+    for (auto &&page : info.pages) {
+      pages.push_back({{"width", page.width},
+                       {"height", page.height},
+                       {"compressed_size", page.compressedSize},
+                       {"original_size", page.originalSize}});
+    }
+    texture_metadata["pages"] = pages;
+  }
+  if (!info.regions.empty()) {
+    nlohmann::json regions = nlohmann::json::array();
+    for (auto &&region : info.regions) {
+      regions.push_back({{"name", region.name},
+                         {"layer", region.layer},
+                         {"uv_scale", region.uvScale},
+                         {"uv_offset", region.uvOffset}});
+    }
+    texture_metadata["regions"] = regions;
+  }
+  if (info.compressionMode == CompressionMode::LZ4Chunked) {
+    texture_metadata["chunk_size"] = info.chunks.chunkSize;
+    texture_metadata["chunk_sizes"] = info.chunks.compressedSizes;
+  }
+  return texture_metadata.dump(2);
+}
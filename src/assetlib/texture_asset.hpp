@@ -1,30 +1,115 @@
 #pragma once
+#include "asset_hash.hpp"
 #include "asset_loader.hpp"
+#include "blob_compression.hpp"
 
 namespace assets {
-enum class TextureFormat : uint32_t { Unknown = 0, RGBA8 };
+// The block compressed formats store 4x4 texel blocks. Color formats are
+// sRGB, BC5 holds the two linear channels of a normal map.
+enum class TextureFormat : uint32_t { Unknown = 0, RGBA8, BC1, BC3, BC5, BC7 };
 
-// struct PageInfo {
-//   uint32_t width;
-//   uint32_t height;
-//   uint32_t compressedSize;
-//   uint32_t originalSize;
-// };
+// One mip level. Pages are stored largest first, back to back both in the
+// blob and unpacked, and each one is compressed on its own.
+struct PageInfo {
+  uint32_t width;
+  uint32_t height;
+  uint32_t compressedSize;
+  uint32_t originalSize;
+};
+
+static_assert(sizeof(PageInfo) == 16);
+
+// Where a texture packed into a texture array landed: its layer and the part
+// of the layer it covers, as a scale and offset of its uvs
+struct AtlasRegion {
+  // Path of the texture's own baked file, relative to the asset root
+  std::string name;
+  uint32_t layer;
+  float uvScale[2];
+  float uvOffset[2];
+};
 
 struct TextureInfo {
+  // Size of every page together
   std::uint64_t textureSize;
   TextureFormat textureFormat;
   CompressionMode compressionMode;
+  // Empty unless compressionMode is LZ4Chunked
+  BlobChunks chunks;
+  // Width, height and array layers
   uint32_t pixelsize[3];
+  // Mip levels, empty in older files that only have the full size image.
+  // The page of a texture array holds the level of every layer.
+  std::vector<PageInfo> pages;
+  // Textures packed into the layers of a texture array
+  std::vector<AtlasRegion> regions;
   std::string originalFile;
+  // Content hash of the source file the texture was baked from
+  std::uint64_t sourceHash;
 };
 
-// Parses the texture metadata from an asset file
+// Version 2 metadata, stored as is in front of the original file name, the
+// page table (4 byte aligned), the region table with the region names after
+// it and the chunk table of chunked blobs
+struct TextureMetadata {
+  std::uint64_t textureSize;
+  std::uint64_t sourceHash;
+  std::uint32_t textureFormat;
+  std::uint32_t compressionMode;
+  std::uint32_t pixelsize[3];
+  // Length of the original file name that follows the header
+  std::uint32_t originalFileSize;
+  std::uint32_t pageCount;
+  // Zero in files written before texture arrays
+  std::uint32_t regionCount;
+};
+
+static_assert(sizeof(TextureMetadata) == 48);
+
+// An AtlasRegion in the region table, its name follows the table
+struct AtlasRegionMetadata {
+  float uvScale[2];
+  float uvOffset[2];
+  std::uint32_t layer;
+  std::uint32_t nameSize;
+};
+
+static_assert(sizeof(AtlasRegionMetadata) == 24);
+
+// Reads the metadata of an asset file of the given version. A malformed
+// header yields TextureFormat::Unknown.
+auto read_texture_info(int version, std::string_view metadata) -> TextureInfo;
 auto read_texture_info(AssetFile *file) -> TextureInfo;
+auto read_texture_info(const AssetFileView *file) -> TextureInfo;
+
+// Decompresses straight into destination, which holds info->textureSize
+// bytes, one page after the other. Chunked blobs are decompressed on jobs
+// when it's not null. Returns false when the blob is corrupt.
+auto unpack_texture(TextureInfo *info, const char *sourceBuffer,
+                    size_t sourceSize, char *destination,
+                    JobSystem *jobs = nullptr) -> bool;
+
+// Decompresses pageCount pages from firstPage on into destination, one after
+// the other. Only chunked blobs can be read a few pages at a time.
+auto unpack_texture_pages(TextureInfo *info, const char *sourceBuffer,
+                          size_t sourceSize, size_t firstPage,
+                          size_t pageCount, char *destination,
+                          JobSystem *jobs = nullptr) -> bool;
+
+// Compresses every page of info->pages in chunks at level. pixelData holds
+// the pages back to back, info->textureSize bytes. Without pages the pixels
+// are a single page of pixelsize.
+auto pack_texture(TextureInfo *info, void *pixelData,
+                  CompressionLevel level = CompressionLevel::Fast)
+    -> AssetFile;
+
+auto texture_format_name(TextureFormat format) -> const char *;
 
-void unpack_texture(TextureInfo *info, const char *sourceBuffer,
-                    size_t sourceSize, char *destination);
+// Name of the texture array the baker packs the small textures of format
+// into, at the asset root, e.g. atlas_bc7.tx
+auto atlas_file_name(TextureFormat format) -> std::string;
 
-auto pack_texture(TextureInfo *info, void *pixelData) -> AssetFile;
+// The metadata as version 1 JSON, for debugging
+auto texture_info_to_json(const TextureInfo &info) -> std::string;
 
 } // namespace assets
\ No newline at end of file
@@ -1,8 +1,22 @@
 #include "vk_engine.hpp"
 
-auto main([[maybe_unused]] int argc, [[maybe_unused]] char *argv[]) -> int {
+#include <string>
+#include <string_view>
+
+auto main(int argc, char *argv[]) -> int {
   VulkanEngine engine;
 
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    // Loads every asset before the first frame, to compare the time to it
+    if (arg == "--sync-loading") {
+      engine._asyncLoading = false;
+    } else if (arg == "--staging-ring" && i + 1 < argc) {
+      // In MB, 0 gives every upload a staging buffer of its own
+      engine._stagingRingSize = std::stoull(argv[++i]) * 1024 * 1024;
+    }
+  }
+
   engine.init();
 
   engine.run();
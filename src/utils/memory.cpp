@@ -0,0 +1,37 @@
+#include "memory.hpp"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+// windows.h must come first
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace utils {
+
+auto peak_rss_bytes() -> std::size_t {
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS counters{};
+  if (K32GetProcessMemoryInfo(GetCurrentProcess(), &counters,
+                              sizeof(counters)) == 0) {
+    return 0;
+  }
+  return counters.PeakWorkingSetSize;
+#else
+  rusage usage{};
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+#if defined(__APPLE__)
+  // Bytes on macOS
+  return static_cast<std::size_t>(usage.ru_maxrss);
+#else
+  // Kilobytes on Linux
+  return static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+} // namespace utils
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstddef>
+
+namespace utils {
+
+// Largest resident set size of the process so far, 0 where unsupported
+auto peak_rss_bytes() -> std::size_t;
+
+} // namespace utils
@@ -0,0 +1,218 @@
+#include "offset_allocator.hpp"
+
+#include <algorithm>
+#include <bit>
+
+namespace {
+
+// Sizes are classed like small floats: a 3 bit mantissa under the highest
+// set bit, and sizes below 8 exactly
+constexpr uint32_t mantissa_bits = 3;
+constexpr uint32_t mantissa_count = 1U << mantissa_bits;
+constexpr uint32_t mantissa_mask = mantissa_count - 1;
+
+// Class a free range of size goes in, every range in it is at least as
+// large as the class's smallest size
+auto bin_round_down(uint32_t size) -> uint32_t {
+  if (size < mantissa_count) {
+    return size;
+  }
+  uint32_t shift = std::bit_width(size) - 1 - mantissa_bits;
+  uint32_t mantissa = (size >> shift) & mantissa_mask;
+  return ((shift + 1) << mantissa_bits) | mantissa;
+}
+
+// First class whose every range holds size
+auto bin_round_up(uint32_t size) -> uint32_t {
+  uint32_t bin = bin_round_down(size);
+  if (size >= mantissa_count) {
+    uint32_t shift = std::bit_width(size) - 1 - mantissa_bits;
+    if ((size & ((1U << shift) - 1)) != 0) {
+      ++bin;
+    }
+  }
+  return bin;
+}
+
+} // namespace
+
+namespace utils {
+
+OffsetAllocator::OffsetAllocator(uint32_t size) { reset(size); }
+
+void OffsetAllocator::reset(uint32_t size) {
+  size_ = size;
+  freeSpace_ = size;
+  allocationCount_ = 0;
+  nodes_.clear();
+  unusedNodes_.clear();
+  binHeads_.fill(no_space);
+  topBits_ = 0;
+  leafBits_.fill(0);
+
+  if (size != 0) {
+    uint32_t node = new_node();
+    nodes_[node].size = size;
+    insert_free(node);
+  }
+}
+
+auto OffsetAllocator::allocate(uint32_t size) -> Allocation {
+  size = std::max(size, 1U);
+  uint32_t minBin = bin_round_up(size);
+  if (minBin >= bin_count) {
+    return {};
+  }
+  uint32_t bin = find_bin(minBin);
+  if (bin == no_space) {
+    return {};
+  }
+
+  uint32_t node = binHeads_[bin];
+  remove_free(node);
+
+  // The rest of the range stays free, right after the allocation
+  if (nodes_[node].size > size) {
+    uint32_t rest = new_node();
+    Node &allocated = nodes_[node];
+    nodes_[rest].offset = allocated.offset + size;
+    nodes_[rest].size = allocated.size - size;
+    nodes_[rest].prev = node;
+    nodes_[rest].next = allocated.next;
+    if (allocated.next != no_space) {
+      nodes_[allocated.next].prev = rest;
+    }
+    allocated.next = rest;
+    allocated.size = size;
+    insert_free(rest);
+  }
+
+  nodes_[node].used = true;
+  freeSpace_ -= size;
+  ++allocationCount_;
+  return {nodes_[node].offset, node};
+}
+
+void OffsetAllocator::free(const Allocation &allocation) {
+  if (allocation.node == no_space) {
+    return;
+  }
+  uint32_t node = allocation.node;
+  nodes_[node].used = false;
+  freeSpace_ += nodes_[node].size;
+  --allocationCount_;
+
+  // Merge with the free ranges on either side
+  uint32_t prev = nodes_[node].prev;
+  if (prev != no_space && !nodes_[prev].used) {
+    remove_free(prev);
+    nodes_[prev].size += nodes_[node].size;
+    nodes_[prev].next = nodes_[node].next;
+    if (nodes_[node].next != no_space) {
+      nodes_[nodes_[node].next].prev = prev;
+    }
+    unusedNodes_.push_back(node);
+    node = prev;
+  }
+  uint32_t next = nodes_[node].next;
+  if (next != no_space && !nodes_[next].used) {
+    remove_free(next);
+    nodes_[node].size += nodes_[next].size;
+    nodes_[node].next = nodes_[next].next;
+    if (nodes_[next].next != no_space) {
+      nodes_[nodes_[next].next].prev = node;
+    }
+    unusedNodes_.push_back(next);
+  }
+
+  insert_free(node);
+}
+
+auto OffsetAllocator::size() const -> uint32_t { return size_; }
+
+auto OffsetAllocator::free_space() const -> uint32_t { return freeSpace_; }
+
+auto OffsetAllocator::largest_free_range() const -> uint32_t {
+  if (topBits_ == 0) {
+    return 0;
+  }
+  // Somewhere in the highest class with any free range
+  uint32_t top = std::bit_width(topBits_) - 1;
+  uint32_t bin = (top << 3) | (std::bit_width(leafBits_[top]) - 1U);
+  uint32_t largest = 0;
+  for (uint32_t node = binHeads_[bin]; node != no_space;
+       node = nodes_[node].binNext) {
+    largest = std::max(largest, nodes_[node].size);
+  }
+  return largest;
+}
+
+auto OffsetAllocator::allocation_count() const -> uint32_t {
+  return allocationCount_;
+}
+
+auto OffsetAllocator::new_node() -> uint32_t {
+  if (!unusedNodes_.empty()) {
+    uint32_t node = unusedNodes_.back();
+    unusedNodes_.pop_back();
+    nodes_[node] = {};
+    return node;
+  }
+  nodes_.emplace_back();
+  return static_cast<uint32_t>(nodes_.size() - 1);
+}
+
+void OffsetAllocator::insert_free(uint32_t node) {
+  uint32_t bin = bin_round_down(nodes_[node].size);
+  nodes_[node].binPrev = no_space;
+  nodes_[node].binNext = binHeads_[bin];
+  if (binHeads_[bin] != no_space) {
+    nodes_[binHeads_[bin]].binPrev = node;
+  }
+  binHeads_[bin] = node;
+
+  leafBits_[bin >> 3] |= static_cast<uint8_t>(1U << (bin & 7));
+  topBits_ |= 1U << (bin >> 3);
+}
+
+void OffsetAllocator::remove_free(uint32_t node) {
+  uint32_t bin = bin_round_down(nodes_[node].size);
+  Node &removed = nodes_[node];
+  if (removed.binPrev != no_space) {
+    nodes_[removed.binPrev].binNext = removed.binNext;
+  } else {
+    binHeads_[bin] = removed.binNext;
+  }
+  if (removed.binNext != no_space) {
+    nodes_[removed.binNext].binPrev = removed.binPrev;
+  }
+  removed.binPrev = no_space;
+  removed.binNext = no_space;
+
+  if (binHeads_[bin] == no_space) {
+    leafBits_[bin >> 3] &= static_cast<uint8_t>(~(1U << (bin & 7)));
+    if (leafBits_[bin >> 3] == 0) {
+      topBits_ &= ~(1U << (bin >> 3));
+    }
+  }
+}
+
+auto OffsetAllocator::find_bin(uint32_t minBin) const -> uint32_t {
+  uint32_t top = minBin >> 3;
+  uint32_t leaf = leafBits_[top] & (0xffU << (minBin & 7)) & 0xffU;
+  if (leaf != 0) {
+    return (top << 3) | static_cast<uint32_t>(std::countr_zero(leaf));
+  }
+
+  // Any class of a higher power of two
+  uint32_t higher = top == 31 ? 0 : topBits_ & ~((2U << top) - 1);
+  if (higher == 0) {
+    return no_space;
+  }
+  top = static_cast<uint32_t>(std::countr_zero(higher));
+  return (top << 3) |
+         static_cast<uint32_t>(std::countr_zero(
+             static_cast<uint32_t>(leafBits_[top])));
+}
+
+} // namespace utils
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace utils {
+
+// Hands out ranges of a linear space, like the places of meshes in a large
+// buffer, in constant time. Free ranges are kept in size classes, eight per
+// power of two (two-level segregated fit), so a class whose ranges are all
+// large enough is found with two bit scans. Freed ranges merge with their
+// free neighbours right away.
+class OffsetAllocator {
+public:
+  static constexpr uint32_t no_space = 0xffffffff;
+
+  struct Allocation {
+    uint32_t offset = no_space;
+    // Identifies the range for free()
+    uint32_t node = no_space;
+  };
+
+  explicit OffsetAllocator(uint32_t size = 0);
+
+  // Forgets every allocation
+  void reset(uint32_t size);
+
+  // The offset is no_space when no free range is large enough
+  auto allocate(uint32_t size) -> Allocation;
+  void free(const Allocation &allocation);
+
+  [[nodiscard]] auto size() const -> uint32_t;
+  [[nodiscard]] auto free_space() const -> uint32_t;
+  [[nodiscard]] auto largest_free_range() const -> uint32_t;
+  [[nodiscard]] auto allocation_count() const -> uint32_t;
+
+private:
+  static constexpr uint32_t bin_count = 256;
+
+  struct Node {
+    uint32_t offset = 0;
+    uint32_t size = 0;
+    // Neighbours in the space, used or not
+    uint32_t prev = no_space;
+    uint32_t next = no_space;
+    // Neighbours in the free list of its size class
+    uint32_t binPrev = no_space;
+    uint32_t binNext = no_space;
+    bool used = false;
+  };
+
+  auto new_node() -> uint32_t;
+  void insert_free(uint32_t node);
+  void remove_free(uint32_t node);
+  // First class from minBin on with a free range, no_space when none
+  [[nodiscard]] auto find_bin(uint32_t minBin) const -> uint32_t;
+
+  uint32_t size_ = 0;
+  uint32_t freeSpace_ = 0;
+  uint32_t allocationCount_ = 0;
+  std::vector<Node> nodes_;
+  std::vector<uint32_t> unusedNodes_;
+  std::array<uint32_t, bin_count> binHeads_{};
+  // Bit i is set when any class of leafBits_[i] has a free range
+  uint32_t topBits_ = 0;
+  std::array<uint8_t, bin_count / 8> leafBits_{};
+};
+
+} // namespace utils
@@ -0,0 +1,154 @@
+#include "vk_asset_loader.hpp"
+
+#include "vk_engine.hpp"
+#include "vk_textures.hpp"
+
+#include <algorithm>
+#include <fmt/core.h>
+
+AssetLoader::AssetLoader(VulkanEngine &engine,
+                         const TextureStreamer &streamer)
+    : engine_(engine), streamer_(streamer) {}
+
+AssetLoader::~AssetLoader() { shutdown(); }
+
+void AssetLoader::load_mesh(const std::string &name,
+                            const std::filesystem::path &path) {
+  auto asset = std::make_unique<LoadedAsset>();
+  asset->kind = LoadedAsset::Kind::Mesh;
+  asset->name = name;
+  asset->path = path;
+  submit(std::move(asset));
+}
+
+void AssetLoader::load_texture(const std::string &name,
+                               const std::filesystem::path &path) {
+  auto asset = std::make_unique<LoadedAsset>();
+  asset->kind = LoadedAsset::Kind::Texture;
+  asset->name = name;
+  asset->path = path;
+  submit(std::move(asset));
+}
+
+void AssetLoader::load_streamed_texture(const std::string &name,
+                                        const std::filesystem::path &path) {
+  auto asset = std::make_unique<LoadedAsset>();
+  asset->kind = LoadedAsset::Kind::StreamedTexture;
+  asset->name = name;
+  asset->path = path;
+  submit(std::move(asset));
+}
+
+auto AssetLoader::take_finished() -> std::vector<std::unique_ptr<LoadedAsset>> {
+  // Loader threads only ever push, so taking the whole list at once needs no
+  // more than an exchange
+  LoadedAsset *node = finished_.exchange(nullptr, std::memory_order_acquire);
+
+  std::vector<std::unique_ptr<LoadedAsset>> assets;
+  while (node != nullptr) {
+    LoadedAsset *next = node->next;
+    node->next = nullptr;
+    assets.emplace_back(node);
+    node = next;
+  }
+  // The list is newest first
+  std::reverse(assets.begin(), assets.end());
+  return assets;
+}
+
+auto AssetLoader::in_flight() const -> size_t {
+  return inFlight_.load(std::memory_order_acquire);
+}
+
+void AssetLoader::wait() {
+  size_t count = inFlight_.load(std::memory_order_acquire);
+  while (count != 0) {
+    inFlight_.wait(count, std::memory_order_acquire);
+    count = inFlight_.load(std::memory_order_acquire);
+  }
+}
+
+void AssetLoader::shutdown() {
+  // Also waits for the jobs to return, not only for their assets
+  engine_._jobSystem.wait();
+
+  for (auto &&asset : take_finished()) {
+    if (asset->staging.mapped != nullptr) {
+      engine_.destroy_staging_buffer(asset->staging);
+    }
+    if (asset->streamed.staging.mapped != nullptr) {
+      engine_.destroy_staging_buffer(asset->streamed.staging);
+    }
+  }
+}
+
+void AssetLoader::submit(std::unique_ptr<LoadedAsset> asset) {
+  inFlight_.fetch_add(1, std::memory_order_relaxed);
+  // std::function wants a copyable job
+  engine_._jobSystem.submit([this, asset = asset.release()]() {
+    std::unique_ptr<LoadedAsset> owned(asset);
+    read(*owned);
+    finish(std::move(owned));
+  });
+}
+
+void AssetLoader::read(LoadedAsset &asset) {
+  switch (asset.kind) {
+  case LoadedAsset::Kind::Mesh:
+    read_mesh(asset);
+    break;
+  case LoadedAsset::Kind::Texture:
+    asset.loaded = vkutil::read_image_asset(engine_, asset.path,
+                                            asset.textureInfo, asset.staging);
+    break;
+  case LoadedAsset::Kind::StreamedTexture:
+    asset.loaded = streamer_.prepare(asset.path, asset.streamed);
+    break;
+  }
+}
+
+void AssetLoader::read_mesh(LoadedAsset &asset) {
+  // Mapped, the blob is read from the page cache straight into staging
+  assets::AssetFileView file;
+  if (!engine_.open_asset(asset.path, file)) {
+    utils::logger.dump(
+        fmt::format("Error when loading mesh {}", asset.path.string()),
+        spdlog::level::err);
+    return;
+  }
+
+  asset.meshInfo = assets::read_mesh_info(&file);
+  asset.meshLayout = assets::mesh_unpack_layout(&asset.meshInfo);
+
+  // The blob is decompressed straight into staging memory, which is also
+  // where the copies to the GPU buffers read from
+  asset.staging = engine_.create_staging_buffer(asset.meshLayout.size);
+  if (!assets::unpack_mesh(&asset.meshInfo, file.binaryBlob.data(),
+                           file.binaryBlob.size(), asset.meshLayout,
+                           asset.staging.mapped, &engine_._jobSystem)) {
+    utils::logger.dump(fmt::format("Corrupt mesh {}", asset.path.string()),
+                       spdlog::level::err);
+    engine_.destroy_staging_buffer(asset.staging);
+    return;
+  }
+  engine_.flush_staging_buffer(asset.staging);
+
+  asset.meshlets = assets::read_meshlets(
+      &asset.meshInfo, asset.staging.mapped + asset.meshLayout.meshletOffset);
+  asset.loaded = true;
+}
+
+void AssetLoader::finish(std::unique_ptr<LoadedAsset> asset) {
+  LoadedAsset *node = asset.release();
+  node->next = finished_.load(std::memory_order_relaxed);
+  while (!finished_.compare_exchange_weak(node->next, node,
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed)) {
+  }
+
+  // Counted down after the push, so seeing no request in flight means every
+  // asset is on the list
+  if (inFlight_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    inFlight_.notify_all();
+  }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "assetlib/mesh_asset.hpp"
+#include "assetlib/texture_asset.hpp"
+#include "vk_texture_streamer.hpp"
+#include "vk_types.hpp"
+#include <atomic>
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+class VulkanEngine;
+
+// An asset read and unpacked on a loader thread, waiting in staging memory
+// for the render thread to create its GPU resources
+struct LoadedAsset {
+  enum class Kind { Mesh, Texture, StreamedTexture };
+
+  Kind kind;
+  // Name the engine asked for it under
+  std::string name;
+  std::filesystem::path path;
+  // False when the file is missing or corrupt, nothing is staged then
+  bool loaded = false;
+
+  // Kind::Mesh: vertices and indices at meshLayout in staging
+  assets::MeshInfo meshInfo;
+  assets::MeshUnpackLayout meshLayout{};
+  assets::MeshletData meshlets;
+  // Kind::Texture: every mip level back to back in staging
+  assets::TextureInfo textureInfo;
+  StagingBuffer staging;
+  // Kind::StreamedTexture: the resident tail, for TextureStreamer::add
+  TextureStreamer::PendingTexture streamed;
+
+  // Next asset in the loader's list of finished ones
+  LoadedAsset *next = nullptr;
+};
+
+// Reads and unpacks baked assets on the job system, so the render thread can
+// set up the device, swapchain and pipelines, or keep drawing, meanwhile.
+// Finished assets are pushed on a lock-free list the render thread drains
+// with take_finished() to create their buffers and images.
+class AssetLoader {
+public:
+  AssetLoader(VulkanEngine &engine, const TextureStreamer &streamer);
+  ~AssetLoader();
+
+  AssetLoader(const AssetLoader &) = delete;
+  AssetLoader(AssetLoader &&other) noexcept = delete;
+  auto operator=(const AssetLoader &) -> AssetLoader & = delete;
+  auto operator=(AssetLoader &&other) noexcept -> AssetLoader & = delete;
+
+  void load_mesh(const std::string &name, const std::filesystem::path &path);
+  void load_texture(const std::string &name,
+                    const std::filesystem::path &path);
+  // Reads the tail levels only, the streamer loads the rest
+  void load_streamed_texture(const std::string &name,
+                             const std::filesystem::path &path);
+
+  // Assets that finished since the last call, oldest first. Render thread
+  // only.
+  auto take_finished() -> std::vector<std::unique_ptr<LoadedAsset>>;
+
+  // Requests still being read
+  [[nodiscard]] auto in_flight() const -> size_t;
+
+  // Blocks until every request was read
+  void wait();
+
+  // Waits for the requests and frees what nobody took
+  void shutdown();
+
+private:
+  void submit(std::unique_ptr<LoadedAsset> asset);
+  void read(LoadedAsset &asset);
+  void read_mesh(LoadedAsset &asset);
+  // Pushes the asset on finished_, from any thread
+  void finish(std::unique_ptr<LoadedAsset> asset);
+
+  VulkanEngine &engine_;
+  const TextureStreamer &streamer_;
+
+  std::atomic<LoadedAsset *> finished_{nullptr};
+  std::atomic<size_t> inFlight_{0};
+};
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "utils/logger.hpp"
+#include <cstdlib>
+#include <fmt/core.h>
+#include <string>
+#include <vulkan/vulkan.h>
+
+// We want to immediately abort when there is an error
+constexpr void VK_CHECK(VkResult err) {
+  if (err != 0) {
+    utils::logger.dump(
+        fmt::format("Detected Vulkan error: {}", std::to_string(err)),
+        spdlog::level::err);
+    abort();
+  }
+}
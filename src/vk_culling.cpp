@@ -0,0 +1,64 @@
+#include "vk_culling.hpp"
+
+#include <algorithm>
+
+auto Frustum::from_matrix(const glm::mat4 &viewproj) -> Frustum {
+  // Gribb/Hartmann plane extraction. GLM is column major, so row i is
+  // (m[0][i], m[1][i], m[2][i], m[3][i]).
+  auto row = [&](int i) {
+    return glm::vec4(viewproj[0][i], viewproj[1][i], viewproj[2][i],
+                     viewproj[3][i]);
+  };
+
+  Frustum frustum{};
+  frustum.planes = {row(3) + row(0), row(3) - row(0), row(3) + row(1),
+                    row(3) - row(1), row(3) + row(2), row(3) - row(2)};
+
+  for (auto &&plane : frustum.planes) {
+    plane /= glm::length(glm::vec3(plane));
+  }
+
+  return frustum;
+}
+
+auto Frustum::is_sphere_visible(const glm::vec3 &center, float radius) const
+    -> bool {
+  for (auto &&plane : planes) {
+    if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+      return false;
+    }
+  }
+  return true;
+}
+
+auto max_scale(const glm::mat4 &transform) -> float {
+  float x = glm::length(glm::vec3(transform[0]));
+  float y = glm::length(glm::vec3(transform[1]));
+  float z = glm::length(glm::vec3(transform[2]));
+  return std::max({x, y, z});
+}
+
+auto is_meshlet_visible(const MeshletBounds &meshlet,
+                        const glm::mat4 &transform, float scale,
+                        const Frustum &frustum,
+                        const glm::vec3 &cameraPosition) -> bool {
+  auto center = glm::vec3(transform * glm::vec4(meshlet.center, 1.0F));
+  float radius = meshlet.radius * scale;
+
+  if (!frustum.is_sphere_visible(center, radius)) {
+    return false;
+  }
+
+  // Every triangle faces away from the camera. Assumes no non-uniform
+  // scaling, which would skew the cone.
+  if (meshlet.coneCutoff < 1.0F) {
+    glm::vec3 axis = glm::normalize(glm::mat3(transform) * meshlet.coneAxis);
+    glm::vec3 offset = center - cameraPosition;
+    if (glm::dot(offset, axis) >=
+        meshlet.coneCutoff * glm::length(offset) + radius) {
+      return false;
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "vk_mesh.hpp"
+#include <array>
+#include <glm/glm.hpp>
+
+// View frustum as six world space planes with the normals pointing inside
+struct Frustum {
+  std::array<glm::vec4, 6> planes;
+
+  static auto from_matrix(const glm::mat4 &viewproj) -> Frustum;
+
+  [[nodiscard]] auto is_sphere_visible(const glm::vec3 &center,
+                                       float radius) const -> bool;
+};
+
+// Largest scale factor of a transform, to bring bounding spheres into world
+// space
+auto max_scale(const glm::mat4 &transform) -> float;
+
+// Frustum and normal cone test of a meshlet of an object with the given
+// transform
+auto is_meshlet_visible(const MeshletBounds &meshlet,
+                        const glm::mat4 &transform, float scale,
+                        const Frustum &frustum,
+                        const glm::vec3 &cameraPosition) -> bool;
@@ -4,6 +4,8 @@
 #include <SDL_vulkan.h>
 #include <glm/gtx/transform.hpp>
 
+#include "vk_check.hpp"
+#include "vk_culling.hpp"
 #include "vk_fonts.hpp"
 #include "vk_initializers.hpp"
 #include "vk_textures.hpp"
@@ -13,26 +15,21 @@
 #include "bindings/imgui_impl_vulkan.h"
 #include <VkBootstrap.h>
 
-#include "utils/timer.hpp"
+#include "utils/memory.hpp"
+#include <algorithm>
 #include <array>
 #include <cstdint>
 #include <fmt/core.h>
 #include <fstream>
+#include <limits>
 #include <numeric>
+#include <tuple>
 
 #include "./implementations/vma_implementation.hpp"
 
-// We want to immediately abort when there is an error
-constexpr void VK_CHECK(VkResult err) {
-  if (err != 0) {
-    utils::logger.dump(
-        fmt::format("Detected Vulkan error: {}", std::to_string(err)),
-        spdlog::level::err);
-    abort();
-  }
-}
-
 void VulkanEngine::init() {
+  _initStart = std::chrono::steady_clock::now();
+
   // We initialize SDL and create a window with it.
   SDL_Init(SDL_INIT_VIDEO);
 
@@ -57,15 +54,29 @@ void VulkanEngine::init() {
 
   // Initialization
   init_vulkan();
+  if (_assetArchive.open(_assetRoot / "assets.pack")) {
+    utils::logger.dump(fmt::format("Opened asset pack with {} assets",
+                                   _assetArchive.size()));
+  }
+  // Reading assets only needs the allocator, the loader gets through them
+  // while the swapchain, descriptors and pipelines are created
+  if (_asyncLoading) {
+    request_assets();
+  }
   init_swapchain();
   init_commands();
   init_default_renderpass();
   init_framebuffers();
   init_sync_structures();
   init_descriptors();
+  init_placeholder_texture();
   init_pipelines();
-  load_images();
   load_meshes();
+  if (!_asyncLoading) {
+    request_assets();
+    _assetLoader.wait();
+    land_loaded_assets();
+  }
   init_scene();
   init_imgui();
 
@@ -83,8 +94,8 @@ void VulkanEngine::init_vulkan() {
   // Make the Vulkan instance, with basic debug features
   auto inst_ret = builder.set_app_name("Example Vulkan Application")
                       .request_validation_layers(true)
-                      // Use 1.1 because MacOS doesn't yet have 1.2
-                      .require_api_version(1, 1, 0)
+                      // 1.2 for timeline semaphores
+                      .require_api_version(1, 2, 0)
                       .use_default_debug_messenger();
 
 // For MacOS (SDL uses deprecated API, see
@@ -102,12 +113,19 @@ void VulkanEngine::init_vulkan() {
   SDL_Vulkan_CreateSurface(_window, _instance, &_surface);
 
   // Use vkbootstrap to select a GPU.
-  // We want a GPU that can write to the SDL surface and supports Vulkan 1.1
+  // We want a GPU that can write to the SDL surface and supports Vulkan 1.2
+  // Uploads signal the frames waiting for them with a timeline semaphore
+  VkPhysicalDeviceVulkan12Features requiredFeatures12 = {};
+  requiredFeatures12.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  requiredFeatures12.timelineSemaphore = VK_TRUE;
+
   vkb::PhysicalDeviceSelector selector{vkb_inst};
   vkb::PhysicalDevice physicalDevice =
       selector
-          // Use 1.1 because MacOS doesn't yet have 1.2
-          .set_minimum_version(1, 1)
+          // MoltenVK has 1.2 too by now
+          .set_minimum_version(1, 2)
+          .set_required_features_12(requiredFeatures12)
           .set_surface(_surface)
           .add_desired_extension("VK_KHR_portability_subset")
           .select()
@@ -119,6 +137,21 @@ void VulkanEngine::init_vulkan() {
   // vk11features.pNext = nullptr;
 
   // vk11features.shaderDrawParameters = VK_TRUE;
+
+  // Baked textures are BC compressed by default. GPUs without BC support
+  // can still draw textures baked as RGBA8.
+  VkPhysicalDeviceFeatures availableFeatures = {};
+  vkGetPhysicalDeviceFeatures(physicalDevice.physical_device,
+                              &availableFeatures);
+  _textureCompressionBC = availableFeatures.textureCompressionBC == VK_TRUE;
+  if (_textureCompressionBC) {
+    physicalDevice.features.textureCompressionBC = VK_TRUE;
+  } else {
+    utils::logger.dump("The GPU has no BC texture support, only textures "
+                       "baked as RGBA8 can be loaded",
+                       spdlog::level::warn);
+  }
+
   // Create the final Vulkan device
   vkb::DeviceBuilder deviceBuilder{physicalDevice};
   vkb::Device vkbDevice = deviceBuilder.build().value();
@@ -132,6 +165,23 @@ void VulkanEngine::init_vulkan() {
   _graphicsQueueFamily =
       vkbDevice.get_queue_index(vkb::QueueType::graphics).value();
 
+  // Uploads go to a transfer queue family without graphics when the device
+  // has one, where they run next to the frames
+  auto transferQueue = vkbDevice.get_queue(vkb::QueueType::transfer);
+  if (transferQueue.has_value()) {
+    _transferQueue = transferQueue.value();
+    _transferQueueFamily =
+        vkbDevice.get_queue_index(vkb::QueueType::transfer).value();
+  } else {
+    _transferQueue = _graphicsQueue;
+    _transferQueueFamily = _graphicsQueueFamily;
+  }
+  utils::logger.dump(fmt::format("Uploading on queue family {}{}",
+                                 _transferQueueFamily,
+                                 _transferQueue == _graphicsQueue
+                                     ? ", the graphics queue"
+                                     : ""));
+
   // Initialize the memory allocator
   VmaAllocatorCreateInfo allocatorInfo = {};
   allocatorInfo.physicalDevice = _chosenGPU;
@@ -140,6 +190,15 @@ void VulkanEngine::init_vulkan() {
   vmaCreateAllocator(&allocatorInfo, &_allocator);
 
   vkGetPhysicalDeviceProperties(_chosenGPU, &_gpuProperties);
+
+  // Before init requests the assets, whose loaders stage them in the ring.
+  // Its ranges are aligned for copies to images of any format and for
+  // flushing without touching the neighbors.
+  VkDeviceSize stagingAlignment = std::max<VkDeviceSize>(
+      {16, _gpuProperties.limits.optimalBufferCopyOffsetAlignment,
+       _gpuProperties.limits.nonCoherentAtomSize});
+  _uploadQueue.init(_transferQueue, _transferQueueFamily, _graphicsQueueFamily,
+                    _stagingRingSize, stagingAlignment);
 }
 
 void VulkanEngine::init_imgui() {
@@ -594,15 +653,18 @@ void VulkanEngine::init_pipelines() {
 
   // Connect the pipeline builder vertex input info to the one we get from
   // Vertex
-  pipelineBuilder._vertexInputInfo.pVertexAttributeDescriptions =
-      vertexDescription.attributes.data();
-  pipelineBuilder._vertexInputInfo.vertexAttributeDescriptionCount =
-      static_cast<uint32_t>(vertexDescription.attributes.size());
-
-  pipelineBuilder._vertexInputInfo.pVertexBindingDescriptions =
-      vertexDescription.bindings.data();
-  pipelineBuilder._vertexInputInfo.vertexBindingDescriptionCount =
-      static_cast<uint32_t>(vertexDescription.bindings.size());
+  auto use_vertex_description = [&](const VertexInputDescription &desc) {
+    pipelineBuilder._vertexInputInfo.pVertexAttributeDescriptions =
+        desc.attributes.data();
+    pipelineBuilder._vertexInputInfo.vertexAttributeDescriptionCount =
+        static_cast<uint32_t>(desc.attributes.size());
+
+    pipelineBuilder._vertexInputInfo.pVertexBindingDescriptions =
+        desc.bindings.data();
+    pipelineBuilder._vertexInputInfo.vertexBindingDescriptionCount =
+        static_cast<uint32_t>(desc.bindings.size());
+  };
+  use_vertex_description(vertexDescription);
 
   // Create pipeline for textured drawing
   pipelineBuilder._shaderStages.push_back(
@@ -628,8 +690,29 @@ void VulkanEngine::init_pipelines() {
   VkPipeline texturePipeline =
       pipelineBuilder.build_pipeline(_device, _renderPass);
 
-  create_material(texturePipeline, texturedPipelineLayout, "terrain");
-  create_material(texturePipeline, texturedPipelineLayout, "character");
+  // Same pipeline for meshes with compact vertices, only the vertex input
+  // differs, and the vertex shader decodes their octahedral normals
+  VertexInputDescription packedVertexDescription =
+      Vertex::get_vertex_description(assets::VertexFormat::P32N8C8V16);
+  use_vertex_description(packedVertexDescription);
+  VkBool32 compactVertices = VK_TRUE;
+  VkSpecializationMapEntry compactVerticesEntry = {0, 0, sizeof(VkBool32)};
+  VkSpecializationInfo packedSpecialization = {
+      1, &compactVerticesEntry, sizeof(compactVertices), &compactVertices};
+  pipelineBuilder._shaderStages[0].pSpecializationInfo = &packedSpecialization;
+  VkPipeline packedTexturePipeline =
+      pipelineBuilder.build_pipeline(_device, _renderPass);
+  pipelineBuilder._shaderStages[0].pSpecializationInfo = nullptr;
+  use_vertex_description(vertexDescription);
+
+  MaterialPipelines texturePipelines{};
+  texturePipelines[static_cast<size_t>(assets::VertexFormat::PNCV_F32)] =
+      texturePipeline;
+  texturePipelines[static_cast<size_t>(assets::VertexFormat::P32N8C8V16)] =
+      packedTexturePipeline;
+
+  create_material(texturePipelines, texturedPipelineLayout, "terrain");
+  create_material(texturePipelines, texturedPipelineLayout, "character");
 
   // ------------------------------
   // Text pipeline
@@ -671,7 +754,11 @@ void VulkanEngine::init_pipelines() {
   pipelineBuilder._pipelineLayout = textPipelineLayout;
   VkPipeline textPipeline =
       pipelineBuilder.build_pipeline(_device, _renderPass);
-  create_material(textPipeline, textPipelineLayout, "text");
+
+  MaterialPipelines textPipelines{};
+  textPipelines[static_cast<size_t>(assets::VertexFormat::PNCV_F32)] =
+      textPipeline;
+  create_material(textPipelines, textPipelineLayout, "text");
 
   // Destroy all shader modules, outside of the queue
   vkDestroyShaderModule(_device, vertexShader, nullptr);
@@ -684,13 +771,21 @@ void VulkanEngine::init_pipelines() {
     vkDestroyPipelineLayout(_device, textPipelineLayout, nullptr);
 
     vkDestroyPipeline(_device, texturePipeline, nullptr);
+    vkDestroyPipeline(_device, packedTexturePipeline, nullptr);
     vkDestroyPipelineLayout(_device, texturedPipelineLayout, nullptr);
   });
 }
 
 void VulkanEngine::init_scene() {
-  // Create a sampler for the texture
-  auto blockySamplerInfo = vkinit::sampler_create_info(VK_FILTER_NEAREST);
+  auto &terrainTexture = _materialTextures["terrain_diffuse"];
+  auto &characterTexture = _materialTextures["character_diffuse"];
+
+  // Create a sampler for the texture. Its textures may still be loading,
+  // so the mip range is left to their image views. Repeating is left to the
+  // shader, which wraps the uvs inside the texture's region of its atlas.
+  auto blockySamplerInfo = vkinit::sampler_create_info(
+      VK_FILTER_NEAREST, VK_SAMPLER_ADDRESS_MODE_REPEAT);
+  blockySamplerInfo.maxLod = VK_LOD_CLAMP_NONE;
 
   VkSampler blockySampler;
   vkCreateSampler(_device, &blockySamplerInfo, nullptr, &blockySampler);
@@ -698,7 +793,8 @@ void VulkanEngine::init_scene() {
   _mainDeletionQueue.push_function(
       [=, this]() { vkDestroySampler(_device, blockySampler, nullptr); });
 
-  // Sampler for text
+  // Sampler for text. It stays on the full size level: averaging distance
+  // fields like colors blurs the glyph edges.
   auto textSamplerInfo = vkinit::sampler_create_info(VK_FILTER_LINEAR);
 
   VkSampler textSampler;
@@ -711,31 +807,8 @@ void VulkanEngine::init_scene() {
   Material *characterMat = get_material("character");
   Material *textMat = get_material("text");
 
-  // Allocate the descriptor set for single-texture to use on the material
-  VkDescriptorSetAllocateInfo allocInfo = {};
-  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-  allocInfo.pNext = nullptr;
-
-  allocInfo.descriptorPool = _descriptorPool;
-  allocInfo.descriptorSetCount = 1;
-  allocInfo.pSetLayouts = &_singleTextureSetLayout;
-
-  vkAllocateDescriptorSets(_device, &allocInfo, &terrainMat->textureSet);
-  vkAllocateDescriptorSets(_device, &allocInfo, &characterMat->textureSet);
-  vkAllocateDescriptorSets(_device, &allocInfo, &textMat->textureSet);
-
-  // Write to the descriptor set so that it points to our diffuse texture
-  VkDescriptorImageInfo terrainIBI = {
-      .sampler = blockySampler,
-      .imageView = _loadedTextures["terrain_diffuse"].imageView,
-      .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-  };
-
-  auto terrain_texture =
-      vkinit::write_descriptor_image(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                                     terrainMat->textureSet, &terrainIBI, 0);
-
-  vkUpdateDescriptorSets(_device, 1, &terrain_texture, 0, nullptr);
+  // Point the material at our diffuse texture
+  bind_material_texture(*terrainMat, terrainTexture, blockySampler);
 
   glm::vec2 gridSize = {50, 50};
   glm::vec2 gridOffset = gridSize / -2.F;
@@ -754,18 +827,7 @@ void VulkanEngine::init_scene() {
     }
   }
 
-  // Write to the descriptor set so that it points to our diffuse texture
-  VkDescriptorImageInfo characterIBI = {
-      .sampler = blockySampler,
-      .imageView = _loadedTextures["character_diffuse"].imageView,
-      .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-  };
-
-  auto character_texture = vkinit::write_descriptor_image(
-      VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, characterMat->textureSet,
-      &characterIBI, 0);
-
-  vkUpdateDescriptorSets(_device, 1, &character_texture, 0, nullptr);
+  bind_material_texture(*characterMat, characterTexture, blockySampler);
 
   RenderObject character = {.mesh = get_mesh("character"),
                             .material = get_material("character"),
@@ -774,18 +836,44 @@ void VulkanEngine::init_scene() {
 
   _renderables.push_back(character);
 
-  // Write to the descriptor set so that it points to our diffuse texture
-  VkDescriptorImageInfo textIBI = {
-      .sampler = textSampler,
-      .imageView = _loadedTextures["text_msdf"].imageView,
-      .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-  };
+  // Point the text material at the font once it's loaded, in a set of its
+  // own since the placeholder's may be in use by then
+  auto bindFont = [this, textMat, textSampler]() {
+    auto font = _loadedTextures.find("text_msdf");
+    if (font == _loadedTextures.end()) {
+      return false;
+    }
 
-  auto text_texture =
-      vkinit::write_descriptor_image(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                                     textMat->textureSet, &textIBI, 0);
+    // Allocate the descriptor set for single-texture to use on the material
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.pNext = nullptr;
+
+    allocInfo.descriptorPool = _descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &_singleTextureSetLayout;
+
+    VkDescriptorSet textSet;
+    vkAllocateDescriptorSets(_device, &allocInfo, &textSet);
 
-  vkUpdateDescriptorSets(_device, 1, &text_texture, 0, nullptr);
+    // Write to the descriptor set so that it points to our font texture
+    VkDescriptorImageInfo textIBI = {
+        .sampler = textSampler,
+        .imageView = font->second.imageView,
+        .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+    };
+
+    auto text_texture = vkinit::write_descriptor_image(
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, textSet, &textIBI, 0);
+
+    vkUpdateDescriptorSets(_device, 1, &text_texture, 0, nullptr);
+    textMat->textureSet = textSet;
+    return true;
+  };
+  if (!bindFont()) {
+    textMat->textureSet = _placeholderSet;
+    _pendingBindings.emplace_back(bindFont);
+  }
 
   // RenderObject text = {
   //     .mesh = get_mesh("text"),
@@ -819,6 +907,22 @@ void VulkanEngine::init_scene() {
         "Glyph {}, atlasBottom {}, atlasLeft {}, atlasRight {}, atlasTop {}",
         unicode, atlas.bottom, atlas.left, atlas.right, atlas.top));
   }
+
+  sort_renderables();
+}
+
+void VulkanEngine::sort_renderables() {
+  // Meshes with 16 and 32 bit indices share the pool's index buffer, which
+  // is bound again whenever the index type changes
+  std::stable_sort(_renderables.begin(), _renderables.end(),
+                   [](const RenderObject &a, const RenderObject &b) {
+                     return std::tie(a.material->pipelineLayout,
+                                     a.material->textureSet,
+                                     a.mesh->_indexType, a.mesh) <
+                            std::tie(b.material->pipelineLayout,
+                                     b.material->textureSet,
+                                     b.mesh->_indexType, b.mesh);
+                   });
 }
 
 void VulkanEngine::init_descriptors() {
@@ -828,17 +932,18 @@ void VulkanEngine::init_descriptors() {
       create_buffer(sceneParamBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
                     VMA_MEMORY_USAGE_CPU_TO_GPU);
 
-  // Create a descriptor pool that will hold 10 uniform buffers
+  // Create a descriptor pool that will hold 10 uniform buffers. Textures
+  // get a set each on top of the placeholder's, which stay allocated.
   std::vector<VkDescriptorPoolSize> sizes = {
       {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 10},
       {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 10},
       {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 10},
-      {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 10}};
+      {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 20}};
 
   VkDescriptorPoolCreateInfo pool_info = {};
   pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
   pool_info.flags = 0;
-  pool_info.maxSets = 10;
+  pool_info.maxSets = 20;
   pool_info.poolSizeCount = static_cast<uint32_t>(sizes.size());
   pool_info.pPoolSizes = sizes.data();
 
@@ -986,169 +1091,379 @@ void VulkanEngine::init_descriptors() {
   }
 }
 
+void VulkanEngine::init_placeholder_texture() {
+  constexpr VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
+  StagingBuffer staging = create_staging_buffer(4);
+  memset(staging.mapped, 0xff, 4);
+  flush_staging_buffer(staging);
+  _placeholderTexture.image =
+      vkutil::upload_image(1, 1, format, *this, staging);
+  _placeholderTexture.imageView = _placeholderTexture.image._defaultView;
+  _uploadQueue.free_staging(staging);
+
+  // The textured materials sample arrays
+  VkImageView arrayView;
+  auto arrayInfo = vkinit::imageview_create_info(
+      format, _placeholderTexture.image._image, VK_IMAGE_ASPECT_COLOR_BIT, 1, 1,
+      VK_IMAGE_VIEW_TYPE_2D_ARRAY);
+  vkCreateImageView(_device, &arrayInfo, nullptr, &arrayView);
+
+  auto samplerInfo = vkinit::sampler_create_info(VK_FILTER_NEAREST);
+  VkSampler sampler;
+  vkCreateSampler(_device, &samplerInfo, nullptr, &sampler);
+
+  _mainDeletionQueue.push_function([=, this]() {
+    vkDestroySampler(_device, sampler, nullptr);
+    vkDestroyImageView(_device, arrayView, nullptr);
+  });
+
+  VkDescriptorSetAllocateInfo allocInfo = {};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = _descriptorPool;
+  allocInfo.descriptorSetCount = 1;
+  allocInfo.pSetLayouts = &_singleTextureSetLayout;
+
+  vkAllocateDescriptorSets(_device, &allocInfo, &_placeholderArraySet);
+  vkAllocateDescriptorSets(_device, &allocInfo, &_placeholderSet);
+
+  std::array<VkDescriptorImageInfo, 2> imageInfos = {{
+      {.sampler = sampler,
+       .imageView = arrayView,
+       .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+      {.sampler = sampler,
+       .imageView = _placeholderTexture.imageView,
+       .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+  }};
+  std::array<VkWriteDescriptorSet, 2> writes = {
+      vkinit::write_descriptor_image(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                     _placeholderArraySet, &imageInfos[0], 0),
+      vkinit::write_descriptor_image(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                     _placeholderSet, &imageInfos[1], 0)};
+  vkUpdateDescriptorSets(_device, static_cast<uint32_t>(writes.size()),
+                         writes.data(), 0, nullptr);
+}
+
 void VulkanEngine::load_meshes() {
-  Mesh terrain{};
-  Mesh character{};
   Mesh text{};
-  {
-    utils::Timer timer("Loading mesh took");
-
-    terrain.load_from_meshasset("./assets/terrain/terrain.mesh");
-    upload_mesh(terrain);
-
-    character.load_from_meshasset("./assets/character/character.mesh");
-    upload_mesh(character);
-
-    text._vertices.resize(6);
-    text._vertices[0] = {.position = glm::vec3(1.F, 0.F, 1.F),
-                         .normal = glm::vec3(0.F),
-                         .color = glm::vec3(0.F),
-                         .uv = glm::vec2(1.F, 1.F)};
-    text._vertices[1] = {.position = glm::vec3(1.F, 0.F, -1.F),
-                         .normal = glm::vec3(0.F),
-                         .color = glm::vec3(0.F),
-                         .uv = glm::vec2(1.F, 0.F)};
-    text._vertices[2] = {.position = glm::vec3(-1.F, 0.F, -1.F),
-                         .normal = glm::vec3(0.F),
-                         .color = glm::vec3(0.F),
-                         .uv = glm::vec2(0.F, 0.F)};
-    text._vertices[3] = {.position = glm::vec3(-1.F, 0.F, -1.F),
-                         .normal = glm::vec3(0.F),
-                         .color = glm::vec3(0.F),
-                         .uv = glm::vec2(0.F, 0.F)};
-    text._vertices[4] = {.position = glm::vec3(-1.F, 0.F, 1.F),
-                         .normal = glm::vec3(0.F),
-                         .color = glm::vec3(0.F),
-                         .uv = glm::vec2(0.F, 1.F)};
-    text._vertices[5] = {.position = glm::vec3(1.F, 0.F, 1.F),
-                         .normal = glm::vec3(0.F),
-                         .color = glm::vec3(0.F),
-                         .uv = glm::vec2(1.F, 1.F)};
-
-    upload_mesh(text);
-  }
+  std::array<Vertex, 6> textVertices;
+  textVertices[0] = {.position = glm::vec3(1.F, 0.F, 1.F),
+                     .normal = glm::vec3(0.F),
+                     .color = glm::vec3(0.F),
+                     .uv = glm::vec2(1.F, 1.F)};
+  textVertices[1] = {.position = glm::vec3(1.F, 0.F, -1.F),
+                     .normal = glm::vec3(0.F),
+                     .color = glm::vec3(0.F),
+                     .uv = glm::vec2(1.F, 0.F)};
+  textVertices[2] = {.position = glm::vec3(-1.F, 0.F, -1.F),
+                     .normal = glm::vec3(0.F),
+                     .color = glm::vec3(0.F),
+                     .uv = glm::vec2(0.F, 0.F)};
+  textVertices[3] = {.position = glm::vec3(-1.F, 0.F, -1.F),
+                     .normal = glm::vec3(0.F),
+                     .color = glm::vec3(0.F),
+                     .uv = glm::vec2(0.F, 0.F)};
+  textVertices[4] = {.position = glm::vec3(-1.F, 0.F, 1.F),
+                     .normal = glm::vec3(0.F),
+                     .color = glm::vec3(0.F),
+                     .uv = glm::vec2(0.F, 1.F)};
+  textVertices[5] = {.position = glm::vec3(1.F, 0.F, 1.F),
+                     .normal = glm::vec3(0.F),
+                     .color = glm::vec3(0.F),
+                     .uv = glm::vec2(1.F, 1.F)};
+  text.set_vertices(textVertices);
+
+  upload_mesh(text);
 
-  _meshes["terrain"] = terrain;
-  _meshes["character"] = character;
   _meshes["text"] = text;
 }
 
-void VulkanEngine::load_images() {
-  Texture terrain;
-  {
-    utils::Timer timer("Loading asset took");
-    vkutil::load_image_from_asset(
-        *this, "./assets/terrain/Textures/Tiled_Stone_Grey_Flat_Albedo.tx",
-        terrain.image);
-  }
+void VulkanEngine::request_assets() {
+  request_images();
+  request_meshes();
+}
+
+void VulkanEngine::request_meshes() {
+  // Drawn from the frame they land on, the objects using them are skipped
+  // until then
+  _meshes["terrain"] = {};
+  _meshes["character"] = {};
+  _assetLoader.load_mesh("terrain", "./assets/terrain/terrain.mesh");
+  _assetLoader.load_mesh("character", "./assets/character/character.mesh");
+}
 
-  auto terrainImageInfo = vkinit::imageview_create_info(
-      VK_FORMAT_R8G8B8A8_SRGB, terrain.image._image, VK_IMAGE_ASPECT_COLOR_BIT);
-  vkCreateImageView(_device, &terrainImageInfo, nullptr, &terrain.imageView);
+void VulkanEngine::request_images() {
+  request_texture_atlases();
 
-  _mainDeletionQueue.push_function(
-      [=, this]() { vkDestroyImageView(_device, terrain.imageView, nullptr); });
+  // Textures that aren't in an atlas only get their small mips loaded here,
+  // the rest streams in while drawing
+  _textureStreamer.set_budget(texture_budget);
+  request_material_texture("terrain_diffuse",
+                           "terrain/Textures/Tiled_Stone_Grey_Flat_Albedo.tx");
+  request_material_texture("character_diffuse",
+                           "character/Textures/Character_Albedo.tx");
 
-  _loadedTextures["terrain_diffuse"] = terrain;
+  // The font atlas is always needed at full size
+  _assetLoader.load_texture("text_msdf", "./assets/fonts/Roboto-Regular.tx");
+}
 
-  Texture character;
-  {
-    utils::Timer timer("Loading asset took");
-    vkutil::load_image_from_asset(
-        *this, "./assets/character/Textures/Character_Albedo.tx",
-        character.image);
+void VulkanEngine::request_texture_atlases() {
+  for (auto format :
+       {assets::TextureFormat::RGBA8, assets::TextureFormat::BC1,
+        assets::TextureFormat::BC3, assets::TextureFormat::BC5,
+        assets::TextureFormat::BC7}) {
+    // The baker only writes the atlases it had textures for
+    auto name = assets::atlas_file_name(format);
+    auto path = _assetRoot / name;
+    assets::AssetFileView file;
+    if (!open_asset(path, file)) {
+      continue;
+    }
+    // The regions are in the metadata, so materials can be pointed at them
+    // before the pixels arrive
+    auto info = assets::read_texture_info(&file);
+
+    TextureAtlas atlas;
+    atlas.name = name;
+    for (auto &&region : info.regions) {
+      atlas.regions[region.name] = region;
+    }
+    _assetLoader.load_texture(name, path);
+    _textureAtlases.push_back(std::move(atlas));
   }
+}
 
-  auto characterImageInfo = vkinit::imageview_create_info(
-      VK_FORMAT_R8G8B8A8_SRGB, character.image._image,
-      VK_IMAGE_ASPECT_COLOR_BIT);
-  vkCreateImageView(_device, &characterImageInfo, nullptr,
-                    &character.imageView);
+void VulkanEngine::request_material_texture(const std::string &name,
+                                            const std::string &file) {
+  for (auto &&atlas : _textureAtlases) {
+    auto region = atlas.regions.find(file);
+    if (region != atlas.regions.end()) {
+      _materialTextures[name] = {.atlas = &atlas, .region = region->second};
+      return;
+    }
+  }
+  // Gets its handle when the tail lands
+  _materialTextures[name] = {};
+  _assetLoader.load_streamed_texture(name, _assetRoot / file);
+}
 
-  _mainDeletionQueue.push_function([=, this]() {
-    vkDestroyImageView(_device, character.imageView, nullptr);
-  });
-  _loadedTextures["character_diffuse"] = character;
+void VulkanEngine::land_loaded_assets() {
+  // Read before taking the list: the loader counts an asset down after
+  // pushing it, so with none in flight this takes the last of them
+  bool lastAssets = _assetLoader.in_flight() == 0;
+  auto loaded = _assetLoader.take_finished();
 
-  Texture text;
-  {
-    utils::Timer timer("Loading asset took");
-    vkutil::load_image_from_asset(*this, "./assets/fonts/Roboto-Regular.tx",
-                                  text.image);
+  for (auto &&asset : loaded) {
+    if (!asset->loaded) {
+      continue;
+    }
+    switch (asset->kind) {
+    case LoadedAsset::Kind::Mesh:
+      upload_mesh_asset(_meshes[asset->name], *asset);
+      break;
+    case LoadedAsset::Kind::Texture:
+      land_texture(*asset);
+      break;
+    case LoadedAsset::Kind::StreamedTexture:
+      _materialTextures[asset->name].streamed =
+          _textureStreamer.add(std::move(asset->streamed));
+      break;
+    }
   }
 
-  auto textImageInfo = vkinit::imageview_create_info(
-      VK_FORMAT_R8G8B8A8_SRGB, text.image._image, VK_IMAGE_ASPECT_COLOR_BIT);
-  vkCreateImageView(_device, &textImageInfo, nullptr, &text.imageView);
+  // Materials leave the placeholder for sets of their own, so the objects
+  // are grouped again
+  if (!loaded.empty() &&
+      std::erase_if(_pendingBindings, [](auto &bind) { return bind(); }) !=
+          0) {
+    sort_renderables();
+  }
 
-  _mainDeletionQueue.push_function(
-      [=, this]() { vkDestroyImageView(_device, text.imageView, nullptr); });
-  _loadedTextures["text_msdf"] = text;
+  if (lastAssets && !_assetsLanded) {
+    _assetsLanded = true;
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - _initStart;
+    utils::logger.dump(
+        fmt::format("All assets loaded {:.1f}ms after start in {} upload "
+                    "submits, {} staging buffers outside the ring, peak "
+                    "memory {:.1f}MB",
+                    elapsed.count(), _uploadQueue.submit_count(),
+                    _uploadQueue.dedicated_staging_count(),
+                    static_cast<double>(utils::peak_rss_bytes()) /
+                        (1024.0 * 1024.0)));
+  }
 }
 
-void VulkanEngine::upload_mesh(Mesh &mesh) {
-  const size_t bufferSize = mesh._vertices.size() * sizeof(Vertex);
-  // Allocate staging buffer
-  VkBufferCreateInfo stagingBufferInfo = {};
-  stagingBufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-  stagingBufferInfo.pNext = nullptr;
+void VulkanEngine::land_texture(LoadedAsset &asset) {
+  Texture texture;
+  texture.image =
+      vkutil::upload_image_asset(*this, asset.textureInfo, asset.staging);
+  _uploadQueue.free_staging(asset.staging);
+
+  auto atlas = std::find_if(
+      _textureAtlases.begin(), _textureAtlases.end(),
+      [&](const TextureAtlas &atlas) { return atlas.name == asset.name; });
+  if (atlas != _textureAtlases.end()) {
+    auto layerCount = std::max(asset.textureInfo.pixelsize[2], 1U);
+    auto imageInfo = vkinit::imageview_create_info(
+        texture.image.format, texture.image._image, VK_IMAGE_ASPECT_COLOR_BIT,
+        static_cast<uint32_t>(texture.image.mipLevels), layerCount,
+        VK_IMAGE_VIEW_TYPE_2D_ARRAY);
+    vkCreateImageView(_device, &imageInfo, nullptr, &texture.imageView);
+    _mainDeletionQueue.push_function([this, view = texture.imageView]() {
+      vkDestroyImageView(_device, view, nullptr);
+    });
 
-  stagingBufferInfo.size = bufferSize;
-  stagingBufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    atlas->texture = texture;
+    utils::logger.dump(fmt::format("Loaded {} textures from {}",
+                                   atlas->regions.size(), asset.name));
+    return;
+  }
 
-  // Let the VMA library know that this data should be on CPU RAM
-  VmaAllocationCreateInfo vmaallocInfo = {};
-  vmaallocInfo.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+  auto imageInfo = vkinit::imageview_create_info(
+      texture.image.format, texture.image._image, VK_IMAGE_ASPECT_COLOR_BIT);
+  vkCreateImageView(_device, &imageInfo, nullptr, &texture.imageView);
 
-  AllocatedBuffer stagingBuffer;
+  _mainDeletionQueue.push_function([this, view = texture.imageView]() {
+    vkDestroyImageView(_device, view, nullptr);
+  });
+  _loadedTextures[asset.name] = texture;
+}
 
-  // Allocate the buffer
-  VK_CHECK(vmaCreateBuffer(_allocator, &stagingBufferInfo, &vmaallocInfo,
-                           &stagingBuffer._buffer, &stagingBuffer._allocation,
-                           nullptr));
+void VulkanEngine::bind_material_texture(Material &material,
+                                         MaterialTexture &texture,
+                                         VkSampler sampler) {
+  if (!texture.is_loaded()) {
+    material.textureSet = _placeholderArraySet;
+    _pendingBindings.emplace_back([this, &material, &texture, sampler]() {
+      if (!texture.is_loaded()) {
+        return false;
+      }
+      bind_material_texture(material, texture, sampler);
+      return true;
+    });
+    return;
+  }
 
-  // Copy vertex data
-  void *data;
-  vmaMapMemory(_allocator, stagingBuffer._allocation, &data);
-  memcpy(data, mesh._vertices.data(), bufferSize);
-  vmaUnmapMemory(_allocator, stagingBuffer._allocation);
+  if (texture.atlas == nullptr) {
+    // The streamer owns the set, and replaces it as the image changes
+    _textureStreamer.bind(texture.streamed, material.textureSet,
+                          _singleTextureSetLayout, 0, sampler);
+    material.streamedTexture = texture.streamed;
+    return;
+  }
 
-  // Allocate vertex buffer
-  VkBufferCreateInfo vertexBufferInfo = {};
-  vertexBufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-  vertexBufferInfo.pNext = nullptr;
+  TextureAtlas &atlas = *texture.atlas;
+  if (atlas.textureSet == VK_NULL_HANDLE) {
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = _descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &_singleTextureSetLayout;
+    vkAllocateDescriptorSets(_device, &allocInfo, &atlas.textureSet);
+
+    VkDescriptorImageInfo imageInfo = {
+        .sampler = sampler,
+        .imageView = atlas.texture.imageView,
+        .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+    };
+    auto write = vkinit::write_descriptor_image(
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, atlas.textureSet,
+        &imageInfo, 0);
+    vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+  }
+
+  const auto &region = texture.region;
+  material.textureSet = atlas.textureSet;
+  material.uvTransform = {region.uvScale[0], region.uvScale[1],
+                          region.uvOffset[0], region.uvOffset[1]};
+  material.textureLayer = region.layer;
+}
 
-  vertexBufferInfo.size = bufferSize;
-  // This buffer is going to be used as a Vertex Buffer
-  vertexBufferInfo.usage =
-      static_cast<unsigned int>(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT) |
-      static_cast<unsigned int>(VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+void VulkanEngine::upload_mesh(Mesh &mesh) {
+  const size_t vertexBufferSize = mesh.vertex_buffer_size();
+  const size_t indexBufferSize = mesh.index_buffer_size();
+
+  mesh._geometry = _geometryPool.allocate(mesh._vertexFormat,
+                                          mesh._vertexCount, mesh._indexCount,
+                                          mesh._indexType);
+  if (mesh._geometry == GeometryPool::no_geometry) {
+    return;
+  }
+  GeometryRange geometry = _geometryPool.range(mesh._geometry);
+
+  // Built on the CPU, so it goes through the staging ring piece by piece
+  // however large it is
+  _uploadQueue.upload_buffer(geometry.vertexBuffer, geometry.vertexByteOffset,
+                             mesh._vertexData.data(), vertexBufferSize);
+  if (indexBufferSize != 0) {
+    _uploadQueue.upload_buffer(geometry.indexBuffer, geometry.indexByteOffset,
+                               mesh._indexData.data(), indexBufferSize);
+  }
+  release_mesh_geometry();
+}
+
+auto VulkanEngine::upload_mesh_asset(Mesh &mesh, LoadedAsset &asset) -> bool {
+  bool valid = mesh.set_asset_info(asset.meshInfo, asset.path);
+  if (valid) {
+    mesh.set_meshlets(asset.meshlets);
+    upload_mesh_buffers(mesh, asset.staging, asset.meshLayout.vertexOffset,
+                        asset.meshLayout.indexOffset);
+
+    utils::logger.dump(fmt::format("Loaded mesh {}: Verts={}, Tris={}, "
+                                   "Meshlets={}, LODs={}",
+                                   asset.path.string(), mesh._vertexCount,
+                                   mesh._indexCount / 3, mesh._meshlets.size(),
+                                   mesh._lods.size()));
+    _uploadQueue.free_staging(asset.staging);
+  } else {
+    destroy_staging_buffer(asset.staging);
+  }
+  return valid;
+}
 
-  // Let the VMA library know that this data should be GPU native
-  vmaallocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+void VulkanEngine::upload_mesh_buffers(Mesh &mesh,
+                                       const StagingBuffer &staging,
+                                       size_t vertexOffset,
+                                       size_t indexOffset) {
+  const size_t vertexBufferSize = mesh.vertex_buffer_size();
+  const size_t indexBufferSize = mesh.index_buffer_size();
+
+  mesh._geometry = _geometryPool.allocate(mesh._vertexFormat,
+                                          mesh._vertexCount, mesh._indexCount,
+                                          mesh._indexType);
+  if (mesh._geometry == GeometryPool::no_geometry) {
+    return;
+  }
+  GeometryRange geometry = _geometryPool.range(mesh._geometry);
 
-  // Allocate the buffer
-  VK_CHECK(vmaCreateBuffer(_allocator, &vertexBufferInfo, &vmaallocInfo,
-                           &mesh._vertexBuffer._buffer,
-                           &mesh._vertexBuffer._allocation, nullptr));
+  VkBuffer stagingBuffer = staging.buffer._buffer;
+  VkDeviceSize stagingOffset = staging.offset;
 
-  immediate_submit([=](VkCommandBuffer cmd) {
+  _uploadQueue.record([=](VkCommandBuffer cmd) {
     VkBufferCopy copy;
-    copy.dstOffset = 0;
-    copy.srcOffset = 0;
-    copy.size = bufferSize;
-    vkCmdCopyBuffer(cmd, stagingBuffer._buffer, mesh._vertexBuffer._buffer, 1,
-                    &copy);
-  });
-
-  // Add the destruction of triangle mesh buffer to the deletion queue
-  _mainDeletionQueue.push_function([=, this]() {
-    vmaDestroyBuffer(_allocator, mesh._vertexBuffer._buffer,
-                     mesh._vertexBuffer._allocation);
+    copy.dstOffset = geometry.vertexByteOffset;
+    copy.srcOffset = stagingOffset + vertexOffset;
+    copy.size = vertexBufferSize;
+    vkCmdCopyBuffer(cmd, stagingBuffer, geometry.vertexBuffer, 1, &copy);
+
+    if (indexBufferSize != 0) {
+      copy.dstOffset = geometry.indexByteOffset;
+      copy.srcOffset = stagingOffset + indexOffset;
+      copy.size = indexBufferSize;
+      vkCmdCopyBuffer(cmd, stagingBuffer, geometry.indexBuffer, 1, &copy);
+    }
   });
+  release_mesh_geometry();
+}
 
-  vmaDestroyBuffer(_allocator, stagingBuffer._buffer,
-                   stagingBuffer._allocation);
+void VulkanEngine::release_mesh_geometry() {
+  // The pool's buffers are shared by both queue families, so there is no
+  // ownership to hand over
+  _uploadQueue.release_shared(VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                              static_cast<unsigned int>(
+                                  VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT) |
+                                  static_cast<unsigned int>(
+                                      VK_ACCESS_INDEX_READ_BIT));
 }
 
 auto VulkanEngine::load_shader_module(const std::filesystem::path &filePath,
@@ -1199,9 +1514,10 @@ auto VulkanEngine::load_shader_module(const std::filesystem::path &filePath,
   return true;
 }
 
-auto VulkanEngine::create_material(VkPipeline pipeline, VkPipelineLayout layout,
+auto VulkanEngine::create_material(const MaterialPipelines &pipelines,
+                                   VkPipelineLayout layout,
                                    const std::string &name) -> Material * {
-  Material mat = {.pipeline = pipeline, .pipelineLayout = layout};
+  Material mat = {.pipelines = pipelines, .pipelineLayout = layout};
   _materials[name] = mat;
   return &_materials[name];
 }
@@ -1247,20 +1563,73 @@ void VulkanEngine::draw_objects(VkCommandBuffer cmd, RenderObject *first,
   for (size_t i = 0; i != count; ++i) {
     RenderObject &object = first[i];
     objectSSBO[i].modelMatrix = object.transformMatrix;
+    objectSSBO[i].uvTransform = object.material->uvTransform;
+    objectSSBO[i].textureLayer = object.material->textureLayer;
   }
   vmaUnmapMemory(_allocator, get_current_frame().objectBuffer._allocation);
 
-  Mesh *lastMesh = nullptr;
-  Material *lastMaterial = nullptr;
+  Frustum frustum = Frustum::from_matrix(camData.viewproj);
+  // Screen pixels covered by a unit radius at unit distance
+  float pixelsPerUnit = glm::abs(projection[1][1]) *
+                        static_cast<float>(_windowExtent.height) / 2.0F;
+
+  VkBuffer lastVertexBuffer = VK_NULL_HANDLE;
+  VkBuffer lastIndexBuffer = VK_NULL_HANDLE;
+  VkIndexType lastIndexType = VK_INDEX_TYPE_UINT32;
+  VkPipelineLayout lastLayout = VK_NULL_HANDLE;
+  VkDescriptorSet lastTextureSet = VK_NULL_HANDLE;
+  VkPipeline lastPipeline = VK_NULL_HANDLE;
 
   for (size_t i = 0; i != count; ++i) {
     RenderObject &object = first[i];
 
+    // Meshes still loading have no geometry yet
+    if (object.mesh->_geometry == GeometryPool::no_geometry) {
+      continue;
+    }
+
+    // Skip objects outside of the view, their meshlets are culled below
+    float scale = max_scale(object.transformMatrix);
+    size_t lod = 0;
+    if (object.mesh->bounds.valid) {
+      auto center = glm::vec3(object.transformMatrix *
+                              glm::vec4(object.mesh->bounds.origin, 1.0F));
+      float radius = object.mesh->bounds.radius * scale;
+      if (!frustum.is_sphere_visible(center, radius)) {
+        continue;
+      }
+
+      float distance = glm::length(center - _camera.position);
+      float screenRadius = std::numeric_limits<float>::max();
+      if (distance > radius) {
+        screenRadius = radius / distance * pixelsPerUnit;
+        lod = object.mesh->select_lod(screenRadius);
+      }
+      _textureStreamer.request(object.material->streamedTexture,
+                               2.0F * screenRadius);
+    } else {
+      _textureStreamer.request(object.material->streamedTexture,
+                               std::numeric_limits<float>::max());
+    }
+
+    // Pipeline matching the vertex format the mesh was uploaded in
+    VkPipeline pipeline = object.material->pipelines[static_cast<size_t>(
+        object.mesh->_vertexFormat)];
+    if (pipeline == VK_NULL_HANDLE) {
+      continue;
+    }
+
     // Only bind the pipeline if it doesn't match with the already bound one
-    if (object.material != lastMaterial) {
-      vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                        object.material->pipeline);
-      lastMaterial = object.material;
+    if (pipeline != lastPipeline) {
+      vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+      lastPipeline = pipeline;
+    }
+
+    // Materials with the same layout share the global and object sets, and
+    // the ones with textures in the same atlas share the texture set too
+    if (object.material->pipelineLayout != lastLayout) {
+      lastLayout = object.material->pipelineLayout;
+      lastTextureSet = VK_NULL_HANDLE;
 
       unsigned int frameIndex = _frameNumber % _frames.size();
 
@@ -1276,13 +1645,16 @@ void VulkanEngine::draw_objects(VkCommandBuffer cmd, RenderObject *first,
       vkCmdBindDescriptorSets(
           cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, object.material->pipelineLayout,
           1, 1, &get_current_frame().objectDescriptor, 0, nullptr);
+    }
 
-      if (object.material->textureSet != VK_NULL_HANDLE) {
-        // Texture descriptor
-        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                                object.material->pipelineLayout, 2, 1,
-                                &object.material->textureSet, 0, nullptr);
-      }
+    if (object.material->textureSet != lastTextureSet &&
+        object.material->textureSet != VK_NULL_HANDLE) {
+      lastTextureSet = object.material->textureSet;
+
+      // Texture descriptor
+      vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                              object.material->pipelineLayout, 2, 1,
+                              &object.material->textureSet, 0, nullptr);
     }
 
     MeshPushConstants constants = {.data = glm::vec4(0),
@@ -1293,17 +1665,66 @@ void VulkanEngine::draw_objects(VkCommandBuffer cmd, RenderObject *first,
                        VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshPushConstants),
                        &constants);
 
-    // Only bind the mesh if it's a different one from last bind
-    if (object.mesh != lastMesh) {
-      // Bind the mesh vertex buffer with offset 0
+    // Meshes share the pool's buffers, which are only bound again when the
+    // mesh is in another one. The draws offset into them.
+    GeometryRange geometry = _geometryPool.range(object.mesh->_geometry);
+    auto vertexOffset = static_cast<int32_t>(geometry.vertexOffset);
+    if (geometry.vertexBuffer != lastVertexBuffer) {
       VkDeviceSize offset = 0;
-      vkCmdBindVertexBuffers(cmd, 0, 1, &object.mesh->_vertexBuffer._buffer,
-                             &offset);
-      lastMesh = object.mesh;
+      vkCmdBindVertexBuffers(cmd, 0, 1, &geometry.vertexBuffer, &offset);
+      lastVertexBuffer = geometry.vertexBuffer;
+    }
+    if (object.mesh->_indexCount != 0 &&
+        (geometry.indexBuffer != lastIndexBuffer ||
+         object.mesh->_indexType != lastIndexType)) {
+      vkCmdBindIndexBuffer(cmd, geometry.indexBuffer, 0,
+                           object.mesh->_indexType);
+      lastIndexBuffer = geometry.indexBuffer;
+      lastIndexType = object.mesh->_indexType;
     }
     // We can draw now
-    vkCmdDraw(cmd, static_cast<uint32_t>(object.mesh->_vertices.size()), 1, 0,
-              static_cast<uint32_t>(i));
+    if (object.mesh->_indexCount == 0) {
+      vkCmdDraw(cmd, object.mesh->_vertexCount, 1, geometry.vertexOffset,
+                static_cast<uint32_t>(i));
+    } else if (lod != 0) {
+      const MeshLod &level = object.mesh->_lods[lod];
+      vkCmdDrawIndexed(cmd, level.indexCount, 1,
+                       geometry.firstIndex + level.firstIndex, vertexOffset,
+                       static_cast<uint32_t>(i));
+    } else if (object.mesh->_meshlets.empty()) {
+      uint32_t indexCount = object.mesh->_indexCount;
+      if (!object.mesh->_lods.empty()) {
+        indexCount = object.mesh->_lods[0].indexCount;
+      }
+      vkCmdDrawIndexed(cmd, indexCount, 1, geometry.firstIndex, vertexOffset,
+                       static_cast<uint32_t>(i));
+    } else {
+      // Draw the visible meshlets, merging neighbouring ranges into a single
+      // draw
+      uint32_t rangeStart = 0;
+      uint32_t rangeCount = 0;
+      for (auto &&meshlet : object.mesh->_meshlets) {
+        if (!is_meshlet_visible(meshlet, object.transformMatrix, scale,
+                                frustum, _camera.position)) {
+          continue;
+        }
+        if (rangeCount != 0 && rangeStart + rangeCount == meshlet.firstIndex) {
+          rangeCount += meshlet.indexCount;
+          continue;
+        }
+        if (rangeCount != 0) {
+          vkCmdDrawIndexed(cmd, rangeCount, 1,
+                           geometry.firstIndex + rangeStart, vertexOffset,
+                           static_cast<uint32_t>(i));
+        }
+        rangeStart = meshlet.firstIndex;
+        rangeCount = meshlet.indexCount;
+      }
+      if (rangeCount != 0) {
+        vkCmdDrawIndexed(cmd, rangeCount, 1, geometry.firstIndex + rangeStart,
+                         vertexOffset, static_cast<uint32_t>(i));
+      }
+    }
   }
 }
 
@@ -1334,6 +1755,70 @@ auto VulkanEngine::create_buffer(size_t allocSize, VkBufferUsageFlags usage,
   return newBuffer;
 }
 
+auto VulkanEngine::supports_texture_format(assets::TextureFormat format) const
+    -> bool {
+  return format == assets::TextureFormat::RGBA8 || _textureCompressionBC;
+}
+
+auto VulkanEngine::open_asset(const std::filesystem::path &path,
+                              assets::AssetFileView &file) const -> bool {
+  if (_assetArchive.is_open()) {
+    auto key = path.lexically_relative(_assetRoot).generic_string();
+    if (_assetArchive.find(key, file)) {
+      return true;
+    }
+  }
+  return assets::load_binaryfile_view(path, file);
+}
+
+auto VulkanEngine::create_staging_buffer(size_t size) -> StagingBuffer {
+  StagingBuffer staging = _uploadQueue.allocate_staging(size);
+  if (staging.mapped == nullptr) {
+    staging = create_dedicated_staging_buffer(size);
+  }
+  return staging;
+}
+
+auto VulkanEngine::create_dedicated_staging_buffer(size_t size)
+    -> StagingBuffer {
+  VkBufferCreateInfo bufferInfo = {};
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size = std::max<size_t>(size, 1);
+  bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+  VmaAllocationCreateInfo vmaallocInfo = {};
+  vmaallocInfo.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+  vmaallocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+  // Decompressors read back their own output, which is very slow from write
+  // combined memory
+  vmaallocInfo.preferredFlags = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+
+  StagingBuffer staging;
+  VmaAllocationInfo allocationInfo;
+  VK_CHECK(vmaCreateBuffer(_allocator, &bufferInfo, &vmaallocInfo,
+                           &staging.buffer._buffer,
+                           &staging.buffer._allocation, &allocationInfo));
+
+  staging.mapped = static_cast<char *>(allocationInfo.pMappedData);
+  staging.size = size;
+  return staging;
+}
+
+void VulkanEngine::flush_staging_buffer(const StagingBuffer &staging) {
+  // No-op on coherent memory, host cached memory may not be
+  vmaFlushAllocation(_allocator, staging.buffer._allocation, staging.offset,
+                     staging.size);
+}
+
+void VulkanEngine::destroy_staging_buffer(StagingBuffer &staging) {
+  if (_uploadQueue.return_staging(staging)) {
+    return;
+  }
+  vmaDestroyBuffer(_allocator, staging.buffer._buffer,
+                   staging.buffer._allocation);
+  staging = {};
+}
+
 auto VulkanEngine::pad_uniform_buffer_size(size_t originalSize) const
     -> size_t {
   // Calculate required alignment based on minimum device offset alignment
@@ -1391,6 +1876,13 @@ void VulkanEngine::cleanup() {
                     static_cast<VkBool32>(true), timeout);
     ++_frameNumber;
 
+    _assetLoader.shutdown();
+    // Waits for the uploads still copying into the streamer's images
+    _uploadQueue.wait_idle();
+    _textureStreamer.shutdown();
+    // After the streamer gave its staging back to the ring
+    _uploadQueue.shutdown();
+    _geometryPool.destroy();
     _mainDeletionQueue.flush();
 
     vmaDestroyAllocator(_allocator);
@@ -1409,6 +1901,15 @@ void VulkanEngine::draw() {
   // second.
   VK_CHECK(vkWaitForFences(_device, 1, &get_current_frame()._renderFence,
                            VK_TRUE, 1000000000));
+
+  // Free the staging memory of the uploads that completed
+  _uploadQueue.collect();
+
+  // Upload the assets that finished loading, drawn from this frame on
+  if (!_assetsLanded) {
+    land_loaded_assets();
+  }
+
   VK_CHECK(vkResetFences(_device, 1, &get_current_frame()._renderFence));
 
   // Now that we are sure that the commands finished executing, we can
@@ -1430,6 +1931,18 @@ void VulkanEngine::draw() {
 
   VK_CHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo));
 
+  // Send the uploads recorded since the last frame off. This frame takes
+  // over the resources they wrote.
+  _uploadQueue.submit();
+  uint64_t uploadValue = _uploadQueue.acquire(cmd);
+
+  // Reuse freed geometry and compact the pool's buffers, before any draw
+  _geometryPool.update(cmd);
+
+  // Swap in the texture levels that finished streaming, with the requests of
+  // the last frame. Materials get new sets pointed at the new images.
+  _textureStreamer.update(cmd);
+
   // Make a clear-color from frame number. This will falsh with a 120*pi
   // frame period.
   VkClearValue clearValue;
@@ -1480,15 +1993,27 @@ void VulkanEngine::draw() {
   // Prepare the submission to the queue
   // We want to wait on the _presentSemaphore, as that semaphore is signaled
   // when the swapchain is ready. We will signal the _renderSemaphore, to
-  // signal that rendering has finished
+  // signal that rendering has finished. A frame that draws with new uploads
+  // also waits for them, but only where vertices are fetched and textures
+  // sampled.
   auto submit = vkinit::submit_info(&cmd);
 
-  VkPipelineStageFlags waitStage =
-      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  submit.pWaitDstStageMask = &waitStage;
+  std::array<VkSemaphore, 2> waitSemaphores = {
+      get_current_frame()._presentSemaphore, _uploadQueue.semaphore()};
+  std::array<VkPipelineStageFlags, 2> waitStages = {
+      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, UploadQueue::wait_stages};
+  // The binary semaphore ignores its value
+  std::array<uint64_t, 2> waitValues = {0, uploadValue};
+  submit.pWaitDstStageMask = waitStages.data();
+
+  submit.waitSemaphoreCount = uploadValue != 0 ? 2 : 1;
+  submit.pWaitSemaphores = waitSemaphores.data();
 
-  submit.waitSemaphoreCount = 1;
-  submit.pWaitSemaphores = &get_current_frame()._presentSemaphore;
+  VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+  timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  timelineInfo.waitSemaphoreValueCount = submit.waitSemaphoreCount;
+  timelineInfo.pWaitSemaphoreValues = waitValues.data();
+  submit.pNext = &timelineInfo;
 
   submit.signalSemaphoreCount = 1;
   submit.pSignalSemaphores = &get_current_frame()._renderSemaphore;
@@ -1515,6 +2040,15 @@ void VulkanEngine::draw() {
 
   VK_CHECK(vkQueuePresentKHR(_graphicsQueue, &presentInfo));
 
+  if (_frameNumber == 0) {
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - _initStart;
+    utils::logger.dump(fmt::format("First frame {:.1f}ms after start, {}",
+                                   elapsed.count(),
+                                   _asyncLoading ? "assets loading async"
+                                                 : "assets loaded first"));
+  }
+
   // Increase the number of frames drawn
   ++_frameNumber;
 }
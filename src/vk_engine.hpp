@@ -1,14 +1,22 @@
 ﻿#pragma once
 
+#include "assetlib/asset_archive.hpp"
+#include "assetlib/job_system.hpp"
 #include "player_camera.hpp"
 #include "utils/logger.hpp"
+#include "vk_asset_loader.hpp"
+#include "vk_geometry_pool.hpp"
 #include "vk_mesh.hpp"
+#include "vk_texture_streamer.hpp"
 #include "vk_types.hpp"
+#include "vk_upload_queue.hpp"
 #include <array>
+#include <chrono>
 #include <cstdint>
 #include <deque>
 #include <functional>
 #include <glm/glm.hpp>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 #include <vk_mem_alloc.h>
@@ -19,9 +27,15 @@ constexpr int window_h = 900;
 // Double buffering
 constexpr unsigned int FRAME_OVERLAP = 2;
 
+// Texture memory the streamed mip levels may take
+constexpr VkDeviceSize texture_budget = 256ULL * 1024 * 1024;
+
+// Host memory uploads are staged in, reused as the GPU copies out of it
+constexpr VkDeviceSize staging_ring_size = 64ULL * 1024 * 1024;
+
 struct Texture {
   AllocatedImage image;
-  VkImageView imageView;
+  VkImageView imageView{VK_NULL_HANDLE};
 };
 
 struct UploadContext {
@@ -31,6 +45,12 @@ struct UploadContext {
 
 struct GPUObjectData {
   glm::mat4 modelMatrix;
+  // Where the material's texture sits in the bound texture array: xy scale
+  // and zw offset of the uvs, and the layer
+  glm::vec4 uvTransform;
+  uint32_t textureLayer;
+  // Pads the struct to its std140 array stride
+  uint32_t padding[3];
 };
 
 struct GPUSceneData {
@@ -62,9 +82,46 @@ struct FrameData {
   VkDescriptorSet objectDescriptor;
 };
 
+// Pipelines of a material indexed by assets::VertexFormat, VK_NULL_HANDLE
+// for the formats it can't draw
+using MaterialPipelines = std::array<VkPipeline, assets::vertex_format_count>;
+
+// Small textures the baker packed into the layers of a texture array. The
+// materials using any of them share its descriptor set.
+struct TextureAtlas {
+  // Baked file, relative to the asset root
+  std::string name;
+  // Null until the loader delivers the pixels
+  Texture texture;
+  std::unordered_map<std::string, assets::AtlasRegion> regions;
+  VkDescriptorSet textureSet{VK_NULL_HANDLE};
+};
+
+// Where the texture of a material comes from: a region of an atlas, or an
+// image of its own streamed by the TextureStreamer. Either may still be
+// loading, see VulkanEngine::bind_material_texture.
+struct MaterialTexture {
+  TextureAtlas *atlas = nullptr;
+  assets::AtlasRegion region{};
+  TextureStreamer::Handle streamed = TextureStreamer::no_texture;
+
+  [[nodiscard]] auto is_loaded() const -> bool {
+    if (atlas != nullptr) {
+      return atlas->texture.imageView != VK_NULL_HANDLE;
+    }
+    return streamed != TextureStreamer::no_texture;
+  }
+};
+
 struct Material {
   VkDescriptorSet textureSet{VK_NULL_HANDLE};
-  VkPipeline pipeline;
+  // Region of the texture array in textureSet that is the material's
+  // texture, the whole of layer 0 unless it's in an atlas
+  glm::vec4 uvTransform{1.0F, 1.0F, 0.0F, 0.0F};
+  uint32_t textureLayer = 0;
+  // Asked for at the on screen size of every object drawn with the material
+  TextureStreamer::Handle streamedTexture{TextureStreamer::no_texture};
+  MaterialPipelines pipelines{};
   VkPipelineLayout pipelineLayout;
 };
 
@@ -103,6 +160,24 @@ public:
 
   VkDevice _device; // Vulkan device for commands
 
+  // Decompresses the chunks of big assets in parallel
+  assets::JobSystem _jobSystem{std::thread::hardware_concurrency()};
+
+  // Load assets on the job system while the rest of init runs, and draw the
+  // first frames without the ones still loading. Off, init waits for all of
+  // them before the first frame.
+  bool _asyncLoading{true};
+
+  // Size of the upload queue's staging ring, assets that don't fit get a
+  // staging buffer of their own
+  VkDeviceSize _stagingRingSize{staging_ring_size};
+
+  // Copies assets to the GPU on the transfer queue, next to the frames
+  UploadQueue _uploadQueue{*this};
+
+  // Vertex and index buffers every mesh is suballocated from
+  GeometryPool _geometryPool{*this};
+
   // initializes everything in the engine
   void init();
 
@@ -118,6 +193,30 @@ public:
   auto create_buffer(size_t allocSize, VkBufferUsageFlags usage,
                      VmaMemoryUsage memoryUsage) -> AllocatedBuffer;
 
+  // Whether the GPU can sample baked textures in format. Block compressed
+  // formats need textureCompressionBC, which isn't required of the GPU.
+  [[nodiscard]] auto supports_texture_format(assets::TextureFormat format) const
+      -> bool;
+
+  // Finds a baked asset in the asset pack, or maps its loose file when there
+  // is no pack or the pack doesn't have it
+  auto open_asset(const std::filesystem::path &path,
+                  assets::AssetFileView &file) const -> bool;
+
+  // Persistently mapped, preferably host cached since LZ4 reads back what it
+  // already wrote. Call flush_staging_buffer after writing. Comes out of the
+  // upload queue's staging ring when it fits. Thread-safe.
+  auto create_staging_buffer(size_t size) -> StagingBuffer;
+  // A staging buffer of its own, outside the ring
+  auto create_dedicated_staging_buffer(size_t size) -> StagingBuffer;
+  void flush_staging_buffer(const StagingBuffer &staging);
+  // Frees staging right away, when nothing copies out of it. Copies that may
+  // still run free it with UploadQueue::free_staging.
+  void destroy_staging_buffer(StagingBuffer &staging);
+
+  // Runs commands on the graphics queue and waits for them. Only for init,
+  // like the ImGui fonts: uploads go to _uploadQueue, and copies the frames
+  // depend on are recorded into the frame's command buffer.
   void immediate_submit(std::function<void(VkCommandBuffer cmd)> &&function);
 
 private:
@@ -128,6 +227,10 @@ private:
 
   struct SDL_Window *_window{nullptr};
 
+  // Baked assets, served from assets.pack when the baker wrote one
+  std::filesystem::path _assetRoot{"./assets"};
+  assets::Archive _assetArchive;
+
   VkInstance _instance;                      // Vulkan library header
   VkDebugUtilsMessengerEXT _debug_messenger; // Vulkan debug output handle
   VkPhysicalDevice _chosenGPU;               // GPU chosen as the default device
@@ -141,8 +244,14 @@ private:
   // array of image-views from the swapchain
   std::vector<VkImageView> _swapchainImageViews;
 
+  // BC texture formats are enabled, see supports_texture_format
+  bool _textureCompressionBC{false};
+
   VkQueue _graphicsQueue;        // Queue we will submit to
   uint32_t _graphicsQueueFamily; // Family of the queue
+  // Queue the uploads go to, the graphics queue when there's no other
+  VkQueue _transferQueue;
+  uint32_t _transferQueueFamily;
 
   VkRenderPass _renderPass;
   std::vector<VkFramebuffer> _framebuffers;
@@ -184,6 +293,24 @@ private:
   UploadContext _uploadContext;
 
   std::unordered_map<std::string, Texture> _loadedTextures;
+  // Textures whose finer mips are streamed in as they're needed
+  TextureStreamer _textureStreamer{*this};
+  AssetLoader _assetLoader{*this, _textureStreamer};
+  // Drawn instead of textures that are still loading: 1x1 white, with one
+  // set for the array view textured materials sample and one for the 2D
+  // view of the text material
+  Texture _placeholderTexture;
+  VkDescriptorSet _placeholderArraySet{VK_NULL_HANDLE};
+  VkDescriptorSet _placeholderSet{VK_NULL_HANDLE};
+  // Material bindings waiting on a texture, each returns true once it could
+  // bind its material
+  std::vector<std::function<bool()>> _pendingBindings;
+  std::chrono::steady_clock::time_point _initStart;
+  bool _assetsLanded{false};
+  // Never resized after request_texture_atlases, MaterialTexture points into
+  // it
+  std::vector<TextureAtlas> _textureAtlases;
+  std::unordered_map<std::string, MaterialTexture> _materialTextures;
 
   PlayerCamera _camera;
 
@@ -198,15 +325,49 @@ private:
   void init_scene();
   void init_descriptors();
   void init_imgui();
+  void init_placeholder_texture();
+  // Builds the meshes made on the CPU
   void load_meshes();
-  void load_images();
+  // Hands every asset the scene needs to the loader. Meshes are empty and
+  // textures unbound until land_loaded_assets() gets them.
+  void request_assets();
+  void request_meshes();
+  void request_images();
+  // Reads the regions of the texture arrays the baker packed small textures
+  // into, and requests their pixels
+  void request_texture_atlases();
+  // Finds a texture in the atlases, or requests it from the loader and
+  // streams it. file is the baked file relative to the asset root.
+  void request_material_texture(const std::string &name,
+                                const std::string &file);
+  // Uploads the assets the loader finished and binds the materials that
+  // were waiting on them. Call while no command buffer using them records.
+  void land_loaded_assets();
+  void land_texture(LoadedAsset &asset);
+  // Points the material's texture set at the texture. Materials with a
+  // texture in the same atlas share the atlas' set, bound with the sampler
+  // of the first one. Textures still loading are drawn as the placeholder
+  // until they land, never rewriting a set a frame may be using.
+  void bind_material_texture(Material &material, MaterialTexture &texture,
+                             VkSampler sampler);
+  // Groups the objects so that draw_objects rebinds layouts, texture sets
+  // and index types as rarely as it can
+  void sort_renderables();
   void upload_mesh(Mesh &mesh);
+  // Uploads a baked mesh the loader unpacked into staging memory
+  auto upload_mesh_asset(Mesh &mesh, LoadedAsset &asset) -> bool;
+  // Allocates the mesh in the geometry pool and copies it from staging
+  void upload_mesh_buffers(Mesh &mesh, const StagingBuffer &staging,
+                           size_t vertexOffset, size_t indexOffset);
+  // Makes the geometry the upload queue copied visible to the frames
+  void release_mesh_geometry();
   // Loads a shader module from a SPIR-V file. Returns false if it errors.
   auto load_shader_module(const std::filesystem::path &filePath,
                           VkShaderModule *outShaderModule) -> bool;
 
   // Create material and add it to the map
-  auto create_material(VkPipeline pipeline, VkPipelineLayout layout,
+  auto create_material(const MaterialPipelines &pipelines,
+                       VkPipelineLayout layout,
                        const std::string &name) -> Material *;
   auto get_material(const std::string &name) -> Material *;
   auto get_mesh(const std::string &name) -> Mesh *;
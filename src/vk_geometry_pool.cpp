@@ -0,0 +1,276 @@
+#include "vk_geometry_pool.hpp"
+
+#include "vk_check.hpp"
+#include "vk_engine.hpp"
+
+#include <algorithm>
+#include <fmt/core.h>
+#include <utility>
+
+namespace {
+
+constexpr VkDeviceSize index_unit = 4;
+
+auto index_size(VkIndexType indexType) -> uint32_t {
+  return indexType == VK_INDEX_TYPE_UINT16 ? 2 : 4;
+}
+
+} // namespace
+
+GeometryPool::GeometryPool(VulkanEngine &engine) : engine_(engine) {}
+
+auto GeometryPool::allocate(assets::VertexFormat format, uint32_t vertexCount,
+                            uint32_t indexCount, VkIndexType indexType)
+    -> Handle {
+  if (vertexCount == 0 || assets::vertex_size(format) == 0) {
+    return no_geometry;
+  }
+
+  Entry entry;
+  entry.vertexCount = vertexCount;
+  entry.indexSize = index_size(indexType);
+  entry.indexWords = static_cast<uint32_t>(
+      (static_cast<VkDeviceSize>(indexCount) * entry.indexSize + index_unit -
+       1) /
+      index_unit);
+  entry.live = true;
+  entry.vertices = allocate_in(false, format, vertexCount, entry.vertexBlock);
+  if (entry.indexWords != 0) {
+    entry.indices = allocate_in(true, assets::VertexFormat::Unknown,
+                                entry.indexWords, entry.indexBlock);
+  }
+
+  if (!unusedHandles_.empty()) {
+    Handle geometry = unusedHandles_.back();
+    unusedHandles_.pop_back();
+    entries_[geometry] = entry;
+    return geometry;
+  }
+  entries_.push_back(entry);
+  return static_cast<Handle>(entries_.size() - 1);
+}
+
+void GeometryPool::free(Handle geometry) {
+  if (geometry == no_geometry || !entries_[geometry].live) {
+    return;
+  }
+  entries_[geometry].live = false;
+  pendingFrees_.push_back({geometry, frame_});
+}
+
+auto GeometryPool::range(Handle geometry) const -> GeometryRange {
+  const Entry &entry = entries_[geometry];
+  const Block &vertexBlock = blocks_[entry.vertexBlock];
+
+  GeometryRange range;
+  range.vertexBuffer = vertexBlock.buffer._buffer;
+  range.vertexOffset = entry.vertices.offset;
+  range.vertexByteOffset = entry.vertices.offset * vertexBlock.unit;
+  if (entry.indexWords != 0) {
+    const Block &indexBlock = blocks_[entry.indexBlock];
+    range.indexBuffer = indexBlock.buffer._buffer;
+    range.indexByteOffset = entry.indices.offset * index_unit;
+    range.firstIndex =
+        static_cast<uint32_t>(range.indexByteOffset / entry.indexSize);
+  }
+  return range;
+}
+
+void GeometryPool::update(VkCommandBuffer cmd) {
+  // Frames before this one have finished drawing what was freed
+  // FRAME_OVERLAP frames ago
+  auto freed = std::partition(
+      pendingFrees_.begin(), pendingFrees_.end(), [&](const PendingFree &p) {
+        return p.frame + FRAME_OVERLAP > frame_;
+      });
+  for (auto it = freed; it != pendingFrees_.end(); ++it) {
+    Entry &entry = entries_[it->geometry];
+    blocks_[entry.vertexBlock].allocator.free(entry.vertices);
+    if (entry.indexWords != 0) {
+      blocks_[entry.indexBlock].allocator.free(entry.indices);
+    }
+    entry = {};
+    unusedHandles_.push_back(it->geometry);
+  }
+  pendingFrees_.erase(freed, pendingFrees_.end());
+
+  auto destroyed =
+      std::partition(retired_.begin(), retired_.end(), [&](const Retired &r) {
+        return r.frame + FRAME_OVERLAP > frame_;
+      });
+  for (auto it = destroyed; it != retired_.end(); ++it) {
+    vmaDestroyBuffer(engine_._allocator, it->buffer._buffer,
+                     it->buffer._allocation);
+  }
+  retired_.erase(destroyed, retired_.end());
+
+  // The copies would miss what uploads still write into the old buffer
+  if (engine_._uploadQueue.idle()) {
+    for (uint32_t block = 0; block != blocks_.size(); ++block) {
+      if (is_fragmented(blocks_[block])) {
+        compact(cmd, block);
+        break;
+      }
+    }
+  }
+
+  ++frame_;
+}
+
+void GeometryPool::destroy() {
+  for (auto &&block : blocks_) {
+    vmaDestroyBuffer(engine_._allocator, block.buffer._buffer,
+                     block.buffer._allocation);
+  }
+  for (auto &&retired : retired_) {
+    vmaDestroyBuffer(engine_._allocator, retired.buffer._buffer,
+                     retired.buffer._allocation);
+  }
+  blocks_.clear();
+  retired_.clear();
+  entries_.clear();
+  unusedHandles_.clear();
+  pendingFrees_.clear();
+}
+
+auto GeometryPool::allocate_in(bool indices, assets::VertexFormat format,
+                               uint32_t count, uint32_t &block)
+    -> utils::OffsetAllocator::Allocation {
+  for (block = 0; block != blocks_.size(); ++block) {
+    Block &candidate = blocks_[block];
+    if (candidate.indices != indices || candidate.format != format) {
+      continue;
+    }
+    auto allocation = candidate.allocator.allocate(count);
+    if (allocation.offset != utils::OffsetAllocator::no_space) {
+      return allocation;
+    }
+  }
+  block = create_block(indices, format, count);
+  return blocks_[block].allocator.allocate(count);
+}
+
+auto GeometryPool::create_block(bool indices, assets::VertexFormat format,
+                                uint32_t minUnits) -> uint32_t {
+  Block block;
+  block.indices = indices;
+  block.format = format;
+  block.unit = indices ? index_unit : assets::vertex_size(format);
+  auto units = static_cast<uint32_t>(std::max<VkDeviceSize>(
+      geometry_block_size / block.unit, minUnits));
+  block.allocator.reset(units);
+  block.buffer = create_buffer(indices, units * block.unit);
+
+  utils::logger.dump(fmt::format(
+      "Geometry pool: new {} buffer of {} MB", indices ? "index" : "vertex",
+      units * block.unit / (1024 * 1024)));
+
+  blocks_.push_back(std::move(block));
+  return static_cast<uint32_t>(blocks_.size() - 1);
+}
+
+auto GeometryPool::create_buffer(bool indices, VkDeviceSize size)
+    -> AllocatedBuffer {
+  VkBufferCreateInfo bufferInfo = {};
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size = size;
+  // Compaction copies out of it
+  bufferInfo.usage =
+      static_cast<unsigned int>(VK_BUFFER_USAGE_TRANSFER_SRC_BIT) |
+      static_cast<unsigned int>(VK_BUFFER_USAGE_TRANSFER_DST_BIT) |
+      static_cast<unsigned int>(indices ? VK_BUFFER_USAGE_INDEX_BUFFER_BIT
+                                        : VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+  // Uploads write new ranges while the frames draw the others
+  engine_._uploadQueue.share(bufferInfo);
+
+  VmaAllocationCreateInfo allocInfo = {};
+  allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+  AllocatedBuffer buffer;
+  VK_CHECK(vmaCreateBuffer(engine_._allocator, &bufferInfo, &allocInfo,
+                           &buffer._buffer, &buffer._allocation, nullptr));
+  return buffer;
+}
+
+auto GeometryPool::is_fragmented(const Block &block) -> bool {
+  uint32_t freeSpace = block.allocator.free_space();
+  return block.allocator.allocation_count() != 0 &&
+         freeSpace >= block.allocator.size() / 4 &&
+         block.allocator.largest_free_range() < freeSpace / 2;
+}
+
+void GeometryPool::compact(VkCommandBuffer cmd, uint32_t block) {
+  Block &old = blocks_[block];
+
+  // Ranges freed but still drawn by the frames in flight stay in the old
+  // buffer, which outlives them
+  for (auto &&pending : pendingFrees_) {
+    Entry &entry = entries_[pending.geometry];
+    if (entry.vertexBlock == block) {
+      entry.vertices = {};
+    }
+    if (entry.indexWords != 0 && entry.indexBlock == block) {
+      entry.indices = {};
+    }
+  }
+
+  // Live ranges in the order they are in the buffer, so they keep it
+  std::vector<std::pair<utils::OffsetAllocator::Allocation *, uint32_t>>
+      moved;
+  for (auto &&entry : entries_) {
+    if (!entry.live) {
+      continue;
+    }
+    if (!old.indices && entry.vertexBlock == block) {
+      moved.emplace_back(&entry.vertices, entry.vertexCount);
+    } else if (old.indices && entry.indexWords != 0 &&
+               entry.indexBlock == block) {
+      moved.emplace_back(&entry.indices, entry.indexWords);
+    }
+  }
+  std::sort(moved.begin(), moved.end(), [](const auto &a, const auto &b) {
+    return a.first->offset < b.first->offset;
+  });
+
+  AllocatedBuffer buffer =
+      create_buffer(old.indices, old.allocator.size() * old.unit);
+
+  // A fresh allocator hands the ranges out back to back from the front
+  old.allocator.reset(old.allocator.size());
+  std::vector<VkBufferCopy> copies;
+  copies.reserve(moved.size());
+  for (auto &&[allocation, count] : moved) {
+    auto packed = old.allocator.allocate(count);
+    copies.push_back({allocation->offset * old.unit, packed.offset * old.unit,
+                      count * old.unit});
+    *allocation = packed;
+  }
+
+  // Earlier frames read the old buffer, and the frames that waited for
+  // uploads into it made those visible at VERTEX_INPUT
+  VkMemoryBarrier barrier = {};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask =
+      VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+  vkCmdPipelineBarrier(
+      cmd, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+  if (!copies.empty()) {
+    vkCmdCopyBuffer(cmd, old.buffer._buffer, buffer._buffer,
+                    static_cast<uint32_t>(copies.size()), copies.data());
+  }
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask =
+      VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier, 0,
+                       nullptr, 0, nullptr);
+
+  utils::logger.dump(fmt::format(
+      "Geometry pool: compacted {} ranges of a {} buffer", copies.size(),
+      old.indices ? "index" : "vertex"));
+
+  retired_.push_back({old.buffer, frame_});
+  old.buffer = buffer;
+}
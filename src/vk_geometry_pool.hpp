@@ -0,0 +1,118 @@
+#pragma once
+
+#include "assetlib/mesh_asset.hpp"
+#include "utils/offset_allocator.hpp"
+#include "vk_types.hpp"
+#include <cstdint>
+#include <vector>
+
+class VulkanEngine;
+
+// Size of the buffers the pool suballocates, meshes larger than that get a
+// buffer of their own size
+constexpr VkDeviceSize geometry_block_size = 64ULL * 1024 * 1024;
+
+// Where the vertices and indices of a mesh are in the pool
+struct GeometryRange {
+  VkBuffer vertexBuffer = VK_NULL_HANDLE;
+  // VK_NULL_HANDLE for meshes without indices
+  VkBuffer indexBuffer = VK_NULL_HANDLE;
+  // The vertexOffset of indexed draws, firstVertex of the others
+  uint32_t vertexOffset = 0;
+  // Added to the firstIndex of draws, counted in the mesh's index type
+  uint32_t firstIndex = 0;
+  // Where uploads copy to
+  VkDeviceSize vertexByteOffset = 0;
+  VkDeviceSize indexByteOffset = 0;
+};
+
+// Keeps the vertices and indices of every mesh in a few large buffers, one
+// set of vertex buffers per vertex format, so meshes are drawn with offsets
+// into the buffers bound once instead of binding buffers of their own. Each
+// buffer is suballocated by a utils::OffsetAllocator. Freed ranges are
+// reused once no frame draws from them anymore, and a buffer that freeing
+// left fragmented is compacted into a new one on the GPU, one a frame.
+class GeometryPool {
+public:
+  using Handle = uint32_t;
+  static constexpr Handle no_geometry = ~0U;
+
+  explicit GeometryPool(VulkanEngine &engine);
+
+  GeometryPool(const GeometryPool &) = delete;
+  GeometryPool(GeometryPool &&other) noexcept = delete;
+  auto operator=(const GeometryPool &) -> GeometryPool & = delete;
+  auto operator=(GeometryPool &&other) noexcept -> GeometryPool & = delete;
+
+  // Room for the vertices and indices of a mesh, to be filled by the upload
+  // queue. indexCount may be 0. no_geometry for a mesh without vertices
+  // or in an unknown format.
+  auto allocate(assets::VertexFormat format, uint32_t vertexCount,
+                uint32_t indexCount, VkIndexType indexType) -> Handle;
+  // Frees the ranges once the frames in flight are done drawing them
+  void free(Handle geometry);
+  // Changes when the pool compacts the buffers, look it up every frame
+  [[nodiscard]] auto range(Handle geometry) const -> GeometryRange;
+
+  // Reclaims what was freed and destroys the buffers compaction left behind
+  // FRAME_OVERLAP frames ago. Compacts a fragmented buffer into cmd, a
+  // graphics command buffer outside of a render pass, when no upload is
+  // pending. Call once a frame, before recording draws.
+  void update(VkCommandBuffer cmd);
+  // Destroys every buffer. Call when the GPU is idle.
+  void destroy();
+
+private:
+  struct Block {
+    AllocatedBuffer buffer;
+    utils::OffsetAllocator allocator;
+    // Bytes per unit of the allocator: a vertex, or 4 bytes of indices so
+    // that 16 and 32 bit indices share a buffer
+    VkDeviceSize unit = 0;
+    bool indices = false;
+    assets::VertexFormat format = assets::VertexFormat::Unknown;
+  };
+
+  struct Entry {
+    uint32_t vertexBlock = 0;
+    uint32_t indexBlock = 0;
+    utils::OffsetAllocator::Allocation vertices;
+    utils::OffsetAllocator::Allocation indices;
+    uint32_t vertexCount = 0;
+    // Units of 4 bytes
+    uint32_t indexWords = 0;
+    uint32_t indexSize = 0;
+    bool live = false;
+  };
+
+  struct Retired {
+    AllocatedBuffer buffer;
+    uint64_t frame;
+  };
+
+  struct PendingFree {
+    Handle geometry;
+    uint64_t frame;
+  };
+
+  // A range of count units in a block for format, creating a block when
+  // none has room
+  auto allocate_in(bool indices, assets::VertexFormat format, uint32_t count,
+                   uint32_t &block) -> utils::OffsetAllocator::Allocation;
+  auto create_block(bool indices, assets::VertexFormat format,
+                    uint32_t minUnits) -> uint32_t;
+  // Shared with the upload queue's family
+  auto create_buffer(bool indices, VkDeviceSize size) -> AllocatedBuffer;
+  // A quarter of the buffer is free, but in pieces
+  static auto is_fragmented(const Block &block) -> bool;
+  // Moves the live ranges of the block to the front of a new buffer
+  void compact(VkCommandBuffer cmd, uint32_t block);
+
+  VulkanEngine &engine_;
+  std::vector<Block> blocks_;
+  std::vector<Entry> entries_;
+  std::vector<Handle> unusedHandles_;
+  std::vector<PendingFree> pendingFrees_;
+  std::vector<Retired> retired_;
+  uint64_t frame_ = 0;
+};
@@ -148,7 +148,8 @@ auto vkinit::pipeline_layout_create_info() -> VkPipelineLayoutCreateInfo {
 }
 
 auto vkinit::image_create_info(VkFormat format, VkImageUsageFlags usageFlags,
-                               VkExtent3D extent, VkSampleCountFlagBits samples)
+                               VkExtent3D extent, VkSampleCountFlagBits samples,
+                               uint32_t mipLevels, uint32_t arrayLayers)
     -> VkImageCreateInfo {
   VkImageCreateInfo info = {};
   info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -159,8 +160,8 @@ auto vkinit::image_create_info(VkFormat format, VkImageUsageFlags usageFlags,
   info.format = format;
   info.extent = extent;
 
-  info.mipLevels = 1;
-  info.arrayLayers = 1;
+  info.mipLevels = mipLevels;
+  info.arrayLayers = arrayLayers;
   info.samples = samples;
   info.tiling = VK_IMAGE_TILING_OPTIMAL;
   info.usage = usageFlags;
@@ -169,20 +170,22 @@ auto vkinit::image_create_info(VkFormat format, VkImageUsageFlags usageFlags,
 }
 
 auto vkinit::imageview_create_info(VkFormat format, VkImage image,
-                                   VkImageAspectFlags aspectFlags)
+                                   VkImageAspectFlags aspectFlags,
+                                   uint32_t mipLevels, uint32_t layerCount,
+                                   VkImageViewType viewType)
     -> VkImageViewCreateInfo {
   // Build and image-view for the depth image to use for rendering
   VkImageViewCreateInfo info = {};
   info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
   info.pNext = nullptr;
 
-  info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  info.viewType = viewType;
   info.image = image;
   info.format = format;
   info.subresourceRange.baseMipLevel = 0;
-  info.subresourceRange.levelCount = 1;
+  info.subresourceRange.levelCount = mipLevels;
   info.subresourceRange.baseArrayLayer = 0;
-  info.subresourceRange.layerCount = 1;
+  info.subresourceRange.layerCount = layerCount;
   info.subresourceRange.aspectMask = aspectFlags;
 
   return info;
@@ -304,8 +307,8 @@ auto vkinit::submit_info(VkCommandBuffer *cmd) -> VkSubmitInfo {
 }
 
 auto vkinit::sampler_create_info(VkFilter filters,
-                                 VkSamplerAddressMode samplerAddressMode)
-    -> VkSamplerCreateInfo {
+                                 VkSamplerAddressMode samplerAddressMode,
+                                 uint32_t mipLevels) -> VkSamplerCreateInfo {
   VkSamplerCreateInfo info = {};
   info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
   info.pNext = nullptr;
@@ -316,6 +319,10 @@ auto vkinit::sampler_create_info(VkFilter filters,
   info.addressModeV = samplerAddressMode;
   info.addressModeW = samplerAddressMode;
 
+  info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+  info.minLod = 0.0F;
+  info.maxLod = static_cast<float>(mipLevels - 1);
+
   return info;
 }
 
@@ -33,11 +33,16 @@ auto color_blend_attachment_state() -> VkPipelineColorBlendAttachmentState;
 auto pipeline_layout_create_info() -> VkPipelineLayoutCreateInfo;
 
 auto image_create_info(VkFormat format, VkImageUsageFlags usageFlags,
-                       VkExtent3D extent, VkSampleCountFlagBits samples)
+                       VkExtent3D extent, VkSampleCountFlagBits samples,
+                       uint32_t mipLevels = 1, uint32_t arrayLayers = 1)
     -> VkImageCreateInfo;
 
+// A 2D view unless viewType says otherwise, e.g. VK_IMAGE_VIEW_TYPE_2D_ARRAY
+// for the textures sampled as arrays
 auto imageview_create_info(VkFormat format, VkImage image,
-                           VkImageAspectFlags aspectFlags)
+                           VkImageAspectFlags aspectFlags,
+                           uint32_t mipLevels = 1, uint32_t layerCount = 1,
+                           VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D)
     -> VkImageViewCreateInfo;
 
 auto depth_stencil_create_info(bool bDepthTest, bool bDepthWrite,
@@ -66,10 +71,11 @@ auto write_descriptor_buffer(VkDescriptorType type, VkDescriptorSet dstSet,
 
 auto submit_info(VkCommandBuffer *cmd) -> VkSubmitInfo;
 
+// Blends between mip levels, up to the last of mipLevels
 auto sampler_create_info(
     VkFilter filters,
-    VkSamplerAddressMode samplerAddressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT)
-    -> VkSamplerCreateInfo;
+    VkSamplerAddressMode samplerAddressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+    uint32_t mipLevels = 1) -> VkSamplerCreateInfo;
 
 auto write_descriptor_image(VkDescriptorType type, VkDescriptorSet dstSet,
                             VkDescriptorImageInfo *imageInfo, uint32_t binding)
@@ -3,16 +3,40 @@
 #include "assetlib/mesh_asset.hpp"
 #include "utils/logger.hpp"
 #include <array>
+#include <cstring>
 #include <filesystem>
 #include <string_view>
+#include <unordered_map>
 
-auto Vertex::get_vertex_description() -> VertexInputDescription {
+namespace {
+// Vertex has no padding, so it can be hashed and compared as raw bytes
+struct VertexBytesHash {
+  auto operator()(const Vertex &vertex) const -> size_t {
+    return static_cast<size_t>(assets::hash_bytes(&vertex, sizeof(Vertex)));
+  }
+};
+
+struct VertexBytesEqual {
+  auto operator()(const Vertex &lhs, const Vertex &rhs) const -> bool {
+    return memcmp(&lhs, &rhs, sizeof(Vertex)) == 0;
+  }
+};
+
+static_assert(sizeof(Vertex) == sizeof(float) * 11,
+              "Vertex must stay tightly packed for bytewise hashing");
+} // namespace
+
+static_assert(sizeof(Vertex) == sizeof(assets::Vertex_f32_PNCV),
+              "Vertex must match the PNCV_F32 asset layout");
+
+auto Vertex::get_vertex_description(assets::VertexFormat format)
+    -> VertexInputDescription {
   VertexInputDescription description;
 
   // We will have just 1 vertex buffer binding, with a per-vertex rate
   VkVertexInputBindingDescription mainBinding = {};
   mainBinding.binding = 0;
-  mainBinding.stride = sizeof(Vertex);
+  mainBinding.stride = static_cast<uint32_t>(assets::vertex_size(format));
   mainBinding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
   description.bindings.push_back(mainBinding);
@@ -22,28 +46,41 @@ auto Vertex::get_vertex_description() -> VertexInputDescription {
   positionAttribute.binding = 0;
   positionAttribute.location = 0;
   positionAttribute.format = VK_FORMAT_R32G32B32_SFLOAT;
-  positionAttribute.offset = offsetof(Vertex, position);
 
   // Normal will be stored at Location 1
   VkVertexInputAttributeDescription normalAttribute = {};
   normalAttribute.binding = 0;
   normalAttribute.location = 1;
-  normalAttribute.format = VK_FORMAT_R32G32B32_SFLOAT;
-  normalAttribute.offset = offsetof(Vertex, normal);
 
   // Color will be stored at Location 2
   VkVertexInputAttributeDescription colorAttribute = {};
   colorAttribute.binding = 0;
   colorAttribute.location = 2;
-  colorAttribute.format = VK_FORMAT_R32G32B32_SFLOAT;
-  colorAttribute.offset = offsetof(Vertex, color);
 
   // UV will be stored at Location 3
   VkVertexInputAttributeDescription uvAttribute = {};
   uvAttribute.binding = 0;
   uvAttribute.location = 3;
-  uvAttribute.format = VK_FORMAT_R32G32_SFLOAT;
-  uvAttribute.offset = offsetof(Vertex, uv);
+
+  if (format == assets::VertexFormat::P32N8C8V16) {
+    using PackedVertex = assets::Vertex_P32N8C8V16;
+
+    positionAttribute.offset = offsetof(PackedVertex, position);
+    normalAttribute.format = VK_FORMAT_R8G8_SNORM;
+    normalAttribute.offset = offsetof(PackedVertex, normal);
+    colorAttribute.format = VK_FORMAT_R8G8B8A8_UNORM;
+    colorAttribute.offset = offsetof(PackedVertex, color);
+    uvAttribute.format = VK_FORMAT_R16G16_SFLOAT;
+    uvAttribute.offset = offsetof(PackedVertex, uv);
+  } else {
+    positionAttribute.offset = offsetof(Vertex, position);
+    normalAttribute.format = VK_FORMAT_R32G32B32_SFLOAT;
+    normalAttribute.offset = offsetof(Vertex, normal);
+    colorAttribute.format = VK_FORMAT_R32G32B32_SFLOAT;
+    colorAttribute.offset = offsetof(Vertex, color);
+    uvAttribute.format = VK_FORMAT_R32G32_SFLOAT;
+    uvAttribute.offset = offsetof(Vertex, uv);
+  }
 
   description.attributes.push_back(positionAttribute);
   description.attributes.push_back(normalAttribute);
@@ -53,92 +90,118 @@ auto Vertex::get_vertex_description() -> VertexInputDescription {
   return description;
 }
 
-auto Mesh::load_from_meshasset(const std::filesystem::path &filename) -> bool {
-  assets::AssetFile file;
-  bool loaded = assets::load_binaryfile(filename, file);
+void Mesh::set_vertices(std::span<const Vertex> vertices) {
+  _vertexFormat = assets::VertexFormat::PNCV_F32;
+  _vertexCount = static_cast<uint32_t>(vertices.size());
+  _vertexData.resize(vertices.size_bytes());
+  memcpy(_vertexData.data(), vertices.data(), vertices.size_bytes());
+}
+
+void Mesh::set_indices(std::span<const uint32_t> indices) {
+  _indexCount = static_cast<uint32_t>(indices.size());
+  if (assets::index_size_for(_vertexCount) == sizeof(uint16_t)) {
+    _indexType = VK_INDEX_TYPE_UINT16;
+    _indexData.resize(indices.size() * sizeof(uint16_t));
+    for (size_t i = 0; i != indices.size(); ++i) {
+      auto index = static_cast<uint16_t>(indices[i]);
+      memcpy(&_indexData[i * sizeof(uint16_t)], &index, sizeof(index));
+    }
+  } else {
+    _indexType = VK_INDEX_TYPE_UINT32;
+    _indexData.resize(indices.size_bytes());
+    memcpy(_indexData.data(), indices.data(), indices.size_bytes());
+  }
+}
 
-  if (!loaded) {
+auto Mesh::set_asset_info(const assets::MeshInfo &info,
+                          const std::filesystem::path &filename) -> bool {
+#ifndef NDEBUG
+  if (assets::is_source_stale(info.originalFile, info.sourceHash)) {
+    utils::logger.dump(fmt::format("Mesh {} is older than its source {}, "
+                                   "rerun asset_baker",
+                                   filename.string(), info.originalFile),
+                       spdlog::level::warn);
+  }
+#endif
+
+  size_t vertexSize = assets::vertex_size(info.vertexFormat);
+  if (vertexSize == 0) {
     utils::logger.dump(
-        fmt::format("Error when loading mesh {}", filename.string()),
+        fmt::format("Unknown vertex format in mesh {}", filename.string()),
         spdlog::level::err);
     return false;
   }
 
-  assets::MeshInfo meshinfo = assets::read_mesh_info(&file);
-
-  std::vector<char> vertexBuffer;
-  std::vector<char> indexBuffer;
-
-  vertexBuffer.resize(meshinfo.vertexBufferSize);
-  indexBuffer.resize(meshinfo.indexBufferSize);
+  if (info.indexSize != sizeof(uint16_t) &&
+      info.indexSize != sizeof(uint32_t)) {
+    utils::logger.dump(fmt::format("Unsupported index size {} in mesh {}",
+                                   int(info.indexSize), filename.string()),
+                       spdlog::level::err);
+    return false;
+  }
 
-  assets::unpack_mesh(&meshinfo, file.binaryBlob.data(), file.binaryBlob.size(),
-                      vertexBuffer.data(), indexBuffer.data());
+  // Vertices stay in the baked format, the pipeline reads them as they are
+  _vertexFormat = info.vertexFormat;
+  _vertexCount = static_cast<uint32_t>(info.vertexBufferSize / vertexSize);
+  _vertexData.clear();
+
+  _indexType = info.indexSize == sizeof(uint16_t) ? VK_INDEX_TYPE_UINT16
+                                                  : VK_INDEX_TYPE_UINT32;
+  _indexCount = static_cast<uint32_t>(info.indexBufferSize / info.indexSize);
+  _indexData.clear();
+
+  _lods.clear();
+  for (auto &&lod : info.lods) {
+    _lods.push_back({.firstIndex = lod.firstIndex,
+                     .indexCount = lod.indexCount,
+                     .error = lod.error});
+  }
 
-  bounds.extents = {meshinfo.bounds.extents[0], meshinfo.bounds.extents[1],
-                    meshinfo.bounds.extents[2]};
-  bounds.origin = {meshinfo.bounds.origin[0], meshinfo.bounds.origin[1],
-                   meshinfo.bounds.origin[2]};
-  bounds.radius = meshinfo.bounds.radius;
+  bounds.extents = {info.bounds.extents[0], info.bounds.extents[1],
+                    info.bounds.extents[2]};
+  bounds.origin = {info.bounds.origin[0], info.bounds.origin[1],
+                   info.bounds.origin[2]};
+  bounds.radius = info.bounds.radius;
   bounds.valid = true;
 
-  _vertices.clear();
-  _indices.clear();
+  return true;
+}
 
-  _indices.resize(indexBuffer.size() / sizeof(uint32_t));
-  for (size_t i = 0; i != _indices.size(); ++i) {
-    uint32_t *unpacked_indices = (uint32_t *)indexBuffer.data();
-    _indices[i] = unpacked_indices[i];
+void Mesh::set_meshlets(const assets::MeshletData &meshlets) {
+  // Only the culling data is kept, the local vertex and triangle arrays are
+  // for mesh shaders
+  _meshlets.clear();
+  _meshlets.reserve(meshlets.meshlets.size());
+  for (auto &&meshlet : meshlets.meshlets) {
+    _meshlets.push_back(
+        {.center = {meshlet.center[0], meshlet.center[1], meshlet.center[2]},
+         .radius = meshlet.radius,
+         .coneAxis = {meshlet.coneAxis[0], meshlet.coneAxis[1],
+                      meshlet.coneAxis[2]},
+         .coneCutoff = meshlet.coneCutoff,
+         .firstIndex = meshlet.triangleOffset * 3,
+         .indexCount = meshlet.triangleCount * 3});
   }
+}
 
-  if (meshinfo.vertexFormat == assets::VertexFormat::PNCV_F32) {
-    assets::Vertex_f32_PNCV *unpackedVertices =
-        (assets::Vertex_f32_PNCV *)vertexBuffer.data();
-
-    _vertices.resize(vertexBuffer.size() / sizeof(assets::Vertex_f32_PNCV));
-
-    for (size_t i = 0; i != _vertices.size(); ++i) {
-
-      _vertices[i].position.x = unpackedVertices[i].position[0];
-      _vertices[i].position.y = unpackedVertices[i].position[1];
-      _vertices[i].position.z = unpackedVertices[i].position[2];
-
-      _vertices[i].normal = glm::vec3(unpackedVertices[i].normal[0],
-                                      unpackedVertices[i].normal[1],
-                                      unpackedVertices[i].normal[2]);
+auto Mesh::vertex_buffer_size() const -> size_t {
+  return static_cast<size_t>(_vertexCount) * assets::vertex_size(_vertexFormat);
+}
 
-      _vertices[i].color =
-          glm::vec3{unpackedVertices[i].color[0], unpackedVertices[i].color[1],
-                    unpackedVertices[i].color[2]};
+auto Mesh::index_buffer_size() const -> size_t {
+  size_t indexSize = _indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t)
+                                                        : sizeof(uint32_t);
+  return static_cast<size_t>(_indexCount) * indexSize;
+}
 
-      _vertices[i].uv.x = unpackedVertices[i].uv[0];
-      _vertices[i].uv.y = unpackedVertices[i].uv[1];
-    }
-  } else if (meshinfo.vertexFormat == assets::VertexFormat::P32N8C8V16) {
-    assets::Vertex_P32N8C8V16 *unpackedVertices =
-        (assets::Vertex_P32N8C8V16 *)vertexBuffer.data();
-
-    _vertices.resize(vertexBuffer.size() / sizeof(assets::Vertex_P32N8C8V16));
-
-    for (size_t i = 0; i < _vertices.size(); i++) {
-      _vertices[i].position = {unpackedVertices[i].position[0],
-                               unpackedVertices[i].position[1],
-                               unpackedVertices[i].position[2]};
-      _vertices[i].normal = {unpackedVertices[i].normal[0],
-                             unpackedVertices[i].normal[1],
-                             unpackedVertices[i].normal[2]};
-      _vertices[i].color = {unpackedVertices[i].color[0],
-                            unpackedVertices[i].color[1],
-                            unpackedVertices[i].color[2]};
-      _vertices[i].uv = {unpackedVertices[i].uv[0], unpackedVertices[i].uv[1]};
+auto Mesh::select_lod(float projectedRadius, float maxPixelError) const
+    -> size_t {
+  for (size_t i = _lods.size(); i-- > 1;) {
+    if (_lods[i].error * projectedRadius <= maxPixelError) {
+      return i;
     }
   }
-
-  utils::logger.dump(fmt::format("Loaded mesh {}: Verts={}, Tris={}",
-                                 filename.string(), _vertices.size(),
-                                 _indices.size() / 3));
-
-  return true;
+  return 0;
 }
 
 auto Mesh::load_from_obj(const std::filesystem::path &filename) -> bool {
@@ -166,6 +229,12 @@ auto Mesh::load_from_obj(const std::filesystem::path &filename) -> bool {
     return false;
   }
 
+  // Corners sharing position, normal and uv are emitted only once
+  std::unordered_map<Vertex, uint32_t, VertexBytesHash, VertexBytesEqual>
+      uniqueVertices;
+  std::vector<Vertex> vertices;
+  std::vector<uint32_t> indices;
+
   // Loop over shapes
   for (auto &&shape : shapes) {
     // Loop over faces(polygon)
@@ -201,10 +270,18 @@ auto Mesh::load_from_obj(const std::filesystem::path &filename) -> bool {
                            .color = nc,
                            .uv = glm::vec2{ux, 1 - uy}};
 
-        _vertices.push_back(new_vert);
+        auto [it, inserted] = uniqueVertices.try_emplace(
+            new_vert, static_cast<uint32_t>(vertices.size()));
+        if (inserted) {
+          vertices.push_back(new_vert);
+        }
+        indices.push_back(it->second);
       }
       index_offset += fv;
     }
   }
+
+  set_vertices(vertices);
+  set_indices(indices);
   return true;
 }
@@ -1,9 +1,12 @@
 #pragma once
 
+#include "assetlib/mesh_asset.hpp"
+#include "vk_geometry_pool.hpp"
 #include "vk_types.hpp"
 #include <filesystem>
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
+#include <span>
 #include <string_view>
 #include <vector>
 
@@ -14,33 +17,89 @@ struct VertexInputDescription {
   VkPipelineVertexInputStateCreateFlags flags = 0;
 };
 
+// Full precision vertex, laid out like assets::Vertex_f32_PNCV
 struct Vertex {
   glm::vec3 position;
   glm::vec3 normal;
   glm::vec3 color;
   glm::vec2 uv;
 
-  static auto get_vertex_description() -> VertexInputDescription;
+  // Vertex input layout of a vertex buffer in the given format. Compact
+  // formats are read as is: P32N8C8V16 normals arrive in the shader as
+  // octahedral xy, colors as unorm and uvs as half floats.
+  static auto get_vertex_description(
+      assets::VertexFormat format = assets::VertexFormat::PNCV_F32)
+      -> VertexInputDescription;
 };
 
 struct RenderBounds {
   glm::vec3 origin;
   float radius;
   glm::vec3 extents;
-  bool valid;
+  bool valid = false;
+};
+
+// Culling data of one meshlet, drawn as a range of the mesh's index buffer
+struct MeshletBounds {
+  glm::vec3 center;
+  float radius;
+  glm::vec3 coneAxis;
+  float coneCutoff;
+  uint32_t firstIndex;
+  uint32_t indexCount;
+};
+
+// A level of detail, drawn as a range of the mesh's index buffer
+struct MeshLod {
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  // Geometric error relative to the bounding sphere radius
+  float error;
 };
 
 struct Mesh {
+  // Vertex buffer contents in _vertexFormat, uploaded without conversion.
+  // Only meshes built on the CPU keep them, baked meshes go straight to
+  // staging memory.
   // NOLINTNEXTLINE(misc-non-private-member-variables-in-classes)
-  std::vector<Vertex> _vertices;
-  std::vector<uint32_t> _indices;
+  std::vector<char> _vertexData;
+  uint32_t _vertexCount = 0;
+  assets::VertexFormat _vertexFormat = assets::VertexFormat::PNCV_F32;
+  // Index buffer contents, 16 bit when every vertex fits
+  std::vector<char> _indexData;
+  uint32_t _indexCount = 0;
+  VkIndexType _indexType = VK_INDEX_TYPE_UINT32;
+  // Vertices and indices on the GPU, no_geometry until uploaded
   // NOLINTNEXTLINE(misc-non-private-member-variables-in-classes)
-  AllocatedBuffer _vertexBuffer;
-  AllocatedBuffer _indexBuffer;
+  GeometryPool::Handle _geometry = GeometryPool::no_geometry;
 
   RenderBounds bounds;
+  // Empty when the mesh wasn't baked with meshlets
+  std::vector<MeshletBounds> _meshlets;
+  // Finest first, meshlets belong to the first level. Empty when the mesh
+  // has a single level.
+  std::vector<MeshLod> _lods;
 
   auto load_from_obj(const std::filesystem::path &filename) -> bool;
 
-  auto load_from_meshasset(const std::filesystem::path &filename) -> bool;
+  // Stores full precision vertices built on the CPU
+  void set_vertices(std::span<const Vertex> vertices);
+  // Stores indices at 16 bits when the vertices set before allow it
+  void set_indices(std::span<const uint32_t> indices);
+
+  // Takes the layout, bounds and detail levels of a baked mesh. Its vertices
+  // and indices are unpacked straight into staging memory, see
+  // AssetLoader::load_mesh.
+  auto set_asset_info(const assets::MeshInfo &info,
+                      const std::filesystem::path &filename) -> bool;
+  // Keeps the culling data of the meshlets
+  void set_meshlets(const assets::MeshletData &meshlets);
+
+  [[nodiscard]] auto vertex_buffer_size() const -> size_t;
+  [[nodiscard]] auto index_buffer_size() const -> size_t;
+
+  // Coarsest level whose error stays under maxPixelError when the bounding
+  // sphere covers projectedRadius pixels on screen
+  [[nodiscard]] auto select_lod(float projectedRadius,
+                                float maxPixelError = 1.0F) const -> size_t;
 };
@@ -0,0 +1,93 @@
+#include "vk_staging_ring.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+// Value of the ranges nobody retired yet
+constexpr uint64_t held = std::numeric_limits<uint64_t>::max();
+
+} // namespace
+
+void StagingRing::init(const StagingBuffer &buffer, VkDeviceSize alignment) {
+  std::lock_guard lock(mutex_);
+  buffer_ = buffer;
+  alignment_ = alignment;
+  // Every range starts aligned, also after wrapping around
+  buffer_.size -= buffer_.size % alignment;
+  head_ = 0;
+  tail_ = 0;
+  ranges_.clear();
+}
+
+auto StagingRing::release() -> StagingBuffer {
+  std::lock_guard lock(mutex_);
+  StagingBuffer buffer = buffer_;
+  buffer_ = {};
+  ranges_.clear();
+  return buffer;
+}
+
+auto StagingRing::allocate(size_t size) -> StagingBuffer {
+  std::lock_guard lock(mutex_);
+  VkDeviceSize capacity = buffer_.size;
+  VkDeviceSize alignedSize =
+      (std::max<VkDeviceSize>(size, 1) + alignment_ - 1) & ~(alignment_ - 1);
+  if (alignedSize > capacity) {
+    return {};
+  }
+
+  // A range doesn't wrap around, it starts over at the front instead. The
+  // end it skips is freed with the range before it.
+  uint64_t begin = head_;
+  VkDeviceSize offset = begin % capacity;
+  if (offset + alignedSize > capacity) {
+    begin += capacity - offset;
+    offset = 0;
+  }
+  if (begin + alignedSize - tail_ > capacity) {
+    return {};
+  }
+  head_ = begin + alignedSize;
+  ranges_.push_back({begin, head_, held});
+
+  StagingBuffer staging;
+  staging.buffer = buffer_.buffer;
+  staging.mapped = buffer_.mapped + offset;
+  staging.offset = offset;
+  staging.size = size;
+  return staging;
+}
+
+auto StagingRing::owns(const StagingBuffer &staging) const -> bool {
+  std::lock_guard lock(mutex_);
+  return staging.buffer._buffer != VK_NULL_HANDLE &&
+         staging.buffer._buffer == buffer_.buffer._buffer;
+}
+
+void StagingRing::retire(const StagingBuffer &staging, uint64_t value) {
+  std::lock_guard lock(mutex_);
+  // Ranges that aren't free don't overlap, so the offset finds it
+  auto range =
+      std::find_if(ranges_.begin(), ranges_.end(), [&](const Range &range) {
+        return range.value == held &&
+               range.begin % buffer_.size == staging.offset;
+      });
+  if (range != ranges_.end()) {
+    range->value = value;
+  }
+}
+
+void StagingRing::reclaim(uint64_t completed) {
+  std::lock_guard lock(mutex_);
+  while (!ranges_.empty() && ranges_.front().value <= completed) {
+    ranges_.pop_front();
+  }
+  tail_ = ranges_.empty() ? head_ : ranges_.front().begin;
+}
+
+auto StagingRing::capacity() const -> VkDeviceSize {
+  std::lock_guard lock(mutex_);
+  return buffer_.size;
+}
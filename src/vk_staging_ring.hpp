@@ -0,0 +1,45 @@
+#pragma once
+
+#include "vk_types.hpp"
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+// One persistently mapped staging buffer handed out front to back, wrapping
+// around at its end, so uploads need no allocation of their own. Ranges may
+// be retired in any order, each once the GPU is past the copies out of it,
+// but come back to the ring in the order they were handed out. Thread-safe.
+class StagingRing {
+public:
+  // Takes over buffer. alignment is a power of two every range starts at.
+  void init(const StagingBuffer &buffer, VkDeviceSize alignment);
+  // Hands the buffer back for the caller to destroy
+  auto release() -> StagingBuffer;
+
+  // A range of size bytes, empty when the ring hasn't that much free
+  auto allocate(size_t size) -> StagingBuffer;
+  [[nodiscard]] auto owns(const StagingBuffer &staging) const -> bool;
+  // Frees the range of staging once reclaim() gets a value of at least
+  // value, 0 frees it on the next reclaim()
+  void retire(const StagingBuffer &staging, uint64_t value);
+  // Gives the oldest ranges retired up to completed back to the ring
+  void reclaim(uint64_t completed);
+
+  [[nodiscard]] auto capacity() const -> VkDeviceSize;
+
+private:
+  struct Range {
+    // Bytes handed out before it, counting every trip around the ring
+    uint64_t begin;
+    uint64_t end;
+    uint64_t value;
+  };
+
+  mutable std::mutex mutex_;
+  StagingBuffer buffer_;
+  VkDeviceSize alignment_ = 1;
+  // Ranges are handed out at head_, and the ones before tail_ are free
+  uint64_t head_ = 0;
+  uint64_t tail_ = 0;
+  std::deque<Range> ranges_;
+};
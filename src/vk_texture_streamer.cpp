@@ -0,0 +1,616 @@
+#include "vk_texture_streamer.hpp"
+
+#include "vk_check.hpp"
+#include "vk_engine.hpp"
+#include "vk_initializers.hpp"
+#include "vk_textures.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fmt/core.h>
+#include <numeric>
+
+namespace {
+
+// Sets of each descriptor pool the streamer allocates
+constexpr uint32_t descriptor_pool_sets = 64;
+
+auto image_barrier(VkImage image, uint32_t levelCount, VkImageLayout from,
+                   VkImageLayout to, VkAccessFlags srcAccess,
+                   VkAccessFlags dstAccess) -> VkImageMemoryBarrier {
+  VkImageMemoryBarrier barrier = {};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.oldLayout = from;
+  barrier.newLayout = to;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount, 0, 1};
+  barrier.srcAccessMask = srcAccess;
+  barrier.dstAccessMask = dstAccess;
+  return barrier;
+}
+
+} // namespace
+
+TextureStreamer::TextureStreamer(VulkanEngine &engine) : engine_(engine) {
+  worker_ = std::thread([this]() { worker_loop(); });
+}
+
+TextureStreamer::~TextureStreamer() { shutdown(); }
+
+void TextureStreamer::set_budget(VkDeviceSize bytes) { budget_ = bytes; }
+
+auto TextureStreamer::prepare(const std::filesystem::path &path,
+                              PendingTexture &pending) const -> bool {
+  if (!engine_.open_asset(path, pending.file)) {
+    utils::logger.dump(
+        fmt::format("Error when loading image {}", path.string()),
+        spdlog::level::err);
+    return false;
+  }
+
+  auto &info = pending.info;
+  info = assets::read_texture_info(&pending.file);
+  pending.format = vkutil::texture_format(info.textureFormat);
+  if (pending.format == VK_FORMAT_UNDEFINED) {
+    utils::logger.dump(
+        fmt::format("Unknown texture format in {}", path.string()),
+        spdlog::level::err);
+    return false;
+  }
+  if (!engine_.supports_texture_format(info.textureFormat)) {
+    utils::logger.dump(
+        fmt::format("Texture {} is block compressed, which the GPU can't "
+                    "sample. Rebake it with --color-format rgba8 and "
+                    "--normal-format rgba8.",
+                    path.string()),
+        spdlog::level::err);
+    return false;
+  }
+  if (info.pixelsize[2] > 1) {
+    utils::logger.dump(
+        fmt::format("Texture arrays aren't streamed, {}", path.string()),
+        spdlog::level::err);
+    return false;
+  }
+
+  // Files baked before mips have a single level, and only chunked pages can
+  // be read a few at a time
+  if (info.pages.empty()) {
+    auto blobSize = static_cast<uint32_t>(pending.file.binaryBlob.size());
+    info.pages.push_back(
+        {.width = info.pixelsize[0],
+         .height = info.pixelsize[1],
+         .compressedSize = blobSize,
+         .originalSize = static_cast<uint32_t>(info.textureSize)});
+  }
+  auto levelCount = static_cast<uint32_t>(info.pages.size());
+  bool streamable = info.compressionMode == assets::CompressionMode::LZ4Chunked;
+
+  uint32_t tailLevel = 0;
+  while (streamable && tailLevel + 1 < levelCount &&
+         std::max(info.pages[tailLevel].width, info.pages[tailLevel].height) >
+             streamed_tail_size) {
+    ++tailLevel;
+  }
+  pending.tailLevel = tailLevel;
+
+  bool loaded = false;
+  if (streamable) {
+    loaded = read_pages(pending.file, info, tailLevel, levelCount,
+                        pending.staging);
+  } else {
+    pending.staging = engine_.create_staging_buffer(info.textureSize);
+    loaded = assets::unpack_texture(&info, pending.file.binaryBlob.data(),
+                                    pending.file.binaryBlob.size(),
+                                    pending.staging.mapped,
+                                    &engine_._jobSystem);
+    engine_.flush_staging_buffer(pending.staging);
+    if (!loaded) {
+      engine_.destroy_staging_buffer(pending.staging);
+    }
+  }
+  if (!loaded) {
+    utils::logger.dump(fmt::format("Corrupt texture {}", path.string()),
+                       spdlog::level::err);
+    return false;
+  }
+  return true;
+}
+
+auto TextureStreamer::add(PendingTexture &&pending) -> Handle {
+  auto texture = std::make_unique<Texture>();
+  texture->file = std::move(pending.file);
+  texture->info = std::move(pending.info);
+  texture->format = pending.format;
+
+  auto levelCount = static_cast<uint32_t>(texture->info.pages.size());
+  uint32_t tailLevel = pending.tailLevel;
+  texture->tailLevel = tailLevel;
+  texture->residentLevel = levelCount;
+  texture->wantedLevel = tailLevel;
+  texture->targetLevel = tailLevel;
+
+  Load load{.texture = texture.get(),
+            .firstLevel = tailLevel,
+            .lastLevel = levelCount,
+            .priority = 0.0F,
+            .staging = pending.staging};
+  pending.staging = {};
+
+  // A new texture has no image to copy from, so the tail is uploaded on the
+  // upload queue like any other asset
+  AllocatedImage image = create_image(*texture, tailLevel);
+  engine_._uploadQueue.record([&](VkCommandBuffer cmd) {
+    auto toTransfer = image_barrier(
+        image._image, levelCount - tailLevel, VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT);
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                         nullptr, 1, &toTransfer);
+    copy_load(cmd, *texture, image, tailLevel, load);
+  });
+  engine_._uploadQueue.release_image(image._image, levelCount - tailLevel);
+  engine_._uploadQueue.free_staging(load.staging);
+  texture->image = image;
+  texture->residentLevel = tailLevel;
+
+  textures_.push_back(std::move(texture));
+  return static_cast<Handle>(textures_.size() - 1);
+}
+
+void TextureStreamer::bind(Handle texture, VkDescriptorSet &set,
+                           VkDescriptorSetLayout layout, uint32_t binding,
+                           VkSampler sampler) {
+  if (texture == no_texture) {
+    return;
+  }
+  Texture &entry = *textures_[texture];
+  entry.bindings.push_back({&set, layout, binding, sampler});
+  // No frame has the new set bound yet
+  set = allocate_set(layout);
+  write_descriptor(entry, entry.bindings.back(), set);
+}
+
+auto TextureStreamer::level_count(Handle texture) const -> uint32_t {
+  if (texture == no_texture) {
+    return 1;
+  }
+  return static_cast<uint32_t>(textures_[texture]->info.pages.size());
+}
+
+void TextureStreamer::request(Handle texture, float screenSize) {
+  if (texture == no_texture) {
+    return;
+  }
+  Texture &entry = *textures_[texture];
+
+  // The level about as wide as the object is on screen, assuming the
+  // texture is stretched over it once
+  auto texels = static_cast<float>(
+      std::max(entry.info.pixelsize[0], entry.info.pixelsize[1]));
+  uint32_t level = 0;
+  if (screenSize < texels) {
+    level = static_cast<uint32_t>(
+        std::log2(texels / std::max(screenSize, 1.0F)));
+  }
+
+  entry.wantedLevel = std::min({entry.wantedLevel, level, entry.tailLevel});
+  entry.priority = std::max(entry.priority, screenSize);
+}
+
+void TextureStreamer::update(VkCommandBuffer cmd) {
+  collect();
+
+  std::vector<Load> finished;
+  {
+    std::lock_guard lock(mutex_);
+    finished.swap(finished_);
+  }
+
+  fit_budget();
+
+  struct Move {
+    Texture *texture;
+    uint32_t firstLevel;
+    const Load *load;
+    AllocatedImage image;
+  };
+  std::vector<Move> moves;
+
+  // Land what finished loading, as far as the budget still wants it
+  for (auto &&load : finished) {
+    Texture &texture = *load.texture;
+    texture.loading = false;
+    if (load.firstLevel == load.lastLevel) {
+      // Stop streaming textures that failed to load
+      texture.tailLevel = texture.residentLevel;
+      continue;
+    }
+
+    uint32_t firstLevel = std::max(load.firstLevel, texture.targetLevel);
+    if (firstLevel < texture.residentLevel) {
+      moves.push_back({&texture, firstLevel, &load, {}});
+    }
+  }
+
+  // Evict down to the budget, or queue the levels that are missing
+  std::vector<Load> queued;
+  for (auto &&texture : textures_) {
+    bool moving = std::any_of(moves.begin(), moves.end(), [&](auto &&move) {
+      return move.texture == texture.get();
+    });
+    if (texture->loading || moving) {
+      continue;
+    }
+
+    if (texture->targetLevel > texture->residentLevel) {
+      moves.push_back({texture.get(), texture->targetLevel, nullptr, {}});
+    } else if (texture->targetLevel < texture->residentLevel) {
+      texture->loading = true;
+      queued.push_back({.texture = texture.get(),
+                        .firstLevel = texture->targetLevel,
+                        .lastLevel = texture->residentLevel,
+                        .priority = texture->priority,
+                        .staging = {}});
+    }
+  }
+
+  // The frames in flight keep sampling the old images through the old sets
+  // until they retire
+  for (auto &&move : moves) {
+    move.image = create_image(*move.texture, move.firstLevel);
+    move_texture(cmd, *move.texture, move.image, move.firstLevel, move.load);
+    retired_.push_back({.image = move.texture->image, .frame = frame_});
+    move.texture->image = move.image;
+    move.texture->residentLevel = move.firstLevel;
+    write_descriptors(*move.texture);
+  }
+
+  // Staging the frame copies out of lives as long as the frame
+  for (auto &&load : finished) {
+    bool copied = std::any_of(moves.begin(), moves.end(), [&](auto &&move) {
+      return move.load == &load;
+    });
+    if (copied) {
+      retired_.push_back({.staging = load.staging, .frame = frame_});
+    } else {
+      engine_.destroy_staging_buffer(load.staging);
+    }
+  }
+
+  if (!queued.empty()) {
+    {
+      std::lock_guard lock(mutex_);
+      queued_.insert(queued_.end(), queued.begin(), queued.end());
+    }
+    wakeCondition_.notify_one();
+  }
+
+  // Requests start over every frame
+  for (auto &&texture : textures_) {
+    texture->wantedLevel = texture->tailLevel;
+    texture->priority = 0.0F;
+  }
+
+  ++frame_;
+}
+
+void TextureStreamer::shutdown() {
+  {
+    std::lock_guard lock(mutex_);
+    stopping_ = true;
+  }
+  wakeCondition_.notify_all();
+  if (worker_.joinable()) {
+    worker_.join();
+  }
+
+  for (auto &&load : finished_) {
+    engine_.destroy_staging_buffer(load.staging);
+  }
+  finished_.clear();
+  queued_.clear();
+
+  for (auto &&texture : textures_) {
+    destroy_image(texture->image);
+  }
+  textures_.clear();
+
+  // Everything retired is done with, the GPU is idle
+  frame_ += FRAME_OVERLAP;
+  collect();
+  freeSets_.clear();
+  for (auto &&pool : descriptorPools_) {
+    vkDestroyDescriptorPool(engine_._device, pool, nullptr);
+  }
+  descriptorPools_.clear();
+}
+
+void TextureStreamer::worker_loop() {
+  std::unique_lock lock(mutex_);
+  while (true) {
+    wakeCondition_.wait(lock,
+                        [this]() { return stopping_ || !queued_.empty(); });
+    if (stopping_) {
+      return;
+    }
+
+    // Most wanted first
+    auto next = std::max_element(
+        queued_.begin(), queued_.end(),
+        [](auto &&a, auto &&b) { return a.priority < b.priority; });
+    Load load = *next;
+    queued_.erase(next);
+
+    lock.unlock();
+    if (!read_pages(load.texture->file, load.texture->info, load.firstLevel,
+                    load.lastLevel, load.staging)) {
+      utils::logger.dump(fmt::format("Corrupt texture {}",
+                                     load.texture->info.originalFile),
+                         spdlog::level::err);
+      load.lastLevel = load.firstLevel;
+    }
+    lock.lock();
+
+    finished_.push_back(load);
+  }
+}
+
+auto TextureStreamer::read_pages(const assets::AssetFileView &file,
+                                assets::TextureInfo &info, uint32_t firstLevel,
+                                uint32_t lastLevel,
+                                StagingBuffer &staging) const -> bool {
+  VkDeviceSize size = 0;
+  for (uint32_t level = firstLevel; level != lastLevel; ++level) {
+    size += info.pages[level].originalSize;
+  }
+
+  staging = engine_.create_staging_buffer(size);
+  if (!assets::unpack_texture_pages(&info, file.binaryBlob.data(),
+                                    file.binaryBlob.size(), firstLevel,
+                                    lastLevel - firstLevel, staging.mapped,
+                                    &engine_._jobSystem)) {
+    engine_.destroy_staging_buffer(staging);
+    return false;
+  }
+  engine_.flush_staging_buffer(staging);
+  return true;
+}
+
+auto TextureStreamer::resident_size(const Texture &texture, uint32_t level)
+    -> VkDeviceSize {
+  VkDeviceSize size = 0;
+  for (size_t i = level; i < texture.info.pages.size(); ++i) {
+    size += texture.info.pages[i].originalSize;
+  }
+  return size;
+}
+
+void TextureStreamer::fit_budget() {
+  std::vector<size_t> order(textures_.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return textures_[a]->priority > textures_[b]->priority;
+  });
+
+  // Tails are always resident and don't count
+  VkDeviceSize remaining = budget_;
+  for (auto index : order) {
+    Texture &texture = *textures_[index];
+    VkDeviceSize tailSize = resident_size(texture, texture.tailLevel);
+
+    uint32_t level = texture.wantedLevel;
+    while (level < texture.tailLevel &&
+           resident_size(texture, level) - tailSize > remaining) {
+      ++level;
+    }
+    remaining -= resident_size(texture, level) - tailSize;
+    texture.targetLevel = level;
+  }
+}
+
+auto TextureStreamer::create_image(const Texture &texture, uint32_t firstLevel)
+    -> AllocatedImage {
+  const assets::PageInfo &page = texture.info.pages[firstLevel];
+  VkExtent3D extent = {page.width, page.height, 1};
+  auto levelCount =
+      static_cast<uint32_t>(texture.info.pages.size()) - firstLevel;
+
+  VkImageCreateInfo imageInfo = vkinit::image_create_info(
+      texture.format,
+      VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+          VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+      extent, VK_SAMPLE_COUNT_1_BIT, levelCount);
+
+  VmaAllocationCreateInfo allocInfo = {};
+  allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+  AllocatedImage image = {};
+  image.format = texture.format;
+  image.mipLevels = static_cast<int>(levelCount);
+  vmaCreateImage(engine_._allocator, &imageInfo, &allocInfo, &image._image,
+                 &image._allocation, nullptr);
+
+  // The textured shader samples every texture as an array, like the atlases
+  VkImageViewCreateInfo viewInfo = vkinit::imageview_create_info(
+      texture.format, image._image, VK_IMAGE_ASPECT_COLOR_BIT, levelCount, 1,
+      VK_IMAGE_VIEW_TYPE_2D_ARRAY);
+  vkCreateImageView(engine_._device, &viewInfo, nullptr, &image._defaultView);
+  return image;
+}
+
+void TextureStreamer::move_texture(VkCommandBuffer cmd, Texture &texture,
+                                   AllocatedImage &newImage,
+                                   uint32_t firstLevel, const Load *load) {
+  const auto &pages = texture.info.pages;
+  auto levelCount = static_cast<uint32_t>(pages.size());
+  bool hasImage = texture.image._image != VK_NULL_HANDLE;
+
+  std::vector<VkImageMemoryBarrier> toTransfer = {image_barrier(
+      newImage._image, levelCount - firstLevel, VK_IMAGE_LAYOUT_UNDEFINED,
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT)};
+  if (hasImage) {
+    toTransfer.push_back(image_barrier(
+        texture.image._image, levelCount - texture.residentLevel,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_SHADER_READ_BIT,
+        VK_ACCESS_TRANSFER_READ_BIT));
+  }
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                       nullptr, static_cast<uint32_t>(toTransfer.size()),
+                       toTransfer.data());
+
+  // Levels both images have are copied on the GPU
+  std::vector<VkImageCopy> imageCopies;
+  for (uint32_t level = std::max(firstLevel, texture.residentLevel);
+       level < levelCount; ++level) {
+    VkImageCopy copy = {};
+    copy.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT,
+                           level - texture.residentLevel, 0, 1};
+    copy.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - firstLevel, 0,
+                           1};
+    copy.extent = {pages[level].width, pages[level].height, 1};
+    imageCopies.push_back(copy);
+  }
+  if (!imageCopies.empty()) {
+    vkCmdCopyImage(cmd, texture.image._image,
+                   VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, newImage._image,
+                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                   static_cast<uint32_t>(imageCopies.size()),
+                   imageCopies.data());
+  }
+
+  // The finer ones come from the load
+  if (load != nullptr) {
+    copy_load(cmd, texture, newImage, firstLevel, *load);
+  }
+
+  auto toReadable = image_barrier(
+      newImage._image, levelCount - firstLevel,
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT,
+      VK_ACCESS_SHADER_READ_BIT);
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &toReadable);
+}
+
+void TextureStreamer::copy_load(VkCommandBuffer cmd, const Texture &texture,
+                                AllocatedImage &newImage, uint32_t firstLevel,
+                                const Load &load) {
+  // The levels are back to back in the staging buffer
+  const auto &pages = texture.info.pages;
+  std::vector<VkBufferImageCopy> bufferCopies;
+  VkDeviceSize offset = 0;
+  for (uint32_t level = load.firstLevel; level != load.lastLevel; ++level) {
+    if (level >= firstLevel && level < texture.residentLevel) {
+      VkBufferImageCopy copy = {};
+      copy.bufferOffset = load.staging.offset + offset;
+      copy.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - firstLevel,
+                               0, 1};
+      copy.imageExtent = {pages[level].width, pages[level].height, 1};
+      bufferCopies.push_back(copy);
+    }
+    offset += pages[level].originalSize;
+  }
+  if (!bufferCopies.empty()) {
+    vkCmdCopyBufferToImage(cmd, load.staging.buffer._buffer, newImage._image,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           static_cast<uint32_t>(bufferCopies.size()),
+                           bufferCopies.data());
+  }
+}
+
+void TextureStreamer::write_descriptors(const Texture &texture) {
+  for (auto &&binding : texture.bindings) {
+    retired_.push_back(
+        {.layout = binding.layout, .set = *binding.set, .frame = frame_});
+    *binding.set = allocate_set(binding.layout);
+    write_descriptor(texture, binding, *binding.set);
+  }
+}
+
+void TextureStreamer::write_descriptor(const Texture &texture,
+                                       const Texture::Binding &binding,
+                                       VkDescriptorSet set) {
+  VkDescriptorImageInfo imageInfo = {
+      .sampler = binding.sampler,
+      .imageView = texture.image._defaultView,
+      .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+  };
+  auto write = vkinit::write_descriptor_image(
+      VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, set, &imageInfo,
+      binding.binding);
+  vkUpdateDescriptorSets(engine_._device, 1, &write, 0, nullptr);
+}
+
+auto TextureStreamer::allocate_set(VkDescriptorSetLayout layout)
+    -> VkDescriptorSet {
+  auto free = std::find_if(freeSets_.begin(), freeSets_.end(),
+                           [&](auto &&set) { return set.layout == layout; });
+  if (free != freeSets_.end()) {
+    VkDescriptorSet set = free->set;
+    freeSets_.erase(free);
+    return set;
+  }
+
+  VkDescriptorSetAllocateInfo allocInfo = {};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorSetCount = 1;
+  allocInfo.pSetLayouts = &layout;
+
+  VkDescriptorSet set = VK_NULL_HANDLE;
+  if (!descriptorPools_.empty()) {
+    allocInfo.descriptorPool = descriptorPools_.back();
+    if (vkAllocateDescriptorSets(engine_._device, &allocInfo, &set) ==
+        VK_SUCCESS) {
+      return set;
+    }
+  }
+
+  // The last pool is full. Sets are never freed, the retired ones are
+  // reused instead.
+  VkDescriptorPoolSize size = {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                               descriptor_pool_sets};
+  VkDescriptorPoolCreateInfo poolInfo = {};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.maxSets = descriptor_pool_sets;
+  poolInfo.poolSizeCount = 1;
+  poolInfo.pPoolSizes = &size;
+  VkDescriptorPool pool = VK_NULL_HANDLE;
+  VK_CHECK(vkCreateDescriptorPool(engine_._device, &poolInfo, nullptr, &pool));
+  descriptorPools_.push_back(pool);
+
+  allocInfo.descriptorPool = pool;
+  VK_CHECK(vkAllocateDescriptorSets(engine_._device, &allocInfo, &set));
+  return set;
+}
+
+void TextureStreamer::collect() {
+  auto done =
+      std::partition(retired_.begin(), retired_.end(), [&](const Retired &r) {
+        return r.frame + FRAME_OVERLAP > frame_;
+      });
+  for (auto it = done; it != retired_.end(); ++it) {
+    destroy_image(it->image);
+    if (it->staging.buffer._buffer != VK_NULL_HANDLE) {
+      engine_.destroy_staging_buffer(it->staging);
+    }
+    if (it->set != VK_NULL_HANDLE) {
+      freeSets_.push_back({it->layout, it->set});
+    }
+  }
+  retired_.erase(done, retired_.end());
+}
+
+void TextureStreamer::destroy_image(AllocatedImage &image) {
+  if (image._image == VK_NULL_HANDLE) {
+    return;
+  }
+  vkDestroyImageView(engine_._device, image._defaultView, nullptr);
+  vmaDestroyImage(engine_._allocator, image._image, image._allocation);
+  image = {};
+}
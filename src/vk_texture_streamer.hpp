@@ -0,0 +1,191 @@
+#pragma once
+
+#include "assetlib/texture_asset.hpp"
+#include "vk_types.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class VulkanEngine;
+
+// Levels up to this many texels on a side are loaded with the texture and
+// never evicted
+constexpr uint32_t streamed_tail_size = 128;
+
+// Streams the mip levels of baked textures in and out under a memory budget.
+// A texture starts out with its levels of at most streamed_tail_size texels
+// on a side, which are always resident, so it can be drawn right away. Finer
+// levels are read and decompressed on a background thread, most wanted
+// first, and swapped in between frames.
+//
+// Each texture lives in an image holding its resident levels only: landing
+// or evicting levels moves it into a new image of the right size, copying
+// the levels both have on the GPU in the frame's command buffer. The sets
+// bound with bind() are replaced by freshly written ones on every swap, and
+// the old image and sets are kept until the frames in flight are done with
+// them, so nothing waits for the GPU.
+class TextureStreamer {
+public:
+  using Handle = uint32_t;
+  static constexpr Handle no_texture = ~0U;
+
+  // A texture whose resident tail prepare() read, waiting for add()
+  struct PendingTexture {
+    assets::AssetFileView file;
+    assets::TextureInfo info;
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    uint32_t tailLevel = 0;
+    // The levels from tailLevel on, back to back
+    StagingBuffer staging;
+  };
+
+  explicit TextureStreamer(VulkanEngine &engine);
+  ~TextureStreamer();
+
+  TextureStreamer(const TextureStreamer &) = delete;
+  TextureStreamer(TextureStreamer &&other) noexcept = delete;
+  auto operator=(const TextureStreamer &) -> TextureStreamer & = delete;
+  auto operator=(TextureStreamer &&other) noexcept
+      -> TextureStreamer & = delete;
+
+  // Bytes of texture memory the streamed levels may take, on top of the
+  // always resident tails
+  void set_budget(VkDeviceSize bytes);
+
+  // Reads the tail of a baked texture into staging memory. Textures baked
+  // without chunked pages can't be read a level at a time and are read
+  // whole. Leaves the streamer alone, so loader threads may call it.
+  auto prepare(const std::filesystem::path &path,
+               PendingTexture &pending) const -> bool;
+  // Uploads a prepared tail and starts streaming the texture
+  auto add(PendingTexture &&pending) -> Handle;
+
+  // Points set, a set of layout the streamer allocates, at the texture at
+  // binding. Every swap replaces set with another one pointed at the new
+  // image, so read it again for each frame.
+  void bind(Handle texture, VkDescriptorSet &set,
+            VkDescriptorSetLayout layout, uint32_t binding, VkSampler sampler);
+
+  // Levels of the full mip chain
+  [[nodiscard]] auto level_count(Handle texture) const -> uint32_t;
+
+  // Asks for the texture to be sharp across screenSize pixels this frame.
+  // Called for every visible object, the largest request of a frame wins.
+  void request(Handle texture, float screenSize);
+
+  // Swaps in the levels that finished loading, evicts what's over budget and
+  // queues the loads for the next frames. The image copies are recorded into
+  // cmd, a graphics command buffer outside of a render pass. Call once a
+  // frame, before recording draws.
+  void update(VkCommandBuffer cmd);
+
+  // Stops the background thread and destroys every image
+  void shutdown();
+
+private:
+  struct Texture {
+    assets::AssetFileView file;
+    assets::TextureInfo info;
+    VkFormat format;
+    AllocatedImage image;
+    // Finest level in image, image level i is texture level residentLevel + i
+    uint32_t residentLevel;
+    // Coarsest level that is ever streamed, the levels after it stay
+    uint32_t tailLevel;
+    // Finest level and largest screen size asked for this frame
+    uint32_t wantedLevel;
+    float priority;
+    // Finest level the budget leaves it this frame
+    uint32_t targetLevel;
+    bool loading = false;
+
+    struct Binding {
+      // Where the user of the texture keeps its set
+      VkDescriptorSet *set;
+      VkDescriptorSetLayout layout;
+      uint32_t binding;
+      VkSampler sampler;
+    };
+    std::vector<Binding> bindings;
+  };
+
+  // Levels [firstLevel, lastLevel) of a texture, read into staging memory
+  struct Load {
+    Texture *texture;
+    uint32_t firstLevel;
+    uint32_t lastLevel;
+    float priority;
+    StagingBuffer staging;
+  };
+
+  // Replaced by a swap, but maybe still used by frames in flight. Any of
+  // the handles may be null.
+  struct Retired {
+    AllocatedImage image{};
+    StagingBuffer staging{};
+    VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+    VkDescriptorSet set = VK_NULL_HANDLE;
+    uint64_t frame = 0;
+  };
+
+  struct FreeSet {
+    VkDescriptorSetLayout layout;
+    VkDescriptorSet set;
+  };
+
+  void worker_loop();
+  // Decompresses levels [firstLevel, lastLevel) into new staging memory
+  auto read_pages(const assets::AssetFileView &file, assets::TextureInfo &info,
+                  uint32_t firstLevel, uint32_t lastLevel,
+                  StagingBuffer &staging) const -> bool;
+
+  // Bytes of the levels from level on
+  static auto resident_size(const Texture &texture, uint32_t level)
+      -> VkDeviceSize;
+  // Sets the finest level every texture may keep under the budget, the
+  // largest on screen first
+  void fit_budget();
+
+  auto create_image(const Texture &texture, uint32_t firstLevel)
+      -> AllocatedImage;
+  // Moves the texture into an image starting at firstLevel. Levels it
+  // already had are copied over, the others come from load.
+  void move_texture(VkCommandBuffer cmd, Texture &texture,
+                    AllocatedImage &newImage, uint32_t firstLevel,
+                    const Load *load);
+  // Copies the levels of load the texture doesn't have yet into newImage,
+  // which starts at firstLevel and is in TRANSFER_DST_OPTIMAL
+  static void copy_load(VkCommandBuffer cmd, const Texture &texture,
+                        AllocatedImage &newImage, uint32_t firstLevel,
+                        const Load &load);
+  // Points new sets at the texture's image and retires the old ones
+  void write_descriptors(const Texture &texture);
+  void write_descriptor(const Texture &texture,
+                        const Texture::Binding &binding, VkDescriptorSet set);
+  // A set no frame uses, allocating one when none was retired
+  auto allocate_set(VkDescriptorSetLayout layout) -> VkDescriptorSet;
+  // Destroys what the frames before the last FRAME_OVERLAP are done with
+  void collect();
+  void destroy_image(AllocatedImage &image);
+
+  VulkanEngine &engine_;
+  VkDeviceSize budget_ = 0;
+
+  std::vector<std::unique_ptr<Texture>> textures_;
+
+  std::thread worker_;
+  std::mutex mutex_;
+  std::condition_variable wakeCondition_;
+  std::vector<Load> queued_;
+  std::vector<Load> finished_;
+  bool stopping_ = false;
+
+  std::vector<Retired> retired_;
+  std::vector<FreeSet> freeSets_;
+  std::vector<VkDescriptorPool> descriptorPools_;
+  uint64_t frame_ = 0;
+};
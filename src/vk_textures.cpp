@@ -6,6 +6,9 @@
 
 #include "./implementations/stb_image_implementation.hpp"
 
+#include <algorithm>
+#include <vector>
+
 auto vkutil::load_image_from_file(VulkanEngine &engine,
                                   const std::filesystem::path &file,
                                   AllocatedImage &outImage) -> bool {
@@ -26,162 +29,146 @@ auto vkutil::load_image_from_file(VulkanEngine &engine,
   VkFormat image_format = VK_FORMAT_R8G8B8A8_SRGB;
 
   // Allocate temporary buffer for holding texture data to upload
-  AllocatedBuffer stagingBuffer = engine.create_buffer(
-      imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+  StagingBuffer staging = engine.create_staging_buffer(imageSize);
 
   // Copy data to buffer
-  void *data;
-  vmaMapMemory(engine._allocator, stagingBuffer._allocation, &data);
-  memcpy(data, pixel_ptr, static_cast<size_t>(imageSize));
-  vmaUnmapMemory(engine._allocator, stagingBuffer._allocation);
+  memcpy(staging.mapped, pixel_ptr, static_cast<size_t>(imageSize));
+  engine.flush_staging_buffer(staging);
 
   // We no longer need the loaded data, so we can free the pixels as they are
   // now in the staging buffer
   stbi_image_free(pixels);
 
-  VkExtent3D imageExtent;
-  imageExtent.width = static_cast<uint32_t>(texWidth);
-  imageExtent.height = static_cast<uint32_t>(texHeight);
-  imageExtent.depth = 1;
-
-  VkImageCreateInfo dimg_info = vkinit::image_create_info(
-      image_format,
-      VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, imageExtent,
-      VK_SAMPLE_COUNT_1_BIT);
-
-  AllocatedImage newImage;
-
-  VmaAllocationCreateInfo dimg_allocinfo = {};
-  dimg_allocinfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-
-  // Allocate and create the image
-  vmaCreateImage(engine._allocator, &dimg_info, &dimg_allocinfo,
-                 &newImage._image, &newImage._allocation, nullptr);
-
-  engine.immediate_submit([&](VkCommandBuffer cmd) {
-    VkImageSubresourceRange range;
-    range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    range.baseMipLevel = 0;
-    range.levelCount = 1;
-    range.baseArrayLayer = 0;
-    range.layerCount = 1;
-
-    VkImageMemoryBarrier ib = {};
-    ib.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    ib.pNext = nullptr;
-
-    ib.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    ib.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    ib.image = newImage._image;
-    ib.subresourceRange = range;
-    ib.srcAccessMask = 0;
-    ib.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-    // Barrier the image into the transfer-receive layout
-    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
-                         nullptr, 1, &ib);
-
-    VkBufferImageCopy copyRegion = {};
-    copyRegion.bufferOffset = 0;
-    copyRegion.bufferRowLength = 0;
-    copyRegion.bufferImageHeight = 0;
-
-    copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    copyRegion.imageSubresource.mipLevel = 0;
-    copyRegion.imageSubresource.baseArrayLayer = 0;
-    copyRegion.imageSubresource.layerCount = 1;
-    copyRegion.imageExtent = imageExtent;
-
-    // Copy the buffer into the image
-    vkCmdCopyBufferToImage(cmd, stagingBuffer._buffer, newImage._image,
-                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
-                           &copyRegion);
-
-    VkImageMemoryBarrier ibtr = ib;
-    ibtr.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    ibtr.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    ibtr.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    ibtr.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-    // Barrier the image into the shader readable layout
-    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
-                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr,
-                         0, nullptr, 1, &ibtr);
-  });
-
-  engine._mainDeletionQueue.push_function([=]() {
-    vmaDestroyImage(engine._allocator, newImage._image, newImage._allocation);
-  });
-
-  vmaDestroyBuffer(engine._allocator, stagingBuffer._buffer,
-                   stagingBuffer._allocation);
+  outImage = upload_image(texWidth, texHeight, image_format, engine, staging);
+  engine._uploadQueue.free_staging(staging);
 
   utils::logger.dump(
       fmt::format("Texture loaded successfully {}", file.string()));
 
-  outImage = newImage;
-
   return true;
 }
 
+auto vkutil::texture_format(assets::TextureFormat format) -> VkFormat {
+  switch (format) {
+  case assets::TextureFormat::RGBA8:
+    return VK_FORMAT_R8G8B8A8_SRGB;
+  case assets::TextureFormat::BC1:
+    return VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+  case assets::TextureFormat::BC3:
+    return VK_FORMAT_BC3_SRGB_BLOCK;
+  case assets::TextureFormat::BC5:
+    return VK_FORMAT_BC5_UNORM_BLOCK;
+  case assets::TextureFormat::BC7:
+    return VK_FORMAT_BC7_SRGB_BLOCK;
+  default:
+    return VK_FORMAT_UNDEFINED;
+  }
+}
+
 auto vkutil::load_image_from_asset(VulkanEngine &engine,
                                    const std::filesystem::path &filename,
                                    AllocatedImage &outImage) -> bool {
-  assets::AssetFile file;
-  bool loaded = assets::load_binaryfile(filename, file);
+  assets::TextureInfo textureInfo;
+  StagingBuffer staging;
+  if (!read_image_asset(engine, filename, textureInfo, staging)) {
+    return false;
+  }
+
+  outImage = upload_image_asset(engine, textureInfo, staging);
+  engine._uploadQueue.free_staging(staging);
+
+  return true;
+}
+
+auto vkutil::read_image_asset(VulkanEngine &engine,
+                              const std::filesystem::path &filename,
+                              assets::TextureInfo &info,
+                              StagingBuffer &staging) -> bool {
+  // Mapped, the blob is read from the page cache straight into staging
+  assets::AssetFileView file;
+  bool loaded = engine.open_asset(filename, file);
 
   if (!loaded) {
     utils::logger.dump("Error when loading image", spdlog::level::err);
     return false;
   }
 
-  assets::TextureInfo textureInfo = assets::read_texture_info(&file);
+  info = assets::read_texture_info(&file);
 
-  VkDeviceSize imageSize = textureInfo.textureSize;
-  VkFormat image_format;
-  switch (textureInfo.textureFormat) {
-  case assets::TextureFormat::RGBA8:
-    image_format = VK_FORMAT_R8G8B8A8_SRGB;
-    break;
-  default:
-    return false;
+#ifndef NDEBUG
+  if (assets::is_source_stale(info.originalFile, info.sourceHash)) {
+    utils::logger.dump(fmt::format("Texture {} is older than its source {}, "
+                                   "rerun asset_baker",
+                                   filename.string(), info.originalFile),
+                       spdlog::level::warn);
   }
+#endif
 
-  AllocatedBuffer stagingBuffer = engine.create_buffer(
-      imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
-
-  std::vector<char> buffer{};
-  buffer.reserve(textureInfo.textureSize);
+  if (texture_format(info.textureFormat) == VK_FORMAT_UNDEFINED) {
+    utils::logger.dump(
+        fmt::format("Unknown texture format in {}", filename.string()),
+        spdlog::level::err);
+    return false;
+  }
+  if (!engine.supports_texture_format(info.textureFormat)) {
+    utils::logger.dump(
+        fmt::format("Texture {} is block compressed, which the GPU can't "
+                    "sample. Rebake it with --color-format rgba8 and "
+                    "--normal-format rgba8.",
+                    filename.string()),
+        spdlog::level::err);
+    return false;
+  }
 
-  void *data;
-  vmaMapMemory(engine._allocator, stagingBuffer._allocation, &data);
-  assets::unpack_texture(&textureInfo, file.binaryBlob.data(),
-                         file.binaryBlob.size(), buffer.data());
-  memcpy(data, buffer.data(), textureInfo.textureSize);
+  // Decompress straight into staging memory
+  staging = engine.create_staging_buffer(info.textureSize);
+  if (!assets::unpack_texture(&info, file.binaryBlob.data(),
+                              file.binaryBlob.size(), staging.mapped,
+                              &engine._jobSystem)) {
+    utils::logger.dump(fmt::format("Corrupt texture {}", filename.string()),
+                       spdlog::level::err);
+    engine.destroy_staging_buffer(staging);
+    return false;
+  }
+  engine.flush_staging_buffer(staging);
 
-  vmaUnmapMemory(engine._allocator, stagingBuffer._allocation);
+  return true;
+}
 
-  outImage = upload_image(textureInfo.pixelsize[0], textureInfo.pixelsize[1],
-                          image_format, engine, stagingBuffer);
-  vmaDestroyBuffer(engine._allocator, stagingBuffer._buffer,
-                   stagingBuffer._allocation);
+auto vkutil::upload_image_asset(VulkanEngine &engine,
+                                const assets::TextureInfo &info,
+                                StagingBuffer &staging) -> AllocatedImage {
+  // The pages were unpacked back to back, one per mip level
+  std::vector<VkDeviceSize> mipOffsets;
+  VkDeviceSize offset = 0;
+  for (auto &&page : info.pages) {
+    mipOffsets.push_back(offset);
+    offset += page.originalSize;
+  }
 
-  return true;
+  return upload_image(static_cast<int>(info.pixelsize[0]),
+                      static_cast<int>(info.pixelsize[1]),
+                      texture_format(info.textureFormat), engine,
+                      staging, mipOffsets,
+                      std::max(info.pixelsize[2], 1U));
 }
 
 auto vkutil::upload_image(int texWidth, int texHeight, VkFormat image_format,
-                          VulkanEngine &engine, AllocatedBuffer &stagingBuffer)
-    -> AllocatedImage {
+                          VulkanEngine &engine, const StagingBuffer &staging,
+                          std::span<const VkDeviceSize> mipOffsets,
+                          uint32_t layerCount) -> AllocatedImage {
   VkExtent3D imageExtent;
   imageExtent.width = static_cast<uint32_t>(texWidth);
   imageExtent.height = static_cast<uint32_t>(texHeight);
   imageExtent.depth = 1;
 
+  auto mipLevels =
+      static_cast<uint32_t>(std::max<size_t>(mipOffsets.size(), 1));
+
   VkImageCreateInfo dimg_info = vkinit::image_create_info(
       image_format,
       VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, imageExtent,
-      VK_SAMPLE_COUNT_1_BIT);
+      VK_SAMPLE_COUNT_1_BIT, mipLevels, layerCount);
 
   AllocatedImage newImage;
 
@@ -193,13 +180,13 @@ auto vkutil::upload_image(int texWidth, int texHeight, VkFormat image_format,
                  &newImage._image, &newImage._allocation, nullptr);
 
   // transition image to transfer-receiver
-  engine.immediate_submit([&](VkCommandBuffer cmd) {
+  engine._uploadQueue.record([&](VkCommandBuffer cmd) {
     VkImageSubresourceRange range;
     range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     range.baseMipLevel = 0;
-    range.levelCount = 1;
+    range.levelCount = mipLevels;
     range.baseArrayLayer = 0;
-    range.layerCount = 1;
+    range.layerCount = layerCount;
 
     VkImageMemoryBarrier imageBarrier_toTransfer = {};
     imageBarrier_toTransfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -217,40 +204,37 @@ auto vkutil::upload_image(int texWidth, int texHeight, VkFormat image_format,
                          VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
                          nullptr, 1, &imageBarrier_toTransfer);
 
-    VkBufferImageCopy copyRegion = {};
-    copyRegion.bufferOffset = 0;
-    copyRegion.bufferRowLength = 0;
-    copyRegion.bufferImageHeight = 0;
-
-    copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    copyRegion.imageSubresource.mipLevel = 0;
-    copyRegion.imageSubresource.baseArrayLayer = 0;
-    copyRegion.imageSubresource.layerCount = 1;
-    copyRegion.imageExtent = imageExtent;
+    // One region per mip level, covering every layer
+    std::vector<VkBufferImageCopy> copyRegions(mipLevels);
+    for (uint32_t level = 0; level != mipLevels; ++level) {
+      VkBufferImageCopy &copyRegion = copyRegions[level];
+      copyRegion.bufferOffset =
+          staging.offset + (mipOffsets.empty() ? 0 : mipOffsets[level]);
+      copyRegion.bufferRowLength = 0;
+      copyRegion.bufferImageHeight = 0;
+
+      copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      copyRegion.imageSubresource.mipLevel = level;
+      copyRegion.imageSubresource.baseArrayLayer = 0;
+      copyRegion.imageSubresource.layerCount = layerCount;
+      copyRegion.imageExtent = {std::max(imageExtent.width >> level, 1U),
+                                std::max(imageExtent.height >> level, 1U), 1};
+    }
 
     // copy the buffer into the image
-    vkCmdCopyBufferToImage(cmd, stagingBuffer._buffer, newImage._image,
-                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
-                           &copyRegion);
-
-    VkImageMemoryBarrier imageBarrier_toReadable = imageBarrier_toTransfer;
-
-    imageBarrier_toReadable.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    imageBarrier_toReadable.newLayout =
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-    imageBarrier_toReadable.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    imageBarrier_toReadable.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-    // barrier the image into the shader readable layout
-    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
-                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr,
-                         0, nullptr, 1, &imageBarrier_toReadable);
+    vkCmdCopyBufferToImage(cmd, staging.buffer._buffer, newImage._image,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels,
+                           copyRegions.data());
   });
 
+  // The graphics queue takes it over in the shader readable layout
+  engine._uploadQueue.release_image(newImage._image, mipLevels, layerCount);
+
   // build a default imageview
   VkImageViewCreateInfo view_info = vkinit::imageview_create_info(
-      image_format, newImage._image, VK_IMAGE_ASPECT_COLOR_BIT);
+      image_format, newImage._image, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels,
+      layerCount,
+      layerCount > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D);
 
   vkCreateImageView(engine._device, &view_info, nullptr,
                     &newImage._defaultView);
@@ -260,6 +244,7 @@ auto vkutil::upload_image(int texWidth, int texHeight, VkFormat image_format,
     vmaDestroyImage(engine._allocator, newImage._image, newImage._allocation);
   });
 
-  newImage.mipLevels = 1; // mips.size();
+  newImage.format = image_format;
+  newImage.mipLevels = static_cast<int>(mipLevels);
   return newImage;
 }
@@ -1,20 +1,45 @@
 #pragma once
 
+#include "assetlib/texture_asset.hpp"
 #include "vk_engine.hpp"
 #include "vk_types.hpp"
 #include <filesystem>
+#include <span>
 
 namespace vkutil {
 auto load_image_from_file(VulkanEngine &engine,
                           const std::filesystem::path &file,
                           AllocatedImage &outImage) -> bool;
 
+// Vulkan format of a baked texture, VK_FORMAT_UNDEFINED when unknown
+auto texture_format(assets::TextureFormat format) -> VkFormat;
+
 auto load_image_from_asset(VulkanEngine &engine,
                            const std::filesystem::path &filename,
                            AllocatedImage &outImage) -> bool;
 
+// First half of load_image_from_asset: reads a baked texture and unpacks
+// every mip level into new staging memory. Records no commands, so loader
+// threads may call it.
+auto read_image_asset(VulkanEngine &engine,
+                      const std::filesystem::path &filename,
+                      assets::TextureInfo &info, StagingBuffer &staging)
+    -> bool;
+
+// Second half: creates the image of a texture read_image_asset staged and
+// copies it over. The staging buffer is left to the caller, to free with
+// UploadQueue::free_staging.
+auto upload_image_asset(VulkanEngine &engine, const assets::TextureInfo &info,
+                        StagingBuffer &staging) -> AllocatedImage;
+
+// Copies every mip level out of the staging buffer with a single copy
+// command. Level i starts at mipOffsets[i], no offsets uploads a single level
+// from the start of the buffer. Each level holds layerCount layers back to
+// back, images with more than one get an array view. The copy goes to the
+// engine's upload queue, the image may be drawn with from the next frame on.
 auto upload_image(int texWidth, int texHeight, VkFormat image_format,
-                  VulkanEngine &engine, AllocatedBuffer &stagingBuffer)
-    -> AllocatedImage;
+                  VulkanEngine &engine, const StagingBuffer &staging,
+                  std::span<const VkDeviceSize> mipOffsets = {},
+                  uint32_t layerCount = 1) -> AllocatedImage;
 
 } // namespace vkutil
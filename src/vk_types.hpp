@@ -4,13 +4,24 @@
 #include <vulkan/vulkan.h>
 
 struct AllocatedBuffer {
-  VkBuffer _buffer;
-  VmaAllocation _allocation;
+  VkBuffer _buffer = VK_NULL_HANDLE;
+  VmaAllocation _allocation = VK_NULL_HANDLE;
+};
+
+// Host buffer that stays mapped for its whole life, so loaders can
+// decompress assets straight into it
+struct StagingBuffer {
+  AllocatedBuffer buffer;
+  char *mapped = nullptr;
+  // Where mapped is in buffer, staging from the upload ring shares one
+  VkDeviceSize offset = 0;
+  size_t size = 0;
 };
 
 struct AllocatedImage {
   VkImage _image;
   VmaAllocation _allocation;
   VkImageView _defaultView;
+  VkFormat format;
   int mipLevels;
 };
\ No newline at end of file
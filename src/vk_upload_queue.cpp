@@ -0,0 +1,356 @@
+#include "vk_upload_queue.hpp"
+
+#include "vk_check.hpp"
+#include "vk_engine.hpp"
+#include "vk_initializers.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+UploadQueue::UploadQueue(VulkanEngine &engine) : engine_(engine) {}
+
+void UploadQueue::init(VkQueue queue, uint32_t queueFamily,
+                       uint32_t graphicsFamily, VkDeviceSize ringSize,
+                       VkDeviceSize alignment) {
+  queue_ = queue;
+  queueFamily_ = queueFamily;
+  graphicsFamily_ = graphicsFamily;
+  families_ = {queueFamily, graphicsFamily};
+
+  // Command buffers are recycled one by one as their batches complete
+  auto poolInfo = vkinit::command_pool_create_info(
+      queueFamily, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+  VK_CHECK(
+      vkCreateCommandPool(engine_._device, &poolInfo, nullptr, &commandPool_));
+
+  VkSemaphoreTypeCreateInfo typeInfo = {};
+  typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+  typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+  typeInfo.initialValue = 0;
+  auto semaphoreInfo = vkinit::semaphore_create_info();
+  semaphoreInfo.pNext = &typeInfo;
+  VK_CHECK(
+      vkCreateSemaphore(engine_._device, &semaphoreInfo, nullptr, &timeline_));
+
+  if (ringSize != 0) {
+    ring_.init(engine_.create_dedicated_staging_buffer(ringSize), alignment);
+  }
+}
+
+void UploadQueue::wait_idle() {
+  if (timeline_ == VK_NULL_HANDLE) {
+    return;
+  }
+
+  submit();
+  uint64_t lastValue = nextValue_ - 1;
+  VkSemaphoreWaitInfo waitInfo = {};
+  waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+  waitInfo.semaphoreCount = 1;
+  waitInfo.pSemaphores = &timeline_;
+  waitInfo.pValues = &lastValue;
+  VK_CHECK(vkWaitSemaphores(engine_._device, &waitInfo,
+                            std::numeric_limits<uint64_t>::max()));
+  collect();
+}
+
+void UploadQueue::shutdown() {
+  if (timeline_ == VK_NULL_HANDLE) {
+    return;
+  }
+  wait_idle();
+
+  // Not through destroy_staging_buffer, which would give it to the ring
+  StagingBuffer ring = ring_.release();
+  if (ring.mapped != nullptr) {
+    vmaDestroyBuffer(engine_._allocator, ring.buffer._buffer,
+                     ring.buffer._allocation);
+  }
+  vkDestroyCommandPool(engine_._device, commandPool_, nullptr);
+  vkDestroySemaphore(engine_._device, timeline_, nullptr);
+  commandPool_ = VK_NULL_HANDLE;
+  timeline_ = VK_NULL_HANDLE;
+  freeCommandBuffers_.clear();
+}
+
+auto UploadQueue::allocate_staging(size_t size) -> StagingBuffer {
+  StagingBuffer staging = ring_.allocate(size);
+  if (staging.mapped == nullptr && size <= ring_.capacity() &&
+      timeline_ != VK_NULL_HANDLE) {
+    // Maybe the GPU finished copying out of enough of it since the last
+    // frame
+    uint64_t completed = 0;
+    VK_CHECK(
+        vkGetSemaphoreCounterValue(engine_._device, timeline_, &completed));
+    ring_.reclaim(completed);
+    staging = ring_.allocate(size);
+  }
+  if (staging.mapped == nullptr) {
+    dedicatedStaging_.fetch_add(1, std::memory_order_relaxed);
+  }
+  return staging;
+}
+
+auto UploadQueue::return_staging(StagingBuffer &staging) -> bool {
+  if (!ring_.owns(staging)) {
+    return false;
+  }
+  ring_.retire(staging, 0);
+  staging = {};
+  return true;
+}
+
+void UploadQueue::record(
+    const std::function<void(VkCommandBuffer cmd)> &function) {
+  function(open_batch().cmd);
+}
+
+void UploadQueue::release_buffer(VkBuffer buffer, VkPipelineStageFlags dstStage,
+                                 VkAccessFlags dstAccess) {
+  VkBufferMemoryBarrier barrier = {};
+  barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = dstAccess;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.buffer = buffer;
+  barrier.offset = 0;
+  barrier.size = VK_WHOLE_SIZE;
+
+  Batch &batch = open_batch();
+  batch.bufferReleases.push_back(barrier);
+  batch.dstStages |= dstStage;
+}
+
+void UploadQueue::release_image(VkImage image, uint32_t levelCount,
+                                uint32_t layerCount) {
+  VkImageMemoryBarrier barrier = {};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount, 0,
+                              layerCount};
+
+  Batch &batch = open_batch();
+  batch.imageReleases.push_back(barrier);
+  batch.dstStages |= VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+}
+
+void UploadQueue::share(VkBufferCreateInfo &bufferInfo) const {
+  if (transfers_ownership()) {
+    bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+    bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(families_.size());
+    bufferInfo.pQueueFamilyIndices = families_.data();
+  }
+}
+
+void UploadQueue::release_shared(VkPipelineStageFlags dstStage,
+                                 VkAccessFlags dstAccess) {
+  Batch &batch = open_batch();
+  batch.sharedAccess |= dstAccess;
+  batch.dstStages |= dstStage;
+}
+
+void UploadQueue::free_staging(StagingBuffer &staging) {
+  Batch &batch = open_batch();
+  if (ring_.owns(staging)) {
+    // The open batch is submitted with the next value
+    ring_.retire(staging, nextValue_);
+  } else {
+    batch.staging.push_back(staging);
+  }
+  staging = {};
+}
+
+void UploadQueue::upload_buffer(VkBuffer dst, VkDeviceSize dstOffset,
+                                const void *data, size_t size) {
+  // Pieces of half the ring, so the next one can be staged while the GPU
+  // copies the last one
+  const auto *bytes = static_cast<const char *>(data);
+  auto pieceSize = std::max<size_t>(ring_.capacity() / 2, 1);
+  while (size != 0) {
+    size_t piece = std::min(size, pieceSize);
+    StagingBuffer staging = ring_.allocate(piece);
+    if (staging.mapped == nullptr) {
+      // Only for payloads the size of the ring, which would otherwise need
+      // a staging buffer as large
+      wait_idle();
+      staging = ring_.allocate(piece);
+    }
+    if (staging.mapped == nullptr) {
+      // The loaders hold the rest of the ring
+      staging = engine_.create_dedicated_staging_buffer(piece);
+      dedicatedStaging_.fetch_add(1, std::memory_order_relaxed);
+    }
+    memcpy(staging.mapped, bytes, piece);
+    engine_.flush_staging_buffer(staging);
+
+    record([&](VkCommandBuffer cmd) {
+      VkBufferCopy copy = {};
+      copy.srcOffset = staging.offset;
+      copy.dstOffset = dstOffset;
+      copy.size = piece;
+      vkCmdCopyBuffer(cmd, staging.buffer._buffer, dst, 1, &copy);
+    });
+    free_staging(staging);
+
+    bytes += piece;
+    dstOffset += piece;
+    size -= piece;
+  }
+}
+
+void UploadQueue::submit() {
+  if (open_.cmd == VK_NULL_HANDLE) {
+    return;
+  }
+  Batch batch = std::move(open_);
+  open_ = {};
+
+  if (batch.releases()) {
+    VkPipelineStageFlags dstStages = batch.dstStages;
+    // On another queue, the semaphore alone makes the writes to shared
+    // buffers visible
+    VkMemoryBarrier sharedBarrier = {};
+    sharedBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    sharedBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    sharedBarrier.dstAccessMask = batch.sharedAccess;
+    uint32_t sharedBarrierCount =
+        batch.sharedAccess != 0 && !transfers_ownership() ? 1 : 0;
+
+    if (transfers_ownership()) {
+      // The release half of the transfer. Its stage and access on the
+      // destination side are the acquire's business, the transfer queue
+      // doesn't even know the graphics stages.
+      dstStages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+      for (auto &&barrier : batch.bufferReleases) {
+        barrier.srcQueueFamilyIndex = queueFamily_;
+        barrier.dstQueueFamilyIndex = graphicsFamily_;
+        VkBufferMemoryBarrier acquire = barrier;
+        acquire.srcAccessMask = 0;
+        bufferAcquires_.push_back(acquire);
+        barrier.dstAccessMask = 0;
+      }
+      for (auto &&barrier : batch.imageReleases) {
+        barrier.srcQueueFamilyIndex = queueFamily_;
+        barrier.dstQueueFamilyIndex = graphicsFamily_;
+        VkImageMemoryBarrier acquire = barrier;
+        acquire.srcAccessMask = 0;
+        imageAcquires_.push_back(acquire);
+        barrier.dstAccessMask = 0;
+      }
+    }
+    vkCmdPipelineBarrier(
+        batch.cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStages, 0,
+        sharedBarrierCount, &sharedBarrier,
+        static_cast<uint32_t>(batch.bufferReleases.size()),
+        batch.bufferReleases.data(),
+        static_cast<uint32_t>(batch.imageReleases.size()),
+        batch.imageReleases.data());
+  }
+  VK_CHECK(vkEndCommandBuffer(batch.cmd));
+
+  batch.value = nextValue_++;
+  VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+  timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  timelineInfo.signalSemaphoreValueCount = 1;
+  timelineInfo.pSignalSemaphoreValues = &batch.value;
+
+  auto submitInfo = vkinit::submit_info(&batch.cmd);
+  submitInfo.pNext = &timelineInfo;
+  submitInfo.signalSemaphoreCount = 1;
+  submitInfo.pSignalSemaphores = &timeline_;
+  VK_CHECK(vkQueueSubmit(queue_, 1, &submitInfo, VK_NULL_HANDLE));
+
+  // A batch that only freed staging needs no frame to wait for it
+  if (batch.releases()) {
+    acquireValue_ = batch.value;
+  }
+  batch.bufferReleases.clear();
+  batch.imageReleases.clear();
+  inFlight_.push_back(std::move(batch));
+}
+
+auto UploadQueue::acquire(VkCommandBuffer cmd) -> uint64_t {
+  if (!bufferAcquires_.empty() || !imageAcquires_.empty()) {
+    // Chained to the semaphore wait by waiting at the same stages
+    vkCmdPipelineBarrier(cmd, wait_stages, wait_stages, 0, 0, nullptr,
+                         static_cast<uint32_t>(bufferAcquires_.size()),
+                         bufferAcquires_.data(),
+                         static_cast<uint32_t>(imageAcquires_.size()),
+                         imageAcquires_.data());
+    bufferAcquires_.clear();
+    imageAcquires_.clear();
+  }
+
+  uint64_t value = acquireValue_;
+  acquireValue_ = 0;
+  return value;
+}
+
+auto UploadQueue::semaphore() const -> VkSemaphore { return timeline_; }
+
+void UploadQueue::collect() {
+  if (timeline_ == VK_NULL_HANDLE) {
+    return;
+  }
+
+  uint64_t completed = 0;
+  VK_CHECK(vkGetSemaphoreCounterValue(engine_._device, timeline_, &completed));
+
+  // Batches complete in submission order
+  auto done = inFlight_.begin();
+  for (; done != inFlight_.end() && done->value <= completed; ++done) {
+    for (auto &&staging : done->staging) {
+      engine_.destroy_staging_buffer(staging);
+    }
+    VK_CHECK(vkResetCommandBuffer(done->cmd, 0));
+    freeCommandBuffers_.push_back(done->cmd);
+  }
+  inFlight_.erase(inFlight_.begin(), done);
+  ring_.reclaim(completed);
+}
+
+auto UploadQueue::idle() const -> bool {
+  return open_.cmd == VK_NULL_HANDLE && inFlight_.empty();
+}
+
+auto UploadQueue::submit_count() const -> uint64_t { return nextValue_ - 1; }
+
+auto UploadQueue::dedicated_staging_count() const -> size_t {
+  return dedicatedStaging_.load(std::memory_order_relaxed);
+}
+
+auto UploadQueue::open_batch() -> Batch & {
+  if (open_.cmd != VK_NULL_HANDLE) {
+    return open_;
+  }
+
+  if (freeCommandBuffers_.empty()) {
+    auto allocInfo = vkinit::command_buffer_allocate_info(commandPool_, 1);
+    VK_CHECK(vkAllocateCommandBuffers(engine_._device, &allocInfo, &open_.cmd));
+  } else {
+    open_.cmd = freeCommandBuffers_.back();
+    freeCommandBuffers_.pop_back();
+  }
+
+  auto beginInfo = vkinit::command_buffer_begin_info(
+      VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+  VK_CHECK(vkBeginCommandBuffer(open_.cmd, &beginInfo));
+  return open_;
+}
+
+auto UploadQueue::Batch::releases() const -> bool {
+  return !bufferReleases.empty() || !imageReleases.empty() ||
+         sharedAccess != 0;
+}
+
+auto UploadQueue::transfers_ownership() const -> bool {
+  return queueFamily_ != graphicsFamily_;
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "vk_staging_ring.hpp"
+#include "vk_types.hpp"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+class VulkanEngine;
+
+// Copies into buffers and images on a queue of their own, the transfer queue
+// family when the device has one, without waiting for them. Every batch of
+// copies signals the next value of a timeline semaphore. The frame that first
+// draws with them acquires the resources from the transfer family and waits
+// for that value on the GPU, at the stages that read them, so neither the CPU
+// nor the rest of the frame ever waits for an upload. Staging memory comes
+// from a ring that is reused as the semaphore passes the copies out of it.
+class UploadQueue {
+public:
+  // Stages a frame waiting for uploads waits at
+  static constexpr VkPipelineStageFlags wait_stages =
+      VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+      VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+  explicit UploadQueue(VulkanEngine &engine);
+
+  UploadQueue(const UploadQueue &) = delete;
+  UploadQueue(UploadQueue &&other) noexcept = delete;
+  auto operator=(const UploadQueue &) -> UploadQueue & = delete;
+  auto operator=(UploadQueue &&other) noexcept -> UploadQueue & = delete;
+
+  // queue may be the graphics queue itself, uploads then only skip the
+  // ownership transfers. Staging ranges start at multiples of alignment.
+  void init(VkQueue queue, uint32_t queueFamily, uint32_t graphicsFamily,
+            VkDeviceSize ringSize, VkDeviceSize alignment);
+  // Submits what was recorded and blocks until every upload completed
+  void wait_idle();
+  // Waits for every upload and destroys the queue and the staging ring
+  void shutdown();
+
+  // Staging memory out of the ring, empty when the ring hasn't that much
+  // free. Thread-safe.
+  auto allocate_staging(size_t size) -> StagingBuffer;
+  // Gives a range of the ring back right away, when nothing copies out of
+  // it. False when staging isn't from the ring. Thread-safe.
+  auto return_staging(StagingBuffer &staging) -> bool;
+
+  // Records copies into the open batch. Images have to be left in
+  // TRANSFER_DST_OPTIMAL for release_image.
+  void record(const std::function<void(VkCommandBuffer cmd)> &function);
+  // Hands a buffer the open batch wrote over to the graphics queue, which
+  // reads it at dstStage with dstAccess
+  void release_buffer(VkBuffer buffer, VkPipelineStageFlags dstStage,
+                      VkAccessFlags dstAccess);
+  // Same for an image, which ends up in SHADER_READ_ONLY_OPTIMAL for the
+  // fragment shader
+  void release_image(VkImage image, uint32_t levelCount,
+                     uint32_t layerCount = 1);
+
+  // Makes a buffer both queue families use at once, without ownership
+  // transfers. Those would leave the rest of a buffer many uploads share
+  // undefined.
+  void share(VkBufferCreateInfo &bufferInfo) const;
+  // Makes what the open batch wrote to shared buffers visible to the
+  // graphics queue at dstStage with dstAccess
+  void release_shared(VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+  // Frees staging once the open batch, which may copy from it, executed
+  void free_staging(StagingBuffer &staging);
+  // Copies data into dst through the ring, in pieces when it is larger than
+  // the ring can hold at once. dst still has to be released.
+  void upload_buffer(VkBuffer dst, VkDeviceSize dstOffset, const void *data,
+                     size_t size);
+
+  // Submits the open batch, if anything was recorded
+  void submit();
+
+  // Records the acquiring half of the transfers submitted since the last call
+  // into cmd, a graphics command buffer outside of a render pass. Returns the
+  // semaphore value the submit of cmd has to wait for at wait_stages, 0 when
+  // it doesn't need to.
+  auto acquire(VkCommandBuffer cmd) -> uint64_t;
+  [[nodiscard]] auto semaphore() const -> VkSemaphore;
+
+  // Frees what batches the GPU finished kept alive. Never blocks.
+  void collect();
+  // True when nothing is recorded and every batch completed by the last
+  // collect()
+  [[nodiscard]] auto idle() const -> bool;
+
+  [[nodiscard]] auto submit_count() const -> uint64_t;
+  // Staging buffers that had to be allocated outside the ring
+  [[nodiscard]] auto dedicated_staging_count() const -> size_t;
+
+private:
+  struct Batch {
+    VkCommandBuffer cmd = VK_NULL_HANDLE;
+    uint64_t value = 0;
+    // Dedicated staging buffers, the ring's ranges are retired instead
+    std::vector<StagingBuffer> staging;
+    // Recorded at the end of the batch, and as acquires into the next frame
+    // when the queue families differ
+    std::vector<VkBufferMemoryBarrier> bufferReleases;
+    std::vector<VkImageMemoryBarrier> imageReleases;
+    VkAccessFlags sharedAccess = 0;
+    VkPipelineStageFlags dstStages = 0;
+
+    [[nodiscard]] auto releases() const -> bool;
+  };
+
+  // The batch commands are recorded into, begun on first use
+  auto open_batch() -> Batch &;
+  [[nodiscard]] auto transfers_ownership() const -> bool;
+
+  VulkanEngine &engine_;
+  VkQueue queue_ = VK_NULL_HANDLE;
+  uint32_t queueFamily_ = 0;
+  uint32_t graphicsFamily_ = 0;
+  std::array<uint32_t, 2> families_{};
+  VkCommandPool commandPool_ = VK_NULL_HANDLE;
+  VkSemaphore timeline_ = VK_NULL_HANDLE;
+  StagingRing ring_;
+  std::atomic<size_t> dedicatedStaging_{0};
+
+  Batch open_;
+  // Value the next submitted batch signals
+  uint64_t nextValue_ = 1;
+  std::vector<Batch> inFlight_;
+  std::vector<VkCommandBuffer> freeCommandBuffers_;
+
+  // Acquires of the submitted batches the frames didn't record yet
+  std::vector<VkBufferMemoryBarrier> bufferAcquires_;
+  std::vector<VkImageMemoryBarrier> imageAcquires_;
+  uint64_t acquireValue_ = 0;
+};